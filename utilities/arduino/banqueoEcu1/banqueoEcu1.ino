@@ -11,6 +11,7 @@
  */
 
 #include <Arduino.h>
+#include "ntc_tables.h"   // Generated by tools/ntc_table_gen.py (ESP32 project)
 
 // Pin definitions for sensor emulation
 #define PIN_EMU_CKP        2     // CKP sensor emulation (crankshaft)
@@ -18,8 +19,8 @@
 #define PIN_EMU_MAP        4     // MAP sensor emulation (manifold pressure)
 #define PIN_EMU_TPS        5     // TPS sensor emulation (throttle position)
 #define PIN_EMU_MAF        6     // MAF sensor emulation (air flow)
-#define PIN_EMU_ECT        7     // ECT sensor emulation (coolant temperature)
-#define PIN_EMU_IAT        8     // IAT sensor emulation (intake air temperature)
+#define PIN_EMU_ECT        9     // ECT sensor emulation (coolant temperature, PWM pin)
+#define PIN_EMU_IAT        10    // IAT sensor emulation (intake air temperature, PWM pin)
 
 // Pin definitions for actuator monitoring
 #define PIN_MON_INJ1       A0    // Injector 1 monitoring
@@ -48,6 +49,7 @@
 #define ECT_MAX            120   // Maximum temperature (°C)
 #define ECT_DEFAULT        85    // Normal operating temperature (°C)
 #define IAT_DEFAULT        25    // Default ambient temperature (°C)
+#define NTC_CURVE_DEFAULT  NTC_CURVE_CUSTOM  // 2.5 kOhm / B3380 sensor
 
 // Constants for anomaly detection
 #define PULSE_MARGIN       0.15  // 15% acceptable error margin
@@ -122,6 +124,7 @@ uint32_t lastCkpUpdateTime = 0;
 uint32_t lastSensorUpdateTime = 0;
 uint32_t lastCommandCheckTime = 0;
 uint32_t lastAnomalyCheckTime = 0;
+uint8_t ntcCurve = NTC_CURVE_DEFAULT;
 
 // Buffer for serial commands
 char cmdBuffer[64];
@@ -178,63 +181,68 @@ void UpdateMafSensor() {
 }
 
 /**
- * Emulates the resistance of the ECT sensor (NTC) using PWM
+ * Interpolates a table stored in flash
+ * Integer arithmetic only, the AVR has no FPU
+ * 
+ * @param v0 Value at the lower table point
+ * @param v1 Value at the upper table point
+ * @param frac Position between the points in tenths of °C (0 to step)
+ * @return Interpolated value
+ */
+uint32_t InterpolateNtc(uint32_t v0, uint32_t v1, uint8_t frac) {
+  const uint8_t step = NTC_TABLE_T_STEP * 10;
+  if (v1 >= v0) {
+    return v0 + (v1 - v0) * frac / step;
+  }
+  return v0 - (v0 - v1) * frac / step;
+}
+
+/**
+ * Emulates an NTC temperature sensor with the precomputed curve tables
  * In a real system, a digital potentiometer would be used
+ * 
+ * @param name Sensor name for the serial output
+ * @param pin PWM output pin
+ * @param temperature Emulated temperature (°C)
  */
-void UpdateEctSensor() {
-  // For temperature sensors, we use a simplification with PWM
-  float resistance = 0;
+void UpdateNtcSensor(const char* name, uint8_t pin, int temperature) {
+  const int lastOffset = (NTC_TABLE_POINTS - 1) * NTC_TABLE_T_STEP * 10;
+  int offset = (temperature - NTC_TABLE_T_MIN) * 10;
+  if (offset < 0) offset = 0;
+  if (offset > lastOffset) offset = lastOffset;
   
-  // Simplified calculation of NTC resistance
-  if (engineParams.ect > -40 && engineParams.ect < 150) {
-    // Simplified formula: R = R0 * e^(B*(1/T - 1/T0))
-    // Where R0 = 2.5kOhm at 25°C, B = 3380
-    float t1 = 1.0f / (273.15f + (float)engineParams.ect);
-    float t0 = 1.0f / (273.15f + 25.0f);  // Reference temperature (25°C)
-    resistance = 2500.0f * exp(3380.0f * (t1 - t0));
-    
-    // Convert to duty cycle (inversely proportional)
-    float maxResistance = 20000.0f; // Maximum expected resistance
-    float dutyPercent = 1.0f - (resistance / maxResistance);
-    if (dutyPercent < 0) dutyPercent = 0;
-    if (dutyPercent > 1) dutyPercent = 1;
-    
-    analogWrite(PIN_EMU_ECT, (uint8_t)(dutyPercent * TPS_MAX_DUTY));
-  }
+  uint8_t index = offset / (NTC_TABLE_T_STEP * 10);
+  uint8_t frac = offset % (NTC_TABLE_T_STEP * 10);
+  uint8_t next = (index < NTC_TABLE_POINTS - 1) ? index + 1 : index;
   
-  Serial.print("ECT: ");
-  Serial.print(engineParams.ect);
+  uint32_t resistance = InterpolateNtc(pgm_read_dword(&ntcResistance[ntcCurve][index]),
+                                       pgm_read_dword(&ntcResistance[ntcCurve][next]), frac);
+  uint16_t output = InterpolateNtc(pgm_read_word(&ntcOutput[ntcCurve][index]),
+                                   pgm_read_word(&ntcOutput[ntcCurve][next]), frac);
+  
+  // Q16 fraction of 5 V to 8-bit PWM
+  analogWrite(pin, output >> 8);
+  
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(temperature);
   Serial.print("°C, Resistance: ");
   Serial.print(resistance);
   Serial.println(" Ohm");
 }
 
+/**
+ * Emulates the resistance of the ECT sensor (NTC) using PWM
+ */
+void UpdateEctSensor() {
+  UpdateNtcSensor("ECT", PIN_EMU_ECT, engineParams.ect);
+}
+
 /**
  * Emulates the resistance of the IAT sensor (NTC) using PWM
  */
 void UpdateIatSensor() {
-  // Implementation similar to ECT
-  float resistance = 0;
-  
-  if (engineParams.iat > -40 && engineParams.iat < 150) {
-    float t1 = 1.0f / (273.15f + (float)engineParams.iat);
-    float t0 = 1.0f / (273.15f + 25.0f);
-    resistance = 2500.0f * exp(3380.0f * (t1 - t0));
-    
-    // Convert to duty cycle (inversely proportional)
-    float maxResistance = 20000.0f;
-    float dutyPercent = 1.0f - (resistance / maxResistance);
-    if (dutyPercent < 0) dutyPercent = 0;
-    if (dutyPercent > 1) dutyPercent = 1;
-    
-    analogWrite(PIN_EMU_IAT, (uint8_t)(dutyPercent * TPS_MAX_DUTY));
-  }
-  
-  Serial.print("IAT: ");
-  Serial.print(engineParams.iat);
-  Serial.print("°C, Resistance: ");
-  Serial.print(resistance);
-  Serial.println(" Ohm");
+  UpdateNtcSensor("IAT", PIN_EMU_IAT, engineParams.iat);
 }
 
 /**
@@ -572,6 +580,15 @@ bool ProcessCommand(const char* cmdBuffer, size_t length) {
       Serial.println("°C");
       return true;
     }
+  } else if (strncmp(cmdBuffer, "ntc:", 4) == 0 && length > 4) {
+    for (uint8_t i = 0; i < NTC_CURVE_COUNT; i++) {
+      if (strcmp_P(cmdBuffer + 4, (const char*)pgm_read_ptr(&ntcCurveNames[i])) == 0) {
+        ntcCurve = i;
+        Serial.print("ECT/IAT sensor curve: ");
+        Serial.println(cmdBuffer + 4);
+        return true;
+      }
+    }
   } else if (strcmp(cmdBuffer, "status") == 0) {
     Serial.println("=== System Status ===");
     Serial.print("RPM: "); Serial.println(engineParams.rpm);
@@ -601,6 +618,7 @@ bool ProcessCommand(const char* cmdBuffer, size_t length) {
     Serial.println("  tps:VALUE     - Adjust throttle position (0-100%)");
     Serial.println("  ect:VALUE     - Adjust coolant temperature (-40 to 120°C)");
     Serial.println("  iat:VALUE     - Adjust air temperature (-40 to 120°C)");
+    Serial.println("  ntc:CURVE     - ECT/IAT sensor curve (bosch, denso, gm, custom)");
     Serial.println("  start         - Start engine (begin signals)");
     Serial.println("  stop          - Stop engine (halt signals)");
     Serial.println("  status        - Show current status");
@@ -0,0 +1,274 @@
+/*
+ * can_filter.h - ID whitelist and MCP2515 acceptance filters of the CAN reader
+ *
+ * The whitelist holds up to CAN_FILTER_MAX_IDS standard (11-bit) IDs,
+ * sorted, so the interrupt finds an ID with a binary search. From the
+ * same list the two masks and six filters of the MCP2515 are computed:
+ * RXB0 has mask 0 with filters 0-1, RXB1 has mask 1 with filters 2-5.
+ * Up to six IDs get one exact filter each. With more IDs, the IDs are
+ * merged into six groups, each time joining the two groups whose merge
+ * lets the fewest IDs through, and the groups are split between the two
+ * masks with the fewest IDs let through. The hardware then drops most of
+ * the bus and the whitelist drops the rest.
+ *
+ * Also compiled on the host by tools/can_filter_check.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAN_FILTER_MAX_IDS      32      // IDs of the whitelist
+#define CAN_STD_ID_MASK         0x7FF
+#define CAN_STD_ID_COUNT        2048
+#define CAN_HW_MASKS            2
+#define CAN_HW_FILTERS          6
+
+// Masks and filters of the MCP2515, standard IDs
+typedef struct {
+  uint16_t masks[CAN_HW_MASKS];
+  uint16_t filters[CAN_HW_FILTERS];
+} CanHwFilter;
+
+// Whitelist, empty accepts every ID
+typedef struct {
+  uint16_t ids[CAN_FILTER_MAX_IDS];
+  uint8_t count;
+  volatile uint32_t rejected;           // Frames dropped by the whitelist
+} CanIdSet;
+
+// Group of IDs sharing one filter: the IDs that match value on the bits of mask
+typedef struct {
+  uint16_t value;
+  uint16_t mask;
+} CanIdGroup;
+
+static inline void CanIdSetClear(CanIdSet* set) {
+  set->count = 0;
+  set->rejected = 0;
+}
+
+// Position of the first ID not smaller than id
+static inline uint8_t CanIdSetFind(const CanIdSet* set, uint16_t id) {
+  uint8_t low = 0;
+  uint8_t high = set->count;
+
+  while (low < high) {
+    uint8_t middle = (low + high) / 2;
+    if (set->ids[middle] < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Frames of the interrupt: true if the ID is in the whitelist or the whitelist is empty
+static inline bool CanIdSetAccepts(const CanIdSet* set, uint32_t id) {
+  if (set->count == 0) {
+    return true;
+  }
+  if (id <= CAN_STD_ID_MASK) {
+    uint8_t i = CanIdSetFind(set, (uint16_t)id);
+    if (i < set->count && set->ids[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Adds an ID keeping the list sorted, false if it is not a standard ID or the list is full
+static inline bool CanIdSetAdd(CanIdSet* set, uint16_t id) {
+  uint8_t i = CanIdSetFind(set, id);
+
+  if (id > CAN_STD_ID_MASK) {
+    return false;
+  }
+  if (i < set->count && set->ids[i] == id) {
+    return true;
+  }
+  if (set->count >= CAN_FILTER_MAX_IDS) {
+    return false;
+  }
+  for (uint8_t j = set->count; j > i; j--) {
+    set->ids[j] = set->ids[j - 1];
+  }
+  set->ids[i] = id;
+  set->count++;
+  return true;
+}
+
+// Removes an ID, false if it was not in the list
+static inline bool CanIdSetRemove(CanIdSet* set, uint16_t id) {
+  uint8_t i = CanIdSetFind(set, id);
+
+  if (i >= set->count || set->ids[i] != id) {
+    return false;
+  }
+  set->count--;
+  for (; i < set->count; i++) {
+    set->ids[i] = set->ids[i + 1];
+  }
+  return true;
+}
+
+static inline uint8_t CanBitCount(uint16_t value) {
+  uint8_t count = 0;
+
+  for (; value != 0; value &= value - 1) {
+    count++;
+  }
+  return count;
+}
+
+// IDs let through by a filter with this mask
+static inline uint16_t CanMaskSpan(uint16_t mask) {
+  return (uint16_t)1 << (11 - CanBitCount(mask & CAN_STD_ID_MASK));
+}
+
+// Mask that keeps only the bits where both groups agree
+static inline uint16_t CanMergedMask(const CanIdGroup* a, const CanIdGroup* b) {
+  return a->mask & b->mask & ~(a->value ^ b->value) & CAN_STD_ID_MASK;
+}
+
+// IDs let through by groups sharing one mask, groups with the same filter are counted once
+static inline uint16_t CanSharedMaskSpan(const CanIdGroup* groups, uint8_t selection, uint8_t count, uint16_t* mask) {
+  uint16_t shared = CAN_STD_ID_MASK;
+  uint16_t span = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (selection & (1 << i)) {
+      shared &= groups[i].mask;
+    }
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    bool repeated = false;
+    if (!(selection & (1 << i))) {
+      continue;
+    }
+    for (uint8_t j = 0; j < i; j++) {
+      if ((selection & (1 << j)) && ((groups[i].value ^ groups[j].value) & shared) == 0) {
+        repeated = true;
+      }
+    }
+    if (!repeated) {
+      span += CanMaskSpan(shared);
+    }
+  }
+  *mask = shared;
+  return span;
+}
+
+// Masks and filters that let through every ID of the list, and as few others as possible
+static inline void CanHwFilterCompute(const CanIdSet* set, CanHwFilter* hw) {
+  CanIdGroup groups[CAN_FILTER_MAX_IDS];
+  uint8_t count = set->count;
+
+  // Empty list: masks at 0 accept every frame
+  if (count == 0) {
+    hw->masks[0] = hw->masks[1] = 0;
+    for (uint8_t i = 0; i < CAN_HW_FILTERS; i++) {
+      hw->filters[i] = 0;
+    }
+    return;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    groups[i].value = set->ids[i];
+    groups[i].mask = CAN_STD_ID_MASK;
+  }
+
+  // Join the pair of groups that lets the fewest IDs through until six are left
+  while (count > CAN_HW_FILTERS) {
+    uint8_t bestA = 0;
+    uint8_t bestB = 1;
+    uint16_t bestSpan = 0xFFFF;
+    for (uint8_t a = 0; a < count; a++) {
+      for (uint8_t b = a + 1; b < count; b++) {
+        uint16_t span = CanMaskSpan(CanMergedMask(&groups[a], &groups[b]));
+        if (span < bestSpan) {
+          bestSpan = span;
+          bestA = a;
+          bestB = b;
+        }
+      }
+    }
+    groups[bestA].mask = CanMergedMask(&groups[bestA], &groups[bestB]);
+    groups[bestA].value &= groups[bestA].mask;
+    groups[bestB] = groups[--count];
+  }
+
+  // Up to two groups on RXB0, the rest (up to four) on RXB1
+  uint8_t all = (uint8_t)((1 << count) - 1);
+  uint8_t bestSelection = 0;
+  uint16_t bestSpan = 0xFFFF;
+  uint16_t bestMasks[2] = { CAN_STD_ID_MASK, CAN_STD_ID_MASK };
+  for (uint8_t selection = 0; selection <= all; selection++) {
+    uint8_t first = CanBitCount(selection);
+    uint16_t masks[2] = { CAN_STD_ID_MASK, CAN_STD_ID_MASK };
+    if (first > 2 || count - first > 4) {
+      continue;
+    }
+    uint16_t span = CanSharedMaskSpan(groups, selection, count, &masks[0]) +
+                    CanSharedMaskSpan(groups, all & ~selection, count, &masks[1]);
+    if (span < bestSpan) {
+      bestSpan = span;
+      bestSelection = selection;
+      bestMasks[0] = masks[0];
+      bestMasks[1] = masks[1];
+    }
+  }
+
+  // Unused filters repeat one already set, an empty buffer only takes the first ID of the list
+  uint8_t used[2] = { 0, 0 };
+  const uint8_t firstFilter[2] = { 0, 2 };
+  const uint8_t filters[2] = { 2, 4 };
+  for (uint8_t buffer = 0; buffer < 2; buffer++) {
+    hw->masks[buffer] = bestMasks[buffer];
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t buffer = (bestSelection & (1 << i)) ? 0 : 1;
+    hw->filters[firstFilter[buffer] + used[buffer]++] = groups[i].value & hw->masks[buffer];
+  }
+  for (uint8_t buffer = 0; buffer < 2; buffer++) {
+    if (used[buffer] == 0) {
+      hw->masks[buffer] = CAN_STD_ID_MASK;
+      hw->filters[firstFilter[buffer]] = set->ids[0];
+      used[buffer] = 1;
+    }
+    for (uint8_t i = used[buffer]; i < filters[buffer]; i++) {
+      hw->filters[firstFilter[buffer] + i] = hw->filters[firstFilter[buffer]];
+    }
+  }
+}
+
+// True if the MCP2515 lets this standard ID through
+static inline bool CanHwFilterAccepts(const CanHwFilter* hw, uint16_t id) {
+  for (uint8_t i = 0; i < CAN_HW_FILTERS; i++) {
+    uint16_t mask = hw->masks[i < 2 ? 0 : 1];
+    if (((id ^ hw->filters[i]) & mask) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Standard IDs the MCP2515 lets through
+static inline uint16_t CanHwFilterSpan(const CanHwFilter* hw) {
+  uint16_t count = 0;
+
+  for (uint16_t id = 0; id < CAN_STD_ID_COUNT; id++) {
+    if (CanHwFilterAccepts(hw, id)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+#endif // CAN_FILTER_H
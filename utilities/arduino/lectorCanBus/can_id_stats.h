@@ -0,0 +1,217 @@
+/*
+ * can_id_stats.h - Statistics per CAN ID of the reader
+ *
+ * A fixed table with open addressing (linear probing) keyed by the
+ * standard ID keeps, per ID: frames, DLC, last payload, bytes changed,
+ * and the minimum, maximum and mean period between frames with its
+ * jitter. The mean and jitter are exponential averages (1/16 of each new
+ * period), so every update takes the same few operations whatever the
+ * history. The minimum and maximum are kept in units of 16 us in 16 bits
+ * and periods above 1.05 s are taken as 1.05 s, so an entry takes 30
+ * bytes; the table is filled to 3/4 at most so a
+ * lookup probes few slots, and IDs that arrive once it is full are only
+ * counted. Extended IDs are counted apart.
+ *
+ * The Uno has room for 16 slots (12 IDs, 489 bytes); on a busier bus the
+ * sketch narrows the IDs with the whitelist, which empties the table so
+ * the listed IDs get the slots. The Mega takes 64 slots (48 IDs).
+ *
+ * Also compiled on the host by tools/can_id_stats_bench.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef CAN_ID_STATS_H
+#define CAN_ID_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef CAN_ID_STATS_SLOTS
+#if defined(__AVR_ATmega2560__)
+#define CAN_ID_STATS_SLOTS      64      // Power of two, 30 bytes each
+#else
+#define CAN_ID_STATS_SLOTS      16
+#endif
+#endif
+#define CAN_ID_STATS_MAX_IDS    (CAN_ID_STATS_SLOTS * 3 / 4)
+#define CAN_ID_STATS_EMPTY      0xFFFF  // Free slot
+#define CAN_PERIOD_SHIFT        4       // Minimum and maximum period unit: 16 us
+#define CAN_PERIOD_MAX          0xFFFF  // Saturated period (1.05 s or more)
+#define CAN_MEAN_SHIFT          4       // Mean period in 1/16 us
+#define CAN_AVERAGE_SHIFT       4       // Weight of a new period in the averages: 1/16
+
+typedef struct {
+  uint16_t id;                          // CAN_ID_STATS_EMPTY when free
+  uint8_t dlc;
+  uint8_t changed;                      // Bit n: byte n changed since the last report
+  uint32_t count;
+  uint32_t lastUs;                      // Time of the last frame
+  uint16_t minPeriod;                   // Units of 16 us
+  uint16_t maxPeriod;
+  uint32_t meanPeriod;                  // 1/16 us
+  uint16_t jitter;                      // Mean deviation from meanPeriod (us)
+  uint8_t data[8];
+} CanIdEntry;
+
+typedef struct {
+  CanIdEntry entries[CAN_ID_STATS_SLOTS];
+  uint8_t used;                         // IDs in the table
+  uint32_t untracked;                   // Frames of standard IDs that arrived with the table full
+  uint32_t extended;                    // Frames with extended ID
+} CanIdStats;
+
+static inline void CanIdStatsClear(CanIdStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (uint8_t i = 0; i < CAN_ID_STATS_SLOTS; i++) {
+    stats->entries[i].id = CAN_ID_STATS_EMPTY;
+  }
+}
+
+// First slot probed for an ID (multiplicative hash, the 11 bits are spread over the table)
+static inline uint8_t CanIdStatsHash(uint16_t id) {
+  return (uint8_t)((uint16_t)(id * 40503U) >> 8) & (CAN_ID_STATS_SLOTS - 1);
+}
+
+// Slot of the ID, or the free slot where it would go
+static inline uint8_t CanIdStatsProbe(const CanIdStats* stats, uint16_t id) {
+  uint8_t slot = CanIdStatsHash(id);
+
+  // At most 3/4 of the slots are used, so a free one is always found
+  while (stats->entries[slot].id != id && stats->entries[slot].id != CAN_ID_STATS_EMPTY) {
+    slot = (slot + 1) & (CAN_ID_STATS_SLOTS - 1);
+  }
+  return slot;
+}
+
+static inline const CanIdEntry* CanIdStatsFind(const CanIdStats* stats, uint16_t id) {
+  const CanIdEntry* entry = &stats->entries[CanIdStatsProbe(stats, id)];
+  return entry->id == id ? entry : NULL;
+}
+
+// Step of an exponential average towards a new value, rounded so it does not stop short of it
+static inline int32_t CanAverageStep(int32_t difference) {
+  return (difference + (1 << (CAN_AVERAGE_SHIFT - 1))) >> CAN_AVERAGE_SHIFT;
+}
+
+// Counts one frame; id has the flags of the MCP_CAN library (bit 31 extended)
+static inline void CanIdStatsUpdate(CanIdStats* stats, uint32_t id, uint8_t len, const uint8_t* data, uint32_t timeUs) {
+  if (id > 0x7FF) {
+    stats->extended++;
+    return;
+  }
+  if (len > 8) {
+    len = 8;
+  }
+
+  CanIdEntry* entry = &stats->entries[CanIdStatsProbe(stats, (uint16_t)id)];
+  if (entry->id == CAN_ID_STATS_EMPTY) {
+    if (stats->used >= CAN_ID_STATS_MAX_IDS) {
+      stats->untracked++;
+      return;
+    }
+    stats->used++;
+    entry->id = (uint16_t)id;
+    entry->count = 1;
+    entry->lastUs = timeUs;
+    entry->minPeriod = CAN_PERIOD_MAX;
+    entry->maxPeriod = 0;
+    entry->meanPeriod = 0;
+    entry->jitter = 0;
+    entry->changed = 0;
+    entry->dlc = len;
+    memcpy(entry->data, data, len);
+    return;
+  }
+
+  // Period, saturated at 1.05 s
+  uint32_t elapsed = timeUs - entry->lastUs;
+  if (elapsed > (uint32_t)CAN_PERIOD_MAX << CAN_PERIOD_SHIFT) {
+    elapsed = (uint32_t)CAN_PERIOD_MAX << CAN_PERIOD_SHIFT;
+  }
+  uint16_t period = (uint16_t)(elapsed >> CAN_PERIOD_SHIFT);
+  entry->lastUs = timeUs;
+  if (period < entry->minPeriod) entry->minPeriod = period;
+  if (period > entry->maxPeriod) entry->maxPeriod = period;
+
+  // Averages: the second frame gives the first period
+  if (entry->count == 1) {
+    entry->meanPeriod = elapsed << CAN_MEAN_SHIFT;
+  } else {
+    int32_t deviation = (int32_t)(elapsed << CAN_MEAN_SHIFT) - (int32_t)entry->meanPeriod;
+    entry->meanPeriod += CanAverageStep(deviation);
+    deviation = (deviation < 0 ? -deviation : deviation) >> CAN_MEAN_SHIFT;
+    if (deviation > 0xFFFF) deviation = 0xFFFF;
+    entry->jitter = (uint16_t)(entry->jitter + CanAverageStep(deviation - (int32_t)entry->jitter));
+  }
+  entry->count++;
+
+  // Bytes that changed, a new DLC marks every byte
+  if (len != entry->dlc) {
+    entry->changed = 0xFF;
+    entry->dlc = len;
+  } else {
+    for (uint8_t i = 0; i < len; i++) {
+      if (entry->data[i] != data[i]) {
+        entry->changed |= 1 << i;
+      }
+    }
+  }
+  memcpy(entry->data, data, len);
+}
+
+// Frames per second from the mean period, 0 before the second frame
+static inline uint16_t CanIdEntryRate(const CanIdEntry* entry) {
+  if (entry->count < 2 || entry->meanPeriod == 0) {
+    return 0;
+  }
+  return (uint16_t)(((1000000UL << CAN_MEAN_SHIFT) + entry->meanPeriod / 2) / entry->meanPeriod);
+}
+
+// True if no frame arrived in 4 mean periods (and at least 100 ms)
+static inline bool CanIdEntryMissing(const CanIdEntry* entry, uint32_t nowUs) {
+  uint32_t limit = (entry->meanPeriod >> CAN_MEAN_SHIFT) * 4;
+  if (entry->count < 2) {
+    return false;
+  }
+  if (limit < 100000UL) {
+    limit = 100000UL;
+  }
+  return nowUs - entry->lastUs > limit;
+}
+
+// Slots of the IDs sorted by rate, highest first; returns how many were written (up to n)
+static inline uint8_t CanIdStatsTop(const CanIdStats* stats, uint8_t* slots, uint8_t n) {
+  uint8_t count = 0;
+
+  if (n > CAN_ID_STATS_MAX_IDS) {
+    n = CAN_ID_STATS_MAX_IDS;
+  }
+
+  // Insertion into the short sorted list, rates are computed once per ID
+  uint16_t rates[CAN_ID_STATS_MAX_IDS];
+  for (uint8_t slot = 0; slot < CAN_ID_STATS_SLOTS; slot++) {
+    if (stats->entries[slot].id == CAN_ID_STATS_EMPTY) {
+      continue;
+    }
+    uint16_t rate = CanIdEntryRate(&stats->entries[slot]);
+    uint8_t i = count < n ? count : n;
+    while (i > 0 && rates[i - 1] < rate) {
+      if (i < n) {
+        rates[i] = rates[i - 1];
+        slots[i] = slots[i - 1];
+      }
+      i--;
+    }
+    if (i < n) {
+      rates[i] = rate;
+      slots[i] = slot;
+      if (count < n) count++;
+    }
+  }
+  return count;
+}
+
+#endif // CAN_ID_STATS_H
@@ -0,0 +1,121 @@
+/*
+ * can_rx_ring.h - Receive ring of CAN frames filled by the MCP2515 interrupt
+ *
+ * The interrupt of the INT pin drains both RX buffers of the MCP2515 into
+ * this ring and loop() takes the frames out. There is one writer (the
+ * interrupt) and one reader (loop()), each index is written by only one of
+ * them, so no lock is needed: the writer copies the frame before moving
+ * the head, the reader copies it before moving the tail. A full ring drops
+ * the new frame and counts an overrun.
+ *
+ * Also compiled on the host by tools/can_rx_ring_check.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef CAN_RX_RING_H
+#define CAN_RX_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef CAN_RX_RING_SIZE
+#define CAN_RX_RING_SIZE        32      // Frames, power of two (8 ms at 4000 frames/s)
+#endif
+
+// Error flags of the MCP2515 (EFLG register)
+#define CAN_EFLG_EWARN          0x01    // TEC or REC reached 96
+#define CAN_EFLG_RXWAR          0x02
+#define CAN_EFLG_TXWAR          0x04
+#define CAN_EFLG_RXEP           0x08    // Receive error passive
+#define CAN_EFLG_TXEP           0x10    // Transmit error passive
+#define CAN_EFLG_TXBO           0x20    // Bus off
+#define CAN_EFLG_RX0OVR         0x40    // Frame lost, RXB0 was full
+#define CAN_EFLG_RX1OVR         0x80    // Frame lost, RXB1 was full
+
+// Keeps the compiler from moving the frame copy past the index update
+#define CAN_RX_BARRIER()        __asm__ __volatile__("" ::: "memory")
+
+// Received frame
+typedef struct {
+  uint32_t id;
+  uint32_t timeUs;                      // micros() when it was taken from the controller
+  uint8_t len;
+  uint8_t data[8];
+} CanFrame;
+
+typedef struct {
+  CanFrame frames[CAN_RX_RING_SIZE];
+  volatile uint8_t head;                // Next frame written, only by the interrupt
+  volatile uint8_t tail;                // Next frame read, only by loop()
+  volatile uint8_t highWater;           // Most frames waiting at once
+  volatile uint32_t received;           // Frames taken from the controller
+  volatile uint32_t overruns;           // Frames dropped because the ring was full
+  volatile uint8_t errorFlags;          // Last EFLG read
+  volatile uint16_t errorCounts[8];     // Times each EFLG bit was found set after being clear
+} CanRxRing;
+
+static inline void CanRxRingInit(CanRxRing* ring) {
+  memset(ring, 0, sizeof(*ring));
+}
+
+// Frames waiting
+static inline uint8_t CanRxRingCount(const CanRxRing* ring) {
+  return (uint8_t)(ring->head - ring->tail) & (CAN_RX_RING_SIZE - 1);
+}
+
+// Interrupt side: stores a frame, returns false if the ring was full
+static inline bool CanRxRingPush(CanRxRing* ring, uint32_t id, uint8_t len, const uint8_t* data, uint32_t timeUs) {
+  uint8_t head = ring->head;
+  uint8_t next = (head + 1) & (CAN_RX_RING_SIZE - 1);
+
+  ring->received++;
+  if (next == ring->tail) {
+    ring->overruns++;
+    return false;
+  }
+
+  CanFrame* frame = &ring->frames[head];
+  frame->id = id;
+  frame->timeUs = timeUs;
+  frame->len = len > 8 ? 8 : len;
+  memcpy(frame->data, data, frame->len);
+  CAN_RX_BARRIER();
+  ring->head = next;
+
+  uint8_t count = CanRxRingCount(ring);
+  if (count > ring->highWater) {
+    ring->highWater = count;
+  }
+  return true;
+}
+
+// loop() side: takes the oldest frame, returns false if the ring is empty
+static inline bool CanRxRingPop(CanRxRing* ring, CanFrame* frame) {
+  uint8_t tail = ring->tail;
+
+  if (tail == ring->head) {
+    return false;
+  }
+  CAN_RX_BARRIER();
+  *frame = ring->frames[tail];
+  CAN_RX_BARRIER();
+  ring->tail = (tail + 1) & (CAN_RX_RING_SIZE - 1);
+  return true;
+}
+
+// Counts the EFLG bits that were clear in the previous read and are now set
+static inline void CanRxRingErrors(CanRxRing* ring, uint8_t flags) {
+  uint8_t raised = flags & ~ring->errorFlags;
+
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    if (raised & (1 << bit)) {
+      ring->errorCounts[bit]++;
+    }
+  }
+  ring->errorFlags = flags;
+}
+
+#endif // CAN_RX_RING_H
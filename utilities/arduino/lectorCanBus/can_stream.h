@@ -0,0 +1,321 @@
+/*
+ * can_stream.h - Frame streaming of the CAN reader: SLCAN text or compact binary
+ *
+ * Each frame is encoded whole into a transmit ring and loop() moves the
+ * ring to the serial port only as fast as the port takes it, so a busy bus
+ * never stalls the program: a frame that does not fit in the ring is
+ * dropped and counted, never cut in half.
+ *
+ * SLCAN (Lawicel) is the ASCII protocol read by slcand and python-can:
+ *   tIIILDD..[TTTT]\r        standard frame, rIIIL[TTTT]\r remote request
+ *   TIIIIIIIILDD..[TTTT]\r   extended frame, RIIIIIIIIL[TTTT]\r remote request
+ * with the optional timestamp in milliseconds, 0000-EA5F (wraps every
+ * 60 s).
+ *
+ * The binary record keeps the microsecond time of the interrupt:
+ *   A5 seq info time[4] id[2|4] data[len] xor
+ * info has the length in bits 0-3, remote request in bit 6 and extended
+ * ID in bit 7; time and ID are little endian; xor covers seq to the last
+ * data byte. seq counts records so the host sees frames dropped by the
+ * ring. A standard 8-byte frame takes 18 bytes instead of 26 in SLCAN.
+ *
+ * The decoders are used on the host by tools/can_stream_decoder.cpp
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef CAN_STREAM_H
+#define CAN_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef CAN_STREAM_RING_SIZE
+#define CAN_STREAM_RING_SIZE    128     // Bytes, power of two (7 binary frames of 8 bytes)
+#endif
+
+#define CAN_STREAM_SYNC         0xA5    // First byte of a binary record
+#define CAN_STREAM_MAX_RECORD   31      // Longest record: extended SLCAN frame with timestamp
+#define CAN_STREAM_SLCAN_WRAP   60000   // SLCAN timestamp period (ms)
+
+// ID flags of the MCP_CAN library
+#define CAN_STREAM_ID_EXTENDED  0x80000000UL
+#define CAN_STREAM_ID_REMOTE    0x40000000UL
+#define CAN_STREAM_ID_MASK      0x1FFFFFFFUL
+
+// Binary info byte
+#define CAN_STREAM_INFO_REMOTE  0x40
+#define CAN_STREAM_INFO_EXT     0x80
+
+typedef enum {
+  CAN_STREAM_OFF = 0,
+  CAN_STREAM_SLCAN,
+  CAN_STREAM_BINARY
+} CanStreamFormat;
+
+typedef struct {
+  uint8_t ring[CAN_STREAM_RING_SIZE];
+  uint8_t head;                         // Next byte written
+  uint8_t tail;                         // Next byte sent
+  uint8_t format;                       // CanStreamFormat
+  bool slcanTimestamps;                 // SLCAN Z1
+  uint8_t sequence;                     // Next binary record
+  uint32_t lastUs;                      // Time of the previous frame
+  uint32_t slcanUs;                     // SLCAN clock, wraps at 60 s
+  uint32_t frames;                      // Frames queued
+  uint32_t dropped;                     // Frames that did not fit in the ring
+} CanStream;
+
+// Frame read back by the host
+typedef struct {
+  uint32_t id;                          // Without flags
+  uint32_t time;                        // us (binary) or ms (SLCAN, 0xFFFFFFFF without timestamp)
+  bool extended;
+  bool remote;
+  uint8_t sequence;                     // Binary only
+  uint8_t len;
+  uint8_t data[8];
+} CanStreamRecord;
+
+static inline void CanStreamInit(CanStream* stream, uint8_t format) {
+  memset(stream, 0, sizeof(*stream));
+  stream->format = format;
+  stream->slcanTimestamps = true;
+}
+
+static inline uint8_t CanStreamUsed(const CanStream* stream) {
+  return (uint8_t)(stream->head - stream->tail) & (CAN_STREAM_RING_SIZE - 1);
+}
+
+static inline char CanStreamHexDigit(uint8_t value) {
+  return value < 10 ? (char)('0' + value) : (char)('A' + value - 10);
+}
+
+// Writes the low digits of value as hex, most significant first
+static inline uint8_t CanStreamPutHex(uint8_t* out, uint32_t value, uint8_t digits) {
+  for (uint8_t i = digits; i > 0; i--) {
+    out[i - 1] = (uint8_t)CanStreamHexDigit(value & 0x0F);
+    value >>= 4;
+  }
+  return digits;
+}
+
+// SLCAN line of a frame, returns its length
+static inline uint8_t CanStreamEncodeSlcan(uint8_t* out, uint32_t id, uint8_t len, const uint8_t* data,
+                                           bool timestamp, uint16_t timeMs) {
+  bool extended = (id & CAN_STREAM_ID_EXTENDED) != 0;
+  bool remote = (id & CAN_STREAM_ID_REMOTE) != 0;
+  uint8_t n = 0;
+
+  if (len > 8) {
+    len = 8;
+  }
+  out[n++] = remote ? (extended ? 'R' : 'r') : (extended ? 'T' : 't');
+  n += CanStreamPutHex(out + n, id & CAN_STREAM_ID_MASK, extended ? 8 : 3);
+  out[n++] = (uint8_t)('0' + len);
+  if (!remote) {
+    for (uint8_t i = 0; i < len; i++) {
+      n += CanStreamPutHex(out + n, data[i], 2);
+    }
+  }
+  if (timestamp) {
+    n += CanStreamPutHex(out + n, timeMs, 4);
+  }
+  out[n++] = '\r';
+  return n;
+}
+
+// Binary record of a frame, returns its length
+static inline uint8_t CanStreamEncodeBinary(uint8_t* out, uint8_t sequence, uint32_t id, uint8_t len,
+                                            const uint8_t* data, uint32_t timeUs) {
+  bool extended = (id & CAN_STREAM_ID_EXTENDED) != 0;
+  uint8_t n = 0;
+  uint8_t check = 0;
+
+  if (len > 8) {
+    len = 8;
+  }
+  out[n++] = CAN_STREAM_SYNC;
+  out[n++] = sequence;
+  out[n++] = len | (extended ? CAN_STREAM_INFO_EXT : 0) | ((id & CAN_STREAM_ID_REMOTE) ? CAN_STREAM_INFO_REMOTE : 0);
+  for (uint8_t i = 0; i < 4; i++) {
+    out[n++] = (uint8_t)(timeUs >> (8 * i));
+  }
+  id &= CAN_STREAM_ID_MASK;
+  for (uint8_t i = 0; i < (extended ? 4 : 2); i++) {
+    out[n++] = (uint8_t)(id >> (8 * i));
+  }
+  memcpy(out + n, data, len);
+  n += len;
+  for (uint8_t i = 1; i < n; i++) {
+    check ^= out[i];
+  }
+  out[n++] = check;
+  return n;
+}
+
+// Queues a frame in the current format, false if it did not fit
+static inline bool CanStreamPutFrame(CanStream* stream, uint32_t id, uint8_t len, const uint8_t* data, uint32_t timeUs) {
+  uint8_t record[CAN_STREAM_MAX_RECORD];
+  uint8_t n;
+
+  // SLCAN clock in us, unsigned difference survives the micros() wrap
+  stream->slcanUs += timeUs - stream->lastUs;
+  stream->lastUs = timeUs;
+  while (stream->slcanUs >= CAN_STREAM_SLCAN_WRAP * 1000UL) {
+    stream->slcanUs -= CAN_STREAM_SLCAN_WRAP * 1000UL;
+  }
+
+  if (stream->format == CAN_STREAM_SLCAN) {
+    n = CanStreamEncodeSlcan(record, id, len, data, stream->slcanTimestamps, (uint16_t)(stream->slcanUs / 1000));
+  } else if (stream->format == CAN_STREAM_BINARY) {
+    n = CanStreamEncodeBinary(record, stream->sequence, id, len, data, timeUs);
+  } else {
+    return false;
+  }
+
+  // One byte of the ring stays free to tell full from empty
+  if (n > CAN_STREAM_RING_SIZE - 1 - CanStreamUsed(stream)) {
+    stream->dropped++;
+    if (stream->format == CAN_STREAM_BINARY) {
+      stream->sequence++;               // The host sees the gap
+    }
+    return false;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    stream->ring[stream->head] = record[i];
+    stream->head = (stream->head + 1) & (CAN_STREAM_RING_SIZE - 1);
+  }
+  stream->sequence++;
+  stream->frames++;
+  return true;
+}
+
+// Queues bytes that are not frames (SLCAN replies), false if they did not fit
+static inline bool CanStreamPutBytes(CanStream* stream, const char* bytes, uint8_t n) {
+  if (n > CAN_STREAM_RING_SIZE - 1 - CanStreamUsed(stream)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    stream->ring[stream->head] = (uint8_t)bytes[i];
+    stream->head = (stream->head + 1) & (CAN_STREAM_RING_SIZE - 1);
+  }
+  return true;
+}
+
+// Contiguous bytes waiting to be sent, up to the end of the ring
+static inline uint8_t CanStreamPeek(const CanStream* stream, const uint8_t** bytes) {
+  *bytes = &stream->ring[stream->tail];
+  if (stream->head >= stream->tail) {
+    return stream->head - stream->tail;
+  }
+  return CAN_STREAM_RING_SIZE - stream->tail;
+}
+
+static inline void CanStreamConsume(CanStream* stream, uint8_t n) {
+  stream->tail = (stream->tail + n) & (CAN_STREAM_RING_SIZE - 1);
+}
+
+static inline int CanStreamHexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static inline bool CanStreamGetHex(const char* text, uint8_t digits, uint32_t* value) {
+  *value = 0;
+  for (uint8_t i = 0; i < digits; i++) {
+    int digit = CanStreamHexValue(text[i]);
+    if (digit < 0) {
+      return false;
+    }
+    *value = (*value << 4) | (uint32_t)digit;
+  }
+  return true;
+}
+
+// Host side: reads one SLCAN frame line without the '\r', false if it is not a valid frame
+static inline bool CanStreamDecodeSlcan(const char* line, size_t length, CanStreamRecord* record) {
+  uint32_t value;
+  size_t n = 1;
+
+  if (length == 0) {
+    return false;
+  }
+  record->extended = line[0] == 'T' || line[0] == 'R';
+  record->remote = line[0] == 'r' || line[0] == 'R';
+  if (!record->extended && line[0] != 't' && line[0] != 'r') {
+    return false;
+  }
+  uint8_t idDigits = record->extended ? 8 : 3;
+  if (length < n + idDigits + 1 || !CanStreamGetHex(line + n, idDigits, &record->id)) {
+    return false;
+  }
+  n += idDigits;
+  if (line[n] < '0' || line[n] > '8') {
+    return false;
+  }
+  record->len = (uint8_t)(line[n++] - '0');
+  if (!record->remote) {
+    if (length < n + 2 * record->len) {
+      return false;
+    }
+    for (uint8_t i = 0; i < record->len; i++, n += 2) {
+      if (!CanStreamGetHex(line + n, 2, &value)) {
+        return false;
+      }
+      record->data[i] = (uint8_t)value;
+    }
+  }
+  record->time = 0xFFFFFFFFUL;
+  if (length == n + 4 && CanStreamGetHex(line + n, 4, &value)) {
+    record->time = value;
+    n += 4;
+  }
+  record->sequence = 0;
+  return length == n;
+}
+
+// Host side: reads the binary record at the start of bytes.
+// Returns its length, 0 if more bytes are needed, -1 if bytes does not start a valid record
+static inline int CanStreamDecodeBinary(const uint8_t* bytes, size_t available, CanStreamRecord* record) {
+  uint8_t check = 0;
+
+  if (available < 3) {
+    return 0;
+  }
+  if (bytes[0] != CAN_STREAM_SYNC || (bytes[2] & 0x0F) > 8 || (bytes[2] & 0x30) != 0) {
+    return -1;
+  }
+  record->extended = (bytes[2] & CAN_STREAM_INFO_EXT) != 0;
+  record->remote = (bytes[2] & CAN_STREAM_INFO_REMOTE) != 0;
+  record->len = bytes[2] & 0x0F;
+  uint8_t idBytes = record->extended ? 4 : 2;
+  size_t length = 3 + 4 + idBytes + record->len + 1;
+  if (available < length) {
+    return 0;
+  }
+  for (size_t i = 1; i < length - 1; i++) {
+    check ^= bytes[i];
+  }
+  if (check != bytes[length - 1]) {
+    return -1;
+  }
+  record->sequence = bytes[1];
+  record->time = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    record->time |= (uint32_t)bytes[3 + i] << (8 * i);
+  }
+  record->id = 0;
+  for (uint8_t i = 0; i < idBytes; i++) {
+    record->id |= (uint32_t)bytes[7 + i] << (8 * i);
+  }
+  memcpy(record->data, bytes + 7 + idBytes, record->len);
+  return (int)length;
+}
+
+#endif // CAN_STREAM_H
@@ -0,0 +1,117 @@
+/*
+ * lcd_shadow.h - Incremental refresh of the 16x2 LCD of the CAN reader
+ *
+ * The screen is composed in RAM (wanted) and compared with a copy of what
+ * the LCD shows (screen); only the characters that differ are written.
+ * Over the PCF8574 I2C backpack every LCD byte is 6 I2C transfers, about
+ * 1.3 ms at 100 kHz, and clear() waits 2 ms more, so rewriting the whole
+ * display blocked loop() for tens of milliseconds. The writes are spread
+ * over the loop() passes: each call of LcdShadowFlush() writes until the
+ * time budget is spent and the next one goes on from there. The LCD
+ * address moves to the next cell after a write, so a run of changed
+ * characters needs one cursor command only.
+ *
+ * The LCD itself is reached through the handlers, so the same code runs
+ * on the host with a fake LCD.
+ *
+ * Also compiled on the host by tools/lcd_shadow_check.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef LCD_SHADOW_H
+#define LCD_SHADOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define LCD_SHADOW_COLS         16
+#define LCD_SHADOW_ROWS         2
+#define LCD_SHADOW_CELLS        (LCD_SHADOW_COLS * LCD_SHADOW_ROWS)
+#define LCD_SHADOW_UNKNOWN      0xFF    // Cursor position not known
+
+typedef struct {
+  void (*setCursor)(uint8_t col, uint8_t row);
+  void (*write)(uint8_t c);
+  uint32_t (*micros)(void);
+} LcdShadowHandlers;
+
+typedef struct {
+  char wanted[LCD_SHADOW_CELLS];        // Row 0 then row 1
+  char screen[LCD_SHADOW_CELLS];        // What the LCD shows
+  uint8_t position;                     // Next cell composed by LcdShadowPut()
+  uint8_t cursor;                       // Cell the LCD writes next, LCD_SHADOW_UNKNOWN if not known
+  uint8_t scan;                         // Cell where the next flush starts looking
+  uint32_t cells;                       // Characters written to the LCD
+  uint32_t commands;                    // Cursor commands sent
+} LcdShadow;
+
+// The LCD was cleared: both copies are blank
+static inline void LcdShadowInit(LcdShadow* shadow) {
+  memset(shadow, 0, sizeof(*shadow));
+  memset(shadow->wanted, ' ', LCD_SHADOW_CELLS);
+  memset(shadow->screen, ' ', LCD_SHADOW_CELLS);
+  shadow->cursor = LCD_SHADOW_UNKNOWN;
+}
+
+// The LCD was written around the shadow: every cell is written again
+static inline void LcdShadowInvalidate(LcdShadow* shadow) {
+  memset(shadow->screen, 0, LCD_SHADOW_CELLS);
+  shadow->cursor = LCD_SHADOW_UNKNOWN;
+}
+
+// Starts composing a new screen, blank, from the top left cell (what lcd.clear() did)
+static inline void LcdShadowBegin(LcdShadow* shadow) {
+  memset(shadow->wanted, ' ', LCD_SHADOW_CELLS);
+  shadow->position = 0;
+}
+
+static inline void LcdShadowSetCursor(LcdShadow* shadow, uint8_t col, uint8_t row) {
+  shadow->position = row < LCD_SHADOW_ROWS && col < LCD_SHADOW_COLS ? row * LCD_SHADOW_COLS + col : LCD_SHADOW_CELLS;
+}
+
+// One composed character; text past the end of a row is dropped, as the LCD does not show it
+static inline void LcdShadowPut(LcdShadow* shadow, char c) {
+  if (shadow->position < LCD_SHADOW_CELLS) {
+    shadow->wanted[shadow->position] = c;
+    if (++shadow->position % LCD_SHADOW_COLS == 0) {
+      shadow->position = LCD_SHADOW_CELLS;
+    }
+  }
+}
+
+// True if the LCD shows what was composed
+static inline bool LcdShadowDone(const LcdShadow* shadow) {
+  return memcmp(shadow->wanted, shadow->screen, LCD_SHADOW_CELLS) == 0;
+}
+
+// Writes changed cells until budgetUs is spent (at least one); returns the cells written
+static inline uint8_t LcdShadowFlush(LcdShadow* shadow, const LcdShadowHandlers* handlers, uint16_t budgetUs) {
+  uint32_t start = handlers->micros();
+  uint8_t written = 0;
+
+  for (uint8_t n = 0; n < LCD_SHADOW_CELLS; n++) {
+    uint8_t cell = shadow->scan;
+    if (shadow->wanted[cell] != shadow->screen[cell]) {
+      if (written > 0 && handlers->micros() - start >= budgetUs) {
+        return written;
+      }
+      if (shadow->cursor != cell) {
+        handlers->setCursor(cell % LCD_SHADOW_COLS, cell / LCD_SHADOW_COLS);
+        shadow->commands++;
+      }
+      handlers->write((uint8_t)shadow->wanted[cell]);
+      shadow->screen[cell] = shadow->wanted[cell];
+      shadow->cells++;
+      written++;
+      // The address goes on past the end of row 0 into memory that is not shown
+      shadow->cursor = (cell + 1) % LCD_SHADOW_COLS == 0 ? LCD_SHADOW_UNKNOWN : cell + 1;
+    }
+    shadow->scan = (cell + 1) % LCD_SHADOW_CELLS;
+  }
+  return written;
+}
+
+#endif // LCD_SHADOW_H
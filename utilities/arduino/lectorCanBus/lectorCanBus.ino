@@ -23,6 +23,12 @@
 #include <SPI.h>
 #include <mcp_can.h>
 #include <LiquidCrystal_I2C.h>
+#include "can_rx_ring.h"
+#include "can_filter.h"
+#include "can_stream.h"
+#include "can_id_stats.h"
+#include "obd_poller.h"
+#include "lcd_shadow.h"
 
 // Pin definitions
 const int PIN_CS_CAN = 10;      // CS (Chip Select) pin for MCP2515 module
@@ -36,12 +42,21 @@ const int PIN_SWITCH_TERM = 4;  // Switch to enable/disable termination resistor
 const unsigned long BAUDRATE_SERIAL = 115200;  // Serial port speed
 const unsigned long REFRESH_INTERVAL = 500;    // Reading refresh interval in ms
 const byte CAN_SPEED = CAN_500KBPS;           // CAN bus speed (adjust according to vehicle)
+const byte CAN_SPEED_SLCAN = 6;               // Lawicel code of CAN_SPEED (S6 = 500 kbps)
 const byte CRYSTAL_MHZ = MCP_16MHZ;           // Crystal frequency of MCP2515 module
+const unsigned long LED_RX_PULSE_MS = 5;       // Time the RX LED stays on after a message
+const unsigned long COUNTERS_INTERVAL = 5000;  // Reception counters on serial in statistics mode (ms)
+const byte SERIAL_LINE_RESERVE = 40;           // Free serial buffer needed to print a message without waiting
+const byte FRAMES_PER_LOOP = 8;                // Messages handled per loop() pass, so the buttons stay responsive
+const byte TOP_IDS_SERIAL = 5;                 // IDs in the periodic statistics report
+const byte TOP_IDS_LCD = 4;                    // IDs shown in turn on the LCD in statistics mode
+const unsigned int LCD_BUDGET_US = 1000;       // LCD writes per loop() pass (at least one character, about 1.3 ms)
 
 // Global variables
 byte operationMode = 0;             // Current operation mode
 unsigned long lastRefreshTime = 0;  // Time control for updates
-unsigned int messagesReceived = 0;  // Counter for received messages
+unsigned long messagesReceived = 0; // Counter for received messages
+unsigned long messagesNotPrinted = 0; // Messages counted but not printed because the serial port was busy
 bool canInitialized = false;        // Initialization state of CAN module
 bool termResistorEnabled = false;   // State of termination resistor
 
@@ -50,30 +65,70 @@ MCP_CAN CAN(PIN_CS_CAN);                      // Object to control CAN module
 LiquidCrystal_I2C lcd(0x27, 16, 2);          // Object to control LCD display
 
 // Variables for message statistics
-unsigned int msgStats[8] = {0, 0, 0, 0, 0, 0, 0, 0};  // Counters by ID
+CanIdStats idStats;                                   // Rate, period, jitter and last payload per ID
 unsigned long lastMessageTime = 0;                    // Time of last message
 
+// Interrupt-driven reception
+CanRxRing canRing;                                    // Frames taken from the MCP2515 by CANInterrupt()
+bool rxLedOn = false;                                 // RX LED pulse running
+unsigned long rxLedOnTime = 0;                        // Start of the RX LED pulse
+
+// Frame filtering
+CanIdSet idWhitelist;                                 // IDs handled, checked by the interrupt (empty: all)
+CanHwFilter hwFilter;                                 // Masks and filters loaded in the MCP2515
+char commandLine[48];                                 // Serial command being received
+byte commandLength = 0;
+
+// Display: UpdateDisplay() composes the screen in RAM, FlushDisplay() writes the cells that changed
+LcdShadow lcdShadow;
+const LcdShadowHandlers LCD_HANDLERS = { SetLCDCursor, WriteLCD, ReadMicros };
+
+// Print target of UpdateDisplay(), same calls as the LCD
+class ShadowDisplay : public Print {
+ public:
+  void clear() { LcdShadowBegin(&lcdShadow); }
+  void setCursor(byte col, byte row) { LcdShadowSetCursor(&lcdShadow, col, row); }
+  size_t write(uint8_t c) { LcdShadowPut(&lcdShadow, (char)c); return 1; }
+};
+ShadowDisplay display;
+
+// Diagnostic mode: supported PIDs polled on every ECU, ISO-TP answers
+ObdPoller obd;
+const ObdHandlers OBD_HANDLERS = { SendOBDFrame, ShowOBDValue, ShowOBDDtc, ShowOBDVin };
+
+// Streaming output, replaces the text of the monitor modes while it is on
+CanStream canStream;                                  // SLCAN or binary frames waiting for the serial port
+
 void setup() {
   // Initialize serial communication
   Serial.begin(BAUDRATE_SERIAL);
   Serial.println(F("CAN Bus Reader - Diagnostic Tool"));
   Serial.println(F("AutomotiveGuide_es"));
   Serial.println(F("--------------------------------------"));
+  Serial.print(F("Free RAM: "));
+  Serial.print(FreeMemory());
+  Serial.println(F(" bytes"));
 
   // Configure pins
   pinMode(PIN_LED_RX, OUTPUT);
   pinMode(PIN_LED_ERROR, OUTPUT);
   pinMode(PIN_BTN_MODE, INPUT_PULLUP);
   pinMode(PIN_SWITCH_TERM, INPUT_PULLUP);
-  pinMode(PIN_INT_CAN, INPUT);
+  pinMode(PIN_INT_CAN, INPUT_PULLUP);  // MCP2515 INT is open drain, low while a frame waits
+  CanRxRingInit(&canRing);
+  CanIdSetClear(&idWhitelist);
+  CanHwFilterCompute(&idWhitelist, &hwFilter);
+  CanStreamInit(&canStream, CAN_STREAM_OFF);
+  CanIdStatsClear(&idStats);
+  LcdShadowInit(&lcdShadow);
   
   // Initialize LCD
   lcd.init();
   lcd.backlight();
   lcd.setCursor(0, 0);
-  lcd.print("CAN Bus Reader");
+  lcd.print(F("CAN Bus Reader"));
   lcd.setCursor(0, 1);
-  lcd.print("Initializing...");
+  lcd.print(F("Initializing..."));
   
   // Check termination resistor switch
   UpdateTerminationResistor();
@@ -92,11 +147,34 @@ void loop() {
   // Check mode button
   CheckModeButton();
   
+  // Filter commands from the serial port
+  ReadCommands();
+  
   // Process received CAN messages
   ProcessCANMessages();
   
-  // Update display based on interval
+  // Diagnostic requests of the supported PIDs that are due
+  if (operationMode == 3 && canInitialized) {
+    ObdPollerRun(&obd, millis());
+  }
+  
+  // Send the streamed frames the serial port can take now
+  FlushStream();
+  
+  // Write the display cells that changed, a few per pass, once the ring is
+  // empty: on a saturated bus the 2.6 ms passes would overflow the ring
+  if (CanRxRingCount(&canRing) == 0) {
+    FlushDisplay();
+  }
+  
+  // End of the RX LED pulse
   unsigned long currentTime = millis();
+  if (rxLedOn && currentTime - rxLedOnTime >= LED_RX_PULSE_MS) {
+    rxLedOn = false;
+    digitalWrite(PIN_LED_RX, LOW);
+  }
+  
+  // Update display based on interval
   if (currentTime - lastRefreshTime >= REFRESH_INTERVAL) {
     lastRefreshTime = currentTime;
     UpdateDisplay();
@@ -111,19 +189,20 @@ void loop() {
 void InitializeCANController() {
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd.print("Starting CAN...");
+  lcd.print(F("Starting CAN..."));
   
   // Attempt to initialize CAN controller
   byte retries = 0;
   canInitialized = false;
   
   while (retries < 3 && !canInitialized) {
-    if (CAN.begin(CAN_SPEED, CRYSTAL_MHZ) == CAN_OK) {
+    // MCP_STDEXT: masks and filters enabled (MCP_ANY would ignore them), ApplyHardwareFilter() sets them
+    if (CAN.begin(MCP_STDEXT, CAN_SPEED, CRYSTAL_MHZ) == CAN_OK) {
       canInitialized = true;
       Serial.println(F("CAN initialized successfully"));
       
       lcd.setCursor(0, 1);
-      lcd.print("OK! 500kbps");
+      lcd.print(F("OK! 500kbps"));
       digitalWrite(PIN_LED_ERROR, LOW);
       delay(1000);
     } else {
@@ -131,7 +210,7 @@ void InitializeCANController() {
       Serial.println(F("Error initializing CAN. Retrying..."));
       
       lcd.setCursor(0, 1);
-      lcd.print("Error: Retry");
+      lcd.print(F("Error: Retry"));
       digitalWrite(PIN_LED_ERROR, HIGH);
       delay(1000);
     }
@@ -141,9 +220,9 @@ void InitializeCANController() {
     Serial.println(F("ERROR: Failed to initialize CAN controller"));
     lcd.clear();
     lcd.setCursor(0, 0);
-    lcd.print("CAN ERROR!");
+    lcd.print(F("CAN ERROR!"));
     lcd.setCursor(0, 1);
-    lcd.print("Check connections");
+    lcd.print(F("Check connections"));
     
     // Keep error LED on
     digitalWrite(PIN_LED_ERROR, HIGH);
@@ -151,60 +230,230 @@ void InitializeCANController() {
     // Additional CAN controller configuration
     CAN.setMode(MCP_NORMAL);  // Set operation mode to normal
     
-    // Simple filters to avoid saturation
-    // This allows all messages but can be modified to filter
-    CAN.init_Mask(0, 0, 0x00000000);
-    CAN.init_Mask(1, 0, 0x00000000);
+    // Frames are taken from the controller by the INT pin interrupt.
+    // SPI transactions of loop() mask this interrupt while they run.
+    SPI.usingInterrupt(digitalPinToInterrupt(PIN_INT_CAN));
+    attachInterrupt(digitalPinToInterrupt(PIN_INT_CAN), CANInterrupt, FALLING);
     
-    // Clear display for operational mode
+    // Acceptance filters of the whitelist, every frame while it is empty
+    ApplyHardwareFilter();
+    
+    // Clear display for operational mode, from here it is written through lcdShadow
     lcd.clear();
+    LcdShadowInit(&lcdShadow);
+  }
+}
+
+/*
+ * Moves every frame waiting in the MCP2515 (RXB0 and RXB1) to canRing.
+ * INT stays low while a buffer is full, so the buffers are read until
+ * both are empty; a frame that arrives meanwhile is read in the same pass.
+ * Runs in the interrupt or, with the interrupt masked, from loop().
+ */
+void DrainCANController() {
+  unsigned long canId;
+  byte len = 0;
+  byte buf[8];
+  
+  while (CAN.checkReceive() == CAN_MSGAVAIL) {
+    if (CAN.readMsgBuf(&canId, &len, buf) != CAN_OK) {
+      break;
+    }
+    // Frames the hardware filters let through but are not in the whitelist
+    if (!CanIdSetAccepts(&idWhitelist, canId)) {
+      idWhitelist.rejected++;
+      continue;
+    }
+    CanRxRingPush(&canRing, canId, len, buf, micros());
   }
+  
+  // Overflows of the controller buffers, error passive and bus off
+  CanRxRingErrors(&canRing, CAN.getError());
+}
+
+// Falling edge of the MCP2515 INT pin
+void CANInterrupt() {
+  DrainCANController();
+}
+
+// The MCP_CAN object is shared with the interrupt: calls from loop() are made with it masked
+void LockCAN() {
+  detachInterrupt(digitalPinToInterrupt(PIN_INT_CAN));
+}
+
+// An edge that arrived while masked runs the interrupt as soon as it is attached again
+void UnlockCAN() {
+  attachInterrupt(digitalPinToInterrupt(PIN_INT_CAN), CANInterrupt, FALLING);
 }
 
 void ProcessCANMessages() {
   if (!canInitialized) return;
   
-  byte len = 0;
-  byte buf[8];
-  unsigned long canId;
+  // INT still low with the interrupt idle: an edge was missed, drain here
+  if (digitalRead(PIN_INT_CAN) == LOW) {
+    LockCAN();
+    DrainCANController();
+    UnlockCAN();
+  }
   
-  // Check if messages are available
-  if (CAN_MSGAVAIL == CAN.checkReceive()) {
-    // Read the message
-    if (CAN.readMsgBuf(&canId, &len, buf) == CAN_OK) {
-      // Update statistics
-      messagesReceived++;
-      lastMessageTime = millis();
-      
-      // Classify by ID for statistics (simplified)
-      byte idCategory = (canId & 0x700) >> 8;  // Use significant bits of ID
-      if (idCategory < 8) {
-        msgStats[idCategory]++;
-      }
-      
-      // Blink reception LED
-      digitalWrite(PIN_LED_RX, HIGH);
-      
-      // Display data based on mode
-      switch (operationMode) {
-        case 0:  // Basic monitor mode
-          PrintBasicInfo(canId, len, buf);
-          break;
-        case 1:  // Detailed monitor mode
-          PrintDetailedInfo(canId, len, buf);
-          break;
-        case 2:  // Statistics mode
-          // Statistics are displayed in UpdateDisplay()
-          break;
-        case 3:  // Specific diagnostic mode
-          ProcessDiagnosticRequest(canId, len, buf);
-          break;
-      }
-      
-      // Turn off LED after a short period
-      delay(5);
-      digitalWrite(PIN_LED_RX, LOW);
+  CanFrame frame;
+  byte handled = 0;
+  
+  // Take the frames received by the interrupt
+  while (handled < FRAMES_PER_LOOP && CanRxRingPop(&canRing, &frame)) {
+    handled++;
+    
+    // Update statistics
+    messagesReceived++;
+    lastMessageTime = millis();
+    
+    // Statistics per ID, with the time the interrupt took the frame
+    CanIdStatsUpdate(&idStats, frame.id, frame.len, frame.data, frame.timeUs);
+    
+    // Pulse reception LED, turned off by loop()
+    digitalWrite(PIN_LED_RX, HIGH);
+    rxLedOn = true;
+    rxLedOnTime = lastMessageTime;
+    
+    // OBD answers, also while streaming
+    if (operationMode == 3) {
+      ObdPollerReceive(&obd, frame.id, frame.len, frame.data, millis());
+    }
+    
+    // Streaming: the frame is queued whole or dropped, FlushStream() sends it
+    if (canStream.format != CAN_STREAM_OFF) {
+      CanStreamPutFrame(&canStream, frame.id, frame.len, frame.data, frame.timeUs);
+      continue;
     }
+    
+    // Printing must not stall the loop while the bus is busy: the message is only counted
+    if ((operationMode == 0 || operationMode == 1) && Serial.availableForWrite() < SERIAL_LINE_RESERVE) {
+      messagesNotPrinted++;
+      continue;
+    }
+    
+    // Display data based on mode
+    switch (operationMode) {
+      case 0:  // Basic monitor mode
+        PrintBasicInfo(frame.id, frame.len, frame.data);
+        break;
+      case 1:  // Detailed monitor mode
+        PrintDetailedInfo(frame.id, frame.len, frame.data);
+        break;
+      case 2:  // Statistics mode
+        // Statistics are displayed in UpdateDisplay()
+        break;
+      case 3:  // Specific diagnostic mode
+        // Answers are read by the poller above
+        break;
+    }
+  }
+}
+
+void PrintReceptionCounters() {
+  // Copy of the counters of the interrupt
+  noInterrupts();
+  unsigned long received = canRing.received;
+  unsigned long overruns = canRing.overruns;
+  byte highWater = canRing.highWater;
+  byte errorFlags = canRing.errorFlags;
+  unsigned int controllerOverflows = canRing.errorCounts[6] + canRing.errorCounts[7];
+  unsigned int errorPassive = canRing.errorCounts[3] + canRing.errorCounts[4];
+  unsigned int busOff = canRing.errorCounts[5];
+  interrupts();
+  
+  Serial.print(F("RX: "));
+  Serial.print(received);
+  Serial.print(F(" frames, ring lost "));
+  Serial.print(overruns);
+  Serial.print(F(" (max "));
+  Serial.print(highWater);
+  Serial.print(F("/"));
+  Serial.print(CAN_RX_RING_SIZE - 1);
+  Serial.print(F("), MCP2515 overflows "));
+  Serial.print(controllerOverflows);
+  Serial.print(F(", error passive "));
+  Serial.print(errorPassive);
+  Serial.print(F(", bus off "));
+  Serial.print(busOff);
+  Serial.print(F(", EFLG 0x"));
+  Serial.print(errorFlags, HEX);
+  Serial.print(F(", not printed "));
+  Serial.print(messagesNotPrinted);
+  Serial.print(F(", stream dropped "));
+  Serial.print(canStream.dropped);
+  Serial.print(F(", free RAM "));
+  Serial.println(FreeMemory());
+}
+
+// Bytes between the heap (or the end of the globals) and the stack, the
+// run-time counterpart of "leaving N bytes for local variables" of the IDE
+int FreeMemory() {
+  extern char __heap_start;
+  extern char* __brkval;
+  char top;
+  return &top - (__brkval != 0 ? __brkval : &__heap_start);
+}
+
+// Period in ms with one decimal, ">1048" when saturated
+void PrintPeriod(unsigned long us) {
+  if (us >= (unsigned long)CAN_PERIOD_MAX << CAN_PERIOD_SHIFT) {
+    Serial.print(F(">1048"));
+    return;
+  }
+  Serial.print(us / 1000);
+  Serial.print(F("."));
+  Serial.print((us % 1000) / 100);
+}
+
+// One line per ID, busiest first: frames/s, mean [min-max] period, jitter, count and
+// last payload with '*' after the bytes that changed since the previous report
+void PrintIdStats(byte count) {
+  byte top[CAN_ID_STATS_MAX_IDS];
+  unsigned long now = micros();
+  
+  count = CanIdStatsTop(&idStats, top, count);
+  Serial.print(F("IDs: "));
+  Serial.print(idStats.used);
+  Serial.print(F(" tracked, untracked frames "));
+  Serial.print(idStats.untracked);
+  Serial.print(F(", extended frames "));
+  Serial.println(idStats.extended);
+  if (idStats.untracked > 0) {
+    Serial.print(F("Table full ("));
+    Serial.print(CAN_ID_STATS_MAX_IDS);
+    Serial.println(F(" IDs), 'filter add ID ...' chooses the IDs tracked"));
+  }
+  
+  for (byte i = 0; i < count; i++) {
+    CanIdEntry* entry = &idStats.entries[top[i]];
+    if (entry->id < 0x100) Serial.print(F("0"));
+    if (entry->id < 0x10) Serial.print(F("0"));
+    Serial.print(entry->id, HEX);
+    Serial.print(F(" "));
+    Serial.print(CanIdEntryRate(entry));
+    Serial.print(F("/s "));
+    PrintPeriod(entry->meanPeriod >> CAN_MEAN_SHIFT);
+    Serial.print(F("ms ["));
+    PrintPeriod((unsigned long)entry->minPeriod << CAN_PERIOD_SHIFT);
+    Serial.print(F("-"));
+    PrintPeriod((unsigned long)entry->maxPeriod << CAN_PERIOD_SHIFT);
+    Serial.print(F("] j"));
+    Serial.print(entry->jitter);
+    Serial.print(F("us #"));
+    Serial.print(entry->count);
+    Serial.print(F(" "));
+    Serial.print(entry->dlc);
+    Serial.print(F(":"));
+    for (byte b = 0; b < entry->dlc; b++) {
+      Serial.print(F(" "));
+      if (entry->data[b] < 0x10) Serial.print(F("0"));
+      Serial.print(entry->data[b], HEX);
+      if (entry->changed & (1 << b)) Serial.print(F("*"));
+    }
+    if (CanIdEntryMissing(entry, now)) Serial.print(F(" LOST"));
+    Serial.println();
+    entry->changed = 0;
   }
 }
 
@@ -268,97 +517,136 @@ void PrintDetailedInfo(unsigned long canId, byte len, byte *buf) {
   Serial.println();
 }
 
-void ProcessDiagnosticRequest(unsigned long canId, byte len, byte *buf) {
-  // Process responses to diagnostic requests
-  if (canId >= 0x7E8 && canId <= 0x7EF) {  // Diagnostic responses
-    Serial.print(F("DIAG RESP ["));
-    Serial.print(canId - 0x7E0, HEX);
+// Poller handler: sends a request or Flow Control frame
+bool SendOBDFrame(uint16_t id, const uint8_t* data) {
+  LockCAN();
+  byte result = CAN.sendMsgBuf(id, 0, 8, (byte*)data);
+  UnlockCAN();
+  return result == CAN_OK;
+}
+
+// Poller handler: one PID value, printed if the serial port has room
+void ShowOBDValue(uint8_t ecu, uint8_t pid, const uint8_t* data, uint8_t len) {
+  if (canStream.format != CAN_STREAM_OFF || Serial.availableForWrite() < SERIAL_LINE_RESERVE) return;
+  
+  Serial.print(F("DIAG RESP ["));
+  Serial.print(ecu + 8, HEX);
+  Serial.print(F("]: PID "));
+  if (pid < 0x10) Serial.print(F("0"));
+  Serial.print(pid, HEX);
+  PrintPIDValues(pid, data, len);
+  Serial.println();
+}
+
+// Poller handler: one stored DTC
+void ShowOBDDtc(uint8_t ecu, uint16_t code) {
+  char text[6];
+  
+  if (canStream.format != CAN_STREAM_OFF) return;
+  ObdFormatDtc(code, text);
+  Serial.print(F("DTC ["));
+  Serial.print(ecu + 8, HEX);
+  Serial.print(F("]: "));
+  Serial.println(text);
+}
+
+// Poller handler: VIN characters as they arrive
+void ShowOBDVin(uint8_t ecu, uint8_t index, char c) {
+  if (canStream.format != CAN_STREAM_OFF) return;
+  if (index == 0) {
+    Serial.print(F("VIN ["));
+    Serial.print(ecu + 8, HEX);
     Serial.print(F("]: "));
-    
-    if (len > 2 && buf[0] > 0) {
-      byte serviceId = buf[1];
-      if (serviceId == 0x41) {  // Response to mode 01 (current data)
-        Serial.print(F("Mode 01 PID "));
-        Serial.print(buf[2], HEX);
-        
-        // Interpret some common PIDs
-        InterpretCommonPIDs(buf[2], &buf[3], len-3);
-      } else if (serviceId == 0x42) {  // Response to mode 02 (frozen data)
-        Serial.println(F("Frozen data"));
-      } else {
-        Serial.print(F("Mode "));
-        Serial.print(serviceId - 0x40, HEX);
-      }
+  }
+  Serial.write(c);
+  if (index == 16) Serial.println();
+}
+
+// Poller state and the ECU polled for each scheduled PID
+void PrintOBDStatus() {
+  Serial.print(obd.phase == OBD_DISCOVERY ? F("Searching supported PIDs") : F("Polling"));
+  Serial.print(F(", ECUs 0x"));
+  Serial.print(obd.present, HEX);
+  Serial.print(F(", "));
+  Serial.print(obd.maxPids);
+  Serial.print(F(" PIDs/request, "));
+  Serial.print(obd.samples);
+  Serial.print(F(" samples, "));
+  Serial.print(obd.requests);
+  Serial.print(F(" requests, "));
+  Serial.print(obd.timeouts);
+  Serial.print(F(" timeouts, "));
+  Serial.print(obd.negative);
+  Serial.print(F(" negative, "));
+  Serial.print(obd.errors);
+  Serial.println(F(" ISO-TP errors"));
+  
+  for (byte i = 0; i < obd.scheduleCount; i++) {
+    byte pid = ObdSchedulePid(&obd, i);
+    Serial.print(F("PID "));
+    if (pid < 0x10) Serial.print(F("0"));
+    Serial.print(pid, HEX);
+    Serial.print(F(" every "));
+    Serial.print(ObdSchedulePeriod(&obd, i));
+    if (obd.pids[i].ecu == OBD_NO_ECU) {
+      Serial.println(F(" ms: not supported"));
+    } else {
+      Serial.print(F(" ms: ECU "));
+      Serial.println(obd.pids[i].ecu + 8, HEX);
     }
-    Serial.println();
   }
 }
 
-void InterpretCommonPIDs(byte pid, byte *data, byte len) {
-  // Simplified interpretation of some common PIDs
-  switch (pid) {
-    case 0x0C:  // RPM
-      if (len >= 2) {
-        int rpm = ((data[0] * 256) + data[1]) / 4;
-        Serial.print(F(" = RPM: "));
-        Serial.print(rpm);
-      }
-      break;
-    case 0x0D:  // Speed
-      if (len >= 1) {
-        Serial.print(F(" = Speed: "));
-        Serial.print(data[0]);
-        Serial.print(F(" km/h"));
-      }
-      break;
-    case 0x05:  // Coolant temperature
-      if (len >= 1) {
-        Serial.print(F(" = Temp: "));
-        Serial.print(data[0] - 40);
-        Serial.print(F("°C"));
-      }
-      break;
-    default:
-      // For other PIDs just display the data in hex
-      Serial.print(F(" = "));
-      for (int i = 0; i < len; i++) {
-        if (data[i] < 0x10) Serial.print(F("0"));
-        Serial.print(data[i], HEX);
-        Serial.print(F(" "));
-      }
+// Every value of a Mode 01 PID from the table of obd_pid.h, hex if the PID is not in it
+void PrintPIDValues(byte pid, const byte *data, byte len) {
+  char text[OBD_PID_TEXT];
+  byte index = 0;
+  
+  while (ObdPidFormat(pid, index, data, len, text, sizeof(text)) > 0) {
+    Serial.print(index == 0 ? F(" = ") : F(", "));
+    Serial.print(text);
+    index++;
+  }
+  if (index == 0) {
+    Serial.print(F(" = "));
+    for (int i = 0; i < len; i++) {
+      if (data[i] < 0x10) Serial.print(F("0"));
+      Serial.print(data[i], HEX);
+      Serial.print(F(" "));
+    }
   }
 }
 
 void UpdateDisplay() {
   if (!canInitialized) return;
   
-  lcd.clear();
+  display.clear();
   
   // First line based on mode
-  lcd.setCursor(0, 0);
+  display.setCursor(0, 0);
   switch (operationMode) {
     case 0:
-      lcd.print("Basic monitor");
+      display.print(F("Basic monitor"));
       break;
     case 1:
-      lcd.print("Detailed monitor");
+      display.print(F("Detailed monitor"));
       break;
     case 2:
-      lcd.print("Statistics");
+      display.print(F("Statistics"));
       break;
     case 3:
-      lcd.print("Diagnostic");
+      display.print(F("Diagnostic"));
       break;
   }
   
   // Second line: relevant information based on mode
-  lcd.setCursor(0, 1);
+  display.setCursor(0, 1);
   switch (operationMode) {
     case 0:
     case 1:
       // Display messages per second
       unsigned long currentTime = millis();
-      static unsigned int lastCount = 0;
+      static unsigned long lastCount = 0;
       static unsigned long lastCalcTime = 0;
       static int msgsPerSecond = 0;
       
@@ -368,65 +656,87 @@ void UpdateDisplay() {
         lastCalcTime = currentTime;
       }
       
-      lcd.print("Msgs: ");
-      lcd.print(msgsPerSecond);
-      lcd.print("/s");
+      display.print(F("Msgs: "));
+      display.print(msgsPerSecond);
+      display.print(F("/s"));
       
       // Display if termination resistor is active
-      lcd.setCursor(13, 1);
-      lcd.print(termResistorEnabled ? "TRM" : "   ");
+      display.setCursor(13, 1);
+      display.print(termResistorEnabled ? F("TRM") : F("   "));
       break;
     
     case 2:
-      // In statistics mode display distribution by type
-      unsigned long total = 0;
-      byte maxIndex = 0;
+      // In statistics mode display the busiest IDs in turn: ID, frames/s and jitter
+      byte top[TOP_IDS_LCD];
+      byte topCount = CanIdStatsTop(&idStats, top, TOP_IDS_LCD);
+      static byte topShown = 0;
       
-      // Find the most frequent message type
-      for (int i = 0; i < 8; i++) {
-        total += msgStats[i];
-        if (msgStats[i] > msgStats[maxIndex]) {
-          maxIndex = i;
-        }
+      // Reception counters and busiest IDs on serial
+      static unsigned long lastCountersTime = 0;
+      if (millis() - lastCountersTime >= COUNTERS_INTERVAL && canStream.format == CAN_STREAM_OFF) {
+        lastCountersTime = millis();
+        PrintReceptionCounters();
+        PrintIdStats(TOP_IDS_SERIAL);
       }
       
-      if (total > 0) {
-        lcd.print("ID:");
-        lcd.print(maxIndex);
-        lcd.print(" ");
-        lcd.print(map(msgStats[maxIndex]*100, 0, total, 0, 100));
-        lcd.print("% ");
-        lcd.print(total);
+      if (topCount > 0) {
+        const CanIdEntry* entry = &idStats.entries[top[topShown++ % topCount]];
+        display.print(entry->id, HEX);
+        display.print(F(" "));
+        if (CanIdEntryMissing(entry, micros())) {
+          display.print(F("lost"));
+        } else {
+          display.print(CanIdEntryRate(entry));
+          display.print(F("/s j"));
+          display.print(min(entry->jitter, 9999));
+        }
       } else {
-        lcd.print("No messages");
+        display.print(F("No messages"));
       }
       break;
       
     case 3:
-      // In diagnostic mode send periodic requests
-      static byte currentPID = 0;
-      
-      // Display current PID
-      lcd.print("PID:");
-      if (currentPID < 0x10) lcd.print("0");
-      lcd.print(currentPID, HEX);
+      // In diagnostic mode display the useful samples per second, requests are sent by the poller
+      static unsigned long lastSamples = 0;
+      static unsigned long lastSamplesTime = 0;
+      static unsigned int samplesPerSecond = 0;
       
-      // Send diagnostic request for this PID
-      SendDiagnosticRequest(0x01, currentPID);  // Mode 01, current PID
+      if (millis() - lastSamplesTime >= 1000) {
+        samplesPerSecond = obd.samples - lastSamples;
+        lastSamples = obd.samples;
+        lastSamplesTime = millis();
+      }
       
-      // Rotate to next PID every certain time
-      currentPID = (currentPID + 1) % 32;  // Limit to first 32 PIDs
+      if (obd.phase == OBD_DISCOVERY) {
+        display.print(F("Searching PIDs"));
+      } else {
+        display.print(F("PID:"));
+        display.print(samplesPerSecond);
+        display.print(F("/s ECU:"));
+        display.print(obd.present, HEX);
+      }
       break;
   }
 }
 
-void SendDiagnosticRequest(byte mode, byte pid) {
-  byte data[8] = {0x02, mode, pid, 0, 0, 0, 0, 0};
-  byte result = CAN.sendMsgBuf(0x7DF, 0, 8, data);  // Standard diagnostic ID
+// LCD handlers of lcdShadow
+void SetLCDCursor(uint8_t col, uint8_t row) {
+  lcd.setCursor(col, row);
+}
+
+void WriteLCD(uint8_t c) {
+  lcd.write(c);
+}
+
+uint32_t ReadMicros() {
+  return micros();
+}
+
+// Writes the changed cells of the display until LCD_BUDGET_US is spent
+void FlushDisplay() {
+  if (!canInitialized) return;
   
-  if (result != CAN_OK) {
-    Serial.println(F("Error sending diagnostic request"));
-  }
+  LcdShadowFlush(&lcdShadow, &LCD_HANDLERS, LCD_BUDGET_US);
 }
 
 void CheckModeButton() {
@@ -445,6 +755,11 @@ void CheckModeButton() {
       // Switch to next mode
       operationMode = (operationMode + 1) % 4;
       
+      // Diagnostic mode starts by asking the ECUs for their supported PIDs
+      if (operationMode == 3) {
+        ObdPollerStart(&obd, OBD_SCHEDULE, sizeof(OBD_SCHEDULE) / sizeof(OBD_SCHEDULE[0]), &OBD_HANDLERS, millis());
+      }
+      
       // Update display immediately
       UpdateDisplay();
       
@@ -453,7 +768,11 @@ void CheckModeButton() {
       delay(100);
       digitalWrite(PIN_LED_RX, LOW);
       
-      // Display new mode on serial
+      // Display new mode on serial, unless frames are being streamed
+      if (canStream.format != CAN_STREAM_OFF) {
+        lastButtonState = buttonState;
+        return;
+      }
       Serial.print(F("Mode changed to: "));
       
       switch (operationMode) {
@@ -491,6 +810,7 @@ void UpdateTerminationResistor() {
   // Here a physical termination resistor would be enabled/disabled 
   // via a relay or transistor if the hardware supports it
   
+  if (canStream.format != CAN_STREAM_OFF) return;
   Serial.print(F("Termination resistor: "));
   Serial.println(termResistorEnabled ? F("ENABLED") : F("DISABLED"));
 }
@@ -501,6 +821,261 @@ void SignalError() {
   digitalWrite(PIN_LED_ERROR, LOW);
 }
 
+// Loads hwFilter in the MCP2515
+void ApplyHardwareFilter() {
+  // A filter with EXIDE clear only matches standard frames whatever the mask. With both masks open
+  // (empty whitelist) the filters alternate extended and standard as the library leaves them, so
+  // every frame of both kinds still reaches the interrupt
+  bool acceptAll = hwFilter.masks[0] == 0 && hwFilter.masks[1] == 0;
+  
+  // The MCP_CAN library takes a standard ID in bits 16-26, bits 0-15 would filter the first two data bytes
+  LockCAN();
+  CAN.init_Mask(0, 0, (unsigned long)hwFilter.masks[0] << 16);
+  CAN.init_Mask(1, 0, (unsigned long)hwFilter.masks[1] << 16);
+  for (byte i = 0; i < CAN_HW_FILTERS; i++) {
+    if (acceptAll) {
+      CAN.init_Filt(i, i % 2 == 0, 0);
+    } else {
+      CAN.init_Filt(i, 0, (unsigned long)hwFilter.filters[i] << 16);
+    }
+  }
+  UnlockCAN();
+}
+
+// Adds or removes the hexadecimal IDs of a command, then loads the filters of the new list
+void ChangeWhitelist(char* ids, bool add) {
+  for (char* token = strtok(ids, " "); token != NULL; token = strtok(NULL, " ")) {
+    char* end;
+    unsigned long id = strtoul(token, &end, 16);
+    bool done = false;
+    
+    // The interrupt reads the list
+    if (*end == '\0' && id <= CAN_STD_ID_MASK) {
+      LockCAN();
+      done = add ? CanIdSetAdd(&idWhitelist, id) : CanIdSetRemove(&idWhitelist, id);
+      UnlockCAN();
+    }
+    if (!done) {
+      Serial.print(add ? F("Not added: ") : F("Not in the list: "));
+      Serial.println(token);
+    }
+  }
+  CanHwFilterCompute(&idWhitelist, &hwFilter);
+  ApplyHardwareFilter();
+  
+  // The statistics follow the whitelist: IDs it no longer lets through give their slots back
+  CanIdStatsClear(&idStats);
+  PrintFilters();
+}
+
+// Whitelist, hardware filters and the number of standard IDs they let through
+void PrintFilters() {
+  Serial.print(F("Whitelist ("));
+  Serial.print(idWhitelist.count);
+  Serial.print(F("):"));
+  if (idWhitelist.count == 0) {
+    Serial.print(F(" all IDs"));
+  }
+  for (byte i = 0; i < idWhitelist.count; i++) {
+    Serial.print(F(" "));
+    Serial.print(idWhitelist.ids[i], HEX);
+  }
+  Serial.println();
+  
+  for (byte buffer = 0; buffer < CAN_HW_MASKS; buffer++) {
+    Serial.print(F("RXB"));
+    Serial.print(buffer);
+    Serial.print(F(" mask "));
+    Serial.print(hwFilter.masks[buffer], HEX);
+    Serial.print(F(" filters"));
+    for (byte i = buffer == 0 ? 0 : 2; i < (buffer == 0 ? 2 : CAN_HW_FILTERS); i++) {
+      Serial.print(F(" "));
+      Serial.print(hwFilter.filters[i], HEX);
+    }
+    Serial.println();
+  }
+  
+  noInterrupts();
+  unsigned long rejected = idWhitelist.rejected;
+  interrupts();
+  Serial.print(F("Hardware lets through "));
+  Serial.print(CanHwFilterSpan(&hwFilter));
+  Serial.print(F(" of 2048 IDs, "));
+  Serial.print(rejected);
+  Serial.println(F(" frames dropped by the whitelist"));
+}
+
+// Reads the serial port without waiting and runs every complete line (\r ends SLCAN commands)
+void ReadCommands() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (commandLength > 0) {
+        commandLine[commandLength] = '\0';
+        ProcessCommand(commandLine);
+        commandLength = 0;
+      }
+    } else if (commandLength < sizeof(commandLine) - 1) {
+      commandLine[commandLength++] = c;
+    }
+  }
+}
+
+// Moves the streamed bytes to the serial port without waiting
+void FlushStream() {
+  const uint8_t* bytes;
+  int space = Serial.availableForWrite();
+  
+  while (space > 0) {
+    uint8_t count = CanStreamPeek(&canStream, &bytes);
+    if (count == 0) break;
+    if (count > space) count = space;
+    Serial.write(bytes, count);
+    CanStreamConsume(&canStream, count);
+    space -= count;
+  }
+}
+
+// Starts or stops streaming, the counters start again
+void SetStreamFormat(byte format) {
+  bool timestamps = canStream.slcanTimestamps;
+  CanStreamInit(&canStream, format);
+  canStream.slcanTimestamps = timestamps;
+}
+
+// Lawicel commands sent by slcand and python-can: \r accepts, BEL (7) refuses.
+// The reader only listens, so the bit rate is the one of CAN_SPEED and transmit commands are refused
+void ProcessSlcanCommand(char* command) {
+  const char* reply = "\a";
+  
+  switch (command[0]) {
+    case 'O':                           // Open: start streaming frames
+      SetStreamFormat(CAN_STREAM_SLCAN);
+      reply = "\r";
+      break;
+    case 'C':                           // Close
+      SetStreamFormat(CAN_STREAM_OFF);
+      reply = "\r";
+      break;
+    case 'S':                           // Bit rate, accepted only if it is the configured one
+      if (command[1] - '0' == CAN_SPEED_SLCAN) reply = "\r";
+      break;
+    case 'Z':                           // Timestamps on/off
+      canStream.slcanTimestamps = command[1] == '1';
+      reply = "\r";
+      break;
+    case 'V':
+      reply = "V0101\r";
+      break;
+    case 'N':
+      reply = "NLCB1\r";
+      break;
+    case 'F':                           // Status flags: no error reported
+      reply = "F00\r";
+      break;
+  }
+  
+  if (canStream.format == CAN_STREAM_OFF) {
+    Serial.print(reply);
+  } else {
+    // Queued behind the frames already encoded so it does not land in the middle of one
+    CanStreamPutBytes(&canStream, reply, strlen(reply));
+  }
+}
+
+// Runs one filter, stream or SLCAN command
+void ProcessCommand(char* command) {
+  unsigned int values[CAN_HW_MASKS + CAN_HW_FILTERS];
+  
+  // Lawicel commands are upper case, or a frame to transmit
+  if ((command[0] >= 'A' && command[0] <= 'Z') || ((command[0] == 't' || command[0] == 'r') && isxdigit(command[1]))) {
+    ProcessSlcanCommand(command);
+    return;
+  }
+  
+  if (strcmp_P(command, PSTR("help")) == 0) {
+    Serial.println(F("filter add ID [ID ...]    - Handle these IDs (hex, 11 bits), up to 32"));
+    Serial.println(F("filter del ID [ID ...]    - Remove IDs from the whitelist"));
+    Serial.println(F("filter clear              - Handle every ID"));
+    Serial.println(F("filter show               - Whitelist and hardware filters"));
+    Serial.println(F("filter hw M0 M1 F0 [..F5] - Load masks and filters by hand (hex)"));
+    Serial.println(F("obd                       - Diagnostic poller state and supported PIDs"));
+    Serial.println(F("obd dtc / obd vin         - Read stored DTCs / VIN (diagnostic mode)"));
+    Serial.println(F("obd pids N                - PIDs per request, 1 for ECUs without multi-PID"));
+    Serial.println(F("stats                     - Statistics of every ID, busiest first"));
+    Serial.println(F("stats clear               - Forget the IDs seen"));
+    Serial.println(F("stream slcan              - Stream frames as SLCAN (Lawicel) text"));
+    Serial.println(F("stream bin                - Stream frames as binary records with us time"));
+    Serial.println(F("stream off                - Back to the text of the current mode"));
+    Serial.println(F("O / C                     - SLCAN open / close, sent by slcand"));
+    return;
+  }
+  if (strncmp_P(command, PSTR("filter add "), 11) == 0) {
+    ChangeWhitelist(command + 11, true);
+  } else if (strncmp_P(command, PSTR("filter del "), 11) == 0) {
+    ChangeWhitelist(command + 11, false);
+  } else if (strcmp_P(command, PSTR("filter clear")) == 0) {
+    LockCAN();
+    CanIdSetClear(&idWhitelist);
+    UnlockCAN();
+    CanHwFilterCompute(&idWhitelist, &hwFilter);
+    ApplyHardwareFilter();
+    CanIdStatsClear(&idStats);
+    PrintFilters();
+  } else if (strcmp_P(command, PSTR("stream slcan")) == 0) {
+    SetStreamFormat(CAN_STREAM_SLCAN);
+  } else if (strcmp_P(command, PSTR("stream bin")) == 0) {
+    SetStreamFormat(CAN_STREAM_BINARY);
+  } else if (strcmp_P(command, PSTR("stream off")) == 0) {
+    SetStreamFormat(CAN_STREAM_OFF);
+    Serial.println(F("Stream off"));
+  } else if (strcmp_P(command, PSTR("stats")) == 0) {
+    PrintIdStats(CAN_ID_STATS_MAX_IDS);
+  } else if (strcmp_P(command, PSTR("stats clear")) == 0) {
+    CanIdStatsClear(&idStats);
+    Serial.println(F("Statistics cleared"));
+  } else if (strcmp_P(command, PSTR("obd")) == 0) {
+    PrintOBDStatus();
+  } else if (strcmp_P(command, PSTR("obd dtc")) == 0 || strcmp_P(command, PSTR("obd vin")) == 0) {
+    if (operationMode != 3) {
+      Serial.println(F("Only in diagnostic mode"));
+    } else if (command[4] == 'd') {
+      ObdPollerDemand(&obd, 0x03, 0);
+    } else {
+      ObdPollerDemand(&obd, 0x09, 0x02);
+    }
+  } else if (strncmp_P(command, PSTR("obd pids "), 9) == 0) {
+    int count = atoi(command + 9);
+    if (count < 1 || count > OBD_MAX_PIDS) {
+      Serial.println(F("Usage: obd pids 1..6"));
+    } else {
+      obd.maxPids = count;
+    }
+  } else if (strcmp_P(command, PSTR("filter show")) == 0) {
+    PrintFilters();
+  } else if (strncmp_P(command, PSTR("filter hw "), 10) == 0) {
+    // Filters not given repeat the last one; the whitelist still applies
+    int count = sscanf(command + 10, "%x %x %x %x %x %x %x %x", &values[0], &values[1], &values[2], &values[3],
+                       &values[4], &values[5], &values[6], &values[7]);
+    if (count < CAN_HW_MASKS + 1) {
+      Serial.println(F("Usage: filter hw M0 M1 F0 [F1 .. F5]"));
+      return;
+    }
+    for (byte i = 0; i < CAN_HW_MASKS + CAN_HW_FILTERS; i++) {
+      unsigned int value = values[i < count ? i : count - 1] & CAN_STD_ID_MASK;
+      if (i < CAN_HW_MASKS) {
+        hwFilter.masks[i] = value;
+      } else {
+        hwFilter.filters[i - CAN_HW_MASKS] = value;
+      }
+    }
+    ApplyHardwareFilter();
+    PrintFilters();
+  } else {
+    Serial.println(F("Unknown command, type 'help'"));
+  }
+}
+
 void PrintInstructions() {
   Serial.println();
   Serial.println(F("=== CAN BUS READER - INSTRUCTIONS ==="));
@@ -514,6 +1089,8 @@ void PrintInstructions() {
   Serial.println(F("3 - Diagnostic: Attempts to communicate with modules using OBD2 protocol"));
   Serial.println();
   Serial.println(F("RX LED: Blinks when receiving messages"));
+  Serial.println(F("Statistics mode also prints the reception counters every 5 s"));
   Serial.println(F("ERROR LED: Indicates initialization or communication issues"));
+  Serial.println(F("Type 'help' for the filter and stream commands"));
   Serial.println(F("======================================"));
 }
\ No newline at end of file
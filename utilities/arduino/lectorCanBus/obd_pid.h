@@ -0,0 +1,434 @@
+/*
+ * obd_pid.h - Decoder of the OBD-II Mode 01 PIDs of the CAN reader
+ *
+ * One table in flash describes every standard Mode 01 PID from 0x00 to
+ * 0x64 (SAE J1979): data length, and for each value in the answer its
+ * position, scale, offset, unit and name. A value is computed in integers
+ * as raw * mul / div + offset, in units of its last decimal, so the AVR
+ * and the host give the same digits without floating point. Bit-field
+ * PIDs have their own types: monitor status (MIL, DTC count and readiness
+ * tests complete), fuel system and secondary air status, freeze frame DTC.
+ * PIDs 0x14-0x1B, 0x24-0x2B, 0x34-0x3B and 0x3C-0x3F share one row per
+ * value, the '#' of the name is the sensor number. PIDs above 0x64 (values
+ * with availability bits in the first byte) are not decoded, apart from
+ * the supported-PID bitmaps.
+ *
+ * Nothing is allocated: a value is formatted into a buffer of the caller.
+ * The rows are sorted by PID, a lookup is a binary search.
+ *
+ * Also compiled on the host by tools/obd_pid_check.c and tools/obd_poller_sim.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef OBD_PID_H
+#define OBD_PID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Tables live in flash on the AVR
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define OBD_PROGMEM             PROGMEM
+#define OBD_READ_BYTE(address)  pgm_read_byte(address)
+#define OBD_READ_WORD(address)  pgm_read_word(address)
+#define OBD_READ(destination, source, size)  memcpy_P(destination, source, size)
+#else
+#define OBD_PROGMEM
+#define OBD_READ_BYTE(address)  (*(const uint8_t*)(address))
+#define OBD_READ_WORD(address)  (*(const uint16_t*)(address))
+#define OBD_READ(destination, source, size)  memcpy(destination, source, size)
+#endif
+
+#define OBD_PID_MAX_LENGTH      5       // Data bytes of the longest PID (0x64)
+#define OBD_PID_NAME            12      // Name characters with the terminator
+#define OBD_PID_TEXT            32      // Buffer for one formatted value
+#define OBD_PID_NONE            0xFF
+
+// How the bytes of a value are read
+#define OBD_FIELD_VALUE         0       // Unsigned, big endian, scaled
+#define OBD_FIELD_SIGNED        1       // Two's complement, scaled
+#define OBD_FIELD_HEX           2       // Bitmap printed in hex (supported PIDs, sensors present)
+#define OBD_FIELD_MIL           3       // Bit 7: malfunction lamp on
+#define OBD_FIELD_DTCS          4       // Bits 0-6: stored DTCs
+#define OBD_FIELD_READINESS     5       // 3 bytes: tests supported and not complete, value: tests complete
+#define OBD_FIELD_FUEL_SYSTEM   6       // One bit set: loop state
+#define OBD_FIELD_AIR_STATUS    7       // One bit set: secondary air flow
+#define OBD_FIELD_DTC           8       // Two bytes of DTC
+
+// Units, index of OBD_UNITS
+#define OBD_UNIT_NONE           0
+#define OBD_UNIT_PERCENT        1
+#define OBD_UNIT_CELSIUS        2
+#define OBD_UNIT_KPA            3
+#define OBD_UNIT_RPM            4
+#define OBD_UNIT_KMH            5
+#define OBD_UNIT_DEGREE         6
+#define OBD_UNIT_GS             7
+#define OBD_UNIT_VOLT           8
+#define OBD_UNIT_SECOND         9
+#define OBD_UNIT_KM             10
+#define OBD_UNIT_PA             11
+#define OBD_UNIT_MA             12
+#define OBD_UNIT_MINUTE         13
+#define OBD_UNIT_LH             14
+#define OBD_UNIT_NM             15
+
+// One value of a PID answer, 26 bytes
+typedef struct {
+  uint8_t first;                        // PIDs first-last decode the same way
+  uint8_t last;
+  uint8_t length;                       // Data bytes of the PID
+  uint8_t type;                         // OBD_FIELD_*
+  uint8_t position;                     // First byte of the value (A = 0)
+  uint8_t size;                         // Bytes of the value
+  uint8_t decimals;
+  uint8_t unit;
+  uint16_t mul;
+  uint16_t div;
+  int16_t offset;                       // In units of the last decimal
+  char name[OBD_PID_NAME];              // '#': number of the PID from first
+} ObdPidField;
+
+static const char OBD_UNITS[16][5] OBD_PROGMEM = {
+  "", "%", "°C", "kPa", "rpm", "km/h", "°", "g/s", "V", "s", "km", "Pa", "mA", "min", "L/h", "Nm"
+};
+
+// Bits 0-4 of the fuel system status and 0-3 of the secondary air status
+static const char OBD_FUEL_SYSTEM[5][9] OBD_PROGMEM = { "OL", "CL", "OL drive", "OL fault", "CL fault" };
+static const char OBD_AIR_STATUS[4][11] OBD_PROGMEM = { "upstream", "downstream", "off", "diag" };
+static const char OBD_MIL[2][4] OBD_PROGMEM = { "off", "on" };
+
+// Percent of 255, fuel trim (A-128)*100/128 and temperature A-40 are the most common rows
+#define OBD_PERCENT(first, name)        { first, first, 1, OBD_FIELD_VALUE, 0, 1, 1, OBD_UNIT_PERCENT, 1000, 255, 0, name }
+#define OBD_TRIM(first, length, position, name) \
+  { first, first, length, OBD_FIELD_VALUE, position, 1, 1, OBD_UNIT_PERCENT, 125, 16, -1000, name }
+#define OBD_TEMPERATURE(first, name)    { first, first, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_CELSIUS, 1, 1, -40, name }
+#define OBD_SUPPORTED(first)            { first, first, 4, OBD_FIELD_HEX, 0, 4, 0, OBD_UNIT_NONE, 1, 1, 0, "Supported" }
+
+// Sorted by first PID; the values of a PID are consecutive rows
+static const ObdPidField OBD_PIDS[] OBD_PROGMEM = {
+  OBD_SUPPORTED(0x00),
+  { 0x01, 0x01, 4, OBD_FIELD_MIL, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "MIL" },
+  { 0x01, 0x01, 4, OBD_FIELD_DTCS, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "DTCs" },
+  { 0x01, 0x01, 4, OBD_FIELD_READINESS, 1, 3, 0, OBD_UNIT_NONE, 1, 1, 0, "Ready" },
+  { 0x02, 0x02, 2, OBD_FIELD_DTC, 0, 2, 0, OBD_UNIT_NONE, 1, 1, 0, "Freeze DTC" },
+  { 0x03, 0x03, 2, OBD_FIELD_FUEL_SYSTEM, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Fuel sys 1" },
+  { 0x03, 0x03, 2, OBD_FIELD_FUEL_SYSTEM, 1, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Fuel sys 2" },
+  OBD_PERCENT(0x04, "Engine load"),
+  OBD_TEMPERATURE(0x05, "Coolant"),
+  OBD_TRIM(0x06, 1, 0, "STFT bank 1"),
+  OBD_TRIM(0x07, 1, 0, "LTFT bank 1"),
+  OBD_TRIM(0x08, 1, 0, "STFT bank 2"),
+  OBD_TRIM(0x09, 1, 0, "LTFT bank 2"),
+  { 0x0A, 0x0A, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_KPA, 3, 1, 0, "Fuel press" },
+  { 0x0B, 0x0B, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_KPA, 1, 1, 0, "MAP" },
+  { 0x0C, 0x0C, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_RPM, 1, 4, 0, "RPM" },
+  { 0x0D, 0x0D, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_KMH, 1, 1, 0, "Speed" },
+  { 0x0E, 0x0E, 1, OBD_FIELD_VALUE, 0, 1, 1, OBD_UNIT_DEGREE, 5, 1, -640, "Timing adv" },
+  OBD_TEMPERATURE(0x0F, "Intake air"),
+  { 0x10, 0x10, 2, OBD_FIELD_VALUE, 0, 2, 2, OBD_UNIT_GS, 1, 1, 0, "MAF" },
+  OBD_PERCENT(0x11, "Throttle"),
+  { 0x12, 0x12, 1, OBD_FIELD_AIR_STATUS, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Sec air" },
+  { 0x13, 0x13, 1, OBD_FIELD_HEX, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "O2 present" },
+  { 0x14, 0x1B, 2, OBD_FIELD_VALUE, 0, 1, 3, OBD_UNIT_VOLT, 5, 1, 0, "O2 S# volt" },
+  { 0x14, 0x1B, 2, OBD_FIELD_VALUE, 1, 1, 1, OBD_UNIT_PERCENT, 125, 16, -1000, "O2 S# trim" },
+  { 0x1C, 0x1C, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "OBD std" },
+  { 0x1D, 0x1D, 1, OBD_FIELD_HEX, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "O2 present" },
+  { 0x1E, 0x1E, 1, OBD_FIELD_HEX, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Aux input" },
+  { 0x1F, 0x1F, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_SECOND, 1, 1, 0, "Run time" },
+  OBD_SUPPORTED(0x20),
+  { 0x21, 0x21, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_KM, 1, 1, 0, "Dist MIL" },
+  { 0x22, 0x22, 2, OBD_FIELD_VALUE, 0, 2, 3, OBD_UNIT_KPA, 79, 1, 0, "Rail press" },
+  { 0x23, 0x23, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_KPA, 10, 1, 0, "Rail gauge" },
+  { 0x24, 0x2B, 4, OBD_FIELD_VALUE, 0, 2, 4, OBD_UNIT_NONE, 625, 2048, 0, "O2 S# ratio" },
+  { 0x24, 0x2B, 4, OBD_FIELD_VALUE, 2, 2, 3, OBD_UNIT_VOLT, 125, 1024, 0, "O2 S# volt" },
+  OBD_PERCENT(0x2C, "EGR cmd"),
+  OBD_TRIM(0x2D, 1, 0, "EGR error"),
+  OBD_PERCENT(0x2E, "Evap purge"),
+  OBD_PERCENT(0x2F, "Fuel level"),
+  { 0x30, 0x30, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Warm-ups" },
+  { 0x31, 0x31, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_KM, 1, 1, 0, "Dist clear" },
+  { 0x32, 0x32, 2, OBD_FIELD_SIGNED, 0, 2, 2, OBD_UNIT_PA, 25, 1, 0, "Evap vapor" },
+  { 0x33, 0x33, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_KPA, 1, 1, 0, "Baro" },
+  { 0x34, 0x3B, 4, OBD_FIELD_VALUE, 0, 2, 4, OBD_UNIT_NONE, 625, 2048, 0, "O2 S# ratio" },
+  { 0x34, 0x3B, 4, OBD_FIELD_VALUE, 2, 2, 2, OBD_UNIT_MA, 25, 64, -12800, "O2 S# curr" },
+  { 0x3C, 0x3F, 2, OBD_FIELD_VALUE, 0, 2, 1, OBD_UNIT_CELSIUS, 1, 1, -400, "Cat temp #" },
+  OBD_SUPPORTED(0x40),
+  { 0x41, 0x41, 4, OBD_FIELD_READINESS, 1, 3, 0, OBD_UNIT_NONE, 1, 1, 0, "Cycle ready" },
+  { 0x42, 0x42, 2, OBD_FIELD_VALUE, 0, 2, 3, OBD_UNIT_VOLT, 1, 1, 0, "Module volt" },
+  { 0x43, 0x43, 2, OBD_FIELD_VALUE, 0, 2, 1, OBD_UNIT_PERCENT, 1000, 255, 0, "Abs load" },
+  { 0x44, 0x44, 2, OBD_FIELD_VALUE, 0, 2, 4, OBD_UNIT_NONE, 625, 2048, 0, "Cmd ratio" },
+  OBD_PERCENT(0x45, "Rel thrott"),
+  OBD_TEMPERATURE(0x46, "Ambient"),
+  OBD_PERCENT(0x47, "Throttle B"),
+  OBD_PERCENT(0x48, "Throttle C"),
+  OBD_PERCENT(0x49, "Pedal D"),
+  OBD_PERCENT(0x4A, "Pedal E"),
+  OBD_PERCENT(0x4B, "Pedal F"),
+  OBD_PERCENT(0x4C, "Thrott cmd"),
+  { 0x4D, 0x4D, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_MINUTE, 1, 1, 0, "Time MIL" },
+  { 0x4E, 0x4E, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_MINUTE, 1, 1, 0, "Time clear" },
+  { 0x4F, 0x4F, 4, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Max ratio" },
+  { 0x4F, 0x4F, 4, OBD_FIELD_VALUE, 1, 1, 0, OBD_UNIT_VOLT, 1, 1, 0, "Max O2 volt" },
+  { 0x4F, 0x4F, 4, OBD_FIELD_VALUE, 2, 1, 0, OBD_UNIT_MA, 1, 1, 0, "Max O2 curr" },
+  { 0x4F, 0x4F, 4, OBD_FIELD_VALUE, 3, 1, 0, OBD_UNIT_KPA, 10, 1, 0, "Max MAP" },
+  { 0x50, 0x50, 4, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_GS, 10, 1, 0, "Max MAF" },
+  { 0x51, 0x51, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Fuel type" },
+  OBD_PERCENT(0x52, "Ethanol"),
+  { 0x53, 0x53, 2, OBD_FIELD_VALUE, 0, 2, 3, OBD_UNIT_KPA, 5, 1, 0, "Evap abs" },
+  { 0x54, 0x54, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_PA, 1, 1, -32767, "Evap wide" },
+  OBD_TRIM(0x55, 2, 0, "O2 STFT B1"),
+  OBD_TRIM(0x55, 2, 1, "O2 STFT B3"),
+  OBD_TRIM(0x56, 2, 0, "O2 LTFT B1"),
+  OBD_TRIM(0x56, 2, 1, "O2 LTFT B3"),
+  OBD_TRIM(0x57, 2, 0, "O2 STFT B2"),
+  OBD_TRIM(0x57, 2, 1, "O2 STFT B4"),
+  OBD_TRIM(0x58, 2, 0, "O2 LTFT B2"),
+  OBD_TRIM(0x58, 2, 1, "O2 LTFT B4"),
+  { 0x59, 0x59, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_KPA, 10, 1, 0, "Rail abs" },
+  OBD_PERCENT(0x5A, "Rel pedal"),
+  OBD_PERCENT(0x5B, "Hybrid batt"),
+  OBD_TEMPERATURE(0x5C, "Oil temp"),
+  { 0x5D, 0x5D, 2, OBD_FIELD_VALUE, 0, 2, 2, OBD_UNIT_DEGREE, 25, 32, -21000, "Inj timing" },
+  { 0x5E, 0x5E, 2, OBD_FIELD_VALUE, 0, 2, 2, OBD_UNIT_LH, 5, 1, 0, "Fuel rate" },
+  { 0x5F, 0x5F, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_NONE, 1, 1, 0, "Emission" },
+  OBD_SUPPORTED(0x60),
+  { 0x61, 0x61, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque dem" },
+  { 0x62, 0x62, 1, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque act" },
+  { 0x63, 0x63, 2, OBD_FIELD_VALUE, 0, 2, 0, OBD_UNIT_NM, 1, 1, 0, "Torque ref" },
+  { 0x64, 0x64, 5, OBD_FIELD_VALUE, 0, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque idle" },
+  { 0x64, 0x64, 5, OBD_FIELD_VALUE, 1, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque pt 1" },
+  { 0x64, 0x64, 5, OBD_FIELD_VALUE, 2, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque pt 2" },
+  { 0x64, 0x64, 5, OBD_FIELD_VALUE, 3, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque pt 3" },
+  { 0x64, 0x64, 5, OBD_FIELD_VALUE, 4, 1, 0, OBD_UNIT_PERCENT, 1, 1, -125, "Torque pt 4" },
+  OBD_SUPPORTED(0x80),
+  OBD_SUPPORTED(0xA0),
+  OBD_SUPPORTED(0xC0),
+};
+
+#define OBD_PID_ROWS            (sizeof(OBD_PIDS) / sizeof(OBD_PIDS[0]))
+
+// First row of a PID, OBD_PID_NONE if it is not in the table
+static inline uint8_t ObdPidFind(uint8_t pid) {
+  uint8_t low = 0;
+  uint8_t high = OBD_PID_ROWS;
+
+  // Last row with first <= pid
+  while (high - low > 1) {
+    uint8_t middle = (low + high) / 2;
+    if (OBD_READ_BYTE(&OBD_PIDS[middle].first) <= pid) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  uint8_t first = OBD_READ_BYTE(&OBD_PIDS[low].first);
+  if (first > pid || OBD_READ_BYTE(&OBD_PIDS[low].last) < pid) {
+    return OBD_PID_NONE;
+  }
+  while (low > 0 && OBD_READ_BYTE(&OBD_PIDS[low - 1].first) == first) {
+    low--;
+  }
+  return low;
+}
+
+// Data bytes of a Mode 01 PID, 0 where the length is not known
+static inline uint8_t ObdPidLength(uint8_t pid) {
+  uint8_t row = ObdPidFind(pid);
+  return row == OBD_PID_NONE ? 0 : OBD_READ_BYTE(&OBD_PIDS[row].length);
+}
+
+// Copies value number index of a PID to RAM; false if the PID has fewer values
+static inline bool ObdPidReadField(uint8_t pid, uint8_t index, ObdPidField* field) {
+  uint8_t row = ObdPidFind(pid);
+
+  if (row == OBD_PID_NONE || row + index >= OBD_PID_ROWS) {
+    return false;
+  }
+  OBD_READ(field, &OBD_PIDS[row + index], sizeof(*field));
+  return field->first <= pid && field->last >= pid;
+}
+
+static inline uint8_t ObdBitCount(uint8_t bits) {
+  uint8_t count = 0;
+
+  for (; bits != 0; bits &= bits - 1) {
+    count++;
+  }
+  return count;
+}
+
+// Value of a field, in units of its last decimal (bitmaps: the bytes, readiness: tests complete)
+static inline int32_t ObdFieldValue(const ObdPidField* field, const uint8_t* data) {
+  const uint8_t* bytes = data + field->position;
+  uint32_t raw = 0;
+
+  for (uint8_t i = 0; i < field->size; i++) {
+    raw = (raw << 8) | bytes[i];
+  }
+  switch (field->type) {
+    case OBD_FIELD_VALUE:
+    case OBD_FIELD_SIGNED: {
+      int32_t product = field->type == OBD_FIELD_SIGNED ? (int32_t)(int16_t)raw * field->mul : (int32_t)(raw * field->mul);
+      int32_t half = field->div / 2;
+      // Rounded to the nearest, the same way for both signs
+      product = product >= 0 ? (product + half) / (int32_t)field->div : (product - half) / (int32_t)field->div;
+      return product + field->offset;
+    }
+    case OBD_FIELD_MIL:
+      return bytes[0] >> 7;
+    case OBD_FIELD_DTCS:
+      return bytes[0] & 0x7F;
+    case OBD_FIELD_READINESS:
+      // B: bits 0-2 supported, 4-6 not complete; C supported, D not complete
+      return ObdBitCount(bytes[0] & 0x07 & ~(bytes[0] >> 4)) + ObdBitCount(bytes[1] & ~bytes[2]);
+    default:
+      return (int32_t)raw;
+  }
+}
+
+// Tests supported of a readiness field
+static inline uint8_t ObdFieldTests(const ObdPidField* field, const uint8_t* data) {
+  return ObdBitCount(data[field->position] & 0x07) + ObdBitCount(data[field->position + 1]);
+}
+
+// DTC as text: P0301 (out takes 6 characters)
+static inline void ObdFormatDtc(uint16_t code, char* out) {
+  static const char letters[4] = { 'P', 'C', 'B', 'U' };
+  const char* digits = "0123456789ABCDEF";
+
+  out[0] = letters[code >> 14];
+  out[1] = digits[(code >> 12) & 0x03];
+  out[2] = digits[(code >> 8) & 0x0F];
+  out[3] = digits[(code >> 4) & 0x0F];
+  out[4] = digits[code & 0x0F];
+  out[5] = '\0';
+}
+
+// Text being written to a buffer of the caller, cut at its size
+typedef struct {
+  char* out;
+  uint8_t size;
+  uint8_t length;
+} ObdText;
+
+static inline void ObdPutChar(ObdText* text, char c) {
+  if (text->length + 1 < text->size) {
+    text->out[text->length++] = c;
+    text->out[text->length] = '\0';
+  }
+}
+
+static inline void ObdPutFlash(ObdText* text, const char* flash) {
+  char c;
+
+  while ((c = (char)OBD_READ_BYTE(flash++)) != '\0') {
+    ObdPutChar(text, c);
+  }
+}
+
+static inline void ObdPutNumber(ObdText* text, int32_t value, uint8_t decimals) {
+  char digits[12];
+  uint8_t count = 0;
+  uint32_t magnitude = value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+
+  do {
+    digits[count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0 || count <= decimals);
+  if (value < 0) {
+    ObdPutChar(text, '-');
+  }
+  while (count > 0) {
+    if (count == decimals) {
+      ObdPutChar(text, '.');
+    }
+    ObdPutChar(text, digits[--count]);
+  }
+}
+
+static inline void ObdPutHex(ObdText* text, uint32_t value, uint8_t bytes) {
+  for (int8_t shift = bytes * 8 - 4; shift >= 0; shift -= 4) {
+    uint8_t digit = (value >> shift) & 0x0F;
+    ObdPutChar(text, (char)(digit < 10 ? '0' + digit : 'A' + digit - 10));
+  }
+}
+
+// Name of one set bit of a state byte, its hex value otherwise
+static inline void ObdPutState(ObdText* text, uint8_t state, const char* names, uint8_t count, uint8_t width) {
+  for (uint8_t bit = 0; bit < count; bit++) {
+    if (state == 1 << bit) {
+      ObdPutFlash(text, names + bit * width);
+      return;
+    }
+  }
+  if (state == 0) {
+    ObdPutChar(text, '-');            // System not present
+  } else {
+    ObdPutHex(text, state, 1);
+  }
+}
+
+// Writes value number index of a PID answer as "RPM 1726 rpm" to out; returns its length,
+// 0 when the PID has no such value or data is shorter than the PID
+static inline uint8_t ObdPidFormat(uint8_t pid, uint8_t index, const uint8_t* data, uint8_t len, char* out, uint8_t size) {
+  ObdPidField field;
+  ObdText text = { out, size, 0 };
+
+  if (size == 0 || !ObdPidReadField(pid, index, &field) || len < field.length) {
+    return 0;
+  }
+  out[0] = '\0';
+
+  for (uint8_t i = 0; i < OBD_PID_NAME && field.name[i] != '\0'; i++) {
+    if (field.name[i] == '#') {
+      ObdPutNumber(&text, pid - field.first + 1, 0);
+    } else {
+      ObdPutChar(&text, field.name[i]);
+    }
+  }
+  ObdPutChar(&text, ' ');
+
+  int32_t value = ObdFieldValue(&field, data);
+  switch (field.type) {
+    case OBD_FIELD_HEX:
+      ObdPutHex(&text, (uint32_t)value, field.size);
+      break;
+    case OBD_FIELD_MIL:
+      ObdPutFlash(&text, OBD_MIL[value]);
+      break;
+    case OBD_FIELD_READINESS:
+      ObdPutNumber(&text, value, 0);
+      ObdPutChar(&text, '/');
+      ObdPutNumber(&text, ObdFieldTests(&field, data), 0);
+      break;
+    case OBD_FIELD_FUEL_SYSTEM:
+      ObdPutState(&text, (uint8_t)value, OBD_FUEL_SYSTEM[0], 5, sizeof(OBD_FUEL_SYSTEM[0]));
+      break;
+    case OBD_FIELD_AIR_STATUS:
+      ObdPutState(&text, (uint8_t)value, OBD_AIR_STATUS[0], 4, sizeof(OBD_AIR_STATUS[0]));
+      break;
+    case OBD_FIELD_DTC: {
+      char code[6];
+      ObdFormatDtc((uint16_t)value, code);
+      for (uint8_t i = 0; code[i] != '\0'; i++) {
+        ObdPutChar(&text, code[i]);
+      }
+      break;
+    }
+    default:
+      ObdPutNumber(&text, value, field.decimals);
+      if (field.unit != OBD_UNIT_NONE) {
+        ObdPutChar(&text, ' ');
+        ObdPutFlash(&text, OBD_UNITS[field.unit]);
+      }
+      break;
+  }
+  return text.length;
+}
+
+#endif // OBD_PID_H
@@ -0,0 +1,469 @@
+/*
+ * obd_poller.h - OBD-II PID poller of the CAN reader with ISO-TP reception
+ *
+ * The poller first asks every ECU (functional request 7DF) for its
+ * supported-PID bitmaps 0x00, 0x20, 0x40... as far as the schedule needs,
+ * and gives each scheduled PID to the first ECU that supports it. Then it
+ * polls each ECU on its physical address (7E0-7E7, answers on 7E8-7EF):
+ * every ECU gets its own request in flight, with up to six due PIDs in
+ * one Mode 01 request as ISO 15765-4 allows, so ECUs answer in parallel
+ * and one answer brings several samples. PIDs are due again after their
+ * period; a period of 0 polls the PID as often as possible.
+ *
+ * Answers longer than one frame come as ISO-TP First Frame plus
+ * Consecutive Frames: the poller sends the Flow Control (no block limit,
+ * no separation time) and reads the bytes as they arrive, without a
+ * reassembly buffer, so a multi-PID answer, a VIN (Mode 09 PID 02) or a
+ * DTC list (Mode 03) of any length costs a few bytes per ECU. Values,
+ * DTCs and VIN characters are passed to the handlers as they complete.
+ *
+ * Also compiled on the host by tools/obd_poller_sim.c
+ *
+ * Part of the AutomotiveGuide_es project
+ * https://github.com/edgarefraindp/AutomotiveGuide_es
+ */
+
+#ifndef OBD_POLLER_H
+#define OBD_POLLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "obd_pid.h"                    // PID lengths, DTC text and the flash access of the tables
+
+#define OBD_MAX_ECUS            8       // Physical addresses 7E0-7E7
+#define OBD_MAX_SCHEDULE        16      // Scheduled PIDs
+#define OBD_MAX_PIDS            6       // PIDs in one Mode 01 request
+#define OBD_FUNCTIONAL_ID       0x7DF
+#define OBD_REQUEST_ID          0x7E0
+#define OBD_RESPONSE_ID         0x7E8
+#define OBD_TIMEOUT_MS          100     // P2 of 50 ms plus the bus
+#define OBD_DISCOVERY_MS        100     // Wait for every ECU to answer a functional request
+#define OBD_RETRY_MS            1000    // Discovery again when no ECU answered
+#define OBD_PAD                 0x00    // Unused bytes of the 8-byte frames
+
+// Phases of the poller
+#define OBD_DISCOVERY           0
+#define OBD_POLLING             1
+
+// States of an ECU
+#define OBD_ECU_IDLE            0
+#define OBD_ECU_WAITING         1       // Request sent
+#define OBD_ECU_RECEIVING       2       // First Frame received, Consecutive Frames due
+
+#define OBD_NO_ECU              0xFF
+
+// Scheduled PID, periods up to 32767 ms
+typedef struct {
+  uint8_t pid;
+  uint16_t periodMs;                    // 0: as often as possible
+} ObdSchedule;
+
+typedef struct {
+  uint8_t supported;                    // Bit n: ECU n supports the PID
+  uint8_t ecu;                          // ECU polled for the PID, OBD_NO_ECU if none
+  uint16_t dueMs;
+} ObdPidState;
+
+typedef struct {
+  uint8_t state;
+  uint8_t service;                      // Response SID of the message being read
+  uint16_t sentMs;                      // Request or last frame, for the timeout
+  uint16_t pending;                     // Bit n: schedule entry n requested, not answered yet
+  uint16_t remaining;                   // Message bytes still to come
+  uint8_t position;                     // Message bytes read (saturates at 255)
+  uint8_t sequence;                     // Next Consecutive Frame number
+  uint8_t pid;                          // Mode 01: PID being read
+  uint8_t needed;                       // Mode 01: data bytes of pid still missing
+  uint8_t count;
+  uint8_t data[OBD_PID_MAX_LENGTH];
+} ObdEcu;
+
+typedef struct {
+  bool (*send)(uint16_t id, const uint8_t* data);      // 8-byte frame, false if it could not be queued
+  void (*value)(uint8_t ecu, uint8_t pid, const uint8_t* data, uint8_t len);
+  void (*dtc)(uint8_t ecu, uint16_t code);
+  void (*vin)(uint8_t ecu, uint8_t index, char c);      // VIN characters 0-16
+} ObdHandlers;
+
+typedef struct {
+  const ObdSchedule* schedule;          // OBD_PROGMEM
+  uint8_t scheduleCount;
+  ObdPidState pids[OBD_MAX_SCHEDULE];
+  ObdEcu ecus[OBD_MAX_ECUS];
+  ObdHandlers handlers;
+  uint8_t phase;
+  uint8_t range;                        // Supported-PID range asked in discovery (0x00, 0x20...)
+  uint8_t more;                         // Some ECU supports the next range
+  uint16_t phaseMs;                     // Discovery request time
+  uint8_t present;                      // Bit n: ECU n answered
+  uint8_t maxPids;                      // PIDs per request, 1 to OBD_MAX_PIDS
+  uint8_t nextPid;                      // First schedule entry looked at, turns so all get their turn
+  uint8_t demandService;                // Mode 03 or 09 asked with ObdPollerDemand(), 0 if none
+  uint8_t demandPid;
+  uint32_t requests;
+  uint32_t samples;                     // Scheduled PID values received
+  uint32_t timeouts;
+  uint32_t negative;                    // Negative responses (7F)
+  uint32_t errors;                      // ISO-TP sequence or format errors
+} ObdPoller;
+
+// Schedule of the reader, in priority order: fast engine values first
+static const ObdSchedule OBD_SCHEDULE[] OBD_PROGMEM = {
+  { 0x0C, 50 },                         // RPM
+  { 0x11, 50 },                         // Throttle position
+  { 0x0B, 50 },                         // MAP
+  { 0x0D, 100 },                        // Vehicle speed
+  { 0x10, 100 },                        // MAF
+  { 0x04, 100 },                        // Calculated load
+  { 0x0E, 100 },                        // Timing advance
+  { 0x49, 100 },                        // Accelerator pedal D
+  { 0x06, 200 },                        // Short term fuel trim bank 1
+  { 0x07, 1000 },                       // Long term fuel trim bank 1
+  { 0x05, 1000 },                       // Coolant temperature
+  { 0x0F, 1000 },                       // Intake air temperature
+  { 0x5C, 1000 },                       // Oil temperature
+  { 0x42, 1000 },                       // Module voltage
+  { 0x2F, 5000 },                       // Fuel level
+  { 0x33, 5000 },                       // Barometric pressure
+};
+
+static inline uint8_t ObdSchedulePid(const ObdPoller* poller, uint8_t index) {
+  return OBD_READ_BYTE(&poller->schedule[index].pid);
+}
+
+static inline uint16_t ObdSchedulePeriod(const ObdPoller* poller, uint8_t index) {
+  return OBD_READ_WORD(&poller->schedule[index].periodMs);
+}
+
+// Sends an 8-byte frame: length, then the bytes, then padding
+static inline bool ObdSend(ObdPoller* poller, uint16_t id, const uint8_t* bytes, uint8_t count, bool singleFrame) {
+  uint8_t frame[8];
+  uint8_t n = 0;
+
+  if (singleFrame) {
+    frame[n++] = count;
+  }
+  memcpy(frame + n, bytes, count);
+  n += count;
+  while (n < 8) {
+    frame[n++] = OBD_PAD;
+  }
+  return poller->handlers.send(id, frame);
+}
+
+// Asks every ECU for a supported-PID range
+static inline void ObdDiscover(ObdPoller* poller, uint8_t range, uint16_t nowMs) {
+  const uint8_t request[2] = { 0x01, range };
+
+  poller->phase = OBD_DISCOVERY;
+  poller->range = range;
+  poller->more = 0;
+  poller->phaseMs = nowMs;
+  if (ObdSend(poller, OBD_FUNCTIONAL_ID, request, 2, true)) {
+    poller->requests++;
+  }
+}
+
+static inline void ObdPollerStart(ObdPoller* poller, const ObdSchedule* schedule, uint8_t count,
+                                  const ObdHandlers* handlers, uint16_t nowMs) {
+  memset(poller, 0, sizeof(*poller));
+  poller->schedule = schedule;
+  poller->scheduleCount = count > OBD_MAX_SCHEDULE ? OBD_MAX_SCHEDULE : count;
+  poller->handlers = *handlers;
+  poller->maxPids = OBD_MAX_PIDS;
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    poller->pids[i].ecu = OBD_NO_ECU;
+  }
+  ObdDiscover(poller, 0x00, nowMs);
+}
+
+// Asks every ECU for a Mode 03 (DTCs) or Mode 09 (VIN: PID 02) answer as soon as they are idle
+static inline void ObdPollerDemand(ObdPoller* poller, uint8_t service, uint8_t pid) {
+  poller->demandService = service;
+  poller->demandPid = pid;
+}
+
+// Supported-PID bitmap of one ECU: bit 7 of the first byte is PID range+1, bit 0 of the last range+0x20
+static inline void ObdSupported(ObdPoller* poller, uint8_t ecu, uint8_t range, const uint8_t* bitmap) {
+  poller->present |= 1 << ecu;
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    uint8_t pid = ObdSchedulePid(poller, i);
+    if (pid > range && pid <= range + 0x20) {
+      uint8_t bit = pid - range - 1;
+      if (bitmap[bit >> 3] & (0x80 >> (bit & 7))) {
+        poller->pids[i].supported |= 1 << ecu;
+      }
+    }
+  }
+  if (bitmap[3] & 0x01) {
+    poller->more = 1;
+  }
+}
+
+// Complete Mode 01 record of an answer
+static inline void ObdRecord(ObdPoller* poller, uint8_t ecu, ObdEcu* e) {
+  if ((e->pid & 0x1F) == 0 && e->count == 4) {
+    if (poller->phase == OBD_DISCOVERY && e->pid == poller->range) {
+      ObdSupported(poller, ecu, e->pid, e->data);
+    }
+    return;
+  }
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    if (ObdSchedulePid(poller, i) == e->pid && (e->pending & (1 << i))) {
+      e->pending &= ~(1 << i);
+      poller->samples++;
+    }
+  }
+  if (poller->handlers.value) {
+    poller->handlers.value(ecu, e->pid, e->data, e->count);
+  }
+}
+
+// One byte of the message of an ECU
+static inline void ObdFeed(ObdPoller* poller, uint8_t ecu, uint8_t byte) {
+  ObdEcu* e = &poller->ecus[ecu];
+  uint8_t position = e->position;
+
+  if (e->position < 0xFF) {
+    e->position++;
+  }
+  if (position == 0) {
+    e->service = byte;
+    e->needed = 0;
+    e->count = 0;
+    return;
+  }
+
+  switch (e->service) {
+    case 0x41:                          // PID, then its data bytes
+      if (e->needed == 0) {
+        e->pid = byte;
+        e->needed = ObdPidLength(byte);
+        e->count = 0;
+        if (e->needed == 0) {
+          poller->errors++;             // Unknown length: the rest cannot be split
+          e->service = 0;
+        }
+      } else {
+        e->data[e->count++] = byte;
+        if (--e->needed == 0) {
+          ObdRecord(poller, ecu, e);
+        }
+      }
+      break;
+    case 0x43:                          // Number of DTCs, then two bytes each
+      if (position >= 2) {
+        e->data[e->count++] = byte;
+        if (e->count == 2) {
+          uint16_t code = (uint16_t)(e->data[0] << 8) | e->data[1];
+          if (code != 0 && poller->handlers.dtc) {
+            poller->handlers.dtc(ecu, code);
+          }
+          e->count = 0;
+        }
+      }
+      break;
+    case 0x49:                          // PID 02, item count, then the 17 VIN characters
+      if (position == 1) {
+        e->pid = byte;
+      } else if (position >= 3 && e->pid == 0x02 && poller->handlers.vin) {
+        poller->handlers.vin(ecu, position - 3, (char)byte);
+      }
+      break;
+    default:                            // 7F (negative) and services not read
+      break;
+  }
+}
+
+// End of the answer of an ECU: PIDs asked and not answered will be asked again when due
+static inline void ObdMessageDone(ObdPoller* poller, ObdEcu* e) {
+  if (e->service == 0x7F) {
+    poller->negative++;
+  }
+  e->state = OBD_ECU_IDLE;
+  e->pending = 0;
+  e->remaining = 0;
+}
+
+static inline void ObdFeedBytes(ObdPoller* poller, uint8_t ecu, const uint8_t* bytes, uint8_t count) {
+  ObdEcu* e = &poller->ecus[ecu];
+
+  for (uint8_t i = 0; i < count && e->remaining > 0; i++) {
+    ObdFeed(poller, ecu, bytes[i]);
+    e->remaining--;
+  }
+  if (e->remaining == 0) {
+    ObdMessageDone(poller, e);
+  }
+}
+
+// Frame received: returns true if it was an OBD answer
+static inline bool ObdPollerReceive(ObdPoller* poller, uint32_t id, uint8_t len, const uint8_t* data, uint16_t nowMs) {
+  if (id < OBD_RESPONSE_ID || id >= OBD_RESPONSE_ID + OBD_MAX_ECUS || len == 0) {
+    return false;
+  }
+  uint8_t ecu = (uint8_t)(id - OBD_RESPONSE_ID);
+  ObdEcu* e = &poller->ecus[ecu];
+
+  switch (data[0] >> 4) {
+    case 0x0: {                         // Single Frame
+      uint8_t count = data[0] & 0x0F;
+      if (count == 0 || count > len - 1) {
+        poller->errors++;
+        return true;
+      }
+      e->remaining = count;
+      e->position = 0;
+      ObdFeedBytes(poller, ecu, data + 1, count);
+      break;
+    }
+    case 0x1: {                         // First Frame: ask for the rest at once
+      const uint8_t flowControl[3] = { 0x30, 0x00, 0x00 };
+      if (len < 8) {
+        poller->errors++;
+        return true;
+      }
+      e->remaining = (uint16_t)((data[0] & 0x0F) << 8) | data[1];
+      e->position = 0;
+      e->sequence = 1;
+      e->state = OBD_ECU_RECEIVING;
+      e->sentMs = nowMs;
+      ObdSend(poller, OBD_REQUEST_ID + ecu, flowControl, 3, false);
+      ObdFeedBytes(poller, ecu, data + 2, 6);
+      break;
+    }
+    case 0x2:                           // Consecutive Frame
+      if (e->state != OBD_ECU_RECEIVING || (data[0] & 0x0F) != e->sequence) {
+        poller->errors++;
+        ObdMessageDone(poller, e);
+        return true;
+      }
+      e->sequence = (e->sequence + 1) & 0x0F;
+      e->sentMs = nowMs;
+      ObdFeedBytes(poller, ecu, data + 1, len - 1);
+      break;
+    default:                            // Flow Control of the ECU: nothing is sent in several frames
+      break;
+  }
+  return true;
+}
+
+// Discovery finished: each PID goes to the first ECU that supports it
+static inline void ObdAssign(ObdPoller* poller, uint16_t nowMs) {
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    ObdPidState* state = &poller->pids[i];
+    state->ecu = OBD_NO_ECU;
+    for (uint8_t ecu = 0; ecu < OBD_MAX_ECUS; ecu++) {
+      if (state->supported & (1 << ecu)) {
+        state->ecu = ecu;
+        break;
+      }
+    }
+    state->dueMs = nowMs;
+  }
+  poller->phase = OBD_POLLING;
+}
+
+// Highest scheduled PID, to know how many ranges discovery needs
+static inline uint8_t ObdHighestPid(const ObdPoller* poller) {
+  uint8_t highest = 0;
+
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    uint8_t pid = ObdSchedulePid(poller, i);
+    if (pid > highest) highest = pid;
+  }
+  return highest;
+}
+
+// Sends the next request of an idle ECU: its due PIDs, up to maxPids
+static inline void ObdPollEcu(ObdPoller* poller, uint8_t ecu, uint16_t nowMs) {
+  uint8_t request[1 + OBD_MAX_PIDS] = { 0x01 };
+  uint8_t count = 0;
+  uint16_t mask = 0;
+
+  for (uint8_t n = 0; n < poller->scheduleCount && count < poller->maxPids; n++) {
+    uint8_t i = (poller->nextPid + n) % poller->scheduleCount;
+    ObdPidState* state = &poller->pids[i];
+    if (state->ecu == ecu && (int16_t)(nowMs - state->dueMs) >= 0) {
+      request[1 + count++] = ObdSchedulePid(poller, i);
+      mask |= 1 << i;
+    }
+  }
+  if (count == 0 || !ObdSend(poller, OBD_REQUEST_ID + ecu, request, 1 + count, true)) {
+    return;
+  }
+
+  // Next time due one period later; a PID that fell behind starts again from now
+  for (uint8_t i = 0; i < poller->scheduleCount; i++) {
+    if (mask & (1 << i)) {
+      uint16_t period = ObdSchedulePeriod(poller, i);
+      uint16_t due = poller->pids[i].dueMs + period;
+      poller->pids[i].dueMs = (int16_t)(nowMs - due) >= 0 ? nowMs + period : due;
+    }
+  }
+  poller->nextPid = (poller->nextPid + 1) % poller->scheduleCount;
+  poller->requests++;
+
+  ObdEcu* e = &poller->ecus[ecu];
+  e->state = OBD_ECU_WAITING;
+  e->sentMs = nowMs;
+  e->pending = mask;
+}
+
+// Called from loop(): timeouts, discovery steps and new requests
+static inline void ObdPollerRun(ObdPoller* poller, uint16_t nowMs) {
+  bool allIdle = true;
+
+  for (uint8_t ecu = 0; ecu < OBD_MAX_ECUS; ecu++) {
+    ObdEcu* e = &poller->ecus[ecu];
+    if (e->state != OBD_ECU_IDLE && (uint16_t)(nowMs - e->sentMs) > OBD_TIMEOUT_MS) {
+      poller->timeouts++;
+      ObdMessageDone(poller, e);
+    }
+    allIdle = allIdle && e->state == OBD_ECU_IDLE;
+  }
+
+  if (poller->phase == OBD_DISCOVERY) {
+    uint16_t elapsed = nowMs - poller->phaseMs;
+    if (poller->present == 0) {
+      // Nobody answered yet: ask again after a while
+      if (elapsed >= OBD_RETRY_MS) {
+        ObdDiscover(poller, 0x00, nowMs);
+      }
+      return;
+    }
+    if (elapsed < OBD_DISCOVERY_MS) {
+      return;
+    }
+    if (poller->more && poller->range <= 0xC0 && ObdHighestPid(poller) > poller->range + 0x20) {
+      ObdDiscover(poller, poller->range + 0x20, nowMs);
+      return;
+    }
+    ObdAssign(poller, nowMs);
+  }
+
+  // Mode 03 / 09 for every ECU, once all have finished
+  if (poller->demandService != 0) {
+    uint8_t request[2] = { poller->demandService, poller->demandPid };
+    if (allIdle && ObdSend(poller, OBD_FUNCTIONAL_ID, request, poller->demandService == 0x03 ? 1 : 2, true)) {
+      for (uint8_t ecu = 0; ecu < OBD_MAX_ECUS; ecu++) {
+        if (poller->present & (1 << ecu)) {
+          poller->ecus[ecu].state = OBD_ECU_WAITING;
+          poller->ecus[ecu].sentMs = nowMs;
+        }
+      }
+      poller->demandService = 0;
+      poller->requests++;
+    }
+    return;
+  }
+
+  for (uint8_t ecu = 0; ecu < OBD_MAX_ECUS; ecu++) {
+    if ((poller->present & (1 << ecu)) && poller->ecus[ecu].state == OBD_ECU_IDLE) {
+      ObdPollEcu(poller, ecu, nowMs);
+    }
+  }
+}
+
+#endif // OBD_POLLER_H
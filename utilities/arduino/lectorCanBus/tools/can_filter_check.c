@@ -0,0 +1,207 @@
+/*
+ * can_filter_check.c - Host check of the ID whitelist and MCP2515 filter computation
+ *
+ * For each ID list the masks and filters are computed with the same
+ * can_filter.h as the sketch and checked against every one of the 2048
+ * standard IDs: every ID of the list must pass the hardware, up to six IDs
+ * must pass exactly, and the whitelist must accept exactly the list. The
+ * IDs let through by the hardware are compared with the best single-mask
+ * solution found by trying every mask (a lower bound is not practical
+ * with two masks, so this is only reported).
+ *
+ * A busy powertrain bus (IDs and rates of a typical 500 kbit/s capture)
+ * shows how many frames per second still reach the interrupt and loop()
+ * when only the diagnostic responses and a few IDs are of interest.
+ *
+ * Build and run:
+ *   cc -O2 -I.. can_filter_check.c -o can_filter_check
+ *   ./can_filter_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "can_filter.h"
+
+typedef struct {
+  const char* name;
+  uint8_t count;
+  uint16_t ids[CAN_FILTER_MAX_IDS];
+} IdList;
+
+// IDs and frames per second of a powertrain bus
+typedef struct {
+  uint16_t id;
+  uint16_t rate;
+} BusId;
+
+static const BusId BUS[] = {
+  { 0x0C9, 100 }, { 0x0F1, 100 }, { 0x120, 50 }, { 0x130, 100 }, { 0x153, 100 }, { 0x1A0, 100 },
+  { 0x1C8, 50 }, { 0x1E1, 50 }, { 0x1F5, 50 }, { 0x200, 100 }, { 0x220, 50 }, { 0x260, 50 },
+  { 0x280, 100 }, { 0x284, 100 }, { 0x288, 100 }, { 0x2A0, 50 }, { 0x316, 100 }, { 0x329, 100 },
+  { 0x340, 20 }, { 0x34A, 20 }, { 0x380, 20 }, { 0x3C0, 10 }, { 0x3D0, 10 }, { 0x43F, 100 },
+  { 0x440, 100 }, { 0x470, 50 }, { 0x4A0, 20 }, { 0x4B0, 50 }, { 0x500, 10 }, { 0x545, 10 },
+  { 0x580, 10 }, { 0x5A0, 5 }, { 0x610, 10 }, { 0x7E8, 20 }, { 0x7E9, 5 },
+};
+
+static uint32_t failures = 0;
+
+static void Fail(const char* list, const char* message, unsigned value) {
+  if (failures++ < 20) {
+    printf("FAIL %s: %s (0x%03X)\n", list, message, value);
+  }
+}
+
+// Fewest IDs one mask with six filters lets through, trying every mask
+static uint16_t BestSingleMask(const IdList* list) {
+  uint16_t best = CAN_STD_ID_COUNT;
+
+  for (uint16_t mask = 0; mask < CAN_STD_ID_COUNT; mask++) {
+    uint16_t values[CAN_FILTER_MAX_IDS];
+    uint8_t distinct = 0;
+    for (uint8_t i = 0; i < list->count && distinct <= CAN_HW_FILTERS; i++) {
+      uint16_t value = list->ids[i] & mask;
+      uint8_t j = 0;
+      while (j < distinct && values[j] != value) {
+        j++;
+      }
+      if (j == distinct) {
+        values[distinct++] = value;
+      }
+    }
+    if (distinct <= CAN_HW_FILTERS) {
+      uint16_t span = (uint16_t)(distinct * CanMaskSpan(mask));
+      if (span < best) {
+        best = span;
+      }
+    }
+  }
+  return best;
+}
+
+static void CheckList(const IdList* list) {
+  CanIdSet set;
+  CanHwFilter hw;
+
+  CanIdSetClear(&set);
+  for (uint8_t i = 0; i < list->count; i++) {
+    if (!CanIdSetAdd(&set, list->ids[i])) {
+      Fail(list->name, "ID not added", list->ids[i]);
+    }
+  }
+  CanHwFilterCompute(&set, &hw);
+
+  uint16_t span = CanHwFilterSpan(&hw);
+  for (uint16_t id = 0; id < CAN_STD_ID_COUNT; id++) {
+    bool listed = false;
+    for (uint8_t i = 0; i < list->count; i++) {
+      listed = listed || list->ids[i] == id;
+    }
+    if (listed && !CanHwFilterAccepts(&hw, id)) {
+      Fail(list->name, "listed ID blocked by the hardware", id);
+    }
+    if (CanIdSetAccepts(&set, id) != (listed || list->count == 0)) {
+      Fail(list->name, "whitelist wrong", id);
+    }
+  }
+  if (list->count > 0 && list->count <= CAN_HW_FILTERS && span != set.count) {
+    Fail(list->name, "up to six IDs not filtered exactly", span);
+  }
+  if (list->count == 0 && span != CAN_STD_ID_COUNT) {
+    Fail(list->name, "empty list does not accept everything", span);
+  }
+
+  printf("%-22s %2u IDs  masks %03X %03X  filters %03X %03X | %03X %03X %03X %03X  pass %4u (one mask: %4u)\n",
+         list->name, set.count, hw.masks[0], hw.masks[1], hw.filters[0], hw.filters[1], hw.filters[2],
+         hw.filters[3], hw.filters[4], hw.filters[5], span, list->count > 0 ? BestSingleMask(list) : CAN_STD_ID_COUNT);
+}
+
+static void CheckWhitelist(void) {
+  CanIdSet set;
+
+  CanIdSetClear(&set);
+  CanIdSetAdd(&set, 0x300);
+  CanIdSetAdd(&set, 0x100);
+  CanIdSetAdd(&set, 0x200);
+  CanIdSetAdd(&set, 0x100);                  // Repeated, kept once
+  if (set.count != 3 || set.ids[0] != 0x100 || set.ids[1] != 0x200 || set.ids[2] != 0x300) {
+    Fail("whitelist", "not sorted or repeated", set.count);
+  }
+  if (CanIdSetAdd(&set, 0x800)) {
+    Fail("whitelist", "extended ID added", 0x800);
+  }
+  if (!CanIdSetRemove(&set, 0x200) || CanIdSetRemove(&set, 0x200) || set.count != 2 || set.ids[1] != 0x300) {
+    Fail("whitelist", "remove", set.count);
+  }
+  if (CanIdSetAccepts(&set, 0x100 | 0x10000)) {
+    Fail("whitelist", "extended ID accepted", 0x100);
+  }
+  for (uint16_t id = 0; set.count < CAN_FILTER_MAX_IDS; id++) {
+    CanIdSetAdd(&set, id);
+  }
+  if (CanIdSetAdd(&set, 0x7FF)) {
+    Fail("whitelist", "full list grew", set.count);
+  }
+}
+
+// Frames per second reaching the MCU with the list loaded
+static void BusLoad(const IdList* list) {
+  CanIdSet set;
+  CanHwFilter hw;
+  uint32_t total = 0;
+  uint32_t hardware = 0;
+  uint32_t whitelist = 0;
+
+  CanIdSetClear(&set);
+  for (uint8_t i = 0; i < list->count; i++) {
+    CanIdSetAdd(&set, list->ids[i]);
+  }
+  CanHwFilterCompute(&set, &hw);
+  for (size_t i = 0; i < sizeof(BUS) / sizeof(BUS[0]); i++) {
+    total += BUS[i].rate;
+    if (CanHwFilterAccepts(&hw, BUS[i].id)) {
+      hardware += BUS[i].rate;
+      if (CanIdSetAccepts(&set, BUS[i].id)) {
+        whitelist += BUS[i].rate;
+      }
+    }
+  }
+  printf("%-22s %4u frames/s on the bus, %4u read by the interrupt, %4u handled by loop()\n", list->name,
+         total, hardware, whitelist);
+}
+
+int main(void) {
+  static IdList lists[] = {
+    { "empty", 0, { 0 } },
+    { "single", 1, { 0x7E8 } },
+    { "six scattered", 6, { 0x0C9, 0x1A0, 0x316, 0x43F, 0x545, 0x7E8 } },
+    { "OBD responses", 8, { 0x7E8, 0x7E9, 0x7EA, 0x7EB, 0x7EC, 0x7ED, 0x7EE, 0x7EF } },
+    { "OBD and engine", 10, { 0x7E8, 0x7E9, 0x7EA, 0x7EB, 0x0C9, 0x316, 0x329, 0x280, 0x284, 0x288 } },
+    { "one bit apart", 12, { 0x100, 0x101, 0x102, 0x104, 0x108, 0x110, 0x120, 0x140, 0x180, 0x300, 0x500, 0x000 } },
+    { "random 20", 20, { 0 } },
+    { "random 32", 32, { 0 } },
+  };
+
+  srand(1);
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    if (lists[i].ids[0] == 0 && lists[i].count > 1) {
+      for (uint8_t j = 0; j < lists[i].count; j++) {
+        lists[i].ids[j] = (uint16_t)(rand() & CAN_STD_ID_MASK);
+        for (uint8_t k = 0; k < j; k++) {
+          if (lists[i].ids[k] == lists[i].ids[j]) {
+            j--;                               // Repeated, drawn again
+            break;
+          }
+        }
+      }
+    }
+    CheckList(&lists[i]);
+  }
+  CheckWhitelist();
+
+  printf("\n");
+  BusLoad(&lists[0]);
+  BusLoad(&lists[2]);
+  BusLoad(&lists[4]);
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
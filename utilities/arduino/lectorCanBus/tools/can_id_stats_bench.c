@@ -0,0 +1,232 @@
+/*
+ * can_id_stats_bench.c - Host check and benchmark of the per-ID statistics table
+ *
+ * A bus of 12 IDs adding up to 4000 frames/s (the most a 500 kbit/s bus
+ * carries with 8-byte frames) is generated with every period shifted by
+ * a random jitter of +-5%, the clock starting just before the micros()
+ * wrap. The frames go through can_id_stats.h, the same code as the
+ * sketch, and for every ID the count, minimum and maximum period, mean
+ * period, jitter and changed bytes are compared with the true values.
+ * A second run adds 23 more IDs (35 in all), those beyond the table must
+ * only be counted. The default table is the one of the Uno (12 IDs); the
+ * one of the Mega is tried with -DCAN_ID_STATS_SLOTS=64 and tracks all 35.
+ *
+ * The cost of an update is measured on the host and the slots probed per
+ * lookup are counted: on the AVR each probe is one 16-bit compare, so the
+ * probe count is what changes between a good and a bad hash.
+ *
+ * Build and run:
+ *   cc -O2 -I.. can_id_stats_bench.c -o can_id_stats_bench
+ *   ./can_id_stats_bench
+ *   cc -O2 -DCAN_ID_STATS_SLOTS=64 -I.. can_id_stats_bench.c -o can_id_stats_bench_mega
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "can_id_stats.h"
+
+#define BUS_SECONDS             60
+#define JITTER_PERCENT          5
+#define EXTRA_IDS               23
+
+// ID of the bus and the truth measured while generating it
+typedef struct {
+  uint16_t id;
+  uint32_t period;                      // Nominal period (us)
+  uint32_t next;
+  uint32_t last;
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint8_t data[8];
+} BusId;
+
+static BusId bus[CAN_ID_STATS_MAX_IDS + EXTRA_IDS];
+static uint32_t failures = 0;
+
+static void Fail(uint16_t id, const char* message, long value, long expected) {
+  if (failures++ < 20) {
+    printf("FAIL ID %03X: %s (%ld, expected %ld)\n", id, message, value, expected);
+  }
+}
+
+static uint32_t Jitter(uint32_t period) {
+  int32_t amplitude = (int32_t)(period * JITTER_PERCENT / 100);
+  return (uint32_t)((int32_t)period + rand() % (2 * amplitude + 1) - amplitude);
+}
+
+static uint8_t BuildBus(uint8_t extra) {
+  static const uint16_t ids[] = { 0x0C9, 0x0F1, 0x120, 0x130, 0x1A0, 0x1C8, 0x200, 0x316, 0x329, 0x43F, 0x545, 0x7E8 };
+  static const uint32_t periods[] = { 1000, 1000, 2000, 2000, 4000, 4000, 5000, 10000, 10000, 20000, 40000, 40000 };
+  uint8_t count = 0;
+
+  for (uint8_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++, count++) {
+    bus[count].id = ids[i];
+    bus[count].period = periods[i];
+  }
+  for (uint8_t i = 0; i < extra; i++, count++) {
+    bus[count].id = (uint16_t)(0x600 + i * 3);
+    bus[count].period = 100000;
+  }
+  // The extra IDs start after every ID of the table was seen once
+  for (uint8_t i = 0; i < count; i++) {
+    bus[i].next = (uint32_t)(rand() % bus[i].period) + (i >= CAN_ID_STATS_MAX_IDS ? 50000 : 0);
+    bus[i].count = 0;
+    bus[i].minUs = UINT32_MAX;
+    bus[i].maxUs = 0;
+    for (uint8_t b = 0; b < 8; b++) {
+      bus[i].data[b] = (uint8_t)(bus[i].id + b);
+    }
+  }
+  return count;
+}
+
+// Runs the bus through the table, returns nanoseconds per update
+static double Run(CanIdStats* stats, uint8_t ids, uint32_t* frames, double* probesMean, uint8_t* probesMax) {
+  const uint32_t start = 0xFFF00000UL;   // micros() wraps after one second
+  uint64_t probes = 0;
+  double seconds = 0;
+
+  *frames = 0;
+  *probesMax = 0;
+  CanIdStatsClear(stats);
+  for (uint64_t elapsed = 0; elapsed < (uint64_t)BUS_SECONDS * 1000000;) {
+    uint8_t next = 0;
+    for (uint8_t i = 1; i < ids; i++) {
+      if (bus[i].next < bus[next].next) {
+        next = i;
+      }
+    }
+    BusId* frame = &bus[next];
+    elapsed = frame->next;
+    uint32_t now = start + frame->next;
+
+    // Truth: periods seen and payload (byte 0 counts, byte 7 changes every 100 frames)
+    if (frame->count > 0) {
+      uint32_t period = now - frame->last;
+      if (period < frame->minUs) frame->minUs = period;
+      if (period > frame->maxUs) frame->maxUs = period;
+    }
+    frame->last = now;
+    frame->count++;
+    frame->data[0]++;
+    if (frame->count % 100 == 0) {
+      frame->data[7]++;
+    }
+    frame->next += Jitter(frame->period);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    CanIdStatsUpdate(stats, frame->id, 8, frame->data, now);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    seconds += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    (*frames)++;
+
+    // Slots probed to find the ID (or the free slot)
+    uint8_t slot = CanIdStatsHash(frame->id);
+    uint8_t found = CanIdStatsProbe(stats, frame->id);
+    uint8_t probed = (uint8_t)(((found - slot) & (CAN_ID_STATS_SLOTS - 1)) + 1);
+    probes += probed;
+    if (probed > *probesMax) {
+      *probesMax = probed;
+    }
+  }
+  *probesMean = (double)probes / *frames;
+  return seconds / *frames * 1e9;
+}
+
+static void Check(const CanIdStats* stats, uint8_t ids) {
+  uint32_t untracked = 0;
+
+  for (uint8_t i = 0; i < ids; i++) {
+    const BusId* truth = &bus[i];
+    const CanIdEntry* entry = CanIdStatsFind(stats, truth->id);
+    if (i >= CAN_ID_STATS_MAX_IDS) {
+      if (entry != NULL) {
+        Fail(truth->id, "tracked with the table full", 1, 0);
+      }
+      untracked += truth->count;
+      continue;
+    }
+    if (entry == NULL) {
+      Fail(truth->id, "not tracked", 0, 1);
+      continue;
+    }
+    if (entry->count != truth->count) {
+      Fail(truth->id, "count", (long)entry->count, (long)truth->count);
+    }
+    if (entry->minPeriod != truth->minUs >> CAN_PERIOD_SHIFT) {
+      Fail(truth->id, "minimum period", entry->minPeriod, (long)(truth->minUs >> CAN_PERIOD_SHIFT));
+    }
+    if (entry->maxPeriod != truth->maxUs >> CAN_PERIOD_SHIFT) {
+      Fail(truth->id, "maximum period", entry->maxPeriod, (long)(truth->maxUs >> CAN_PERIOD_SHIFT));
+    }
+
+    // The exponential average moves with the last periods, 1.5% covers the jitter of +-5%
+    long mean = (long)(entry->meanPeriod >> CAN_MEAN_SHIFT);
+    if (labs(mean - (long)truth->period) > (long)truth->period * 15 / 1000) {
+      Fail(truth->id, "mean period (us)", mean, (long)truth->period);
+    }
+
+    // Uniform jitter of +-a has a mean deviation of a/2
+    long jitter = entry->jitter;
+    long expected = (long)truth->period * JITTER_PERCENT / 200;
+    if (labs(jitter - expected) > expected / 3 + 16) {
+      Fail(truth->id, "jitter (us)", jitter, expected);
+    }
+    if (entry->changed != 0x81) {
+      Fail(truth->id, "changed bytes", entry->changed, 0x81);
+    }
+  }
+  if (stats->untracked != untracked) {
+    Fail(0, "untracked frames", (long)stats->untracked, (long)untracked);
+  }
+
+  // Top list sorted by rate
+  uint8_t top[CAN_ID_STATS_MAX_IDS];
+  uint8_t count = CanIdStatsTop(stats, top, CAN_ID_STATS_MAX_IDS);
+  if (count != stats->used) {
+    Fail(0, "IDs in the top list", count, stats->used);
+  }
+  for (uint8_t i = 1; i < count; i++) {
+    if (CanIdEntryRate(&stats->entries[top[i]]) > CanIdEntryRate(&stats->entries[top[i - 1]])) {
+      Fail(stats->entries[top[i]].id, "top list not sorted", i, 0);
+    }
+  }
+}
+
+int main(void) {
+  static CanIdStats stats;
+  uint32_t frames;
+  double probesMean;
+  uint8_t probesMax;
+
+  srand(1);
+  printf("Table: %u slots of %u bytes on the host (30 on the AVR, no padding), up to %u IDs, %u bytes\n", CAN_ID_STATS_SLOTS,
+         (unsigned)sizeof(CanIdEntry), CAN_ID_STATS_MAX_IDS, (unsigned)sizeof(CanIdStats));
+
+  uint8_t ids = BuildBus(0);
+  double ns = Run(&stats, ids, &frames, &probesMean, &probesMax);
+  Check(&stats, ids);
+  printf("%2u IDs:   %u frames in %u s (%u/s), %.0f ns per update on the host, probes %.2f mean %u max\n", ids,
+         frames, BUS_SECONDS, frames / BUS_SECONDS, ns, probesMean, probesMax);
+
+  uint8_t top[4];
+  uint8_t count = CanIdStatsTop(&stats, top, 4);
+  for (uint8_t i = 0; i < count; i++) {
+    const CanIdEntry* entry = &stats.entries[top[i]];
+    printf("  %03X %4u/s mean %5u us [%5u-%5u] jitter %4u us\n", entry->id, CanIdEntryRate(entry),
+           entry->meanPeriod >> CAN_MEAN_SHIFT, entry->minPeriod << CAN_PERIOD_SHIFT,
+           entry->maxPeriod << CAN_PERIOD_SHIFT, entry->jitter);
+  }
+
+  ids = BuildBus(EXTRA_IDS);
+  ns = Run(&stats, ids, &frames, &probesMean, &probesMax);
+  Check(&stats, ids);
+  printf("%2u IDs:   %u frames in %u s (%u/s), %.0f ns per update on the host, probes %.2f mean %u max, %u untracked\n",
+         ids, frames, BUS_SECONDS, frames / BUS_SECONDS, ns, probesMean, probesMax, stats.untracked);
+
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,417 @@
+/*
+ * can_rx_ring_check.c - Host check of the CAN reception against a fake MCP2515
+ *
+ * Simulates, in steps of 1 us, a 500 kbit/s bus sending frames of 8 bytes
+ * back to back (128 bits each with stuffing and interframe space, 3906
+ * frames/s at 100% load), an MCP2515 with its two RX buffers (rollover
+ * from RXB0 to RXB1, RX1OVR when both are full) and the AVR running the
+ * sketch, with the time of each SPI call of the MCP_CAN library, the
+ * serial port at 115200 baud with its 64-byte buffer and the LCD refresh
+ * every 500 ms, which blocks loop() but not the interrupt.
+ *
+ * Two ways of receiving are compared:
+ *   previous  loop() polls checkReceive(), reads one frame, prints it and
+ *             waits delay(5) for the LED; the LCD is cleared and rewritten
+ *             in one go, about 30 ms
+ *   interrupt the INT falling edge runs DrainCANController(), which fills
+ *             the same can_rx_ring.h as the sketch; loop() takes up to 8
+ *             frames per pass, prints only when the serial buffer has room,
+ *             and writes the LCD through lcd_shadow.h a little every pass.
+ *             The statistics screen, the busiest, takes 9.2 passes per
+ *             refresh in lcd_shadow_check; 10 passes of the 2.6 ms maximum
+ *             (a cursor command and a character) are modelled
+ *
+ * Every frame carries its sequence number, so the check also verifies that
+ * the frames come out of the ring complete and in order. It fails if the
+ * interrupt path loses a frame in the controller or in the ring, or if a
+ * frame is missing, repeated or damaged.
+ *
+ * Build and run:
+ *   cc -O2 -I.. can_rx_ring_check.c -o can_rx_ring_check
+ *   ./can_rx_ring_check
+ * The ring size can be tried with -DCAN_RX_RING_SIZE=64
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "can_rx_ring.h"
+
+// Bus
+#define BIT_US              2.0      // 500 kbit/s
+#define FRAME_BITS          128      // 11-bit ID, 8 bytes, stuffing and interframe space
+#define SIM_US              10000000 // 10 s per run
+
+// AVR at 16 MHz with the MCP_CAN library (SPI at 8 MHz, chip select with digitalWrite)
+#define ISR_ENTRY_US        5        // Interrupt entry and attachInterrupt dispatch
+#define SPI_CHECK_US        15       // checkReceive(): read status
+#define SPI_READ_US         90       // readMsgBuf(): status, 13 bytes of RXBn, clear RXnIF
+#define SPI_EFLG_US         15       // getError()
+#define LOOP_US             60       // Buttons, switch and LED of each loop() pass
+#define POP_US              8        // Frame copied out of the ring and counted
+#define OLD_DELAY_US        5000     // delay(5) of the previous LED blink
+#define FRAMES_PER_LOOP     8
+
+// Serial port and LCD
+#define SERIAL_BYTE_US      86.8     // 115200 baud
+#define SERIAL_BUFFER       63       // Usable bytes of the 64-byte TX buffer
+#define SERIAL_LINE_RESERVE 40
+#define LINE_BYTES          32       // "ID: 0x7E8 [2 41 C 1A F8 0 0 0]" and line end
+#define LCD_PERIOD_US       500000
+#define LCD_US              30000    // Previous: lcd.clear() and 32 characters over I2C at 100 kHz
+#define LCD_PASSES          10       // Interrupt: flush passes per refresh through lcd_shadow.h
+#define LCD_PASS_US         2600     // Longest flush pass: a cursor command and a character
+
+// Fake MCP2515
+typedef struct {
+  bool full[2];
+  CanFrame frame[2];
+  uint8_t eflg;                    // Overflow bits stay set, the library does not clear them
+  uint32_t lost;
+} FakeMcp;
+
+typedef enum { STEP_LOOP, STEP_LCD, STEP_CHECK, STEP_READ, STEP_PRINT, STEP_DELAY, STEP_POP } MainStep;
+typedef enum { ISR_ENTRY, ISR_CHECK, ISR_READ, ISR_EFLG } IsrStep;
+
+typedef struct {
+  const char* name;
+  bool interrupt;                  // Interrupt path, otherwise polling
+  bool print;                      // Monitor mode, otherwise statistics mode
+  double load;                     // Bus load (0-1)
+} Scenario;
+
+typedef struct {
+  uint32_t sent;                   // Frames on the bus
+  uint32_t handled;                // Frames counted by loop()
+  uint32_t printed;
+  uint32_t notPrinted;
+  uint32_t lostController;         // Frames lost in the MCP2515
+  uint32_t lostRing;
+  uint32_t lostRingLcd;            // Ring overruns while LCD writes are pending or loop() catches up after them
+  uint32_t lcdLate;                // Refreshes that found the previous screen not yet written
+  uint32_t isrUs;                  // CPU time in the interrupt
+  uint32_t broken;                 // Frames out of order or damaged
+} Result;
+
+static uint32_t failures = 0;
+
+static void Fail(const char* scenario, const char* message, uint32_t value) {
+  if (failures++ < 20) {
+    printf("FAIL %s: %s (%u)\n", scenario, message, value);
+  }
+}
+
+// Frame with its sequence number in the ID and data
+static void MakeFrame(CanFrame* frame, uint32_t sequence) {
+  frame->id = sequence & 0x7FF;
+  frame->len = 8;
+  for (int i = 0; i < 8; i++) {
+    frame->data[i] = (uint8_t)(sequence >> (8 * (i & 3))) ^ (uint8_t)i;
+  }
+}
+
+// A frame finished on the bus: RXB0, rollover to RXB1, or lost
+static void FakeReceive(FakeMcp* mcp, const CanFrame* frame) {
+  if (!mcp->full[0]) {
+    mcp->frame[0] = *frame;
+    mcp->full[0] = true;
+  } else if (!mcp->full[1]) {
+    mcp->frame[1] = *frame;
+    mcp->full[1] = true;
+  } else {
+    mcp->eflg |= CAN_EFLG_RX1OVR;
+    mcp->lost++;
+  }
+}
+
+// readMsgBuf(): RXB0 first, as the library does
+static bool FakeRead(FakeMcp* mcp, CanFrame* frame) {
+  int buffer = mcp->full[0] ? 0 : mcp->full[1] ? 1 : -1;
+
+  if (buffer < 0) {
+    return false;
+  }
+  *frame = mcp->frame[buffer];
+  mcp->full[buffer] = false;
+  return true;
+}
+
+// Checks the order and content of a frame taken by loop()
+static void CheckFrame(const CanFrame* frame, uint32_t* expected, Result* result) {
+  CanFrame wanted;
+
+  // Frames lost before are skipped, the ID holds the low bits of the sequence
+  while ((*expected & 0x7FF) != frame->id && *expected < result->sent) {
+    (*expected)++;
+  }
+  MakeFrame(&wanted, *expected);
+  if (*expected >= result->sent || frame->len != 8 || memcmp(frame->data, wanted.data, 8) != 0) {
+    result->broken++;
+  }
+  (*expected)++;
+}
+
+static Result Run(const Scenario* scenario) {
+  static CanRxRing ring;
+  FakeMcp mcp = {0};
+  Result result = {0};
+  CanFrame frame;
+  double period = FRAME_BITS * BIT_US / scenario->load;
+  double nextFrame = period;
+  double nextSerialByte = 0.0;
+  uint32_t serialQueued = 0;
+  uint32_t nextLcd = LCD_PERIOD_US;
+  uint32_t expected = 0;
+  bool intLow = false;
+  bool intPending = false;
+  bool inIsr = false;
+  IsrStep isrStep = ISR_ENTRY;
+  uint32_t isrRemaining = 0;
+  MainStep step = STEP_LOOP;
+  uint32_t remaining = LOOP_US;
+  uint32_t printLeft = 0;
+  uint32_t popped = 0;
+  uint32_t lcdPasses = 0;          // Flush passes still to run
+  bool lcdBacklog = false;         // From the start of an LCD refresh until the ring is empty again
+  CanFrame held;                   // Frame read by the polling loop
+
+  CanRxRingInit(&ring);
+  for (uint32_t now = 0; now < SIM_US; now++) {
+    // Bus and controller
+    if (now >= nextFrame) {
+      MakeFrame(&frame, result.sent++);
+      FakeReceive(&mcp, &frame);
+      nextFrame += period;
+    }
+    bool low = mcp.full[0] || mcp.full[1];
+    if (low && !intLow) {
+      intPending = true;       // Falling edge latched by the AVR
+    }
+    intLow = low;
+
+    // Serial port sends one byte at a time
+    if (serialQueued > 0 && now >= nextSerialByte) {
+      serialQueued--;
+      nextSerialByte = now + SERIAL_BYTE_US;
+    }
+
+    // Interrupt
+    if (!inIsr && scenario->interrupt && intPending) {
+      intPending = false;
+      inIsr = true;
+      isrStep = ISR_ENTRY;
+      isrRemaining = ISR_ENTRY_US;
+    }
+    if (inIsr) {
+      result.isrUs++;
+      if (--isrRemaining > 0) {
+        continue;
+      }
+      switch (isrStep) {
+        case ISR_ENTRY:
+          isrStep = ISR_CHECK;
+          isrRemaining = SPI_CHECK_US;
+          break;
+        case ISR_CHECK:
+          if (mcp.full[0] || mcp.full[1]) {
+            isrStep = ISR_READ;
+            isrRemaining = SPI_READ_US;
+          } else {
+            isrStep = ISR_EFLG;
+            isrRemaining = SPI_EFLG_US;
+          }
+          break;
+        case ISR_READ:
+          FakeRead(&mcp, &frame);
+          if (!CanRxRingPush(&ring, frame.id, frame.len, frame.data, now) && lcdBacklog) {
+            result.lostRingLcd++;
+          }
+          isrStep = ISR_CHECK;
+          isrRemaining = SPI_CHECK_US;
+          break;
+        case ISR_EFLG:
+          CanRxRingErrors(&ring, mcp.eflg);
+          inIsr = false;
+          break;
+      }
+      continue;
+    }
+
+    // loop()
+    if (step == STEP_PRINT) {
+      if (serialQueued < SERIAL_BUFFER) {
+        if (serialQueued++ == 0 && now >= nextSerialByte) {
+          nextSerialByte = now + SERIAL_BYTE_US;
+        }
+        printLeft--;
+      }
+      if (printLeft > 0) {
+        continue;
+      }
+      result.printed++;
+      if (scenario->interrupt) {
+        step = STEP_POP;
+        remaining = 1;
+      } else {
+        step = STEP_DELAY;
+        remaining = OLD_DELAY_US;
+      }
+      continue;
+    }
+    if (--remaining > 0) {
+      continue;
+    }
+    switch (step) {
+      case STEP_LOOP:
+        if (now >= nextLcd && scenario->interrupt) {
+          // UpdateDisplay() only composes the screen, FlushDisplay() writes it pass by pass
+          nextLcd += LCD_PERIOD_US;
+          lcdBacklog = true;
+          if (lcdPasses > 0) {
+            result.lcdLate++;
+          }
+          lcdPasses = LCD_PASSES;
+        }
+        if (now >= nextLcd) {
+          nextLcd += LCD_PERIOD_US;
+          lcdBacklog = true;
+          step = STEP_LCD;
+          remaining = LCD_US;
+        } else if (scenario->interrupt) {
+          popped = 0;
+          step = STEP_POP;
+          remaining = 1;
+        } else {
+          step = STEP_CHECK;
+          remaining = SPI_CHECK_US;
+        }
+        break;
+      case STEP_LCD:
+        step = STEP_LOOP;
+        remaining = LOOP_US;
+        break;
+      case STEP_CHECK:
+        if (mcp.full[0] || mcp.full[1]) {
+          step = STEP_READ;
+          remaining = SPI_READ_US;
+        } else {
+          step = STEP_LOOP;
+          remaining = LOOP_US;
+        }
+        break;
+      case STEP_READ:
+        FakeRead(&mcp, &held);
+        result.handled++;
+        CheckFrame(&held, &expected, &result);
+        if (scenario->print) {
+          step = STEP_PRINT;
+          printLeft = LINE_BYTES;
+        } else {
+          step = STEP_DELAY;
+          remaining = OLD_DELAY_US;
+        }
+        break;
+      case STEP_DELAY:
+        step = STEP_LOOP;
+        remaining = LOOP_US;
+        break;
+      case STEP_POP:
+        if (popped < FRAMES_PER_LOOP && CanRxRingPop(&ring, &held)) {
+          popped++;
+          result.handled++;
+          CheckFrame(&held, &expected, &result);
+          if (scenario->print && SERIAL_BUFFER - serialQueued >= SERIAL_LINE_RESERVE) {
+            step = STEP_PRINT;
+            printLeft = LINE_BYTES;
+          } else {
+            if (scenario->print) {
+              result.notPrinted++;
+            }
+            remaining = POP_US;
+          }
+        } else if (lcdPasses > 0 && CanRxRingCount(&ring) == 0) {
+          // FlushDisplay() once the pass has taken every waiting frame
+          lcdPasses--;
+          step = STEP_LCD;
+          remaining = LCD_PASS_US;
+        } else {
+          lcdBacklog = lcdBacklog && CanRxRingCount(&ring) > 0;
+          step = STEP_LOOP;
+          remaining = LOOP_US;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  result.lostController = mcp.lost;
+  result.lostRing = ring.overruns;
+  if (scenario->interrupt) {
+    // Frames still waiting are not lost
+    uint32_t waiting = CanRxRingCount(&ring) + mcp.full[0] + mcp.full[1];
+    if (result.handled + result.lostRing + result.lostController + waiting != result.sent) {
+      Fail(scenario->name, "frames not accounted for", result.sent);
+    }
+    if ((mcp.lost > 0) != (ring.errorCounts[7] > 0)) {
+      Fail(scenario->name, "controller overflow not flagged", ring.errorCounts[7]);
+    }
+  }
+  return result;
+}
+
+// EFLG bits are counted once when they rise
+static void CheckErrorCounting(void) {
+  static CanRxRing ring;
+  const uint8_t flags[] = { 0x00, 0x40, 0x40, 0x00, 0x48, 0x28, 0x20, 0x00, 0x80 };
+
+  CanRxRingInit(&ring);
+  for (size_t i = 0; i < sizeof(flags); i++) {
+    CanRxRingErrors(&ring, flags[i]);
+  }
+  if (ring.errorCounts[6] != 2 || ring.errorCounts[3] != 1 || ring.errorCounts[5] != 1 ||
+    ring.errorCounts[7] != 1 || ring.errorFlags != 0x80) {
+    Fail("errors", "EFLG edges counted wrong", ring.errorCounts[6]);
+  }
+}
+
+int main(void) {
+  const double loads[] = { 0.25, 0.5, 1.0 };
+
+  CheckErrorCounting();
+  printf("Ring of %u frames, %.0f frames/s at 100%% load, %d s per run\n", CAN_RX_RING_SIZE - 1,
+           1e6 / (FRAME_BITS * BIT_US), SIM_US / 1000000);
+  printf("%-10s %-10s %4s %7s %7s %6s %7s %7s %9s %6s %5s %8s\n", "path", "mode", "load", "sent", "counted", "lost%",
+           "in MCP", "in ring", "(in LCD)", "print", "ISR%", "LCD late");
+  for (int path = 0; path < 2; path++) {
+    for (int mode = 0; mode < 2; mode++) {
+      for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        Scenario scenario = { path ? "interrupt" : "previous", path == 1, mode == 0, loads[i] };
+        Result result = Run(&scenario);
+        uint32_t lost = result.lostController + result.lostRing;
+
+        printf("%-10s %-10s %3.0f%% %7u %7u %5.1f%% %7u %7u %9u %6u %4.1f%% %8u\n", scenario.name,
+                       scenario.print ? "monitor" : "statistics", scenario.load * 100, result.sent, result.handled,
+                       100.0 * lost / result.sent, result.lostController, result.lostRing, result.lostRingLcd,
+                       result.printed, 100.0 * result.isrUs / SIM_US, result.lcdLate);
+        if (result.broken > 0) {
+          Fail(scenario.name, "frames out of order or damaged", result.broken);
+        }
+        if (scenario.interrupt) {
+          if (result.lostController > 0) {
+            Fail(scenario.name, "frames lost in the MCP2515", result.lostController);
+          }
+          if (result.lostRing > 0) {
+            Fail(scenario.name, "frames lost in the ring", result.lostRing);
+          }
+          if (result.lcdLate > 0) {
+            Fail(scenario.name, "LCD screen not written before the next refresh", result.lcdLate);
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+/*
+ * can_stream_decoder.cpp - Converts a capture of the reader stream to a candump log
+ *
+ * Reads the serial output of lectorCanBus in stream mode (SLCAN text or
+ * binary records, see can_stream.h) and writes one candump log line per
+ * frame:
+ *   (0000000012.345678) can0 7E8#0441057B00000000
+ * The times start at 0 on the first frame; binary captures keep the
+ * microseconds of the interrupt, SLCAN ones the milliseconds of the
+ * Lawicel timestamp (frames without timestamp repeat the previous time).
+ * Lines that are not frames (the start banner, SLCAN replies) and damaged
+ * binary records are skipped and counted; gaps in the binary sequence are
+ * reported as frames dropped by the reader.
+ *
+ * The log is replayed and analyzed with can-utils:
+ *   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+ *   canplayer -I capture.log vcan0=can0
+ *   candump vcan0
+ *
+ * Build and run:
+ *   c++ -O2 -std=c++17 -I.. can_stream_decoder.cpp -o can_stream_decoder
+ *   stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > capture.bin
+ *   ./can_stream_decoder bin capture.bin > capture.log
+ * A capture of "-" is read from stdin.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "can_stream.h"
+
+namespace {
+
+// Counters of the whole capture
+struct DecodeSummary {
+  uint64_t bytes = 0;
+  uint64_t frames = 0;
+  uint64_t extended = 0;
+  uint64_t skippedLines = 0;
+  uint64_t skippedBytes = 0;
+  uint64_t lostFrames = 0;
+  uint64_t lastTime = 0;
+};
+
+// Turns the device clock (us wrapping at 2^32, or ms wrapping at 60 s) into a time from the first frame
+class Timeline {
+ public:
+  explicit Timeline(uint64_t period) : period_(period) {}
+
+  uint64_t Add(uint32_t time) {
+    if (!started_) {
+      started_ = true;
+      first_ = time;
+    } else if (time < last_) {
+      wraps_++;
+    }
+    last_ = time;
+    return wraps_ * period_ + time - first_;
+  }
+
+ private:
+  uint64_t period_;
+  bool started_ = false;
+  uint32_t first_ = 0;
+  uint32_t last_ = 0;
+  uint64_t wraps_ = 0;
+};
+
+void WriteFrame(const CanStreamRecord& record, uint64_t timeUs, const char* interface, DecodeSummary& summary) {
+  std::printf("(%010llu.%06llu) %s ", (unsigned long long)(timeUs / 1000000), (unsigned long long)(timeUs % 1000000),
+              interface);
+  std::printf(record.extended ? "%08X#" : "%03X#", record.id);
+  if (record.remote) {
+    std::printf("R");
+  } else {
+    for (uint8_t i = 0; i < record.len; i++) {
+      std::printf("%02X", record.data[i]);
+    }
+  }
+  std::printf("\n");
+  summary.frames++;
+  summary.extended += record.extended ? 1 : 0;
+  summary.lastTime = timeUs;
+}
+
+// Converts the complete SLCAN lines of buffer, returns the bytes used
+size_t DecodeSlcan(const std::vector<uint8_t>& buffer, Timeline& timeline, uint64_t& timeUs, const char* interface,
+                   DecodeSummary& summary) {
+  size_t lineStart = 0;
+
+  for (size_t i = 0; i < buffer.size(); i++) {
+    if (buffer[i] != '\r' && buffer[i] != '\n' && buffer[i] != '\a') {
+      continue;
+    }
+    const char* line = reinterpret_cast<const char*>(buffer.data()) + lineStart;
+    size_t length = i - lineStart;
+    lineStart = i + 1;
+    if (length == 0) {
+      continue;
+    }
+
+    CanStreamRecord record;
+    if (!CanStreamDecodeSlcan(line, length, &record)) {
+      summary.skippedLines++;
+      continue;
+    }
+    if (record.time != 0xFFFFFFFFUL) {
+      timeUs = timeline.Add(record.time) * 1000;
+    }
+    WriteFrame(record, timeUs, interface, summary);
+  }
+  return lineStart;
+}
+
+// Converts the complete binary records of buffer, returns the bytes used
+size_t DecodeBinary(const std::vector<uint8_t>& buffer, Timeline& timeline, bool& haveSequence, uint8_t& sequence,
+                    const char* interface, DecodeSummary& summary) {
+  size_t position = 0;
+
+  while (position < buffer.size()) {
+    CanStreamRecord record;
+    int length = CanStreamDecodeBinary(buffer.data() + position, buffer.size() - position, &record);
+    if (length == 0) {
+      break;
+    }
+    if (length < 0) {
+      summary.skippedBytes++;           // Not a record: look for the next sync byte
+      position++;
+      continue;
+    }
+    position += length;
+
+    if (haveSequence) {
+      summary.lostFrames += static_cast<uint8_t>(record.sequence - sequence);
+    }
+    haveSequence = true;
+    sequence = static_cast<uint8_t>(record.sequence + 1);
+    WriteFrame(record, timeline.Add(record.time), interface, summary);
+  }
+  return position;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3 || (std::strcmp(argv[1], "slcan") != 0 && std::strcmp(argv[1], "bin") != 0)) {
+    std::fprintf(stderr, "Usage: %s slcan|bin capture [interface] > capture.log\n", argv[0]);
+    return 1;
+  }
+  bool slcan = std::strcmp(argv[1], "slcan") == 0;
+  std::FILE* input = std::strcmp(argv[2], "-") == 0 ? stdin : std::fopen(argv[2], "rb");
+  if (!input) {
+    std::fprintf(stderr, "Cannot open %s\n", argv[2]);
+    return 1;
+  }
+  const char* interface = argc > 3 ? argv[3] : "can0";
+
+  DecodeSummary summary;
+  Timeline timeline(slcan ? CAN_STREAM_SLCAN_WRAP : 0x100000000ULL);
+  uint64_t slcanTimeUs = 0;
+  bool haveSequence = false;
+  uint8_t sequence = 0;
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[4096];
+
+  // Read in chunks so a live capture from stdin is converted as it arrives
+  size_t count;
+  while ((count = std::fread(chunk, 1, sizeof(chunk), input)) > 0) {
+    summary.bytes += count;
+    buffer.insert(buffer.end(), chunk, chunk + count);
+    size_t used = slcan ? DecodeSlcan(buffer, timeline, slcanTimeUs, interface, summary)
+                        : DecodeBinary(buffer, timeline, haveSequence, sequence, interface, summary);
+    buffer.erase(buffer.begin(), buffer.begin() + used);
+    std::fflush(stdout);
+  }
+  if (input != stdin) {
+    std::fclose(input);
+  }
+  summary.skippedBytes += buffer.size();  // Incomplete record or line at the end
+
+  double seconds = summary.lastTime / 1e6;
+  std::fprintf(stderr, "Capture: %llu bytes, %llu frames (%llu extended)\n", (unsigned long long)summary.bytes,
+               (unsigned long long)summary.frames, (unsigned long long)summary.extended);
+  std::fprintf(stderr, "Skipped: %llu lines, %llu bytes; frames dropped by the reader: %llu\n",
+               (unsigned long long)summary.skippedLines, (unsigned long long)summary.skippedBytes,
+               (unsigned long long)summary.lostFrames);
+  if (seconds > 0) {
+    std::fprintf(stderr, "Duration: %.3f s, %.0f frames/s, %.0f bytes/s\n", seconds, summary.frames / seconds,
+                 summary.bytes / seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * lcd_shadow_check.c - Host check of the incremental LCD refresh with a fake LCD
+ *
+ * A fake HD44780 keeps its display memory and address counter as the
+ * real one does (row 1 starts at address 0x40, the address goes on past
+ * column 15 into memory that is not shown), and a fake clock charges
+ * every LCD byte what it costs over the PCF8574 backpack at 100 kHz:
+ * 6 I2C transfers of 2 bytes, about 1.3 ms, plus 2 ms for clear().
+ *
+ * For the screens of every mode of the sketch, refreshed every 500 ms
+ * with changing values, the LCD bytes of the old refresh (clear() and
+ * both lines printed again) are compared with lcd_shadow.h, the same
+ * code as the sketch, flushed once per loop() pass with its time budget.
+ * After every refresh the visible cells of the fake LCD must equal the
+ * composed screen, and no pass may block longer than the budget plus
+ * one cell.
+ *
+ * Build and run:
+ *   cc -O2 -I.. lcd_shadow_check.c -o lcd_shadow_check
+ *   ./lcd_shadow_check
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lcd_shadow.h"
+
+#define LCD_BYTE_US             1300    // 2 nibbles, 3 expander writes each, 200 us per write
+#define LCD_CLEAR_US            2000    // Extra wait of clear()
+#define I2C_BYTES_PER_LCD_BYTE  12
+#define BUDGET_US               1000    // As LCD_BUDGET_US of the sketch
+#define LOOP_US                 300     // Rest of a loop() pass
+#define REFRESHES               200
+
+// Fake HD44780 behind the I2C backpack
+static struct {
+  char memory[0x80];
+  uint8_t address;
+  uint32_t bytes;
+} lcd;
+
+static uint32_t clock;
+static uint32_t failures;
+
+static void Fail(const char* screen, const char* message, long value, long expected) {
+  if (failures++ < 20) {
+    printf("FAIL %s: %s (%ld, expected %ld)\n", screen, message, value, expected);
+  }
+}
+
+static void FakeSetCursor(uint8_t col, uint8_t row) {
+  lcd.address = (uint8_t)(col + (row ? 0x40 : 0));
+  lcd.bytes++;
+  clock += LCD_BYTE_US;
+}
+
+static void FakeWrite(uint8_t c) {
+  lcd.memory[lcd.address] = (char)c;
+  lcd.address = (lcd.address + 1) & 0x7F;
+  lcd.bytes++;
+  clock += LCD_BYTE_US;
+}
+
+static void FakeClear(void) {
+  memset(lcd.memory, ' ', sizeof(lcd.memory));
+  lcd.address = 0;
+  lcd.bytes++;
+  clock += LCD_BYTE_US + LCD_CLEAR_US;
+}
+
+static uint32_t FakeMicros(void) {
+  return clock;
+}
+
+static const LcdShadowHandlers HANDLERS = { FakeSetCursor, FakeWrite, FakeMicros };
+
+// Screen of one refresh, as UpdateDisplay() prints it: title, then text at (col, row) pairs
+typedef struct {
+  const char* title;
+  char line[17];
+  uint8_t extraCol;                     // Second text on row 1 (TRM), 0 if none
+  char extra[4];
+} Screen;
+
+static void Compose(LcdShadow* shadow, const Screen* screen) {
+  LcdShadowBegin(shadow);
+  for (const char* c = screen->title; *c; c++) LcdShadowPut(shadow, *c);
+  LcdShadowSetCursor(shadow, 0, 1);
+  for (const char* c = screen->line; *c; c++) LcdShadowPut(shadow, *c);
+  if (screen->extraCol) {
+    LcdShadowSetCursor(shadow, screen->extraCol, 1);
+    for (const char* c = screen->extra; *c; c++) LcdShadowPut(shadow, *c);
+  }
+}
+
+// Old refresh: clear() and everything printed again; returns the time it blocked
+static uint32_t OldRefresh(const Screen* screen) {
+  uint32_t start = clock;
+
+  FakeClear();
+  FakeSetCursor(0, 0);
+  for (const char* c = screen->title; *c; c++) FakeWrite((uint8_t)*c);
+  FakeSetCursor(0, 1);
+  for (const char* c = screen->line; *c; c++) FakeWrite((uint8_t)*c);
+  if (screen->extraCol) {
+    FakeSetCursor(screen->extraCol, 1);
+    for (const char* c = screen->extra; *c; c++) FakeWrite((uint8_t)*c);
+  }
+  return clock - start;
+}
+
+static void CheckVisible(const LcdShadow* shadow, const char* name) {
+  for (uint8_t cell = 0; cell < LCD_SHADOW_CELLS; cell++) {
+    uint8_t address = (uint8_t)(cell % LCD_SHADOW_COLS + (cell < LCD_SHADOW_COLS ? 0 : 0x40));
+    if (lcd.memory[address] != shadow->wanted[cell]) {
+      Fail(name, "visible cell differs", cell, lcd.memory[address]);
+      return;
+    }
+  }
+}
+
+typedef void (*ScreenMaker)(Screen* screen, int refresh);
+
+static void BasicMonitor(Screen* screen, int refresh) {
+  (void)refresh;
+  screen->title = "Basic monitor";
+  snprintf(screen->line, sizeof(screen->line), "Msgs: %d/s", 1950 + rand() % 100);
+  screen->extraCol = 13;
+  strcpy(screen->extra, "TRM");
+}
+
+static void Statistics(Screen* screen, int refresh) {
+  static const char* const ids[4] = { "0C9 %d/s j%d", "0F1 %d/s j%d", "120 %d/s j%d", "7E8 %d/s j%d" };
+  static const int rates[4] = { 1000, 1000, 500, 100 };
+  screen->title = "Statistics";
+  snprintf(screen->line, sizeof(screen->line), ids[refresh % 4], rates[refresh % 4] - rand() % 2, 20 + rand() % 30);
+  screen->extraCol = 0;
+}
+
+static void Diagnostic(Screen* screen, int refresh) {
+  screen->title = "Diagnostic";
+  if (refresh < 2) {
+    strcpy(screen->line, "Searching PIDs");
+  } else {
+    snprintf(screen->line, sizeof(screen->line), "PID:%d/s ECU:3", 115 + rand() % 6);
+  }
+  screen->extraCol = 0;
+}
+
+// Same screen with a value that stays the same: nothing to write
+static void Steady(Screen* screen, int refresh) {
+  (void)refresh;
+  screen->title = "Basic monitor";
+  strcpy(screen->line, "Msgs: 0/s");
+  screen->extraCol = 13;
+  strcpy(screen->extra, "   ");
+}
+
+static void Run(const char* name, ScreenMaker maker) {
+  static LcdShadow shadow;
+  Screen screen;
+  uint64_t oldBytes = 0, newBytes = 0, oldBlock = 0, passes = 0;
+  uint32_t oldMax = 0, newMax = 0;
+
+  // The previous mode left its screen: start from a cleared LCD, the first refresh writes everything
+  FakeClear();
+  LcdShadowInit(&shadow);
+  srand(7);
+  for (int refresh = 0; refresh < REFRESHES; refresh++) {
+    maker(&screen, refresh);
+
+    uint32_t before = lcd.bytes;
+    uint32_t block = OldRefresh(&screen);
+    oldBytes += lcd.bytes - before;
+    oldBlock += block;
+    if (block > oldMax) oldMax = block;
+  }
+
+  FakeClear();
+  LcdShadowInit(&shadow);
+  srand(7);
+  for (int refresh = 0; refresh < REFRESHES; refresh++) {
+    maker(&screen, refresh);
+    Compose(&shadow, &screen);
+
+    uint32_t before = lcd.bytes;
+    uint32_t commands = shadow.commands;
+    uint32_t cells = shadow.cells;
+    // loop() passes until the next refresh; the screen must be complete well before
+    for (uint32_t elapsed = 0; elapsed < 500000;) {
+      uint32_t start = clock;
+      uint8_t written = LcdShadowFlush(&shadow, &HANDLERS, BUDGET_US);
+      uint32_t block = clock - start;
+      if (written > 0) passes++;
+      if (block > newMax) newMax = block;
+      clock += LOOP_US;
+      elapsed += clock - start;
+      if (LcdShadowDone(&shadow)) break;
+    }
+    if (!LcdShadowDone(&shadow)) {
+      Fail(name, "screen not complete before the next refresh", refresh, 0);
+    }
+    CheckVisible(&shadow, name);
+    newBytes += lcd.bytes - before;
+    if (lcd.bytes - before != (shadow.commands - commands) + (shadow.cells - cells)) {
+      Fail(name, "LCD bytes and counters differ", (long)(lcd.bytes - before), (long)0);
+    }
+  }
+
+  if (newMax > BUDGET_US + 2 * LCD_BYTE_US) {
+    Fail(name, "pass blocked longer than the budget plus one cell (us)", newMax, BUDGET_US + 2 * LCD_BYTE_US);
+  }
+  if (newBytes > oldBytes) {
+    Fail(name, "more LCD bytes than a full refresh", (long)newBytes, (long)oldBytes);
+  }
+  printf("%-14s old %5.1f LCD bytes (%4.0f I2C) %5.1f ms blocked | new %4.1f LCD bytes (%3.0f I2C) in %4.2f passes, "
+         "%3.1f ms max per pass\n", name, (double)oldBytes / REFRESHES, (double)oldBytes * I2C_BYTES_PER_LCD_BYTE / REFRESHES,
+         oldBlock / 1000.0 / REFRESHES, (double)newBytes / REFRESHES, (double)newBytes * I2C_BYTES_PER_LCD_BYTE / REFRESHES,
+         (double)passes / REFRESHES, newMax / 1000.0);
+}
+
+// Writes around the shadow (start messages) and a full screen of text ending at the last cells
+static void CheckInvalidate(void) {
+  static LcdShadow shadow;
+  const char* full = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+  FakeClear();
+  LcdShadowInit(&shadow);
+  LcdShadowBegin(&shadow);
+  for (uint8_t i = 0; i < 16; i++) LcdShadowPut(&shadow, full[i]);
+  LcdShadowPut(&shadow, 'X');           // Past the end of row 0: dropped
+  LcdShadowSetCursor(&shadow, 0, 1);
+  for (uint8_t i = 16; i < 32; i++) LcdShadowPut(&shadow, full[i]);
+  while (LcdShadowFlush(&shadow, &HANDLERS, 0) > 0) {
+  }
+  CheckVisible(&shadow, "full screen");
+  if (shadow.commands != 2) {
+    Fail("full screen", "cursor commands", (long)shadow.commands, 2);
+  }
+
+  // Start messages written directly: every cell again
+  FakeSetCursor(0, 0);
+  for (const char* c = "Starting CAN..."; *c; c++) FakeWrite((uint8_t)*c);
+  LcdShadowInvalidate(&shadow);
+  uint32_t cells = shadow.cells;
+  while (LcdShadowFlush(&shadow, &HANDLERS, 0) > 0) {
+  }
+  CheckVisible(&shadow, "invalidate");
+  if (shadow.cells - cells != LCD_SHADOW_CELLS) {
+    Fail("invalidate", "cells written", (long)(shadow.cells - cells), LCD_SHADOW_CELLS);
+  }
+}
+
+int main(void) {
+  printf("Per refresh, %u refreshes, LCD byte %u us, budget %u us per loop() pass\n", REFRESHES, LCD_BYTE_US, BUDGET_US);
+  Run("Basic monitor", BasicMonitor);
+  Run("Statistics", Statistics);
+  Run("Diagnostic", Diagnostic);
+  Run("Steady", Steady);
+  CheckInvalidate();
+
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+/*
+ * obd_pid_check.c - Host check of the Mode 01 PID decoder against reference vectors
+ *
+ * Three checks of obd_pid.h, the same code as the sketch:
+ *   - the table: rows sorted, every value inside the PID data, and the
+ *     length of every PID 0x00-0x64 equal to the SAE J1979 one
+ *   - answers of known vehicles and J1979 examples formatted as the
+ *     sketch prints them, including bit-field PIDs and short data
+ *   - every raw value of every scaled PID (all 65536 for two-byte values)
+ *     against the J1979 formula in floating point: the integer result
+ *     must be the formula rounded to the decimals of the value
+ *
+ * Build and run:
+ *   cc -O2 -I.. obd_pid_check.c -o obd_pid_check
+ *   ./obd_pid_check
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "obd_pid.h"
+
+static uint32_t failures = 0;
+
+static void Fail(uint8_t pid, const char* message, const char* value, const char* expected) {
+  if (failures++ < 20) {
+    printf("FAIL PID %02X: %s (%s, expected %s)\n", pid, message, value, expected);
+  }
+}
+
+// Data bytes of PIDs 0x00-0x64, SAE J1979
+static const uint8_t J1979_LENGTH[0x65] = {
+  4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,    // 00-0F
+  2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,    // 10-1F
+  4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,    // 20-2F
+  1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,    // 30-3F
+  4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,    // 40-4F
+  4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,    // 50-5F
+  4, 1, 1, 2, 5                                      // 60-64
+};
+
+static void CheckTable(void) {
+  char text[16];
+
+  for (uint8_t i = 0; i < OBD_PID_ROWS; i++) {
+    const ObdPidField* row = &OBD_PIDS[i];
+    if (i > 0 && row->first < OBD_PIDS[i - 1].first) {
+      Fail(row->first, "rows not sorted", row->name, "");
+    }
+    if (row->last < row->first || row->position + row->size > row->length || row->length > OBD_PID_MAX_LENGTH) {
+      Fail(row->first, "value outside the PID data", row->name, "");
+    }
+    if (memchr(row->name, '\0', OBD_PID_NAME) == NULL || row->div == 0) {
+      Fail(row->first, "name or divisor", row->name, "");
+    }
+  }
+  for (uint16_t pid = 0; pid <= 0xFF; pid++) {
+    uint8_t expected = pid < sizeof(J1979_LENGTH) ? J1979_LENGTH[pid] : (pid & 0x1F) == 0 && pid <= 0xC0 ? 4 : 0;
+    uint8_t length = ObdPidLength((uint8_t)pid);
+    if (length != expected) {
+      char value[4], reference[4];
+      snprintf(value, sizeof(value), "%u", length);
+      snprintf(reference, sizeof(reference), "%u", expected);
+      Fail((uint8_t)pid, "length", value, reference);
+    }
+    if (length == 0 && ObdPidFormat((uint8_t)pid, 0, (const uint8_t*)"\0\0\0\0\0", 5, text, sizeof(text)) != 0) {
+      Fail((uint8_t)pid, "unknown PID decoded", text, "nothing");
+    }
+  }
+}
+
+// Answer of one PID and every value it must print
+typedef struct {
+  uint8_t pid;
+  uint8_t len;
+  uint8_t data[OBD_PID_MAX_LENGTH];
+  const char* text[5];
+} PidVector;
+
+static const PidVector VECTORS[] = {
+  { 0x00, 4, { 0xBE, 0x1F, 0xA8, 0x13 }, { "Supported BE1FA813" } },
+  { 0x01, 4, { 0x83, 0x07, 0x65, 0x21 }, { "MIL on", "DTCs 3", "Ready 5/7" } },
+  { 0x01, 4, { 0x00, 0x07, 0xE5, 0x00 }, { "MIL off", "DTCs 0", "Ready 8/8" } },
+  { 0x02, 2, { 0x01, 0x33 }, { "Freeze DTC P0133" } },
+  { 0x03, 2, { 0x02, 0x00 }, { "Fuel sys 1 CL", "Fuel sys 2 -" } },
+  { 0x03, 2, { 0x04, 0x03 }, { "Fuel sys 1 OL drive", "Fuel sys 2 03" } },
+  { 0x04, 1, { 0xFF }, { "Engine load 100.0 %" } },
+  { 0x04, 1, { 0x80 }, { "Engine load 50.2 %" } },
+  { 0x05, 1, { 0x7B }, { "Coolant 83 °C" } },
+  { 0x05, 1, { 0x00 }, { "Coolant -40 °C" } },
+  { 0x06, 1, { 0x80 }, { "STFT bank 1 0.0 %" } },
+  { 0x07, 1, { 0x00 }, { "LTFT bank 1 -100.0 %" } },
+  { 0x08, 1, { 0xFF }, { "STFT bank 2 99.2 %" } },
+  { 0x0A, 1, { 0x64 }, { "Fuel press 300 kPa" } },
+  { 0x0C, 2, { 0x1A, 0xF8 }, { "RPM 1726 rpm" } },
+  { 0x0D, 1, { 0x3C }, { "Speed 60 km/h" } },
+  { 0x0E, 1, { 0x00 }, { "Timing adv -64.0 °" } },
+  { 0x0E, 1, { 0x96 }, { "Timing adv 11.0 °" } },
+  { 0x10, 2, { 0x01, 0x2C }, { "MAF 3.00 g/s" } },
+  { 0x12, 1, { 0x04 }, { "Sec air off" } },
+  { 0x13, 1, { 0x33 }, { "O2 present 33" } },
+  { 0x14, 2, { 0x5A, 0x80 }, { "O2 S1 volt 0.450 V", "O2 S1 trim 0.0 %" } },
+  { 0x1B, 2, { 0xB4, 0x70 }, { "O2 S8 volt 0.900 V", "O2 S8 trim -12.5 %" } },
+  { 0x1C, 1, { 0x06 }, { "OBD std 6" } },
+  { 0x1F, 2, { 0x02, 0x58 }, { "Run time 600 s" } },
+  { 0x22, 2, { 0x00, 0x64 }, { "Rail press 7.900 kPa" } },
+  { 0x24, 4, { 0x80, 0x00, 0x80, 0x00 }, { "O2 S1 ratio 1.0000", "O2 S1 volt 4.000 V" } },
+  { 0x34, 4, { 0x80, 0x00, 0x80, 0x00 }, { "O2 S1 ratio 1.0000", "O2 S1 curr 0.00 mA" } },
+  { 0x3B, 4, { 0x7A, 0xE1, 0x7F, 0x00 }, { "O2 S8 ratio 0.9600", "O2 S8 curr -1.00 mA" } },
+  { 0x3C, 2, { 0x11, 0x94 }, { "Cat temp 1 410.0 °C" } },
+  { 0x3F, 2, { 0x00, 0x00 }, { "Cat temp 4 -40.0 °C" } },
+  { 0x32, 2, { 0xFF, 0xFC }, { "Evap vapor -1.00 Pa" } },
+  { 0x32, 2, { 0x7F, 0xFF }, { "Evap vapor 8191.75 Pa" } },
+  { 0x41, 4, { 0x00, 0x05, 0x01, 0x00 }, { "Cycle ready 3/3" } },
+  { 0x42, 2, { 0x36, 0xB0 }, { "Module volt 14.000 V" } },
+  { 0x43, 2, { 0x00, 0xFF }, { "Abs load 100.0 %" } },
+  { 0x44, 2, { 0x80, 0x00 }, { "Cmd ratio 1.0000" } },
+  { 0x4F, 4, { 0x01, 0x02, 0x03, 0x04 }, { "Max ratio 1", "Max O2 volt 2 V", "Max O2 curr 3 mA", "Max MAP 40 kPa" } },
+  { 0x53, 2, { 0x4E, 0x20 }, { "Evap abs 100.000 kPa" } },
+  { 0x54, 2, { 0x7F, 0xFF }, { "Evap wide 0 Pa" } },
+  { 0x56, 2, { 0x90, 0x80 }, { "O2 LTFT B1 12.5 %", "O2 LTFT B3 0.0 %" } },
+  { 0x5C, 1, { 0x82 }, { "Oil temp 90 °C" } },
+  { 0x5D, 2, { 0x69, 0x00 }, { "Inj timing 0.00 °" } },
+  { 0x5E, 2, { 0x00, 0x64 }, { "Fuel rate 5.00 L/h" } },
+  { 0x64, 5, { 0x7D, 0x8C, 0x9B, 0xAA, 0xE1 }, { "Torque idle 0 %", "Torque pt 1 15 %", "Torque pt 2 30 %",
+                                                 "Torque pt 3 45 %", "Torque pt 4 100 %" } },
+  { 0x80, 4, { 0x00, 0x00, 0x00, 0x01 }, { "Supported 00000001" } },
+  { 0x0C, 1, { 0x1A }, { NULL } },      // Shorter than the PID: nothing decoded
+  { 0x70, 4, { 0x01, 0x02, 0x03, 0x04 }, { NULL } },
+};
+
+static void CheckVectors(void) {
+  char text[OBD_PID_TEXT];
+
+  for (size_t v = 0; v < sizeof(VECTORS) / sizeof(VECTORS[0]); v++) {
+    const PidVector* vector = &VECTORS[v];
+    uint8_t index = 0;
+    for (; index < 5 && vector->text[index] != NULL; index++) {
+      uint8_t length = ObdPidFormat(vector->pid, index, vector->data, vector->len, text, sizeof(text));
+      if (length == 0 || length != strlen(text) || strcmp(text, vector->text[index]) != 0) {
+        Fail(vector->pid, "text", length == 0 ? "nothing" : text, vector->text[index]);
+      }
+    }
+    if (ObdPidFormat(vector->pid, index, vector->data, vector->len, text, sizeof(text)) != 0) {
+      Fail(vector->pid, "value not expected", text, "nothing");
+    }
+  }
+
+  // A small buffer cuts the text and keeps it terminated
+  if (ObdPidFormat(0x05, 0, (const uint8_t*)"\x7B", 1, text, 6) != 5 || strcmp(text, "Coola") != 0) {
+    Fail(0x05, "cut text", text, "Coola");
+  }
+}
+
+// J1979 formula of a scaled value from the bytes A B C D
+typedef double (*Formula)(const uint8_t* d);
+
+static double Percent(const uint8_t* d) { return d[0] * 100.0 / 255; }
+static double Temperature(const uint8_t* d) { return d[0] - 40.0; }
+static double Trim(const uint8_t* d) { return (d[0] - 128) * 100.0 / 128; }
+static double TrimB(const uint8_t* d) { return (d[1] - 128) * 100.0 / 128; }
+static double TripleA(const uint8_t* d) { return d[0] * 3.0; }
+static double ByteA(const uint8_t* d) { return d[0]; }
+static double Rpm(const uint8_t* d) { return (256 * d[0] + d[1]) / 4.0; }
+static double Timing(const uint8_t* d) { return d[0] / 2.0 - 64; }
+static double Maf(const uint8_t* d) { return (256 * d[0] + d[1]) / 100.0; }
+static double O2Volt(const uint8_t* d) { return d[0] / 200.0; }
+static double WordAB(const uint8_t* d) { return 256 * d[0] + d[1]; }
+static double RailPressure(const uint8_t* d) { return (256 * d[0] + d[1]) * 0.079; }
+static double WordAB10(const uint8_t* d) { return (256 * d[0] + d[1]) * 10.0; }
+static double Ratio(const uint8_t* d) { return 2.0 / 65536 * (256 * d[0] + d[1]); }
+static double RatioVolt(const uint8_t* d) { return 8.0 / 65536 * (256 * d[2] + d[3]); }
+static double RatioCurrent(const uint8_t* d) { return (256 * d[2] + d[3]) / 256.0 - 128; }
+static double EvapVapor(const uint8_t* d) { return (int16_t)(256 * d[0] + d[1]) / 4.0; }
+static double CatalystTemp(const uint8_t* d) { return (256 * d[0] + d[1]) / 10.0 - 40; }
+static double ModuleVolt(const uint8_t* d) { return (256 * d[0] + d[1]) / 1000.0; }
+static double AbsoluteLoad(const uint8_t* d) { return (256 * d[0] + d[1]) * 100.0 / 255; }
+static double EvapAbsolute(const uint8_t* d) { return (256 * d[0] + d[1]) / 200.0; }
+static double EvapWide(const uint8_t* d) { return 256 * d[0] + d[1] - 32767.0; }
+static double InjectionTiming(const uint8_t* d) { return (256 * d[0] + d[1]) / 128.0 - 210; }
+static double FuelRate(const uint8_t* d) { return (256 * d[0] + d[1]) / 20.0; }
+static double Torque(const uint8_t* d) { return d[0] - 125.0; }
+
+typedef struct {
+  uint8_t pid;
+  uint8_t index;
+  Formula formula;
+} FormulaCheck;
+
+static const FormulaCheck FORMULAS[] = {
+  { 0x04, 0, Percent }, { 0x05, 0, Temperature }, { 0x06, 0, Trim }, { 0x09, 0, Trim }, { 0x0A, 0, TripleA },
+  { 0x0B, 0, ByteA }, { 0x0C, 0, Rpm }, { 0x0D, 0, ByteA }, { 0x0E, 0, Timing }, { 0x0F, 0, Temperature },
+  { 0x10, 0, Maf }, { 0x11, 0, Percent }, { 0x14, 0, O2Volt }, { 0x17, 1, TrimB }, { 0x1F, 0, WordAB },
+  { 0x21, 0, WordAB }, { 0x22, 0, RailPressure }, { 0x23, 0, WordAB10 }, { 0x24, 0, Ratio }, { 0x2B, 1, RatioVolt },
+  { 0x2C, 0, Percent }, { 0x2D, 0, Trim }, { 0x2F, 0, Percent }, { 0x31, 0, WordAB }, { 0x32, 0, EvapVapor },
+  { 0x33, 0, ByteA }, { 0x34, 0, Ratio }, { 0x3A, 1, RatioCurrent }, { 0x3C, 0, CatalystTemp }, { 0x42, 0, ModuleVolt },
+  { 0x43, 0, AbsoluteLoad }, { 0x44, 0, Ratio }, { 0x46, 0, Temperature }, { 0x4C, 0, Percent }, { 0x4D, 0, WordAB },
+  { 0x52, 0, Percent }, { 0x53, 0, EvapAbsolute }, { 0x54, 0, EvapWide }, { 0x55, 0, Trim }, { 0x58, 1, TrimB },
+  { 0x59, 0, WordAB10 }, { 0x5C, 0, Temperature }, { 0x5D, 0, InjectionTiming }, { 0x5E, 0, FuelRate },
+  { 0x61, 0, Torque }, { 0x64, 0, Torque },
+};
+
+static uint32_t CheckFormulas(void) {
+  uint32_t values = 0;
+
+  for (size_t f = 0; f < sizeof(FORMULAS) / sizeof(FORMULAS[0]); f++) {
+    const FormulaCheck* check = &FORMULAS[f];
+    ObdPidField field;
+    if (!ObdPidReadField(check->pid, check->index, &field)) {
+      Fail(check->pid, "no such value", "", "");
+      continue;
+    }
+    double unit = pow(10, -field.decimals);
+    uint32_t combinations = field.size == 2 ? 65536 : 256;
+    for (uint32_t raw = 0; raw < combinations; raw++) {
+      uint8_t data[OBD_PID_MAX_LENGTH] = { 0 };
+      if (field.size == 2) {
+        data[field.position] = (uint8_t)(raw >> 8);
+        data[field.position + 1] = (uint8_t)raw;
+      } else {
+        data[field.position] = (uint8_t)raw;
+      }
+      double expected = check->formula(data);
+      double value = ObdFieldValue(&field, data) * unit;
+      values++;
+      // Rounded to the last decimal: half a unit, plus the error of the decimal constant
+      if (fabs(value - expected) > unit * 0.5 + 1e-9) {
+        char got[24], reference[24];
+        snprintf(got, sizeof(got), "%.*f", field.decimals, value);
+        snprintf(reference, sizeof(reference), "%.6f", expected);
+        Fail(check->pid, field.name, got, reference);
+        break;
+      }
+    }
+  }
+  return values;
+}
+
+int main(void) {
+  printf("Table: %u rows of %u bytes (%u bytes of flash on the AVR)\n", (unsigned)OBD_PID_ROWS,
+         (unsigned)sizeof(ObdPidField), (unsigned)sizeof(OBD_PIDS));
+
+  CheckTable();
+  CheckVectors();
+  printf("Vectors: %u answers\n", (unsigned)(sizeof(VECTORS) / sizeof(VECTORS[0])));
+  uint32_t values = CheckFormulas();
+  printf("Formulas: %u values of %u PIDs against J1979\n", values, (unsigned)(sizeof(FORMULAS) / sizeof(FORMULAS[0])));
+
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+/*
+ * obd_poller_sim.c - Host simulation of the OBD-II poller against simulated ECUs
+ *
+ * A 500 kbit/s bus (one 8-byte frame every 250 us) carries the requests
+ * of obd_poller.h, the same code as the sketch, to two simulated ECUs:
+ *   ECU 0 (7E0/7E8)  engine, answers in 5-15 ms, 5 DTCs and the VIN
+ *   ECU 1 (7E1/7E9)  transmission, answers in 10-25 ms, oil temperature
+ *                    and pedal position only, no DTC, refuses Mode 09
+ * Both answer multi-PID requests with ISO-TP multi-frame messages and
+ * wait for the Flow Control as a real ECU does. loop() runs every 500 us.
+ *
+ * Every value is checked byte by byte (a wrong split of a multi-PID answer
+ * shows here), the VIN and DTC list must arrive complete, and no PID an
+ * ECU does not support may be asked to it. The samples per second are
+ * measured with one PID per request and with six, for the reader schedule
+ * and for every PID as often as possible, and once more with the engine
+ * ECU losing 5% of its answers.
+ *
+ * Build and run:
+ *   cc -O2 -I.. obd_poller_sim.c -o obd_poller_sim
+ *   ./obd_poller_sim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "obd_poller.h"
+
+#define SIM_SECONDS             60
+#define FRAME_US                250     // 8-byte standard frame at 500 kbit/s
+#define LOOP_US                 500
+#define QUEUE_SIZE              256
+#define ECUS                    2
+
+// Frame on the bus, ready at time us
+typedef struct {
+  uint64_t time;
+  uint16_t id;
+  uint8_t data[8];
+} SimFrame;
+
+typedef struct {
+  SimFrame frames[QUEUE_SIZE];
+  int count;
+} FrameQueue;
+
+// Simulated ECU
+typedef struct {
+  const uint8_t* pids;                  // Supported Mode 01 PIDs, 0-terminated
+  uint32_t minDelayUs;
+  uint32_t maxDelayUs;
+  int dropPercent;                      // Answers lost
+  const uint16_t* dtcs;
+  uint8_t dtcCount;
+  const char* vin;                      // NULL: Mode 09 refused
+  uint8_t message[64];                  // Answer being sent in several frames
+  uint8_t length;
+  uint8_t sent;
+  uint8_t sequence;
+  bool waitingFlowControl;
+  uint64_t busyUntil;
+  uint32_t unsupportedAsked;
+} SimEcu;
+
+static const uint8_t ENGINE_PIDS[] = { 0x04, 0x05, 0x06, 0x07, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11,
+                                       0x1F, 0x2F, 0x33, 0x42, 0 };
+static const uint8_t TRANSMISSION_PIDS[] = { 0x49, 0x5C, 0 };
+static const uint16_t ENGINE_DTCS[] = { 0x0301, 0x0171, 0x4035, 0xC100, 0x0420 };
+static const char ENGINE_VIN[] = "1HGCM82633A004352";
+
+static SimEcu ecus[ECUS];
+static FrameQueue toBus;                // Frames waiting for the bus, in order
+static FrameQueue toReader;             // Frames received by the MCP2515, read by the next loop()
+static uint64_t busFree;
+static uint64_t now;
+static ObdPoller poller;
+static uint32_t failures;
+static uint32_t pidSamples[0x61];
+static char vin[18];
+static uint8_t vinLength;
+static uint16_t dtcs[8];
+static uint8_t dtcCount;
+
+static void Fail(const char* message, long value) {
+  if (failures++ < 20) {
+    printf("FAIL %s (%ld)\n", message, value);
+  }
+}
+
+static void Queue(FrameQueue* queue, uint64_t time, uint16_t id, const uint8_t* data) {
+  if (queue->count == QUEUE_SIZE) {
+    Fail("queue full", id);
+    return;
+  }
+  SimFrame* frame = &queue->frames[queue->count++];
+  frame->time = time;
+  frame->id = id;
+  memcpy(frame->data, data, 8);
+}
+
+static uint32_t Random(uint32_t low, uint32_t high) {
+  return low + (uint32_t)rand() % (high - low + 1);
+}
+
+static bool Supports(const SimEcu* ecu, uint8_t pid) {
+  if ((pid & 0x1F) == 0) {
+    return pid <= 0x40;
+  }
+  for (const uint8_t* p = ecu->pids; *p != 0; p++) {
+    if (*p == pid) return true;
+  }
+  return false;
+}
+
+// Value bytes an ECU sends for a PID, the handler checks them
+static uint8_t ValueByte(uint8_t ecu, uint8_t pid, uint8_t index) {
+  return (uint8_t)(pid ^ (index * 0x11) ^ (ecu << 5));
+}
+
+// Supported-PID bitmap of a range
+static void Bitmap(const SimEcu* ecu, uint8_t range, uint8_t* out) {
+  memset(out, 0, 4);
+  for (uint8_t bit = 0; bit < 32; bit++) {
+    uint8_t pid = range + bit + 1;
+    if (Supports(ecu, pid)) {
+      out[bit >> 3] |= 0x80 >> (bit & 7);
+    }
+  }
+}
+
+// Starts sending an answer: Single Frame, or First Frame and wait for the Flow Control
+static void Answer(uint8_t index, const uint8_t* message, uint8_t length, uint64_t at) {
+  SimEcu* ecu = &ecus[index];
+  uint8_t frame[8];
+  uint16_t id = OBD_RESPONSE_ID + index;
+
+  memset(frame, 0xAA, 8);
+  if (length <= 7) {
+    frame[0] = length;
+    memcpy(frame + 1, message, length);
+    Queue(&toBus, at, id, frame);
+    return;
+  }
+  memcpy(ecu->message, message, length);
+  ecu->length = length;
+  ecu->sent = 6;
+  ecu->sequence = 1;
+  ecu->waitingFlowControl = true;
+  frame[0] = 0x10;
+  frame[1] = length;
+  memcpy(frame + 2, message, 6);
+  Queue(&toBus, at, id, frame);
+}
+
+// Request received by an ECU at the end of its frame
+static void EcuRequest(uint8_t index, const uint8_t* data, bool functional) {
+  SimEcu* ecu = &ecus[index];
+  uint8_t message[64];
+  uint8_t length = 0;
+  uint64_t at = now + Random(ecu->minDelayUs, ecu->maxDelayUs);
+
+  // Flow Control of an answer in several frames: send the rest with no separation
+  if ((data[0] >> 4) == 0x3) {
+    if (functional || !ecu->waitingFlowControl) return;
+    ecu->waitingFlowControl = false;
+    at = now + 100;
+    while (ecu->sent < ecu->length) {
+      uint8_t frame[8];
+      memset(frame, 0xAA, 8);
+      frame[0] = 0x20 | ecu->sequence;
+      uint8_t count = ecu->length - ecu->sent < 7 ? ecu->length - ecu->sent : 7;
+      memcpy(frame + 1, ecu->message + ecu->sent, count);
+      ecu->sent += count;
+      ecu->sequence = (ecu->sequence + 1) & 0x0F;
+      Queue(&toBus, at, OBD_RESPONSE_ID + index, frame);
+      at += 50;
+    }
+    return;
+  }
+  if ((data[0] >> 4) != 0 || (data[0] & 0x0F) == 0 || now < ecu->busyUntil) {
+    return;
+  }
+  if (ecu->dropPercent > 0 && (int)Random(0, 99) < ecu->dropPercent) {
+    return;
+  }
+  uint8_t count = data[0] & 0x0F;
+  uint8_t service = data[1];
+
+  if (service == 0x01) {
+    message[length++] = 0x41;
+    for (uint8_t i = 2; i <= count; i++) {
+      uint8_t pid = data[i];
+      if (!Supports(ecu, pid)) {
+        if (!functional) ecu->unsupportedAsked++;
+        continue;
+      }
+      message[length++] = pid;
+      if ((pid & 0x1F) == 0) {
+        Bitmap(ecu, pid, message + length);
+        length += 4;
+      } else {
+        for (uint8_t k = 0; k < ObdPidLength(pid); k++) {
+          message[length++] = ValueByte(index, pid, k);
+        }
+      }
+    }
+    if (length == 1) return;            // Nothing supported: no answer
+  } else if (service == 0x03) {
+    message[length++] = 0x43;
+    message[length++] = ecu->dtcCount;
+    for (uint8_t i = 0; i < ecu->dtcCount; i++) {
+      message[length++] = (uint8_t)(ecu->dtcs[i] >> 8);
+      message[length++] = (uint8_t)ecu->dtcs[i];
+    }
+  } else if (service == 0x09 && data[2] == 0x02 && ecu->vin != NULL) {
+    message[length++] = 0x49;
+    message[length++] = 0x02;
+    message[length++] = 0x01;
+    memcpy(message + length, ecu->vin, 17);
+    length += 17;
+  } else {
+    message[length++] = 0x7F;           // Service not supported
+    message[length++] = service;
+    message[length++] = 0x11;
+  }
+  ecu->busyUntil = at;
+  Answer(index, message, length, at);
+}
+
+// Moves frames over the bus, one at a time in the order they were queued
+static void RunBus(void) {
+  while (toBus.count > 0) {
+    int first = 0;
+    for (int i = 1; i < toBus.count; i++) {
+      if (toBus.frames[i].time < toBus.frames[first].time) first = i;
+    }
+    SimFrame frame = toBus.frames[first];
+    uint64_t start = frame.time > busFree ? frame.time : busFree;
+    if (start + FRAME_US > now) {
+      return;
+    }
+    toBus.frames[first] = toBus.frames[--toBus.count];
+    busFree = start + FRAME_US;
+
+    uint64_t saved = now;
+    now = busFree;
+    if (frame.id == OBD_FUNCTIONAL_ID) {
+      for (uint8_t i = 0; i < ECUS; i++) EcuRequest(i, frame.data, true);
+    } else if (frame.id >= OBD_REQUEST_ID && frame.id < OBD_REQUEST_ID + ECUS) {
+      EcuRequest(frame.id - OBD_REQUEST_ID, frame.data, false);
+    } else {
+      Queue(&toReader, busFree, frame.id, frame.data);
+    }
+    now = saved;
+  }
+}
+
+static bool SendFrame(uint16_t id, const uint8_t* data) {
+  Queue(&toBus, now, id, data);
+  return true;
+}
+
+static void Value(uint8_t ecu, uint8_t pid, const uint8_t* data, uint8_t len) {
+  if (len != ObdPidLength(pid)) {
+    Fail("value length", pid);
+  }
+  for (uint8_t k = 0; k < len; k++) {
+    if (data[k] != ValueByte(ecu, pid, k)) {
+      Fail("value byte", pid);
+      break;
+    }
+  }
+  pidSamples[pid]++;
+}
+
+static void Dtc(uint8_t ecu, uint16_t code) {
+  (void)ecu;
+  if (dtcCount < 8) dtcs[dtcCount++] = code;
+}
+
+static void Vin(uint8_t ecu, uint8_t index, char c) {
+  (void)ecu;
+  if (index < 17) {
+    vin[index] = c;
+    vinLength = index + 1;
+  }
+}
+
+// Runs the poller for a while, returns scheduled samples per second
+static double Run(const ObdSchedule* schedule, uint8_t count, uint8_t maxPids, int dropPercent, bool report) {
+  const ObdHandlers handlers = { SendFrame, Value, Dtc, Vin };
+  const uint64_t end = (uint64_t)SIM_SECONDS * 1000000;
+  uint64_t nextLoop = 0;
+
+  memset(ecus, 0, sizeof(ecus));
+  ecus[0] = (SimEcu){ .pids = ENGINE_PIDS, .minDelayUs = 5000, .maxDelayUs = 15000, .dropPercent = dropPercent,
+                      .dtcs = ENGINE_DTCS, .dtcCount = 5, .vin = ENGINE_VIN };
+  ecus[1] = (SimEcu){ .pids = TRANSMISSION_PIDS, .minDelayUs = 10000, .maxDelayUs = 25000 };
+  toBus.count = toReader.count = 0;
+  busFree = now = 0;
+  memset(pidSamples, 0, sizeof(pidSamples));
+  dtcCount = vinLength = 0;
+
+  ObdPollerStart(&poller, schedule, count, &handlers, 0);
+  poller.maxPids = maxPids;
+  for (now = 0; now < end; now += 50) {
+    RunBus();
+    if (now < nextLoop) {
+      continue;
+    }
+    nextLoop = now + LOOP_US;
+
+    // loop(): frames received, then the poller
+    uint16_t ms = (uint16_t)(now / 1000);
+    for (int i = 0; i < toReader.count; i++) {
+      ObdPollerReceive(&poller, toReader.frames[i].id, 8, toReader.frames[i].data, ms);
+    }
+    toReader.count = 0;
+    if (report && now == 30000000) {
+      ObdPollerDemand(&poller, 0x03, 0);
+    } else if (report && now == 31000000) {
+      ObdPollerDemand(&poller, 0x09, 0x02);
+    }
+    ObdPollerRun(&poller, ms);
+  }
+
+  for (uint8_t i = 0; i < ECUS; i++) {
+    if (ecus[i].unsupportedAsked > 0) {
+      Fail("unsupported PID asked", ecus[i].unsupportedAsked);
+    }
+  }
+  if (poller.present != 0x03) {
+    Fail("ECUs found", poller.present);
+  }
+  return (double)poller.samples / SIM_SECONDS;
+}
+
+int main(void) {
+  static ObdSchedule fastest[16];
+  const uint8_t count = sizeof(OBD_SCHEDULE) / sizeof(OBD_SCHEDULE[0]);
+  double demanded = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    demanded += 1000.0 / OBD_SCHEDULE[i].periodMs;
+    fastest[i].pid = OBD_SCHEDULE[i].pid;
+    fastest[i].periodMs = 0;
+  }
+  srand(1);
+  printf("Old diagnostic mode: one PID every 500 ms, 2.0 samples/s, PIDs 00-1F without checking support\n");
+
+  // Reader schedule, six PIDs per request, with DTC and VIN asked halfway
+  double rate = Run(OBD_SCHEDULE, count, OBD_MAX_PIDS, 0, true);
+  printf("Schedule, 6 PIDs/request:  %6.1f samples/s of %.1f demanded, %u requests, %u timeouts, %u negative, %u errors\n",
+         rate, demanded, poller.requests, poller.timeouts, poller.negative, poller.errors);
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t pid = OBD_SCHEDULE[i].pid;
+    double achieved = (double)pidSamples[pid] / SIM_SECONDS;
+    double wanted = 1000.0 / OBD_SCHEDULE[i].periodMs;
+    printf("  PID %02X ECU %u every %4u ms: %5.1f/s\n", pid, poller.pids[i].ecu, OBD_SCHEDULE[i].periodMs, achieved);
+    if (achieved < wanted * 0.9) {
+      Fail("PID below its rate", pid);
+    }
+  }
+  vin[vinLength] = '\0';
+  printf("  VIN %s, DTCs:", vin);
+  for (uint8_t i = 0; i < dtcCount; i++) {
+    char text[6];
+    ObdFormatDtc(dtcs[i], text);
+    printf(" %s", text);
+  }
+  printf("\n");
+  if (strcmp(vin, ENGINE_VIN) != 0) {
+    Fail("VIN", vinLength);
+  }
+  if (dtcCount != 5 || memcmp(dtcs, ENGINE_DTCS, sizeof(ENGINE_DTCS)) != 0) {
+    Fail("DTC list", dtcCount);
+  }
+  if (poller.negative != 1 || poller.errors != 0 || poller.timeouts != 0) {
+    Fail("negative answers, errors or timeouts", (long)(poller.negative + poller.errors + poller.timeouts));
+  }
+
+  rate = Run(OBD_SCHEDULE, count, 1, 0, false);
+  printf("Schedule, 1 PID/request:   %6.1f samples/s of %.1f demanded\n", rate, demanded);
+  rate = Run(fastest, count, 1, 0, false);
+  printf("Fastest, 1 PID/request:    %6.1f samples/s, %u requests\n", rate, poller.requests);
+  double fastestRate = Run(fastest, count, OBD_MAX_PIDS, 0, false);
+  printf("Fastest, 6 PIDs/request:   %6.1f samples/s, %u requests\n", fastestRate, poller.requests);
+  if (fastestRate < 2 * rate) {
+    Fail("multi-PID requests not faster", (long)fastestRate);
+  }
+  rate = Run(OBD_SCHEDULE, count, OBD_MAX_PIDS, 5, false);
+  printf("Schedule, 5%% answers lost: %6.1f samples/s, %u timeouts, %u errors\n", rate, poller.timeouts,
+         poller.errors);
+  if (poller.timeouts == 0 || rate < demanded * 0.8) {
+    Fail("recovery from lost answers", (long)rate);
+  }
+
+  printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -2,11 +2,26 @@
  * INJECTOR PULSER
  * 
  * This program simulates pulse signals for 4 fuel injectors
- * using different firing orders common in 4-cylinder engines.
+ * using the firing orders of common 3 and 4-cylinder engines, or any
+ * order typed over the serial port, with sequential, batch or
+ * simultaneous injection. Each firing order is turned once into a table
+ * of injection events (crank angle and injectors that open), the same
+ * way as the ESP32 pulser, which also drives 5, 6 and 8-cylinder engines.
  * 
  * The pulse speed is controlled by a potentiometer connected
  * to an analog input, simulating the throttle position.
  * 
+ * Cleaning and flow matching programs can be loaded over the serial
+ * port. They are timed by the Timer1 compare interrupt, which switches
+ * all the selected injectors with a single port write, and nothing is
+ * printed until the program has finished.
+ * 
+ * The firing order sequence does not print anything per pulse either: it
+ * counts the pulses of each injector and the measured time between them,
+ * and a summary is written at the rate selected with the 'status' command,
+ * one field at a time and only when it fits in the serial transmit
+ * buffer, so the serial port never delays an injection.
+ * 
  * Repository: https://github.com/edgarefraindp/AutomotiveGuide_es
  * For support or donations: Please visit the GitHub repository page
  * 
@@ -31,20 +46,129 @@
 #define MIN_CYCLE_TIME    20    // Minimum time between cycles in ms (maximum RPM)
 #define MAX_CYCLE_TIME    200   // Maximum time between cycles in ms (minimum RPM)
 
-// FIRING ORDERS FOR 4-CYLINDER ENGINES
-// Each order is an array with the sequence of injectors that the system should activate
-const byte ORDER_1342[] = {0, 2, 3, 1}; // Order 1-3-4-2 (common in many inline 4-cylinder engines)
-const byte ORDER_1243[] = {0, 1, 3, 2}; // Order 1-2-4-3 (some European engines)
-const byte ORDER_1324[] = {0, 2, 1, 3}; // Order 1-3-2-4 (some Japanese engines)
+// FIRING ORDERS
+#define MAX_CYLINDERS     4     // One cylinder per injector output
+#define CYCLE_DEGREES     720   // One engine cycle, two turns of the crankshaft
+
+// Engine with evenly spaced firing, cylinders numbered from 1
+struct EngineLayout {
+  const char* name;
+  byte cylinders;
+  byte order[MAX_CYLINDERS];
+};
+
+// Engines the button rotates through
+const EngineLayout ENGINE_LAYOUTS[] = {
+  {"Inline 4", 4, {1, 3, 4, 2}},   // Common in many inline 4-cylinder engines
+  {"Inline 4", 4, {1, 2, 4, 3}},   // Some European engines
+  {"Inline 4", 4, {1, 3, 2, 4}},   // Some Japanese engines
+  {"Inline 3", 3, {1, 2, 3}},
+};
+const byte ENGINE_LAYOUT_COUNT = sizeof(ENGINE_LAYOUTS) / sizeof(ENGINE_LAYOUTS[0]);
+
+// How the injectors are grouped
+#define INJECTION_SEQUENTIAL    0   // One injector per cylinder, in firing order
+#define INJECTION_BATCH         1   // Two halves of the firing order, 360 degrees apart
+#define INJECTION_SIMULTANEOUS  2   // Every injector at once, every turn of the crankshaft
+#define INJECTION_MODE_COUNT    3
+const char* const MODE_NAMES[INJECTION_MODE_COUNT] = {"sequential", "batch", "simultaneous"};
+
+// Injectors opened together at one angle of the cycle
+struct FiringEvent {
+  unsigned int angle;           // Degrees from the start of the cycle (0-719)
+  byte mask;                    // Injectors opened (bit 0 is injector 1)
+};
 
 // Global variables
-byte currentOrder = 0;          // 0=1342, 1=1243, 2=1324
-byte currentPosition = 0;       // Current position in the sequence (0-3)
+EngineLayout engine = ENGINE_LAYOUTS[0];   // Current engine, a copy so a typed order fits too
+byte engineIndex = 0;           // Engine of ENGINE_LAYOUTS selected by the button
+byte injectionMode = INJECTION_SEQUENTIAL;
+FiringEvent firingEvents[MAX_CYLINDERS];   // Events of one cycle, sorted by angle
+byte eventCount = 0;
+byte currentPosition = 0;       // Next event of the cycle
 unsigned long previousTime = 0; // For time control
 int pulseWidth = 5;             // Initial pulse width in ms
-int cycleTime = 100;            // Initial time between cycles in ms
+int cycleTime = 100;            // Initial time between two firings in ms
 boolean orderChanged = false;   // Flag to detect order change
 
+// STATUS SUMMARY
+#define STATUS_INTERVAL     1000  // Initial time between summaries in ms
+
+unsigned int statusInterval = STATUS_INTERVAL;   // 0 turns the summaries off
+unsigned long lastStatusTime = 0;
+unsigned int injectorPulses[4];   // Pulses since the last summary
+unsigned long lastActivationUs = 0;
+unsigned long minCycleUs = 0xFFFFFFFF;   // Shortest measured time between two injections
+unsigned long maxCycleUs = 0;
+byte statusField = 0;             // Next field of the summary being written, 0 when none
+
+// Copy of the counters the summary being written is made of
+unsigned int reportPulses[4];
+unsigned long reportMinCycleUs;
+unsigned long reportMaxCycleUs;
+int reportCycleTime;
+int reportPulseWidth;
+
+// TEST PROGRAMS
+#define MAX_STEPS           8     // Steps of a program
+#define MAX_DEADTIME_POINTS 6     // Points of the dead time table
+#define MIN_PROGRAM_PULSE   100   // Shortest electrical pulse of a program in us
+#define MIN_OFF_TIME        500   // Shortest closed time between two pulses in us
+#define TICKS_PER_US        2     // Timer1 with prescaler 8 counts every 0.5 us
+
+// Injector pins 9-12 are bits 1-4 of PORTB on the Arduino Uno
+const byte INJECTOR_PORT_BITS[] = {_BV(PB1), _BV(PB2), _BV(PB3), _BV(PB4)};
+
+// One step: count pulses on every selected injector at the same time
+struct ProgramStep {
+  unsigned long count;
+  unsigned long periodUs;       // Time between the openings of two pulses
+  unsigned long pulseUs;        // Fuel pulse without dead time (first pulse of a sweep)
+  unsigned long endPulseUs;     // Fuel pulse of the last pulse (same as pulseUs if not a sweep)
+};
+
+// Injector dead time at one supply voltage
+struct DeadTimePoint {
+  unsigned int millivolts;
+  unsigned int deadTimeUs;
+};
+
+ProgramStep programSteps[MAX_STEPS];
+byte stepCount = 0;
+DeadTimePoint deadTimeTable[MAX_DEADTIME_POINTS];    // Sorted by voltage
+byte deadTimePoints = 0;
+unsigned int supplyMv = 13500;  // Injector supply voltage, selects the dead time
+byte programChannels = 0x0F;    // Injectors driven by the program (bit per injector)
+
+// The firing order sequence stays off after a program until 'engine' is sent
+boolean sequenceEnabled = true;
+
+// Results, written by the Timer1 interrupt
+volatile boolean programRunning = false;
+volatile boolean programFinished = false;
+volatile unsigned long programPulses = 0;    // Pulses delivered
+volatile unsigned long programOnTicks = 0;   // Sum of the measured pulse widths in timer ticks
+volatile unsigned int maxLatencyTicks = 0;   // Longest delay of an edge after its time
+
+// State of the running program, only used by the Timer1 interrupt once started
+byte runStep;
+unsigned long runPulse;
+unsigned long pulseTicks;       // Electrical width of the current pulse
+unsigned long periodTicks;
+unsigned long deadTicks;
+unsigned long sweepStep;        // Change of the pulse width from one pulse to the next
+unsigned long sweepRemainder;
+unsigned long sweepError;
+boolean sweepDown;
+boolean injectorsOpen;
+unsigned long waitTicks;        // Ticks still to wait before the next edge
+unsigned int openLatency;
+byte programPortMask;
+
+// Serial command line
+char commandLine[40];
+byte commandLength = 0;
+
 void setup() {
   // It is necessary to configure output pins (injectors)
   pinMode(PIN_INJECTOR_1, OUTPUT);
@@ -66,10 +190,29 @@ void setup() {
   Serial.begin(9600);
   Serial.println("Injector Pulse Simulator");
   Serial.println("------------------------");
+  Serial.println("Type 'help' for the test program commands");
+  BuildFiringEvents();
   PrintCurrentOrder();
 }
 
 void loop() {
+  // Program commands are read from the serial port
+  ReadCommands();
+  
+  // The summary is written a little on every pass, never waiting for the serial port
+  WriteStatus();
+  
+  // The results are shown once the interrupt has closed the last pulse
+  if (programFinished) {
+    programFinished = false;
+    PrintReport();
+  }
+  
+  // The Timer1 interrupt drives the injectors while a program runs
+  if (programRunning || !sequenceEnabled) {
+    return;
+  }
+  
   // The system must read the potentiometer and adjust cycle time and pulse width
   int throttleValue = analogRead(PIN_THROTTLE);
   
@@ -83,7 +226,9 @@ void loop() {
   // The system checks if the button was pressed to change order
   if (digitalRead(PIN_ORDER_BUTTON) == LOW && !orderChanged) {
     orderChanged = true;
-    currentOrder = (currentOrder + 1) % 3; // The system rotates among the 3 orders
+    engineIndex = (engineIndex + 1) % ENGINE_LAYOUT_COUNT; // The system rotates among the engines
+    engine = ENGINE_LAYOUTS[engineIndex];
+    BuildFiringEvents();
     PrintCurrentOrder();
   }
   
@@ -93,14 +238,92 @@ void loop() {
   }
   
   // Time control is performed for the injection sequence
+  // cycleTime is the time between two firings, so the engine cycle lasts one per cylinder
+  unsigned long eventTime = (unsigned long)cycleTime * engine.cylinders * EventGap(currentPosition) / CYCLE_DEGREES;
   unsigned long currentTime = millis();
-  if (currentTime - previousTime >= cycleTime) {
+  if (currentTime - previousTime >= eventTime) {
     previousTime = currentTime;
     ActivateNextInjector();
   }
 }
 
-// Activates the next injector in the sequence according to selected order
+// Builds the injection events of one cycle for the current engine and mode
+void BuildFiringEvents() {
+  byte n = engine.cylinders;
+  
+  for (byte i = 0; i < MAX_CYLINDERS; i++) {
+    firingEvents[i].angle = 0;
+    firingEvents[i].mask = 0;
+  }
+  
+  if (injectionMode == INJECTION_SEQUENTIAL) {
+    for (byte i = 0; i < n; i++) {
+      firingEvents[i].angle = (unsigned long)CYCLE_DEGREES * i / n;
+      firingEvents[i].mask = 1 << (engine.order[i] - 1);
+    }
+    eventCount = n;
+  } else if (injectionMode == INJECTION_BATCH) {
+    // With an odd number of cylinders the first half gets the extra one
+    for (byte i = 0; i < n; i++) {
+      firingEvents[i < (n + 1) / 2 ? 0 : 1].mask |= 1 << (engine.order[i] - 1);
+    }
+    firingEvents[1].angle = CYCLE_DEGREES / 2;
+    eventCount = 2;
+  } else {
+    firingEvents[0].mask = (1 << n) - 1;
+    firingEvents[1].angle = CYCLE_DEGREES / 2;
+    firingEvents[1].mask = firingEvents[0].mask;
+    eventCount = 2;
+  }
+  
+  // The new sequence starts from the first event with every injector closed
+  digitalWrite(PIN_INJECTOR_1, LOW);
+  digitalWrite(PIN_INJECTOR_2, LOW);
+  digitalWrite(PIN_INJECTOR_3, LOW);
+  digitalWrite(PIN_INJECTOR_4, LOW);
+  currentPosition = 0;
+  lastActivationUs = 0;
+}
+
+// Degrees from the event before a position of the cycle to that position
+unsigned int EventGap(byte position) {
+  unsigned int previous = firingEvents[position == 0 ? eventCount - 1 : position - 1].angle;
+  unsigned int angle = firingEvents[position].angle;
+  return angle > previous ? angle - previous : angle + CYCLE_DEGREES - previous;
+}
+
+// Reads an order such as "1-3-4-2", every cylinder exactly once
+boolean ParseOrder(const char* text) {
+  EngineLayout parsed = {"Custom", 0, {0}};
+  byte seen = 0;
+  
+  while (*text != '\0') {
+    if (*text < '1' || *text > '0' + MAX_CYLINDERS || parsed.cylinders >= MAX_CYLINDERS) {
+      return false;
+    }
+    parsed.order[parsed.cylinders++] = *text++ - '0';
+    if (*text == '-' && text[1] != '\0') {
+      text++;
+    } else if (*text != '\0') {
+      return false;
+    }
+  }
+  for (byte i = 0; i < parsed.cylinders; i++) {
+    byte bit = 1 << (parsed.order[i] - 1);
+    if (parsed.order[i] > parsed.cylinders || (seen & bit)) {
+      return false;
+    }
+    seen |= bit;
+  }
+  // Batch injection needs a cylinder in each half of the cycle
+  if (parsed.cylinders < 2) {
+    return false;
+  }
+  engine = parsed;
+  return true;
+}
+
+// Activates the injectors of the next event of the cycle
 void ActivateNextInjector() {
   // The system must turn off all injectors first
   digitalWrite(PIN_INJECTOR_1, LOW);
@@ -108,75 +331,488 @@ void ActivateNextInjector() {
   digitalWrite(PIN_INJECTOR_3, LOW);
   digitalWrite(PIN_INJECTOR_4, LOW);
   
-  // It is necessary to determine which injector to activate based on current order
-  byte injector = 0;
-  
-  switch(currentOrder) {
-    case 0: // Order 1-3-4-2
-      injector = ORDER_1342[currentPosition];
-      break;
-    case 1: // Order 1-2-4-3
-      injector = ORDER_1243[currentPosition];
-      break;
-    case 2: // Order 1-3-2-4
-      injector = ORDER_1324[currentPosition];
-      break;
+  // The injectors of the event open together with a single port write
+  byte mask = firingEvents[currentPosition].mask;
+  byte portBits = 0;
+  for (byte i = 0; i < 4; i++) {
+    if (mask & (1 << i)) {
+      portBits |= INJECTOR_PORT_BITS[i];
+    }
   }
-  
-  // The corresponding injector is activated
-  ActivateInjector(injector);
+  PORTB |= portBits;
   
   // It is recommended to blink the status LED for visualization
   digitalWrite(PIN_STATUS_LED, HIGH);
   
-  // The system advances to the next position in the sequence
-  currentPosition = (currentPosition + 1) % 4;
+  // The system advances to the next event of the cycle
+  currentPosition = (currentPosition + 1) % eventCount;
   
-  // Information is shown on the serial monitor
-  Serial.print("Injector: ");
-  Serial.print(injector + 1); // +1 to show 1-4 instead of 0-3
-  Serial.print(" | Cycle: ");
-  Serial.print(cycleTime);
-  Serial.print("ms | Pulse: ");
-  Serial.print(pulseWidth);
-  Serial.println("ms");
+  // Only counters are updated here, the summary is written by WriteStatus
+  unsigned long now = micros();
+  if (lastActivationUs != 0) {
+    unsigned long measured = now - lastActivationUs;
+    minCycleUs = min(minCycleUs, measured);
+    maxCycleUs = max(maxCycleUs, measured);
+  }
+  lastActivationUs = now;
+  for (byte i = 0; i < 4; i++) {
+    if (mask & (1 << i)) {
+      injectorPulses[i]++;
+    }
+  }
   
   // It is necessary to turn off the LED after pulse time
   delay(pulseWidth);
   digitalWrite(PIN_STATUS_LED, LOW);
 }
 
-// Activates a specific injector
-void ActivateInjector(byte injectorNum) {
-  switch(injectorNum) {
-    case 0:
-      digitalWrite(PIN_INJECTOR_1, HIGH);
-      break;
-    case 1:
-      digitalWrite(PIN_INJECTOR_2, HIGH);
-      break;
-    case 2:
-      digitalWrite(PIN_INJECTOR_3, HIGH);
-      break;
-    case 3:
-      digitalWrite(PIN_INJECTOR_4, HIGH);
-      break;
+// Writes the next field of the status summary if it fits in the serial transmit buffer
+void WriteStatus() {
+  char field[40];
+  
+  if (statusField == 0) {
+    if (statusInterval == 0 || !sequenceEnabled || programRunning || millis() - lastStatusTime < statusInterval) {
+      return;
+    }
+    lastStatusTime = millis();
+    
+    // The counters are copied and cleared at once, the next interval starts now
+    for (byte i = 0; i < 4; i++) {
+      reportPulses[i] = injectorPulses[i];
+      injectorPulses[i] = 0;
+    }
+    reportMinCycleUs = minCycleUs;
+    reportMaxCycleUs = maxCycleUs;
+    minCycleUs = 0xFFFFFFFF;
+    maxCycleUs = 0;
+    reportCycleTime = cycleTime;
+    reportPulseWidth = pulseWidth;
+    statusField = 1;
+  }
+  
+  if (statusField == 1) {
+    snprintf(field, sizeof(field), "Cycle: %d ms | Pulse: %d ms", reportCycleTime, reportPulseWidth);
+  } else if (statusField <= 5) {
+    snprintf(field, sizeof(field), " | Inj %d: %u", statusField - 1, reportPulses[statusField - 2]);
+  } else if (reportMaxCycleUs > 0) {
+    snprintf(field, sizeof(field), " | Measured: %lu-%lu us\r\n", reportMinCycleUs, reportMaxCycleUs);
+  } else {
+    snprintf(field, sizeof(field), "\r\n");
   }
+  
+  // A field that does not fit yet is tried again on the next pass
+  if (Serial.availableForWrite() < (int)strlen(field)) {
+    return;
+  }
+  Serial.print(field);
+  statusField = statusField >= 6 ? 0 : statusField + 1;
 }
 
-// Shows the current firing order in the serial monitor
+// Shows the current engine, firing order and injection mode in the serial monitor
 void PrintCurrentOrder() {
-  Serial.print("Firing order: ");
-  
-  switch(currentOrder) {
-    case 0:
-      Serial.println("1-3-4-2");
-      break;
-    case 1:
-      Serial.println("1-2-4-3");
-      break;
-    case 2:
-      Serial.println("1-3-2-4");
-      break;
-  }
-}
\ No newline at end of file
+  Serial.print("Engine: ");
+  Serial.print(engine.name);
+  Serial.print(" | Firing order: ");
+  for (byte i = 0; i < engine.cylinders; i++) {
+    if (i > 0) {
+      Serial.print("-");
+    }
+    Serial.print(engine.order[i]);
+  }
+  Serial.print(" | Mode: ");
+  Serial.println(MODE_NAMES[injectionMode]);
+}
+
+// Reads the serial port without waiting and runs every complete line
+void ReadCommands() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (commandLength > 0) {
+        commandLine[commandLength] = '\0';
+        ProcessCommand(commandLine);
+        commandLength = 0;
+      }
+    } else if (commandLength < sizeof(commandLine) - 1) {
+      commandLine[commandLength++] = c;
+    }
+  }
+}
+
+// Runs one test program command
+void ProcessCommand(char* command) {
+  unsigned long a, b, c, d;
+  char channels[5];
+  
+  if (strcmp(command, "help") == 0) {
+    Serial.println("pulses N WIDTH_US FREQ_HZ   - N pulses of WIDTH_US at FREQ_HZ");
+    Serial.println("sweep N START% END% FREQ_HZ - N pulses, duty from START% to END%");
+    Serial.println("deadtime MV US              - Injector dead time at MV millivolts");
+    Serial.println("supply MV                   - Injector supply voltage");
+    Serial.println("channels 1234               - Injectors driven by the program");
+    Serial.println("status MS                   - Time between status summaries, 0 turns them off");
+    Serial.println("order 1-3-4-2               - Firing order of up to 4 cylinders");
+    Serial.println("mode NAME                   - sequential, batch or simultaneous injection");
+    Serial.println("clear | list | run | stop | report | engine");
+    return;
+  }
+  if (strcmp(command, "engine") == 0) {
+    StopProgram();
+    sequenceEnabled = true;
+    lastActivationUs = 0;
+    PrintCurrentOrder();
+    return;
+  }
+  if (strcmp(command, "stop") == 0) {
+    StopProgram();
+    sequenceEnabled = false;
+    Serial.println("Stopped");
+    return;
+  }
+  if (sscanf(command, "status %lu", &a) == 1) {
+    statusInterval = a;
+    Serial.println(a > 0 ? "OK" : "Status summaries off");
+    return;
+  }
+  if (strcmp(command, "report") == 0) {
+    PrintReport();
+    return;
+  }
+  if (strcmp(command, "list") == 0) {
+    PrintProgram();
+    return;
+  }
+  
+  // The program cannot change under the interrupt
+  if (programRunning) {
+    Serial.println("Program running, send 'stop' first");
+    return;
+  }
+  
+  if (strcmp(command, "run") == 0) {
+    StartProgram();
+  } else if (strncmp(command, "order ", 6) == 0) {
+    SelectOrder(command + 6);
+  } else if (strncmp(command, "mode ", 5) == 0) {
+    SelectMode(command + 5);
+  } else if (strcmp(command, "clear") == 0) {
+    stepCount = 0;
+    deadTimePoints = 0;
+    Serial.println("Program cleared");
+  } else if (sscanf(command, "pulses %lu %lu %lu", &a, &b, &c) == 3) {
+    AddStep(a, b, b, c);
+  } else if (sscanf(command, "sweep %lu %lu %lu %lu", &a, &b, &c, &d) == 4) {
+    // The duty is turned into pulse widths of the step period
+    if (d > 0 && b <= 100 && c <= 100) {
+      AddStep(a, 1000000UL / d * b / 100, 1000000UL / d * c / 100, d);
+    } else {
+      Serial.println("Step rejected");
+    }
+  } else if (sscanf(command, "deadtime %lu %lu", &a, &b) == 2) {
+    SetDeadTime(a, b);
+  } else if (sscanf(command, "supply %lu", &a) == 1) {
+    supplyMv = a;
+    Serial.print("Dead time: ");
+    Serial.print(DeadTime());
+    Serial.println(" us");
+  } else if (sscanf(command, "channels %4s", channels) == 1) {
+    programChannels = 0;
+    for (byte i = 0; channels[i] != '\0'; i++) {
+      if (channels[i] >= '1' && channels[i] <= '4') {
+        programChannels |= 1 << (channels[i] - '1');
+      }
+    }
+    Serial.println(programChannels != 0 ? "OK" : "No channel selected");
+  } else {
+    Serial.println("Unknown command, type 'help'");
+  }
+}
+
+// Selects a firing order typed over the serial port
+void SelectOrder(const char* text) {
+  if (!ParseOrder(text)) {
+    Serial.println("Invalid firing order");
+    return;
+  }
+  BuildFiringEvents();
+  PrintCurrentOrder();
+}
+
+// Selects the injection mode by name
+void SelectMode(const char* name) {
+  for (byte i = 0; i < INJECTION_MODE_COUNT; i++) {
+    if (strcmp(name, MODE_NAMES[i]) == 0) {
+      injectionMode = i;
+      BuildFiringEvents();
+      PrintCurrentOrder();
+      return;
+    }
+  }
+  Serial.println("Unknown mode");
+}
+
+// Appends a step to the program
+void AddStep(unsigned long count, unsigned long pulseUs, unsigned long endPulseUs, unsigned long frequencyHz) {
+  if (stepCount >= MAX_STEPS || count == 0 || frequencyHz == 0) {
+    Serial.println("Step rejected");
+    return;
+  }
+  programSteps[stepCount].count = count;
+  programSteps[stepCount].periodUs = 1000000UL / frequencyHz;
+  programSteps[stepCount].pulseUs = pulseUs;
+  programSteps[stepCount].endPulseUs = endPulseUs;
+  stepCount++;
+  Serial.println("OK");
+}
+
+// Adds or replaces the dead time at one supply voltage, keeping the table sorted
+void SetDeadTime(unsigned int millivolts, unsigned int deadTimeUs) {
+  byte i = 0;
+  while (i < deadTimePoints && deadTimeTable[i].millivolts < millivolts) {
+    i++;
+  }
+  if (i >= deadTimePoints || deadTimeTable[i].millivolts != millivolts) {
+    if (deadTimePoints >= MAX_DEADTIME_POINTS) {
+      Serial.println("Dead time table full");
+      return;
+    }
+    for (byte j = deadTimePoints; j > i; j--) {
+      deadTimeTable[j] = deadTimeTable[j - 1];
+    }
+    deadTimePoints++;
+  }
+  deadTimeTable[i].millivolts = millivolts;
+  deadTimeTable[i].deadTimeUs = deadTimeUs;
+  Serial.println("OK");
+}
+
+// Dead time at the supply voltage, interpolated between the table points
+unsigned int DeadTime() {
+  if (deadTimePoints == 0) {
+    return 0;
+  }
+  if (supplyMv <= deadTimeTable[0].millivolts) {
+    return deadTimeTable[0].deadTimeUs;
+  }
+  for (byte i = 1; i < deadTimePoints; i++) {
+    if (supplyMv <= deadTimeTable[i].millivolts) {
+      long span = (long)deadTimeTable[i].deadTimeUs - deadTimeTable[i - 1].deadTimeUs;
+      return deadTimeTable[i - 1].deadTimeUs + span * (long)(supplyMv - deadTimeTable[i - 1].millivolts) /
+             (long)(deadTimeTable[i].millivolts - deadTimeTable[i - 1].millivolts);
+    }
+  }
+  return deadTimeTable[deadTimePoints - 1].deadTimeUs;
+}
+
+// Loads a step into the interrupt state, the sweep is calculated without divisions per pulse
+void LoadStep(byte step) {
+  const ProgramStep* s = &programSteps[step];
+  unsigned long span;
+  
+  runStep = step;
+  runPulse = 0;
+  periodTicks = s->periodUs * TICKS_PER_US;
+  pulseTicks = s->pulseUs * TICKS_PER_US + deadTicks;
+  sweepDown = s->endPulseUs < s->pulseUs;
+  span = (sweepDown ? s->pulseUs - s->endPulseUs : s->endPulseUs - s->pulseUs) * TICKS_PER_US;
+  sweepStep = s->count > 1 ? span / (s->count - 1) : 0;
+  sweepRemainder = s->count > 1 ? span % (s->count - 1) : 0;
+  sweepError = 0;
+}
+
+// Checks the program and starts it on the Timer1 compare interrupt
+void StartProgram() {
+  unsigned int deadTime = DeadTime();
+  
+  if (stepCount == 0 || programChannels == 0) {
+    Serial.println("Empty program");
+    return;
+  }
+  for (byte i = 0; i < stepCount; i++) {
+    unsigned long shortest = min(programSteps[i].pulseUs, programSteps[i].endPulseUs) + deadTime;
+    unsigned long longest = max(programSteps[i].pulseUs, programSteps[i].endPulseUs) + deadTime;
+    if (shortest < MIN_PROGRAM_PULSE || longest + MIN_OFF_TIME > programSteps[i].periodUs) {
+      Serial.print("Step ");
+      Serial.print(i + 1);
+      Serial.println(": pulse plus dead time does not fit in the period");
+      return;
+    }
+  }
+  
+  // The sequence may have left an injector open
+  digitalWrite(PIN_INJECTOR_1, LOW);
+  digitalWrite(PIN_INJECTOR_2, LOW);
+  digitalWrite(PIN_INJECTOR_3, LOW);
+  digitalWrite(PIN_INJECTOR_4, LOW);
+  digitalWrite(PIN_STATUS_LED, LOW);
+  
+  programPortMask = 0;
+  for (byte i = 0; i < 4; i++) {
+    if (programChannels & (1 << i)) {
+      programPortMask |= INJECTOR_PORT_BITS[i];
+    }
+  }
+  deadTicks = (unsigned long)deadTime * TICKS_PER_US;
+  LoadStep(0);
+  injectorsOpen = false;
+  programPulses = 0;
+  programOnTicks = 0;
+  maxLatencyTicks = 0;
+  Serial.println("Running");
+  Serial.flush();
+  
+  // Timer1 runs freely with prescaler 8, the first pulse starts 1 ms from now
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  OCR1A = TCNT1;
+  ScheduleTicks(1000UL * TICKS_PER_US);
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  programRunning = true;
+  sequenceEnabled = false;
+  interrupts();
+}
+
+// Stops the program and closes the injectors
+void StopProgram() {
+  noInterrupts();
+  TIMSK1 &= ~_BV(OCIE1A);
+  PORTB &= ~programPortMask;
+  programRunning = false;
+  interrupts();
+}
+
+// Programs the next compare, long waits are split in steps the 16-bit comparator can reach
+void ScheduleTicks(unsigned long ticks) {
+  unsigned int step = ticks > 0xC000 ? 0x8000 : ticks;
+  OCR1A += step;
+  waitTicks = ticks - step;
+}
+
+// Timer1 compare: applies the edge that is due and programs the next one
+ISR(TIMER1_COMPA_vect) {
+  unsigned int latency;
+  
+  if (waitTicks > 0) {
+    ScheduleTicks(waitTicks);
+    return;
+  }
+  
+  if (!injectorsOpen) {
+    PORTB |= programPortMask;
+    openLatency = TCNT1 - OCR1A;
+    latency = openLatency;
+    injectorsOpen = true;
+    ScheduleTicks(pulseTicks);
+  } else {
+    PORTB &= ~programPortMask;
+    latency = TCNT1 - OCR1A;
+    injectorsOpen = false;
+    
+    // The measured width includes the delay of both edges
+    programOnTicks += pulseTicks + latency - openLatency;
+    programPulses++;
+    unsigned long offTicks = periodTicks - pulseTicks;
+    
+    if (++runPulse >= programSteps[runStep].count) {
+      if (runStep + 1 >= stepCount) {
+        TIMSK1 &= ~_BV(OCIE1A);
+        programRunning = false;
+        programFinished = true;
+        return;
+      }
+      LoadStep(runStep + 1);
+    } else {
+      // Sweep: the width moves by span / (count - 1) with the remainder spread over the pulses
+      unsigned long change = sweepStep;
+      sweepError += sweepRemainder;
+      if (sweepError >= programSteps[runStep].count - 1) {
+        sweepError -= programSteps[runStep].count - 1;
+        change++;
+      }
+      pulseTicks = sweepDown ? pulseTicks - change : pulseTicks + change;
+    }
+    ScheduleTicks(offTicks);
+  }
+  
+  if (latency > maxLatencyTicks) {
+    maxLatencyTicks = latency;
+  }
+}
+
+// Shows the loaded program
+void PrintProgram() {
+  for (byte i = 0; i < stepCount; i++) {
+    Serial.print("Step ");
+    Serial.print(i + 1);
+    Serial.print(": ");
+    Serial.print(programSteps[i].count);
+    Serial.print(" pulses of ");
+    Serial.print(programSteps[i].pulseUs);
+    if (programSteps[i].endPulseUs != programSteps[i].pulseUs) {
+      Serial.print(" to ");
+      Serial.print(programSteps[i].endPulseUs);
+    }
+    Serial.print(" us every ");
+    Serial.print(programSteps[i].periodUs);
+    Serial.println(" us");
+  }
+  for (byte i = 0; i < deadTimePoints; i++) {
+    Serial.print("Dead time at ");
+    Serial.print(deadTimeTable[i].millivolts);
+    Serial.print(" mV: ");
+    Serial.print(deadTimeTable[i].deadTimeUs);
+    Serial.println(" us");
+  }
+  Serial.print("Supply: ");
+  Serial.print(supplyMv);
+  Serial.print(" mV | Dead time: ");
+  Serial.print(DeadTime());
+  Serial.print(" us | Channels:");
+  for (byte i = 0; i < 4; i++) {
+    if (programChannels & (1 << i)) {
+      Serial.print(" ");
+      Serial.print(i + 1);
+    }
+  }
+  Serial.println();
+}
+
+// Shows the pulses and on-time the injectors received in the last program
+// Every selected injector is switched by the same port write, so they all receive the same
+void PrintReport() {
+  unsigned long expectedPulses = 0;
+  unsigned long expectedOnTime = 0;
+  unsigned int deadTime = DeadTime();
+  
+  for (byte i = 0; i < stepCount; i++) {
+    expectedPulses += programSteps[i].count;
+    expectedOnTime += programSteps[i].count * ((programSteps[i].pulseUs + programSteps[i].endPulseUs) / 2 + deadTime);
+  }
+  
+  noInterrupts();
+  unsigned long pulses = programPulses;
+  unsigned long onTicks = programOnTicks;
+  unsigned int latency = maxLatencyTicks;
+  interrupts();
+  
+  for (byte i = 0; i < 4; i++) {
+    if (programChannels & (1 << i)) {
+      Serial.print("Injector ");
+      Serial.print(i + 1);
+      Serial.print(": ");
+      Serial.print(pulses);
+      Serial.print("/");
+      Serial.print(expectedPulses);
+      Serial.print(" pulses | On-time: ");
+      Serial.print(onTicks / TICKS_PER_US);
+      Serial.print(" us (expected ");
+      Serial.print(expectedOnTime);
+      Serial.println(" us)");
+    }
+  }
+  Serial.print("Max edge latency: ");
+  Serial.print(latency / TICKS_PER_US);
+  Serial.println(" us");
+}
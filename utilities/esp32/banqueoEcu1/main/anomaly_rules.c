@@ -0,0 +1,407 @@
+/**
+ * @file anomaly_rules.c
+ * @brief Streaming, table-driven anomaly detection for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Edges are accumulated per engine cycle. When the cycle ends, the
+ * per-cycle values are pushed into a short history window and every
+ * enabled rule of the table is evaluated once. A rule must fail for
+ * minCycles consecutive cycles before it is raised, and it is cleared
+ * as soon as it passes again, so only state changes are reported.
+ */
+
+#include <string.h>
+#include "anomaly_rules.h"
+
+// Full engine cycle in tenths of degree (720°)
+#define CYCLE_ANGLE             7200
+
+// Expected coil dwell band vs RPM (μs), interpolated between points
+typedef struct {
+    uint16_t rpm;
+    uint16_t minUs;
+    uint16_t maxUs;
+} DwellCurvePoint;
+
+static const DwellCurvePoint dwellCurve[] = {
+    {  800, 1500, 6000 },
+    { 3000, 1500, 4500 },
+    { 6000, 1200, 3500 }
+};
+
+#define DWELL_CURVE_POINTS      (sizeof(dwellCurve) / sizeof(dwellCurve[0]))
+
+static const char* const ruleTypeNames[RULE_TYPE_COUNT] = {
+    "pulse-count", "imbalance", "dwell-curve", "injection-phase", "load-response"
+};
+
+// Physical range of the parameters A, B and C of each rule type
+typedef struct {
+    int16_t min[ANOMALY_RULE_PARAMS];
+    int16_t max[ANOMALY_RULE_PARAMS];
+} RuleParamLimits;
+
+#define UNUSED_MIN              INT16_MIN
+#define UNUSED_MAX              INT16_MAX
+
+static const RuleParamLimits ruleParamLimits[RULE_TYPE_COUNT] = {
+    { { 0, UNUSED_MIN, UNUSED_MIN }, { UINT8_MAX, UNUSED_MAX, UNUSED_MAX } },      // Pulses, counted in 8 bits
+    { { 0, UNUSED_MIN, UNUSED_MIN }, { INT16_MAX, UNUSED_MAX, UNUSED_MAX } },      // ‰, a channel may double another
+    { { 0, UNUSED_MIN, UNUSED_MIN }, { 1000, UNUSED_MAX, UNUSED_MAX } },           // ‰, the band stays above 0 μs
+    { { 0, 0, 0 }, { 720, 720, 720 } },                                            // °, spread and window of the cycle
+    { { 0, 0, UNUSED_MIN }, { 100, INT16_MAX, UNUSED_MAX } }                       // TPS %, μs
+};
+
+/**
+ * Mean per-cycle width of a channel over the history window
+ *
+ * @param engine Detection engine
+ * @param channel Channel index
+ * @return Mean width (μs), 0 when the channel had no pulses
+ */
+static uint32_t WindowMeanWidth(const AnomalyEngine* engine, int channel)
+{
+    uint64_t sum = 0;
+    uint32_t samples = 0;
+
+    for (int i = 0; i < engine->windowFill; i++) {
+        uint32_t width = engine->windowWidth[i][channel];
+        if (width > 0) {
+            sum += width;
+            samples++;
+        }
+    }
+
+    return samples > 0 ? (uint32_t)(sum / samples) : 0;
+}
+
+/**
+ * Normalizes an angle difference to the range [-360°, 360°)
+ *
+ * @param diff Angle difference (tenths of degree)
+ * @return Normalized difference
+ */
+static int32_t WrapAngleDiff(int32_t diff)
+{
+    while (diff >= CYCLE_ANGLE / 2) diff -= CYCLE_ANGLE;
+    while (diff < -CYCLE_ANGLE / 2) diff += CYCLE_ANGLE;
+    return diff;
+}
+
+/**
+ * Interpolates the expected dwell band for an engine speed
+ *
+ * @param rpm Engine speed
+ * @param minUs Output minimum dwell (μs)
+ * @param maxUs Output maximum dwell (μs)
+ */
+static void DwellBandForRpm(uint16_t rpm, int32_t* minUs, int32_t* maxUs)
+{
+    if (rpm <= dwellCurve[0].rpm) {
+        *minUs = dwellCurve[0].minUs;
+        *maxUs = dwellCurve[0].maxUs;
+        return;
+    }
+
+    for (unsigned i = 1; i < DWELL_CURVE_POINTS; i++) {
+        const DwellCurvePoint* a = &dwellCurve[i - 1];
+        const DwellCurvePoint* b = &dwellCurve[i];
+        if (rpm <= b->rpm) {
+            int32_t span = b->rpm - a->rpm;
+            int32_t pos = rpm - a->rpm;
+            *minUs = a->minUs + ((int32_t)b->minUs - a->minUs) * pos / span;
+            *maxUs = a->maxUs + ((int32_t)b->maxUs - a->maxUs) * pos / span;
+            return;
+        }
+    }
+
+    *minUs = dwellCurve[DWELL_CURVE_POINTS - 1].minUs;
+    *maxUs = dwellCurve[DWELL_CURVE_POINTS - 1].maxUs;
+}
+
+/**
+ * Evaluates one rule for every channel of its mask
+ *
+ * @param engine Detection engine
+ * @param rule Rule to evaluate
+ * @param context Engine state at the end of the cycle
+ * @param fail Output failure flag per channel
+ * @param value Output measured value per channel
+ * @param other Output reference channel per channel
+ */
+static void EvaluateRule(const AnomalyEngine* engine, const AnomalyRule* rule, const AnomalyContext* context,
+                         bool fail[PULSE_CHANNEL_COUNT], int32_t value[PULSE_CHANNEL_COUNT],
+                         uint8_t other[PULSE_CHANNEL_COUNT])
+{
+    uint32_t means[PULSE_CHANNEL_COUNT];
+
+    for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+        fail[ch] = false;
+        value[ch] = 0;
+        other[ch] = ch;
+        means[ch] = WindowMeanWidth(engine, ch);
+    }
+
+    switch (rule->type) {
+        case RULE_PULSE_COUNT:
+            // Missing or extra pulses in the cycle that just ended
+            for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+                if (rule->channelMask & CHANNEL_MASK(ch)) {
+                    value[ch] = engine->cyclePulses[ch];
+                    fail[ch] = (value[ch] != rule->paramA);
+                }
+            }
+            break;
+
+        case RULE_IMBALANCE: {
+            // Compare every channel against every other one (N×N) and flag
+            // the channels that disagree with the majority of the group
+            int candidates = 0;
+            for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+                if ((rule->channelMask & CHANNEL_MASK(ch)) && means[ch] > 0) {
+                    candidates++;
+                }
+            }
+            if (candidates < 2) {
+                break;
+            }
+
+            for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+                if (!(rule->channelMask & CHANNEL_MASK(i)) || means[i] == 0) {
+                    continue;
+                }
+                int failingPairs = 0;
+                for (int j = 0; j < PULSE_CHANNEL_COUNT; j++) {
+                    if (j == i || !(rule->channelMask & CHANNEL_MASK(j)) || means[j] == 0) {
+                        continue;
+                    }
+                    uint32_t low = means[i] < means[j] ? means[i] : means[j];
+                    uint32_t diff = means[i] > means[j] ? means[i] - means[j] : means[j] - means[i];
+                    int32_t deviation = (int32_t)((uint64_t)diff * 1000 / low);
+                    if (deviation > rule->paramA) {
+                        failingPairs++;
+                    }
+                    if (deviation > value[i]) {
+                        value[i] = deviation;
+                        other[i] = j;
+                    }
+                }
+                fail[i] = (failingPairs * 2 > candidates - 1);
+            }
+            break;
+        }
+
+        case RULE_DWELL_CURVE: {
+            int32_t minUs, maxUs;
+            DwellBandForRpm(context->rpm, &minUs, &maxUs);
+            minUs = minUs * (1000 - rule->paramA) / 1000;
+            maxUs = maxUs * (1000 + rule->paramA) / 1000;
+            for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+                if ((rule->channelMask & CHANNEL_MASK(ch)) && means[ch] > 0) {
+                    value[ch] = (int32_t)means[ch];
+                    fail[ch] = (value[ch] < minUs || value[ch] > maxUs);
+                }
+            }
+            break;
+        }
+
+        case RULE_INJECTION_PHASE:
+            for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+                if (!(rule->channelMask & CHANNEL_MASK(ch))) {
+                    continue;
+                }
+
+                // Spread of the start of injection over the window
+                int16_t reference = ANOMALY_NO_ANGLE;
+                int32_t lowest = 0, highest = 0;
+                for (int i = 0; i < engine->windowFill; i++) {
+                    int16_t soi = engine->windowSoi[i][ch];
+                    if (soi == ANOMALY_NO_ANGLE) {
+                        continue;
+                    }
+                    if (reference == ANOMALY_NO_ANGLE) {
+                        reference = soi;
+                        continue;
+                    }
+                    int32_t diff = WrapAngleDiff(soi - reference);
+                    if (diff < lowest) lowest = diff;
+                    if (diff > highest) highest = diff;
+                }
+                if (reference == ANOMALY_NO_ANGLE) {
+                    continue;
+                }
+                value[ch] = highest - lowest;
+                fail[ch] = (value[ch] > rule->paramA * 10);
+
+                // Optional absolute window for the last start of injection
+                int16_t lastSoi = engine->cycleSoi[ch];
+                if (rule->paramB != rule->paramC && lastSoi != ANOMALY_NO_ANGLE) {
+                    int32_t from = rule->paramB * 10;
+                    int32_t to = rule->paramC * 10;
+                    bool inside = (from < to) ? (lastSoi >= from && lastSoi <= to)
+                                              : (lastSoi >= from || lastSoi <= to);
+                    if (!inside) {
+                        fail[ch] = true;
+                        value[ch] = lastSoi;
+                    }
+                }
+            }
+            break;
+
+        case RULE_LOAD_RESPONSE:
+            // High throttle must produce long injection times
+            if (context->tps <= rule->paramA) {
+                break;
+            }
+            for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+                if (rule->channelMask & CHANNEL_MASK(ch)) {
+                    value[ch] = (int32_t)means[ch];
+                    fail[ch] = (value[ch] < rule->paramB);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void AnomalyEngineInit(AnomalyEngine* engine, const AnomalyRule* rules, uint8_t ruleCount)
+{
+    memset(engine, 0, sizeof(*engine));
+
+    if (ruleCount > ANOMALY_MAX_RULES) {
+        ruleCount = ANOMALY_MAX_RULES;
+    }
+    memcpy(engine->rules, rules, ruleCount * sizeof(AnomalyRule));
+    engine->ruleCount = ruleCount;
+
+    for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+        engine->cycleSoi[ch] = ANOMALY_NO_ANGLE;
+    }
+}
+
+void AnomalyEngineProcessEdge(AnomalyEngine* engine, PulseChannel channel, bool rising,
+                              uint64_t timestamp, int16_t angle)
+{
+    if (channel >= PULSE_CHANNEL_COUNT) {
+        return;
+    }
+
+    if (rising) {
+        engine->riseTime[channel] = timestamp;
+        engine->active[channel] = true;
+        // Only the first start of injection of each cycle is kept
+        if (engine->cycleSoi[channel] == ANOMALY_NO_ANGLE) {
+            engine->cycleSoi[channel] = angle;
+        }
+        return;
+    }
+
+    if (engine->active[channel] && timestamp > engine->riseTime[channel]) {
+        uint32_t width = (uint32_t)(timestamp - engine->riseTime[channel]);
+        if (width > MIN_VALID_PULSE_US) {
+            engine->cyclePulses[channel]++;
+            engine->cycleWidthSum[channel] += width;
+        }
+    }
+    engine->active[channel] = false;
+}
+
+uint8_t AnomalyEngineEndCycle(AnomalyEngine* engine, const AnomalyContext* context,
+                              AnomalyDetection* detections, uint8_t maxDetections)
+{
+    uint8_t detectionCount = 0;
+    bool fail[PULSE_CHANNEL_COUNT];
+    int32_t value[PULSE_CHANNEL_COUNT];
+    uint8_t other[PULSE_CHANNEL_COUNT];
+
+    // Push the finished cycle into the history window
+    for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+        engine->windowWidth[engine->windowIndex][ch] = engine->cyclePulses[ch] > 0
+            ? engine->cycleWidthSum[ch] / engine->cyclePulses[ch] : 0;
+        engine->windowSoi[engine->windowIndex][ch] = engine->cycleSoi[ch];
+    }
+    engine->windowIndex = (engine->windowIndex + 1) % ANOMALY_WINDOW_CYCLES;
+    if (engine->windowFill < ANOMALY_WINDOW_CYCLES) {
+        engine->windowFill++;
+    }
+    engine->cycleCount++;
+
+    // Evaluate the rule table, the first cycle is partial and only fills the window
+    for (uint8_t r = 0; engine->cycleCount > 1 && r < engine->ruleCount; r++) {
+        const AnomalyRule* rule = &engine->rules[r];
+        if (!rule->enabled) {
+            continue;
+        }
+
+        EvaluateRule(engine, rule, context, fail, value, other);
+
+        for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+            if (!(rule->channelMask & CHANNEL_MASK(ch))) {
+                continue;
+            }
+
+            bool raised = (engine->raisedMask[r] & CHANNEL_MASK(ch)) != 0;
+            bool changed = false;
+
+            if (fail[ch]) {
+                if (engine->streak[r][ch] < UINT8_MAX) {
+                    engine->streak[r][ch]++;
+                }
+                if (!raised && engine->streak[r][ch] >= rule->minCycles) {
+                    engine->raisedMask[r] |= CHANNEL_MASK(ch);
+                    changed = true;
+                }
+            } else {
+                engine->streak[r][ch] = 0;
+                if (raised) {
+                    engine->raisedMask[r] &= ~CHANNEL_MASK(ch);
+                    changed = true;
+                }
+            }
+
+            if (changed && detectionCount < maxDetections) {
+                AnomalyDetection* det = &detections[detectionCount++];
+                det->ruleIndex = r;
+                det->ruleType = rule->type;
+                det->limit = rule->paramA;
+                det->channel = ch;
+                det->otherChannel = other[ch];
+                det->raised = fail[ch];
+                det->value = value[ch];
+            }
+        }
+    }
+
+    // Start accumulating the next cycle
+    for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+        engine->cyclePulses[ch] = 0;
+        engine->cycleWidthSum[ch] = 0;
+        engine->cycleSoi[ch] = ANOMALY_NO_ANGLE;
+    }
+
+    return detectionCount;
+}
+
+const char* AnomalyRuleTypeName(uint8_t type)
+{
+    return type < RULE_TYPE_COUNT ? ruleTypeNames[type] : "unknown";
+}
+
+bool AnomalyRuleParamRange(uint8_t type, int param, int16_t* min, int16_t* max)
+{
+    if (type >= RULE_TYPE_COUNT || param < 0 || param >= ANOMALY_RULE_PARAMS) {
+        return false;
+    }
+    *min = ruleParamLimits[type].min[param];
+    *max = ruleParamLimits[type].max[param];
+    return true;
+}
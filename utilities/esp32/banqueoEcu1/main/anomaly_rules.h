@@ -0,0 +1,120 @@
+/**
+ * @file anomaly_rules.h
+ * @brief Streaming, table-driven anomaly detection for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef ANOMALY_RULES_H
+#define ANOMALY_RULES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pulse_stats.h"
+
+// Maximum number of rules held by the engine
+#define ANOMALY_MAX_RULES       12
+
+// Number of engine cycles kept for windowed statistics
+#define ANOMALY_WINDOW_CYCLES   4
+
+// Parameters of a rule (A, B, C)
+#define ANOMALY_RULE_PARAMS     3
+
+// Crank angle value meaning "no edge seen" (tenths of degree)
+#define ANOMALY_NO_ANGLE        (-1)
+
+// Channel masks for the rule table
+#define CHANNEL_MASK(ch)        (1u << (ch))
+#define INJECTOR_CHANNEL_MASK   0x0Fu
+#define COIL_CHANNEL_MASK       CHANNEL_MASK(PULSE_CHANNEL_COIL)
+
+// Types of rules understood by the engine
+typedef enum {
+    RULE_PULSE_COUNT,            // paramA = expected pulses per cycle (missing/extra pulses)
+    RULE_IMBALANCE,              // paramA = max deviation between channels (‰), N×N comparison
+    RULE_DWELL_CURVE,            // paramA = tolerance around the dwell vs RPM curve (‰)
+    RULE_INJECTION_PHASE,        // paramA = max SOI spread (°), paramB-paramC = allowed SOI window (°)
+    RULE_LOAD_RESPONSE,          // paramA = TPS threshold (%), paramB = minimum mean width (μs)
+    RULE_TYPE_COUNT
+} AnomalyRuleType;
+
+// One entry of the rule table (8 bytes)
+typedef struct {
+    uint8_t type;                // AnomalyRuleType
+    uint8_t channelMask;         // Channels the rule applies to
+    uint8_t minCycles;           // Consecutive failing cycles before raising (debounce)
+    uint8_t enabled;             // 0 = rule disabled
+    int16_t paramA;              // Rule specific parameter
+    int16_t paramB;              // Rule specific parameter
+    int16_t paramC;              // Rule specific parameter
+} AnomalyRule;
+
+// Engine state seen by the rules at the end of each cycle
+typedef struct {
+    uint16_t rpm;                // Emulated engine speed
+    uint8_t tps;                 // Emulated throttle position (%)
+} AnomalyContext;
+
+// Raised or cleared anomaly reported to the caller
+// The rule type and limit are copied so the report needs no access to the engine after it is unlocked
+typedef struct {
+    uint8_t ruleIndex;           // Index in the rule table
+    uint8_t ruleType;            // AnomalyRuleType of the rule when it was evaluated
+    int16_t limit;               // paramA of the rule when it was evaluated
+    uint8_t channel;             // Affected channel
+    uint8_t otherChannel;        // Reference channel (imbalance rule), otherwise same as channel
+    bool raised;                 // true = anomaly raised, false = anomaly cleared
+    int32_t value;               // Measured value that triggered the rule
+} AnomalyDetection;
+
+// Complete state of the detection engine
+typedef struct {
+    AnomalyRule rules[ANOMALY_MAX_RULES];
+    uint8_t ruleCount;
+
+    // Accumulation for the cycle in progress
+    uint64_t riseTime[PULSE_CHANNEL_COUNT];
+    bool active[PULSE_CHANNEL_COUNT];
+    uint8_t cyclePulses[PULSE_CHANNEL_COUNT];
+    uint32_t cycleWidthSum[PULSE_CHANNEL_COUNT];
+    int16_t cycleSoi[PULSE_CHANNEL_COUNT];
+
+    // Per-cycle history used by the windowed rules
+    uint32_t windowWidth[ANOMALY_WINDOW_CYCLES][PULSE_CHANNEL_COUNT];
+    int16_t windowSoi[ANOMALY_WINDOW_CYCLES][PULSE_CHANNEL_COUNT];
+    uint8_t windowIndex;
+    uint8_t windowFill;
+
+    // Debounce and raised state per rule and channel
+    uint8_t streak[ANOMALY_MAX_RULES][PULSE_CHANNEL_COUNT];
+    uint8_t raisedMask[ANOMALY_MAX_RULES];
+    uint32_t cycleCount;
+} AnomalyEngine;
+
+// Initializes the engine and loads a rule table
+void AnomalyEngineInit(AnomalyEngine* engine, const AnomalyRule* rules, uint8_t ruleCount);
+
+// Feeds one edge of a channel, angle in tenths of degree of the 720° cycle
+void AnomalyEngineProcessEdge(AnomalyEngine* engine, PulseChannel channel, bool rising,
+                              uint64_t timestamp, int16_t angle);
+
+// Closes the current engine cycle and evaluates every rule
+// Returns the number of raised/cleared anomalies written to detections
+uint8_t AnomalyEngineEndCycle(AnomalyEngine* engine, const AnomalyContext* context,
+                              AnomalyDetection* detections, uint8_t maxDetections);
+
+// Returns a short name for a rule type
+const char* AnomalyRuleTypeName(uint8_t type);
+
+// Gets the physical range of parameter 0-2 (A-C) of a rule type, unused parameters accept any int16_t
+// Returns false for an unknown type or parameter
+bool AnomalyRuleParamRange(uint8_t type, int param, int16_t* min, int16_t* max);
+
+#endif // ANOMALY_RULES_H
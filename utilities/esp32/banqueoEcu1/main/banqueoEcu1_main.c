@@ -12,11 +12,15 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
 #include "driver/ledc.h"
@@ -25,6 +29,15 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_adc_cal.h"
+#include "pulse_stats.h"
+#include "anomaly_rules.h"
+#include "crank_angle.h"
+#include "telemetry.h"
+#include "command_parser.h"
+#include "ntc_sensor.h"
+#include "sensor_outputs.h"
+#include "engine_model.h"
+#include "o2_sensor.h"
 
 // Pin definitions for sensor emulation
 #define PIN_EMU_CKP        GPIO_NUM_16    // CKP sensor emulation (crankshaft)
@@ -34,6 +47,7 @@
 #define PIN_EMU_MAF        GPIO_NUM_21    // MAF sensor emulation (air flow)
 #define PIN_EMU_ECT        GPIO_NUM_22    // ECT sensor emulation (coolant temp)
 #define PIN_EMU_IAT        GPIO_NUM_23    // IAT sensor emulation (intake air temp)
+#define PIN_EMU_O2         GPIO_NUM_4     // O2 sensor emulation (oxygen sensor)
 
 // Pin definitions for actuator monitoring
 #define PIN_MON_INJ1       GPIO_NUM_25    // Injector 1 monitoring
@@ -43,19 +57,24 @@
 #define PIN_MON_COIL       GPIO_NUM_33    // Coil monitoring
 #define PIN_CTRL_PUMP      GPIO_NUM_34    // Fuel pump control
 #define PIN_COMM           GPIO_NUM_35    // Communication line
+#define PIN_TELEMETRY_TX   GPIO_NUM_13    // Binary telemetry output (UART1 TX)
 
-// Constants for PWM configuration
-#define LEDC_TIMER              LEDC_TIMER_0
+// Constants for PWM configuration (one LEDC channel per analog sensor)
 #define LEDC_MODE               LEDC_LOW_SPEED_MODE
-#define LEDC_OUTPUT_IO          PIN_EMU_TPS
-#define LEDC_CHANNEL            LEDC_CHANNEL_0
-#define LEDC_DUTY_RES           LEDC_TIMER_13_BIT // 8192 levels of resolution
-#define LEDC_FREQUENCY          5000              // Frequency in Hz
+#define LEDC_VOLTAGE_TIMER      LEDC_TIMER_0      // Shared carrier of the voltage-only outputs
+#define LEDC_MAP_TIMER          LEDC_TIMER_1      // MAP and MAF can switch to frequency mode,
+#define LEDC_MAF_TIMER          LEDC_TIMER_2      // so each one has a timer of its own
+#define LEDC_TIMER_COUNT        3
+#define LEDC_VOLTAGE_RES        LEDC_TIMER_13_BIT // 8192 levels of resolution
+#define LEDC_FREQUENCY_RES      LEDC_TIMER_10_BIT // Up to 78 kHz in frequency mode
+#define LEDC_FREQUENCY          5000              // Carrier frequency in Hz
+#define NTC_CURVE_DEFAULT       NTC_CURVE_CUSTOM  // 2.5 kOhm / B3380 sensor
 
 // Timer configuration for signal generation
 #define TIMER_DIVIDER           16
 #define TIMER_SCALE             (TIMER_BASE_CLK / TIMER_DIVIDER)
 #define TIMER_CKP_INTERVAL_SEC  0.02              // 50Hz for 1500 RPM (4-stroke)
+#define CMP_PULSE_TOOTH         10                // Tooth of the first revolution with CMP pulse
 
 // Constants for simulated engine control
 #define RPM_MIN                 800
@@ -72,16 +91,49 @@
 #define ECT_MAX                 120               // Maximum temperature (°C)
 #define ECT_DEFAULT             85                // Normal operating temperature (°C)
 #define IAT_DEFAULT             25                // Default ambient temperature (°C)
+#define O2_MIN                  0                 // Lean narrowband signal (mV)
+#define O2_MAX                  1000              // Rich narrowband signal (mV)
+#define O2_DEFAULT              450               // Stoichiometric mixture (mV)
+#define INJECTOR_FLOW_MIN       50                // Injector static flow range (cc/min)
+#define INJECTOR_FLOW_MAX       2000
+
+// Engine model
+#define ENGINE_OUTPUT_STEPS     10                // Model steps between sensor output updates (10 ms)
+#define ENGINE_REPORT_MS        500               // Engine state log and telemetry period (ms)
+#define INJECTOR_STALE_US       200000            // No pulse for this long means the injector is off (μs)
 
 // Data buffer size
 #define DATA_BUFFER_SIZE        1024
 
-// Queue size for events
-#define QUEUE_SIZE              10
+// Queue size for events (4 injectors + coil at 6000 RPM produce ~1000 edges/s)
+#define QUEUE_SIZE              64
+
+// Console command interface
+#define CONSOLE_RX_BUFFER_SIZE  4096              // UART driver RX buffer (bytes)
+#define CONSOLE_EVENT_QUEUE_SIZE 20
+#define CONSOLE_READ_CHUNK      256               // Bytes read from the driver at once
+#define CONSOLE_REPLY_LENGTH    160               // Longest line printed by a console command
+
+// Binary telemetry link
+#define TELEMETRY_UART          UART_NUM_1
+#define TELEMETRY_BAUD_RATE     921600
+#define TELEMETRY_RING_SIZE     8192              // Frames waiting for the telemetry task (bytes)
+#define TELEMETRY_UART_TX_SIZE  4096              // UART driver TX buffer (bytes)
+#define TELEMETRY_CHUNK_SIZE    512               // Largest block handed to the UART at once
 
 // Constants for anomaly detection
-#define PULSE_MARGIN            0.15              // 15% acceptable error margin
-#define MIN_VALID_PULSE_US      50                // Minimum valid pulse (μs)
+#define MAX_CYCLE_DETECTIONS    16                // Raised/cleared anomalies reported per cycle
+
+// Pseudo channel used to signal the end of an engine cycle (720°)
+#define PULSE_EVENT_CYCLE_END   0xFF
+
+// Crank angle reference
+#define TDC_OFFSET_DEFAULT      1200              // Cylinder 1 TDC 120° after the first tooth (tenths of degree)
+
+// Pulse statistics reporting period
+#define STATS_REPORT_DEFAULT_MS 1000              // Default summary period (ms)
+#define STATS_REPORT_MIN_MS     100               // Fastest allowed summary period (ms)
+#define STATS_REPORT_MAX_MS     60000             // Slowest allowed summary period (ms)
 
 static const char *TAG = "BANQUEO_ECU";
 
@@ -93,45 +145,46 @@ typedef struct {
     uint8_t maf;                 // MAF flow (g/s)
     int8_t ect;                  // Coolant temperature (°C)
     int8_t iat;                  // Intake air temperature (°C)
+    uint16_t o2;                 // O2 sensor voltage (mV)
     bool engineRunning;          // Engine state (on/off)
 } EngineParams;
 
-// Structure to store output pulse parameters
-typedef struct {
-    uint32_t inj1PulseWidth;     // Injector 1 pulse width (μs)
-    uint32_t inj2PulseWidth;     // Injector 2 pulse width (μs)
-    uint32_t inj3PulseWidth;     // Injector 3 pulse width (μs)
-    uint32_t inj4PulseWidth;     // Injector 4 pulse width (μs)
-    uint32_t coilDwell;          // Coil dwell time (μs)
-    uint32_t lastUpdateTime;     // Last update time (ms)
-    bool inj1Active;             // Injector 1 state
-    bool inj2Active;             // Injector 2 state
-    bool inj3Active;             // Injector 3 state
-    bool inj4Active;             // Injector 4 state
-    bool coilActive;             // Coil state
-    bool pumpActive;             // Pump state
-} OutputSignals;
-
-// Enumeration for pulse event types
-typedef enum {
-    EVENT_INJ1_RISING,
-    EVENT_INJ1_FALLING,
-    EVENT_INJ2_RISING,
-    EVENT_INJ2_FALLING,
-    EVENT_INJ3_RISING,
-    EVENT_INJ3_FALLING,
-    EVENT_INJ4_RISING,
-    EVENT_INJ4_FALLING,
-    EVENT_COIL_RISING,
-    EVENT_COIL_FALLING
-} PulseEventType;
-
 // Structure for pulse events
 typedef struct {
-    PulseEventType type;
+    uint8_t channel;             // Monitored channel (PulseChannel) or PULSE_EVENT_CYCLE_END
+    uint8_t rising;              // 1 = rising edge, 0 = falling edge
+    int16_t angle;               // Emulated crank angle of the edge (tenths of degree, 0-7199)
     uint64_t timestamp;          // Timestamp in microseconds
 } PulseEvent;
 
+// Monitoring pins indexed by PulseChannel
+static const gpio_num_t monitorPins[PULSE_CHANNEL_COUNT] = {
+    PIN_MON_INJ1,
+    PIN_MON_INJ2,
+    PIN_MON_INJ3,
+    PIN_MON_INJ4,
+    PIN_MON_COIL
+};
+
+// Channel names used in reports
+static const char* const channelNames[PULSE_CHANNEL_COUNT] = {
+    "INJ1", "INJ2", "INJ3", "INJ4", "COIL"
+};
+
+// Firing order 1-3-4-2 (0-based cylinder indexes)
+static const uint8_t firingOrder[CRANK_CYLINDERS] = { 0, 2, 3, 1 };
+
+// Default anomaly rule table, evaluated once per engine cycle
+static const AnomalyRule defaultAnomalyRules[] = {
+    // type                  channels               cycles  on  paramA  paramB  paramC
+    { RULE_PULSE_COUNT,      INJECTOR_CHANNEL_MASK,  1,     1,  1,      0,      0 },    // 1 injection per cycle
+    { RULE_PULSE_COUNT,      COIL_CHANNEL_MASK,      1,     1,  1,      0,      0 },    // 1 spark per cycle
+    { RULE_IMBALANCE,        INJECTOR_CHANNEL_MASK,  2,     1,  150,    0,      0 },    // 15% between injectors
+    { RULE_DWELL_CURVE,      COIL_CHANNEL_MASK,      2,     1,  150,    0,      0 },    // 15% around dwell curve
+    { RULE_INJECTION_PHASE,  INJECTOR_CHANNEL_MASK,  2,     1,  30,     0,      0 },    // SOI stable within 30°
+    { RULE_LOAD_RESPONSE,    INJECTOR_CHANNEL_MASK,  4,     1,  50,     3000,   0 }     // TPS > 50% needs >= 3 ms
+};
+
 // Global variables
 static EngineParams engineParams = {
     .rpm = RPM_DEFAULT,
@@ -140,45 +193,149 @@ static EngineParams engineParams = {
     .maf = MAF_MIN + 3,          // 5 g/s at idle
     .ect = ECT_DEFAULT,
     .iat = IAT_DEFAULT,
+    .o2 = O2_DEFAULT,
     .engineRunning = true
 };
 
-static OutputSignals outputSignals = {0};
+// Analog sensor outputs, MAP and MAF on timers of their own
+static const SensorOutputConfig sensorOutputConfig[SENSOR_OUT_COUNT] = {
+    // name   gpio          timer               channel         frequency capable
+    { "TPS",  PIN_EMU_TPS,  LEDC_VOLTAGE_TIMER, LEDC_CHANNEL_0, false },
+    { "MAP",  PIN_EMU_MAP,  LEDC_MAP_TIMER,     LEDC_CHANNEL_4, true  },
+    { "MAF",  PIN_EMU_MAF,  LEDC_MAF_TIMER,     LEDC_CHANNEL_5, true  },
+    { "ECT",  PIN_EMU_ECT,  LEDC_VOLTAGE_TIMER, LEDC_CHANNEL_1, false },
+    { "IAT",  PIN_EMU_IAT,  LEDC_VOLTAGE_TIMER, LEDC_CHANNEL_2, false },
+    { "O2",   PIN_EMU_O2,   LEDC_VOLTAGE_TIMER, LEDC_CHANNEL_3, false }
+};
+
+static const SensorOutputTimer sensorOutputTimers[LEDC_TIMER_COUNT] = {
+    { LEDC_FREQUENCY, LEDC_VOLTAGE_RES },      // LEDC_VOLTAGE_TIMER
+    { LEDC_FREQUENCY, LEDC_FREQUENCY_RES },    // LEDC_MAP_TIMER
+    { LEDC_FREQUENCY, LEDC_FREQUENCY_RES }     // LEDC_MAF_TIMER
+};
+
+static SensorOutputs sensorOutputs;
+
+// Emulated engine: 1.6 L four cylinder, 250 cc/min injectors (INJ1-4 feed cylinders 1-4)
+static EngineModelConfig engineModelConfig = {
+    .displacementCc = 1600,
+    .manifoldVolumeCc = 2500,
+    .cylinders = PULSE_INJECTOR_COUNT,
+    .injectorFlowCcMin = { 250, 250, 250, 250 },
+    .injectorDeadTimeUs = 1000,
+    .exhaustDelayMs = 80,
+    .sensorResponseMs = 60,
+    .thermostatC = 88
+};
+
+static EngineModel engineModel;
+static SemaphoreHandle_t engineModelMutex = NULL;
+static TaskHandle_t engineSimulationTaskHandle = NULL;
+static uint32_t engineModelOverruns = 0;
+static O2SensorType o2SensorType = O2_SENSOR_MANUAL;
+static NtcCurve ntcCurve = NTC_CURVE_DEFAULT;
+static PulseStats pulseStats;
+static portMUX_TYPE pulseStatsLock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t droppedPulseEvents = 0;
+static uint32_t statsReportPeriodMs = STATS_REPORT_DEFAULT_MS;
+static AnomalyEngine anomalyEngine;
+static SemaphoreHandle_t anomalyEngineMutex = NULL;
 static uint64_t lastCkpPulseTime = 0;
 static QueueHandle_t pulseEventQueue = NULL;
+static QueueHandle_t consoleEventQueue = NULL;
+static CommandLineBuffer consoleLine;
+static bool scriptMode = false;
+static uint32_t consoleCommandCount = 0;
+static uint32_t consoleOverruns = 0;
+static RingbufHandle_t telemetryRing = NULL;
+static SemaphoreHandle_t telemetryMutex = NULL;              // Frames reach the ring in sequence order
+static volatile bool telemetryEnabled = false;
+static uint16_t telemetrySequence = 0;
+static volatile uint32_t telemetryFramesQueued = 0;
+static volatile uint32_t telemetryFramesDropped = 0;
 
 // Variables for CKP teeth emulation (type 60-2)
 static const int TOTAL_TEETH = 60;
 static const int MISSING_TEETH = 2;
-static int currentTooth = 0;
+static volatile int currentTooth = 0;
+static volatile int crankRevolution = 0;     // 0 or 1 within the 720° engine cycle
+static CrankPosition crankPosition;
+static portMUX_TYPE crankPositionLock = portMUX_INITIALIZER_UNLOCKED;
+static CrankTiming crankTiming;
+static portMUX_TYPE crankTimingLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void TimerGroupIsr(void *para);
 
 /**
- * Configures the PWM channel for analog sensor emulation
+ * LEDC backend of the sensor output manager
  * 
- * @return ESP_OK if configuration was successful
+ * @param timer LEDC timer
+ * @param frequencyHz Timer frequency
+ * @param resolutionBits Duty resolution
  */
-static esp_err_t ConfigurePwm(void)
+static void LedcConfigureTimer(uint8_t timer, uint32_t frequencyHz, uint8_t resolutionBits)
 {
-    // Timer configuration for PWM
     ledc_timer_config_t ledc_timer = {
-        .duty_resolution = LEDC_DUTY_RES,
-        .freq_hz = LEDC_FREQUENCY,
+        .duty_resolution = resolutionBits,
+        .freq_hz = frequencyHz,
         .speed_mode = LEDC_MODE,
-        .timer_num = LEDC_TIMER,
+        .timer_num = timer,
         .clk_cfg = LEDC_AUTO_CLK,
     };
     ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
+}
 
-    // Channel configuration for TPS
+static void LedcConfigureChannel(uint8_t channel, uint8_t timer, uint8_t gpio)
+{
     ledc_channel_config_t ledc_channel = {
-        .channel = LEDC_CHANNEL,
+        .channel = channel,
         .duty = 0,
-        .gpio_num = PIN_EMU_TPS,
+        .gpio_num = gpio,
         .speed_mode = LEDC_MODE,
         .hpoint = 0,
-        .timer_sel = LEDC_TIMER
+        .timer_sel = timer
     };
     ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+}
+
+static void LedcSetFrequency(uint8_t timer, uint32_t frequencyHz)
+{
+    ledc_set_freq(LEDC_MODE, timer, frequencyHz);
+}
+
+static void LedcSetDuty(uint8_t channel, uint32_t duty)
+{
+    ledc_set_duty(LEDC_MODE, channel, duty);
+}
+
+static void LedcUpdateDuty(uint8_t channel)
+{
+    ledc_update_duty(LEDC_MODE, channel);
+}
+
+static const SensorOutputDriver ledcDriver = {
+    .configureTimer = LedcConfigureTimer,
+    .configureChannel = LedcConfigureChannel,
+    .setFrequency = LedcSetFrequency,
+    .setDuty = LedcSetDuty,
+    .updateDuty = LedcUpdateDuty
+};
+
+/**
+ * Configures the PWM channels for analog sensor emulation
+ * 
+ * @return ESP_OK if configuration was successful
+ */
+static esp_err_t ConfigurePwm(void)
+{
+    if (!SensorOutputsInit(&sensorOutputs, sensorOutputConfig, sensorOutputTimers,
+                           LEDC_TIMER_COUNT, &ledcDriver)) {
+        ESP_LOGE(TAG, "Invalid sensor output table");
+        return ESP_FAIL;
+    }
+
+    // MAP keeps the frequency signal used before the output manager
+    SensorOutputsSetMode(&sensorOutputs, SENSOR_OUT_MAP, OUTPUT_MODE_FREQUENCY);
 
     return ESP_OK;
 }
@@ -190,16 +347,12 @@ static esp_err_t ConfigurePwm(void)
  */
 static esp_err_t ConfigureGPIO(void)
 {
-    // Configure pins for digital sensor emulation
+    // Configure pins for digital sensor emulation (analog outputs belong to LEDC)
     gpio_config_t io_conf_output = {
         .intr_type = GPIO_INTR_DISABLE,
         .mode = GPIO_MODE_OUTPUT,
         .pin_bit_mask = (1ULL << PIN_EMU_CKP) | 
-                        (1ULL << PIN_EMU_CMP) |
-                        (1ULL << PIN_EMU_MAP) |
-                        (1ULL << PIN_EMU_MAF) |
-                        (1ULL << PIN_EMU_ECT) |
-                        (1ULL << PIN_EMU_IAT),
+                        (1ULL << PIN_EMU_CMP),
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .pull_up_en = GPIO_PULLUP_DISABLE
     };
@@ -243,13 +396,33 @@ static esp_err_t ConfigureUART(void)
     };
     
     // Configure UART for terminal communication
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_0, 1024 * 2, 0, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_0, CONSOLE_RX_BUFFER_SIZE, 0,
+                                        CONSOLE_EVENT_QUEUE_SIZE, &consoleEventQueue, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM_0, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(UART_NUM_0, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     
+    // Configure UART for binary telemetry (TX only, high baud rate)
+    uart_config_t telemetry_config = uart_config;
+    telemetry_config.baud_rate = TELEMETRY_BAUD_RATE;
+    ESP_ERROR_CHECK(uart_driver_install(TELEMETRY_UART, 256, TELEMETRY_UART_TX_SIZE, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_param_config(TELEMETRY_UART, &telemetry_config));
+    ESP_ERROR_CHECK(uart_set_pin(TELEMETRY_UART, PIN_TELEMETRY_TX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    
     return ESP_OK;
 }
 
+/**
+ * Calculates the duration of one CKP tooth in timer ticks
+ * Integer math only, so it can be used from the timer ISR
+ * 
+ * @param rpm Engine speed
+ * @return Timer ticks per tooth
+ */
+static uint32_t CkpToothTicks(uint16_t rpm)
+{
+    return (uint32_t)((uint64_t)TIMER_SCALE * 60 / ((uint32_t)rpm * TOTAL_TEETH));
+}
+
 /**
  * Configures the timer for CKP/CMP signal generation
  * 
@@ -269,9 +442,16 @@ static esp_err_t ConfigureTimer(void)
     ESP_ERROR_CHECK(timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0));
     
     // Calculate interval for CKP signal based on RPM
-    double ckp_interval = (60.0 / engineParams.rpm) / (TOTAL_TEETH - MISSING_TEETH);
-    ESP_ERROR_CHECK(timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, ckp_interval * TIMER_SCALE));
+    uint32_t toothTicks = CkpToothTicks(engineParams.rpm);
+    ESP_ERROR_CHECK(timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, toothTicks));
+    
+    // Crank angle reference starts at tooth 0 of the first revolution
+    crankPosition.tooth = 0;
+    crankPosition.teethPerRev = TOTAL_TEETH;
+    crankPosition.toothPeriodUs = (uint32_t)((uint64_t)toothTicks * 1000000 / TIMER_SCALE);
+    crankPosition.toothTime = esp_timer_get_time();
     
+    ESP_ERROR_CHECK(timer_isr_register(TIMER_GROUP_0, TIMER_0, TimerGroupIsr, NULL, 0, NULL));
     ESP_ERROR_CHECK(timer_enable_intr(TIMER_GROUP_0, TIMER_0));
     ESP_ERROR_CHECK(timer_start(TIMER_GROUP_0, TIMER_0));
     
@@ -279,26 +459,22 @@ static esp_err_t ConfigureTimer(void)
 }
 
 /**
- * Generates PWM value based on sensor value and range
+ * Converts a sensor value to a voltage with a linear transfer function
  * 
  * @param value Current sensor value
  * @param minValue Minimum sensor range value
  * @param maxValue Maximum sensor range value
- * @return Duty cycle value (0-8191)
+ * @param minMv Voltage at minValue (mV)
+ * @param maxMv Voltage at maxValue (mV)
+ * @return Voltage (mV)
  */
-static uint32_t CalculatePwmDuty(int value, int minValue, int maxValue)
+static uint32_t LinearMillivolts(int value, int minValue, int maxValue, uint32_t minMv, uint32_t maxMv)
 {
-    const uint32_t MAX_DUTY = (1 << LEDC_DUTY_RES) - 1;
-    
     // Limit value to range
     if (value < minValue) value = minValue;
     if (value > maxValue) value = maxValue;
     
-    // Calculate percentage (0.0 - 1.0)
-    float percentage = (float)(value - minValue) / (float)(maxValue - minValue);
-    
-    // Calculate duty cycle (inversely proportional for some sensors like NTC)
-    return (uint32_t)(percentage * MAX_DUTY);
+    return minMv + (uint32_t)(value - minValue) * (maxMv - minMv) / (uint32_t)(maxValue - minValue);
 }
 
 /**
@@ -306,32 +482,48 @@ static uint32_t CalculatePwmDuty(int value, int minValue, int maxValue)
  */
 static void UpdateTpsSensor(void)
 {
-    uint32_t duty = CalculatePwmDuty(engineParams.tps, TPS_MIN, TPS_MAX);
-    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, duty);
-    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL);
+    SensorOutputsSetMillivolts(&sensorOutputs, SENSOR_OUT_TPS,
+                               LinearMillivolts(engineParams.tps, TPS_MIN, TPS_MAX, 0, 5000));
 }
 
 /**
- * Updates the MAP sensor signal (implemented with PWM)
+ * Updates the MAP sensor signal (frequency or voltage type sensor)
  */
 static void UpdateMapSensor(void)
 {
-    // For MAP we use variable PWM frequency based on pressure
-    // 100 Hz higher for every additional 10 kPa
-    int frequency = 100 + (engineParams.map - MAP_MIN) * 10;
-    ledc_set_freq(LEDC_MODE, LEDC_TIMER, frequency);
+    // Frequency type: 100 Hz higher for every additional 10 kPa
+    SensorOutputsSetFrequency(&sensorOutputs, SENSOR_OUT_MAP, 100 + (engineParams.map - MAP_MIN) * 10);
+    
+    // Voltage type: 0.5 V at minimum pressure, 4.5 V at atmospheric pressure
+    SensorOutputsSetMillivolts(&sensorOutputs, SENSOR_OUT_MAP,
+                               LinearMillivolts(engineParams.map, MAP_MIN, MAP_MAX, 500, 4500));
 }
 
 /**
- * Updates the MAF sensor emulation
+ * Updates the MAF sensor signal (voltage or frequency type sensor)
  */
 static void UpdateMafSensor(void)
 {
-    // Basic implementation - in a real system DAC would be used
-    // For simple emulation we use PWM output with duty cycle
-    uint32_t duty = CalculatePwmDuty(engineParams.maf, MAF_MIN, MAF_MAX);
+    // Voltage type: full output range over the flow range
+    SensorOutputsSetMillivolts(&sensorOutputs, SENSOR_OUT_MAF,
+                               LinearMillivolts(engineParams.maf, MAF_MIN, MAF_MAX, 0, 5000));
     
-    // Here output to an external DAC or filtered PWM would be implemented
+    // Frequency type: 2 kHz at idle to 10 kHz at full load
+    SensorOutputsSetFrequency(&sensorOutputs, SENSOR_OUT_MAF,
+                              2000 + (engineParams.maf - MAF_MIN) * 8000 / (MAF_MAX - MAF_MIN));
+}
+
+/**
+ * Drives one NTC sensor output from the precomputed curve tables
+ * 
+ * @param output Sensor output
+ * @param tempTenths Emulated temperature (tenths of °C)
+ */
+static void UpdateNtcSensor(SensorOutputId output, int16_t tempTenths)
+{
+    NtcReading reading;
+    NtcLookup(ntcCurve, tempTenths, &reading);
+    SensorOutputsSetLevel(&sensorOutputs, output, reading.output);
 }
 
 /**
@@ -339,20 +531,7 @@ static void UpdateMafSensor(void)
  */
 static void UpdateEctSensor(void)
 {
-    // For temperature sensors a digital potentiometer or resistor network would be used
-    // This is a simulated implementation for demonstration purposes
-    float resistance = 0;
-    
-    // Simplified NTC resistance calculation
-    if (engineParams.ect > -40 && engineParams.ect < 150) {
-        // Simplified formula: R = R0 * e^(B*(1/T - 1/T0))
-        // Where R0 = 2.5kOhm at 25°C, B = 3380
-        float t1 = 1.0f / (273.15f + (float)engineParams.ect);
-        float t0 = 1.0f / (273.15f + 25.0f);  // Reference temperature (25°C)
-        resistance = 2500.0f * expf(3380.0f * (t1 - t0));
-    }
-    
-    ESP_LOGI(TAG, "ECT: %d°C, Resistance: %.2f Ohm", engineParams.ect, resistance);
+    UpdateNtcSensor(SENSOR_OUT_ECT, EngineModelCoolant(&engineModel));
 }
 
 /**
@@ -360,16 +539,29 @@ static void UpdateEctSensor(void)
  */
 static void UpdateIatSensor(void)
 {
-    // Similar implementation to ECT
-    float resistance = 0;
+    UpdateNtcSensor(SENSOR_OUT_IAT, engineParams.iat * 10);
+}
+
+/**
+ * Updates the O2 sensor signal
+ * In closed loop the signal follows the lambda of the engine model, so it
+ * reacts to the injection of the ECU under test
+ */
+static void UpdateO2Sensor(void)
+{
+    switch (o2SensorType) {
+        case O2_SENSOR_NARROWBAND:
+            engineParams.o2 = O2NarrowbandMillivolts(EngineModelLambda(&engineModel));
+            break;
     
-    if (engineParams.iat > -40 && engineParams.iat < 150) {
-        float t1 = 1.0f / (273.15f + (float)engineParams.iat);
-        float t0 = 1.0f / (273.15f + 25.0f);
-        resistance = 2500.0f * expf(3380.0f * (t1 - t0));
-    }
+        case O2_SENSOR_WIDEBAND:
+            engineParams.o2 = O2WidebandMillivolts(EngineModelLambda(&engineModel));
+            break;
     
-    ESP_LOGI(TAG, "IAT: %d°C, Resistance: %.2f Ohm", engineParams.iat, resistance);
+        default:
+            break;
+    }
+    SensorOutputsSetMillivolts(&sensorOutputs, SENSOR_OUT_O2, engineParams.o2);
 }
 
 /**
@@ -383,8 +575,38 @@ static void IRAM_ATTR TimerGroupIsr(void *para)
     timer_group_clr_intr_status_in_isr(TIMER_GROUP_0, TIMER_0);
     timer_group_enable_alarm_in_isr(TIMER_GROUP_0, TIMER_0);
     
+    uint64_t now = esp_timer_get_time();
+    uint32_t toothTicks = CkpToothTicks(engineParams.rpm);
+    
     // Increment tooth position
     currentTooth = (currentTooth + 1) % TOTAL_TEETH;
+    if (currentTooth == 0) {
+        crankRevolution ^= 1;
+    }
+    
+    // Publish the new tooth as the reference for edge angles
+    portENTER_CRITICAL_ISR(&crankPositionLock);
+    crankPosition.tooth = crankRevolution * TOTAL_TEETH + currentTooth;
+    crankPosition.toothPeriodUs = (uint32_t)((uint64_t)toothTicks * 1000000 / TIMER_SCALE);
+    crankPosition.toothTime = now;
+    portEXIT_CRITICAL_ISR(&crankPositionLock);
+    
+    // Every second revolution closes a 720° engine cycle
+    if (currentTooth == 0) {
+        if (crankRevolution == 0 && engineParams.engineRunning) {
+            PulseEvent cycleEvent = {
+                .channel = PULSE_EVENT_CYCLE_END,
+                .timestamp = now
+            };
+            BaseType_t higherPriorityTaskWoken = pdFALSE;
+            if (xQueueSendFromISR(pulseEventQueue, &cycleEvent, &higherPriorityTaskWoken) != pdTRUE) {
+                droppedPulseEvents++;
+            }
+            if (higherPriorityTaskWoken) {
+                portYIELD_FROM_ISR();
+            }
+        }
+    }
     
     // Check if we are in the missing teeth position (58-59 in a 60-2)
     bool generatePulse = true;
@@ -396,51 +618,43 @@ static void IRAM_ATTR TimerGroupIsr(void *para)
     if (engineParams.engineRunning) {
         gpio_set_level(PIN_EMU_CKP, generatePulse ? 1 : 0);
         
-        // At a certain tooth, also generate CMP pulse (e.g., at tooth 10)
-        if (currentTooth == 10) {
+        // CMP pulse only on the first revolution, so the ECU sees the same phase as the angle reference
+        if (crankRevolution == 0 && currentTooth == CMP_PULSE_TOOTH) {
             gpio_set_level(PIN_EMU_CMP, 1);
-        } else if (currentTooth == 11) {
+        } else if (crankRevolution == 0 && currentTooth == CMP_PULSE_TOOTH + 1) {
             gpio_set_level(PIN_EMU_CMP, 0);
         }
     }
     
     // Recalculate interval based on current RPM
-    double ckp_interval = (60.0 / engineParams.rpm) / (TOTAL_TEETH - MISSING_TEETH);
-    timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, ckp_interval * TIMER_SCALE);
+    timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, toothTicks);
 }
 
 /**
  * ISR (Interrupt Service Routine) for monitoring input pins
  * 
- * @param arg Custom argument (pin number in this case)
+ * @param arg Custom argument (PulseChannel index in this case)
  */
 static void IRAM_ATTR GpioIsrHandler(void* arg)
 {
-    uint32_t gpio_num = (uint32_t)arg;
     PulseEvent event;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    
     event.timestamp = esp_timer_get_time();
+    event.channel = (uint8_t)(uintptr_t)arg;
+    event.rising = gpio_get_level(monitorPins[event.channel]) ? 1 : 0;
     
-    int level = gpio_get_level(gpio_num);
+    portENTER_CRITICAL_ISR(&crankPositionLock);
+    event.angle = CrankAngleAt(&crankPosition, event.timestamp);
+    portEXIT_CRITICAL_ISR(&crankPositionLock);
     
-    switch (gpio_num) {
-        case PIN_MON_INJ1:
-            event.type = level ? EVENT_INJ1_RISING : EVENT_INJ1_FALLING;
-            break;
-        case PIN_MON_INJ2:
-            event.type = level ? EVENT_INJ2_RISING : EVENT_INJ2_FALLING;
-            break;
-        case PIN_MON_INJ3:
-            event.type = level ? EVENT_INJ3_RISING : EVENT_INJ3_FALLING;
-            break;
-        case PIN_MON_INJ4:
-            event.type = level ? EVENT_INJ4_RISING : EVENT_INJ4_FALLING;
-            break;
-        case PIN_MON_COIL:
-            event.type = level ? EVENT_COIL_RISING : EVENT_COIL_FALLING;
-            break;
+    if (xQueueSendFromISR(pulseEventQueue, &event, &higherPriorityTaskWoken) != pdTRUE) {
+        droppedPulseEvents++;
     }
     
-    xQueueSendFromISR(pulseEventQueue, &event, NULL);
+    if (higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
 }
 
 /**
@@ -453,356 +667,1039 @@ static void UpdateAllSensors(void)
     UpdateMafSensor();
     UpdateEctSensor();
     UpdateIatSensor();
+    UpdateO2Sensor();
     
-    ESP_LOGI(TAG, "Sensors updated - RPM: %d, TPS: %d%%, MAP: %dkPa", 
-             engineParams.rpm, engineParams.tps, engineParams.map);
+    // Every output changes in the same step
+    SensorOutputsCommit(&sensorOutputs);
 }
 
 /**
- * Calculates sensor values based on physical relationships
- * For example, higher TPS (throttle) results in lower MAP (suction pressure)
+ * Logs the emulated engine state
  */
-static void CalculateSensorRelationships(void)
+static void LogEngineState(void)
 {
-    // Correlate TPS with MAP (higher throttle opening, higher manifold pressure)
-    if (engineParams.tps < 10) {
-        // Idle - high suction
-        engineParams.map = MAP_MIN + 15;
-    } else if (engineParams.tps > 90) {
-        // Throttle almost fully open - pressure close to atmospheric
-        engineParams.map = MAP_MAX - 5;
-    } else {
-        // Linear interpolation between minimum and maximum
-        engineParams.map = MAP_MIN + ((engineParams.tps * (MAP_MAX - MAP_MIN)) / 100);
-    }
+    NtcReading ect, iat;
     
-    // Correlate TPS with MAF (higher opening, higher air flow)
-    if (engineParams.tps < 10) {
-        // Minimum flow at idle
-        engineParams.maf = MAF_MIN + 3;
-    } else {
-        // Non-linear interpolation (flow increases exponentially with TPS)
-        float tpsPercentage = (float)engineParams.tps / 100.0f;
-        float mafRange = MAF_MAX - MAF_MIN;
-        engineParams.maf = MAF_MIN + (uint8_t)(mafRange * tpsPercentage * tpsPercentage);
-    }
+    xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+    uint16_t map = EngineModelMap(&engineModel);
+    uint32_t throttleFlow = engineModel.throttleFlow;
+    int16_t coolant = EngineModelCoolant(&engineModel);
+    uint16_t lambda = EngineModelLambda(&engineModel);
+    xSemaphoreGive(engineModelMutex);
+    
+    NtcLookup(ntcCurve, coolant, &ect);
+    NtcLookup(ntcCurve, engineParams.iat * 10, &iat);
+    
+    ESP_LOGI(TAG, "Engine - RPM: %d, TPS: %d%%, MAP: %u.%u kPa, MAF: %lu.%lu g/s, Lambda: %u.%03u",
+             engineParams.rpm, engineParams.tps, map / 10, map % 10,
+             throttleFlow / 1000, (throttleFlow % 1000) / 100, lambda / 1000, lambda % 1000);
+    ESP_LOGI(TAG, "ECT: %d.%d°C (%lu Ohm), IAT: %d°C (%lu Ohm), curve: %s", coolant / 10, abs(coolant % 10),
+             ect.resistance, engineParams.iat, iat.resistance, ntcCurveNames[ntcCurve]);
 }
 
 /**
- * Processes pulse events from the ECU output
+ * Injector pulse widths the ECU is currently generating, one per cylinder
+ * Injectors without a pulse in INJECTOR_STALE_US count as delivering no fuel
  * 
- * @param lastEvent The last detected pulse event
- * @param state Current output state
+ * @param now Current time (μs)
+ * @param pulses Output pulse width per cylinder (μs)
  */
-static void ProcessPulseEvent(PulseEvent lastEvent, OutputSignals* state)
+static void GetInjectorPulses(uint64_t now, uint32_t pulses[ENGINE_MAX_CYLINDERS])
 {
-    static uint64_t injStartTimes[4] = {0};
-    static uint64_t coilStartTime = 0;
+    memset(pulses, 0, ENGINE_MAX_CYLINDERS * sizeof(pulses[0]));
     
-    uint64_t pulseWidth = 0;
-    
-    switch (lastEvent.type) {
-        case EVENT_INJ1_RISING:
-            injStartTimes[0] = lastEvent.timestamp;
-            state->inj1Active = true;
-            break;
-        
-        case EVENT_INJ1_FALLING:
-            if (injStartTimes[0] > 0) {
-                pulseWidth = lastEvent.timestamp - injStartTimes[0];
-                if (pulseWidth > MIN_VALID_PULSE_US) {
-                    state->inj1PulseWidth = pulseWidth;
-                    ESP_LOGI(TAG, "Injector 1: %llu μs", pulseWidth);
-                }
-            }
-            state->inj1Active = false;
-            break;
-            
-        case EVENT_INJ2_RISING:
-            injStartTimes[1] = lastEvent.timestamp;
-            state->inj2Active = true;
-            break;
-            
-        case EVENT_INJ2_FALLING:
-            if (injStartTimes[1] > 0) {
-                pulseWidth = lastEvent.timestamp - injStartTimes[1];
-                if (pulseWidth > MIN_VALID_PULSE_US) {
-                    state->inj2PulseWidth = pulseWidth;
-                    ESP_LOGI(TAG, "Injector 2: %llu μs", pulseWidth);
-                }
-            }
-            state->inj2Active = false;
-            break;
-            
-        case EVENT_INJ3_RISING:
-            injStartTimes[2] = lastEvent.timestamp;
-            state->inj3Active = true;
-            break;
-            
-        case EVENT_INJ3_FALLING:
-            if (injStartTimes[2] > 0) {
-                pulseWidth = lastEvent.timestamp - injStartTimes[2];
-                if (pulseWidth > MIN_VALID_PULSE_US) {
-                    state->inj3PulseWidth = pulseWidth;
-                    ESP_LOGI(TAG, "Injector 3: %llu μs", pulseWidth);
-                }
-            }
-            state->inj3Active = false;
-            break;
-            
-        case EVENT_INJ4_RISING:
-            injStartTimes[3] = lastEvent.timestamp;
-            state->inj4Active = true;
-            break;
-            
-        case EVENT_INJ4_FALLING:
-            if (injStartTimes[3] > 0) {
-                pulseWidth = lastEvent.timestamp - injStartTimes[3];
-                if (pulseWidth > MIN_VALID_PULSE_US) {
-                    state->inj4PulseWidth = pulseWidth;
-                    ESP_LOGI(TAG, "Injector 4: %llu μs", pulseWidth);
-                }
-            }
-            state->inj4Active = false;
-            break;
-            
-        case EVENT_COIL_RISING:
-            coilStartTime = lastEvent.timestamp;
-            state->coilActive = true;
-            break;
-            
-        case EVENT_COIL_FALLING:
-            if (coilStartTime > 0) {
-                pulseWidth = lastEvent.timestamp - coilStartTime;
-                if (pulseWidth > MIN_VALID_PULSE_US) {
-                    state->coilDwell = pulseWidth;
-                    ESP_LOGI(TAG, "Coil Dwell: %llu μs", pulseWidth);
-                }
-            }
-            state->coilActive = false;
-            break;
+    portENTER_CRITICAL(&pulseStatsLock);
+    for (int i = PULSE_CHANNEL_INJ1; i < PULSE_INJECTOR_COUNT; i++) {
+        const PulseChannelStats* channel = &pulseStats.channels[i];
+        if (channel->lastRiseTime + INJECTOR_STALE_US > now) {
+            pulses[i] = channel->lastWidth;
+        }
     }
+    portEXIT_CRITICAL(&pulseStatsLock);
+}
+
+/**
+ * Copies the model outputs to the engine parameters
+ */
+static void PublishEngineModel(void)
+{
+    xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+    uint16_t map = EngineModelMap(&engineModel);
+    uint32_t throttleFlow = engineModel.throttleFlow;
+    int16_t coolant = EngineModelCoolant(&engineModel);
+    xSemaphoreGive(engineModelMutex);
     
-    state->lastUpdateTime = esp_timer_get_time() / 1000; // time in ms
+    engineParams.map = (map + 5) / 10;
+    engineParams.maf = (throttleFlow + 500) / 1000 > 255 ? 255 : (throttleFlow + 500) / 1000;
+    engineParams.ect = (coolant + (coolant >= 0 ? 5 : -5)) / 10;
 }
 
 /**
- * Analyzes ECU outputs and detects anomalies
+ * Queues one telemetry record for transmission
+ * Never waits for the UART: when the ring is full the frame is dropped and
+ * counted. The sequence number is taken and the frame queued under one
+ * mutex, so the decoder only sees a gap when a frame was really dropped;
+ * other senders wait at most one encode and one non-blocking ring write
  * 
- * @param state Current output signal state
+ * @param type Record type (TelemetryRecordType)
+ * @param payload Record data
+ * @param length Record size
  */
-static void DetectAnomalies(const OutputSignals* state)
+static void TelemetrySend(uint8_t type, const void* payload, size_t length)
 {
-    static uint32_t lastAnomalyTime = 0;
-    uint32_t currentTime = esp_timer_get_time() / 1000;
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint16_t sequence;
     
-    // Only check every second to avoid console saturation
-    if (currentTime - lastAnomalyTime < 1000) {
+    if (!telemetryEnabled) {
         return;
     }
     
-    lastAnomalyTime = currentTime;
+    xSemaphoreTake(telemetryMutex, portMAX_DELAY);
+    sequence = telemetrySequence++;
+    size_t frameLength = TelemetryEncodeFrame(type, sequence, payload, length, frame, sizeof(frame));
+    if (frameLength > 0 && xRingbufferSend(telemetryRing, frame, frameLength, 0) == pdTRUE) {
+        telemetryFramesQueued++;
+    } else {
+        telemetryFramesDropped++;
+    }
+    xSemaphoreGive(telemetryMutex);
+}
+
+/**
+ * Sends the timing figures of the engine cycle that just ended
+ */
+static void SendCycleTelemetry(void)
+{
+    CylinderTiming cylinders[CRANK_CYLINDERS];
+    uint32_t cycleCount;
     
-    // 1. Check for missing pulses in injectors
-    if (engineParams.engineRunning && engineParams.rpm > 0) {
-        if (state->inj1PulseWidth == 0 && currentTime > 2000) {
-            ESP_LOGE(TAG, "ANOMALY: No pulses in Injector 1");
-        }
-        
-        if (state->inj2PulseWidth == 0 && currentTime > 2000) {
-            ESP_LOGE(TAG, "ANOMALY: No pulses in Injector 2");
-        }
-        
-        if (state->inj3PulseWidth == 0 && currentTime > 2000) {
-            ESP_LOGE(TAG, "ANOMALY: No pulses in Injector 3");
-        }
-        
-        if (state->inj4PulseWidth == 0 && currentTime > 2000) {
-            ESP_LOGE(TAG, "ANOMALY: No pulses in Injector 4");
-        }
+    if (!telemetryEnabled) {
+        return;
+    }
+    
+    portENTER_CRITICAL(&crankTimingLock);
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        cylinders[i] = crankTiming.last[i];
     }
+    cycleCount = crankTiming.cycleCount;
+    portEXIT_CRITICAL(&crankTimingLock);
+    
+    uint64_t now = esp_timer_get_time();
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        TelemetryCylinderTiming record = {
+            .timestamp = now,
+            .cycle = cycleCount,
+            .cylinder = i,
+            .soi = cylinders[i].soi,
+            .eoi = cylinders[i].eoi,
+            .sparkAdvance = cylinders[i].sparkAdvance
+        };
+        TelemetrySend(TELEMETRY_CYLINDER_TIMING, &record, sizeof(record));
+    }
+}
+
+/**
+ * Sends the emulated engine state
+ */
+static void SendEngineTelemetry(void)
+{
+    TelemetryEngineState record = {
+        .timestamp = esp_timer_get_time(),
+        .rpm = engineParams.rpm,
+        .tps = engineParams.tps,
+        .map = engineParams.map,
+        .maf = engineParams.maf,
+        .ect = engineParams.ect,
+        .iat = engineParams.iat,
+        .running = engineParams.engineRunning ? 1 : 0
+    };
+    TelemetrySend(TELEMETRY_ENGINE_STATE, &record, sizeof(record));
+}
+
+/**
+ * Drains the telemetry ring into the telemetry UART
+ * This is the only task that may block on the link
+ * 
+ * @param pvParameters Task parameters (not used)
+ */
+static void TelemetryTask(void *pvParameters)
+{
+    size_t size;
     
-    // 2. Check balance between injectors (should not have more than 15% difference)
-    if (state->inj1PulseWidth > 0 && state->inj2PulseWidth > 0) {
-        float ratio = (float)state->inj1PulseWidth / (float)state->inj2PulseWidth;
-        if (ratio < (1.0 - PULSE_MARGIN) || ratio > (1.0 + PULSE_MARGIN)) {
-            ESP_LOGW(TAG, "ANOMALY: Imbalance between Injector 1 (%lu μs) and Injector 2 (%lu μs)", 
-                    state->inj1PulseWidth, state->inj2PulseWidth);
+    while (1) {
+        uint8_t* data = xRingbufferReceiveUpTo(telemetryRing, &size, portMAX_DELAY, TELEMETRY_CHUNK_SIZE);
+        if (data) {
+            uart_write_bytes(TELEMETRY_UART, (const char*)data, size);
+            vRingbufferReturnItem(telemetryRing, data);
         }
     }
+}
+
+/**
+ * Processes pulse events from the ECU output
+ * This runs for every edge, so it must not perform any I/O
+ * 
+ * @param event The detected pulse event
+ */
+static void ProcessPulseEvent(const PulseEvent* event)
+{
+    portENTER_CRITICAL(&pulseStatsLock);
+    PulseStatsProcessEdge(&pulseStats, (PulseChannel)event->channel, event->rising, event->timestamp);
+    portEXIT_CRITICAL(&pulseStatsLock);
+    
+    AnomalyEngineProcessEdge(&anomalyEngine, (PulseChannel)event->channel, event->rising,
+                             event->timestamp, event->angle);
     
-    // 3. Check that injection times increase with high TPS
-    if (engineParams.tps > 50 && state->inj1PulseWidth < 3000) {
-        ESP_LOGW(TAG, "ANOMALY: High TPS (%d%%) but low injection time (%lu μs)", 
-                engineParams.tps, state->inj1PulseWidth);
+    portENTER_CRITICAL(&crankTimingLock);
+    CrankTimingProcessEdge(&crankTiming, (PulseChannel)event->channel, event->rising, event->angle);
+    portEXIT_CRITICAL(&crankTimingLock);
+    
+    if (telemetryEnabled) {
+        TelemetryPulseEdge record = {
+            .timestamp = event->timestamp,
+            .channel = event->channel,
+            .rising = event->rising,
+            .angle = event->angle
+        };
+        TelemetrySend(TELEMETRY_PULSE_EDGE, &record, sizeof(record));
+    }
+}
+
+/**
+ * Copies the last measured width of every channel
+ * 
+ * @param widths Output array indexed by PulseChannel (μs)
+ */
+static void GetLastPulseWidths(uint32_t widths[PULSE_CHANNEL_COUNT])
+{
+    portENTER_CRITICAL(&pulseStatsLock);
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+        widths[i] = pulseStats.channels[i].lastWidth;
     }
+    portEXIT_CRITICAL(&pulseStatsLock);
+}
+
+/**
+ * Closes the engine cycle and reports anomalies raised or cleared in it
+ * Only state changes are logged, so a persistent fault is printed once
+ */
+static void DetectAnomalies(void)
+{
+    AnomalyDetection detections[MAX_CYCLE_DETECTIONS];
+    AnomalyContext context = {
+        .rpm = engineParams.rpm,
+        .tps = engineParams.tps
+    };
     
-    // 4. Check correlation between RPM and coil dwell
-    // Higher RPM, shorter dwell time
-    if (engineParams.rpm > 3000 && state->coilDwell > 4000) {
-        ESP_LOGW(TAG, "ANOMALY: High RPM (%d) but very long coil dwell (%lu μs)",
-                engineParams.rpm, state->coilDwell);
+    xSemaphoreTake(anomalyEngineMutex, portMAX_DELAY);
+    uint8_t count = AnomalyEngineEndCycle(&anomalyEngine, &context, detections, MAX_CYCLE_DETECTIONS);
+    xSemaphoreGive(anomalyEngineMutex);
+    
+    for (uint8_t i = 0; i < count; i++) {
+        const AnomalyDetection* det = &detections[i];
+    
+        if (!det->raised) {
+            ESP_LOGI(TAG, "Anomaly cleared: rule %d (%s) on %s", det->ruleIndex,
+                     AnomalyRuleTypeName(det->ruleType), channelNames[det->channel]);
+            continue;
+        }
+    
+        switch (det->ruleType) {
+            case RULE_PULSE_COUNT:
+                ESP_LOGE(TAG, "ANOMALY: %s produced %ld pulses in the cycle (expected %d)",
+                         channelNames[det->channel], det->value, det->limit);
+                break;
+            case RULE_IMBALANCE:
+                ESP_LOGW(TAG, "ANOMALY: Imbalance of %ld.%ld%% between %s and %s",
+                         det->value / 10, det->value % 10,
+                         channelNames[det->channel], channelNames[det->otherChannel]);
+                break;
+            case RULE_DWELL_CURVE:
+                ESP_LOGW(TAG, "ANOMALY: %s dwell %ld μs out of the expected curve at %d RPM",
+                         channelNames[det->channel], det->value, context.rpm);
+                break;
+            case RULE_INJECTION_PHASE:
+                ESP_LOGW(TAG, "ANOMALY: %s start of injection unstable or out of window (%ld.%ld°)",
+                         channelNames[det->channel], det->value / 10, det->value % 10);
+                break;
+            case RULE_LOAD_RESPONSE:
+                ESP_LOGW(TAG, "ANOMALY: High TPS (%d%%) but low injection time on %s (%ld μs)",
+                         context.tps, channelNames[det->channel], det->value);
+                break;
+            default:
+                break;
+        }
     }
 }
 
 /**
  * Task to handle pulse events from ISR
- * 
+ *
  * @param pvParameters Task parameters (not used)
  */
 static void PulseMonitorTask(void *pvParameters)
 {
     PulseEvent event;
     
-    // Initialize timestamps to avoid false positives
-    outputSignals.lastUpdateTime = esp_timer_get_time() / 1000;
-    
     while (1) {
         if (xQueueReceive(pulseEventQueue, &event, portMAX_DELAY)) {
-            // Process pulse event
-            ProcessPulseEvent(event, &outputSignals);
-            
-            // Analyze outputs to detect anomalies
-            DetectAnomalies(&outputSignals);
+            if (event.channel == PULSE_EVENT_CYCLE_END) {
+                // Publish the timing figures and evaluate the rules once per engine cycle
+                portENTER_CRITICAL(&crankTimingLock);
+                CrankTimingEndCycle(&crankTiming);
+                portEXIT_CRITICAL(&crankTimingLock);
+                SendCycleTelemetry();
+                DetectAnomalies();
+            } else {
+                // Process pulse event
+                ProcessPulseEvent(&event);
+            }
         }
     }
 }
 
 /**
- * Processes commands received via serial port
- * 
- * @param cmdBuffer Buffer containing the received command
- * @param length Command length
- * @return true if the command was recognized and processed
- */
-static bool ProcessCommand(const char* cmdBuffer, size_t length)
-{
-    if (strncmp(cmdBuffer, "rpm:", 4) == 0 && length > 4) {
-        int value = atoi(cmdBuffer + 4);
-        if (value >= RPM_MIN && value <= RPM_MAX) {
-            engineParams.rpm = value;
-            ESP_LOGI(TAG, "RPM set to: %d", engineParams.rpm);
-            return true;
+ * Prints one line of the output of a console command
+ * In script mode the TAG logs are limited to warnings, so the line goes
+ * straight to the console, before the ok/err line of the command
+ *
+ * @param format printf style format, without the final newline
+ */
+static void ConsoleReply(const char* format, ...)
+{
+    char line[CONSOLE_REPLY_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if (length > (int)sizeof(line) - 2) {
+        length = (int)sizeof(line) - 2;
+    }
+
+    if (scriptMode) {
+        line[length++] = '\n';
+        uart_write_bytes(UART_NUM_0, line, length);
+    } else {
+        ESP_LOGI(TAG, "%s", line);
+    }
+}
+
+/**
+ * Prints one line of a periodic report through the log
+ *
+ * @param format printf style format, without the final newline
+ */
+static void LogReply(const char* format, ...)
+{
+    char line[CONSOLE_REPLY_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    ESP_LOGI(TAG, "%s", line);
+}
+
+// Destination of the lines printed by the functions shared by commands and reports
+typedef void (*ReplyPrinter)(const char* format, ...);
+
+/**
+ * Prints the rule table and the channels with a raised anomaly
+ */
+static void PrintAnomalyRules(void)
+{
+    xSemaphoreTake(anomalyEngineMutex, portMAX_DELAY);
+    ConsoleReply("=== Anomaly rules (%lu cycles evaluated) ===", anomalyEngine.cycleCount);
+    for (uint8_t r = 0; r < anomalyEngine.ruleCount; r++) {
+        const AnomalyRule* rule = &anomalyEngine.rules[r];
+        ConsoleReply("%d: %-15s mask=0x%02X cycles=%d %s A=%d B=%d C=%d raised=0x%02X",
+                     r, AnomalyRuleTypeName(rule->type), rule->channelMask, rule->minCycles,
+                     rule->enabled ? "on " : "off", rule->paramA, rule->paramB, rule->paramC,
+                     anomalyEngine.raisedMask[r]);
+    }
+    xSemaphoreGive(anomalyEngineMutex);
+}
+
+/**
+ * Changes one rule of the table at runtime
+ * Format: "N:on", "N:off" or "N:A,B,C"
+ *
+ * @param args Text after "rule:"
+ * @return true if the rule was updated
+ */
+static bool ConfigureAnomalyRule(const char* args)
+{
+    char* rest;
+    long index = strtol(args, &rest, 10);
+    
+    if (rest == args || *rest != ':' || index < 0 || index >= anomalyEngine.ruleCount) {
+        return false;
+    }
+    rest++;
+    
+    xSemaphoreTake(anomalyEngineMutex, portMAX_DELAY);
+    AnomalyRule* rule = &anomalyEngine.rules[index];
+    bool ok = true;
+    long params[ANOMALY_RULE_PARAMS];
+    char extra;
+    
+    if (strcmp(rest, "on") == 0) {
+        rule->enabled = 1;
+    } else if (strcmp(rest, "off") == 0) {
+        rule->enabled = 0;
+        anomalyEngine.raisedMask[index] = 0;
+    } else if (sscanf(rest, "%ld,%ld,%ld%c", &params[0], &params[1], &params[2], &extra) == 3) {
+        // Every value must fit its int16_t field and the physical range of the rule
+        for (int i = 0; i < ANOMALY_RULE_PARAMS && ok; i++) {
+            int16_t min = 0, max = 0;
+            ok = AnomalyRuleParamRange(rule->type, i, &min, &max) && params[i] >= min && params[i] <= max;
+            if (!ok) {
+                ESP_LOGW(TAG, "Rule %ld (%s): %c=%ld out of range %d..%d", index, AnomalyRuleTypeName(rule->type),
+                         'A' + i, params[i], min, max);
+            }
         }
-    } else if (strncmp(cmdBuffer, "tps:", 4) == 0 && length > 4) {
-        int value = atoi(cmdBuffer + 4);
-        if (value >= TPS_MIN && value <= TPS_MAX) {
-            engineParams.tps = value;
-            ESP_LOGI(TAG, "TPS set to: %d%%", engineParams.tps);
-            return true;
+        if (ok) {
+            rule->paramA = (int16_t)params[0];
+            rule->paramB = (int16_t)params[1];
+            rule->paramC = (int16_t)params[2];
         }
-    } else if (strncmp(cmdBuffer, "ect:", 4) == 0 && length > 4) {
-        int value = atoi(cmdBuffer + 4);
-        if (value >= ECT_MIN && value <= ECT_MAX) {
-            engineParams.ect = value;
-            ESP_LOGI(TAG, "ECT set to: %d°C", engineParams.ect);
-            return true;
+    } else {
+        ok = false;
+    }
+    xSemaphoreGive(anomalyEngineMutex);
+    
+    if (ok) {
+        ESP_LOGI(TAG, "Rule %ld updated", index);
+    }
+    return ok;
+}
+
+/**
+ * Formats an angle in tenths of degree as "DDD.D°" or "---" when not measured
+ * 
+ * @param angle Angle (tenths of degree) or CRANK_ANGLE_UNKNOWN
+ * @param buffer Output buffer
+ * @param size Buffer size
+ * @return buffer
+ */
+static const char* FormatAngle(int16_t angle, char* buffer, size_t size)
+{
+    if (angle == CRANK_ANGLE_UNKNOWN) {
+        snprintf(buffer, size, "---");
+    } else {
+        snprintf(buffer, size, "%s%d.%d°", angle < 0 ? "-" : "", abs(angle) / 10, abs(angle) % 10);
+    }
+    return buffer;
+}
+
+/**
+ * Prints SOI/EOI and spark advance of every cylinder for the last engine cycle
+ * Angles are degrees before the firing TDC of each cylinder
+ *
+ * @param print ConsoleReply for the timing command, LogReply for the periodic report
+ */
+static void PrintCylinderTiming(ReplyPrinter print)
+{
+    CylinderTiming cylinders[CRANK_CYLINDERS];
+    int16_t tdcOffset;
+    uint32_t cycleCount;
+    char soi[12], eoi[12], advance[12];
+    
+    portENTER_CRITICAL(&crankTimingLock);
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        cylinders[i] = crankTiming.last[i];
+    }
+    tdcOffset = crankTiming.tdcOffset;
+    cycleCount = crankTiming.cycleCount;
+    portEXIT_CRITICAL(&crankTimingLock);
+    
+    print("--- Cylinder timing (cycle %lu, TDC offset %d.%d°, BTDC) ---",
+          cycleCount, tdcOffset / 10, tdcOffset % 10);
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        print("CYL%d SOI=%s EOI=%s advance=%s", i + 1,
+              FormatAngle(cylinders[i].soi, soi, sizeof(soi)),
+              FormatAngle(cylinders[i].eoi, eoi, sizeof(eoi)),
+              FormatAngle(cylinders[i].sparkAdvance, advance, sizeof(advance)));
+    }
+}
+
+/**
+ * Prints the aggregated pulse statistics and starts a new window
+ */
+static void ReportPulseStatistics(void)
+{
+    PulseChannelSummary summaries[PULSE_CHANNEL_COUNT];
+    uint32_t eventCount;
+    uint64_t windowStart;
+    uint64_t now = esp_timer_get_time();
+    
+    // Take a consistent snapshot and restart the window
+    portENTER_CRITICAL(&pulseStatsLock);
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+        PulseStatsSummarize(&pulseStats, (PulseChannel)i, &summaries[i]);
+    }
+    eventCount = pulseStats.eventCount;
+    windowStart = pulseStats.windowStart;
+    PulseStatsResetWindow(&pulseStats, now);
+    portEXIT_CRITICAL(&pulseStatsLock);
+    
+    // With telemetry enabled the summary goes only to the binary link
+    if (telemetryEnabled) {
+        for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+            const PulseChannelSummary* sum = &summaries[i];
+            TelemetryChannelStats record = {
+                .timestamp = now,
+                .windowUs = (uint32_t)(now - windowStart),
+                .channel = i,
+                .count = sum->count,
+                .last = sum->last,
+                .min = sum->min,
+                .max = sum->max,
+                .mean = sum->mean,
+                .stddev = sum->stddev,
+                .dutyPermille = sum->dutyPermille,
+                .freqCentiHz = sum->freqCentiHz
+            };
+            TelemetrySend(TELEMETRY_CHANNEL_STATS, &record, sizeof(record));
         }
-    } else if (strncmp(cmdBuffer, "iat:", 4) == 0 && length > 4) {
-        int value = atoi(cmdBuffer + 4);
-        if (value >= ECT_MIN && value <= ECT_MAX) { // Same range as ECT
-            engineParams.iat = value;
-            ESP_LOGI(TAG, "IAT set to: %d°C", engineParams.iat);
-            return true;
+    
+        TelemetryLinkStats link = {
+            .timestamp = now,
+            .framesQueued = telemetryFramesQueued,
+            .framesDropped = telemetryFramesDropped,
+            .edgesDropped = droppedPulseEvents
+        };
+        TelemetrySend(TELEMETRY_LINK_STATS, &link, sizeof(link));
+        return;
+    }
+    
+    uint32_t windowMs = (uint32_t)((now - windowStart) / 1000);
+    ESP_LOGI(TAG, "--- Pulse statistics (%lu ms, %lu edges, %lu dropped) ---",
+             windowMs, eventCount, droppedPulseEvents);
+    
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+        const PulseChannelSummary* sum = &summaries[i];
+        ESP_LOGI(TAG, "%s n=%lu last=%lu min=%lu max=%lu mean=%lu sd=%lu us duty=%u.%u%% f=%lu.%02lu Hz",
+                 channelNames[i], sum->count, sum->last, sum->min, sum->max, sum->mean, sum->stddev,
+                 sum->dutyPermille / 10, sum->dutyPermille % 10,
+                 sum->freqCentiHz / 100, sum->freqCentiHz % 100);
+    }
+    
+    PrintCylinderTiming(LogReply);
+}
+
+/**
+ * Low priority task that emits pulse statistics summaries
+ *
+ * @param pvParameters Task parameters (not used)
+ */
+static void StatsReportTask(void *pvParameters)
+{
+    while (1) {
+        vTaskDelay(statsReportPeriodMs / portTICK_PERIOD_MS);
+        ReportPulseStatistics();
+    }
+}
+
+/**
+ * Command handlers, called only with arguments already validated by the table
+ * 
+ * @param value Numeric argument (tenths for decimal arguments)
+ * @param text Raw argument text
+ * @return true if the command was applied
+ */
+static bool CmdSetRpm(int32_t value, const char* text)
+{
+    engineParams.rpm = value;
+    ESP_LOGI(TAG, "RPM set to: %d", engineParams.rpm);
+    return true;
+}
+
+static bool CmdSetTps(int32_t value, const char* text)
+{
+    engineParams.tps = value;
+    ESP_LOGI(TAG, "TPS set to: %d%%", engineParams.tps);
+    return true;
+}
+
+static bool CmdSetEct(int32_t value, const char* text)
+{
+    xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+    EngineModelSetCoolant(&engineModel, (int16_t)value);
+    xSemaphoreGive(engineModelMutex);
+    engineParams.ect = value;
+    ESP_LOGI(TAG, "ECT set to: %d°C", engineParams.ect);
+    return true;
+}
+
+static bool CmdWarmup(int32_t value, const char* text)
+{
+    bool enable;
+    if (strcmp(text, "on") == 0) {
+        enable = true;
+    } else if (strcmp(text, "off") == 0) {
+        enable = false;
+    } else {
+        return false;
+    }
+    xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+    engineModel.warmup = enable;
+    xSemaphoreGive(engineModelMutex);
+    ESP_LOGI(TAG, "Coolant warm-up %s", enable ? "enabled" : "disabled, ECT held");
+    return true;
+}
+
+static bool CmdSetIat(int32_t value, const char* text)
+{
+    engineParams.iat = value;
+    ESP_LOGI(TAG, "IAT set to: %d°C", engineParams.iat);
+    return true;
+}
+
+static bool CmdSetO2(int32_t value, const char* text)
+{
+    o2SensorType = O2_SENSOR_MANUAL;
+    engineParams.o2 = value;
+    ESP_LOGI(TAG, "O2 set to: %d mV (open loop)", engineParams.o2);
+    return true;
+}
+
+static bool CmdSetO2Sensor(int32_t value, const char* text)
+{
+    O2SensorType type = O2SensorTypeFromName(text);
+    if (type == O2_SENSOR_TYPE_COUNT) {
+        return false;
+    }
+    o2SensorType = type;
+    ESP_LOGI(TAG, "O2 sensor: %s", O2SensorTypeName(o2SensorType));
+    return true;
+}
+
+static bool CmdSetInjectorFlow(int32_t value, const char* text)
+{
+    char* rest;
+    long cylinder = strtol(text, &rest, 10);
+    
+    if (rest == text || *rest != ':' || cylinder < 1 || cylinder > engineModelConfig.cylinders) {
+        return false;
+    }
+    long flow = strtol(rest + 1, &rest, 10);
+    if (*rest != '\0' || flow < INJECTOR_FLOW_MIN || flow > INJECTOR_FLOW_MAX) {
+        return false;
+    }
+    
+    xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+    engineModelConfig.injectorFlowCcMin[cylinder - 1] = (uint16_t)flow;
+    xSemaphoreGive(engineModelMutex);
+    ESP_LOGI(TAG, "Cylinder %ld injector flow set to: %ld cc/min", cylinder, flow);
+    return true;
+}
+
+static bool CmdSetOutputMode(int32_t value, const char* text)
+{
+    char name[8];
+    const char* colon = strchr(text, ':');
+    size_t length = colon ? (size_t)(colon - text) : 0;
+    if (length == 0 || length >= sizeof(name)) {
+        return false;
+    }
+    memcpy(name, text, length);
+    name[length] = '\0';
+    
+    SensorOutputId output = SensorOutputFromName(&sensorOutputs, name);
+    SensorOutputMode mode;
+    if (strcmp(colon + 1, "voltage") == 0) {
+        mode = OUTPUT_MODE_VOLTAGE;
+    } else if (strcmp(colon + 1, "frequency") == 0) {
+        mode = OUTPUT_MODE_FREQUENCY;
+    } else {
+        return false;
+    }
+    if (!SensorOutputsSetMode(&sensorOutputs, output, mode)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "%s output set to %s mode", sensorOutputConfig[output].name, SensorOutputModeName(mode));
+    return true;
+}
+
+static bool CmdOutputs(int32_t value, const char* text)
+{
+    ConsoleReply("=== Sensor outputs (%lu steps with changes, %lu writes) ===",
+                 sensorOutputs.commits, sensorOutputs.writes);
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        const SensorOutputConfig* config = &sensorOutputConfig[i];
+        const SensorOutputState* state = &sensorOutputs.outputs[i];
+        if (state->appliedMode == OUTPUT_MODE_FREQUENCY) {
+            ConsoleReply("  %-4s GPIO%-2d timer %d ch %d  frequency %5lu Hz",
+                         config->name, config->gpio, config->timer, config->channel, state->appliedFrequency);
+        } else {
+            ConsoleReply("  %-4s GPIO%-2d timer %d ch %d  voltage   %5lu mV (duty %lu)",
+                         config->name, config->gpio, config->timer, config->channel,
+                         SensorOutputLevelToMillivolts(state->level), state->appliedDuty);
         }
-    } else if (strcmp(cmdBuffer, "status") == 0) {
-        ESP_LOGI(TAG, "=== System Status ===");
-        ESP_LOGI(TAG, "RPM: %d", engineParams.rpm);
-        ESP_LOGI(TAG, "TPS: %d%%", engineParams.tps);
-        ESP_LOGI(TAG, "MAP: %d kPa", engineParams.map);
-        ESP_LOGI(TAG, "MAF: %d g/s", engineParams.maf);
-        ESP_LOGI(TAG, "ECT: %d°C", engineParams.ect);
-        ESP_LOGI(TAG, "IAT: %d°C", engineParams.iat);
-        ESP_LOGI(TAG, "Engine: %s", engineParams.engineRunning ? "On" : "Off");
-        ESP_LOGI(TAG, "Injector 1: %lu μs", outputSignals.inj1PulseWidth);
-        ESP_LOGI(TAG, "Injector 2: %lu μs", outputSignals.inj2PulseWidth);
-        ESP_LOGI(TAG, "Injector 3: %lu μs", outputSignals.inj3PulseWidth);
-        ESP_LOGI(TAG, "Injector 4: %lu μs", outputSignals.inj4PulseWidth);
-        ESP_LOGI(TAG, "Coil Dwell: %lu μs", outputSignals.coilDwell);
-        return true;
-    } else if (strcmp(cmdBuffer, "start") == 0) {
-        engineParams.engineRunning = true;
-        ESP_LOGI(TAG, "Engine started");
-        return true;
-    } else if (strcmp(cmdBuffer, "stop") == 0) {
-        engineParams.engineRunning = false;
-        ESP_LOGI(TAG, "Engine stopped");
-        return true;
-    } else if (strcmp(cmdBuffer, "help") == 0) {
-        ESP_LOGI(TAG, "Available commands:");
-        ESP_LOGI(TAG, "  rpm:VALUE     - Set RPM (800-6000)");
-        ESP_LOGI(TAG, "  tps:VALUE     - Set throttle position (0-100%)");
-        ESP_LOGI(TAG, "  ect:VALUE     - Set coolant temperature (-40 to 120°C)");
-        ESP_LOGI(TAG, "  iat:VALUE     - Set intake air temperature (-40 to 120°C)");
-        ESP_LOGI(TAG, "  start         - Start engine (begin signals)");
-        ESP_LOGI(TAG, "  stop          - Stop engine (halt signals)");
-        ESP_LOGI(TAG, "  status        - Show current status");
-        ESP_LOGI(TAG, "  help          - Show this help");
-        return true;
-    }
-    
-    return false;
+    }
+    return true;
+}
+
+static bool CmdSetReportPeriod(int32_t value, const char* text)
+{
+    statsReportPeriodMs = value;
+    ESP_LOGI(TAG, "Statistics report period set to: %lu ms", statsReportPeriodMs);
+    return true;
+}
+
+static bool CmdSetTdc(int32_t value, const char* text)
+{
+    portENTER_CRITICAL(&crankTimingLock);
+    CrankTimingSetTdcOffset(&crankTiming, (int16_t)value);
+    portEXIT_CRITICAL(&crankTimingLock);
+    ESP_LOGI(TAG, "Cylinder 1 TDC set to: %ld.%ld°", value / 10, value % 10);
+    return true;
+}
+
+static bool CmdSetNtcCurve(int32_t value, const char* text)
+{
+    NtcCurve curve = NtcCurveFromName(text);
+    if (curve == NTC_CURVE_COUNT) {
+        return false;
+    }
+    ntcCurve = curve;
+    ESP_LOGI(TAG, "ECT/IAT sensor curve set to: %s", ntcCurveNames[ntcCurve]);
+    return true;
+}
+
+static bool CmdTelemetry(int32_t value, const char* text)
+{
+    if (strcmp(text, "on") == 0) {
+        telemetryEnabled = true;
+        ESP_LOGI(TAG, "Binary telemetry enabled on UART1 (%d baud)", TELEMETRY_BAUD_RATE);
+    } else if (strcmp(text, "off") == 0) {
+        telemetryEnabled = false;
+        ESP_LOGI(TAG, "Binary telemetry disabled (%lu frames sent, %lu dropped)",
+                 telemetryFramesQueued, telemetryFramesDropped);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool CmdTiming(int32_t value, const char* text)
+{
+    PrintCylinderTiming(ConsoleReply);
+    return true;
+}
+
+static bool CmdStatus(int32_t value, const char* text)
+{
+    ConsoleReply("=== System Status ===");
+    ConsoleReply("RPM: %d", engineParams.rpm);
+    ConsoleReply("TPS: %d%%", engineParams.tps);
+    ConsoleReply("MAP: %d kPa", engineParams.map);
+    ConsoleReply("MAF: %d g/s", engineParams.maf);
+    ConsoleReply("ECT: %d°C", engineParams.ect);
+    ConsoleReply("IAT: %d°C", engineParams.iat);
+    ConsoleReply("O2: %d mV (%s)", engineParams.o2, O2SensorTypeName(o2SensorType));
+    ConsoleReply("Lambda: %u (x1000), exhaust delay %u ms, warm-up %s", EngineModelLambda(&engineModel),
+                 engineModel.exhaustDelay * ENGINE_MODEL_STEP_US / 1000, engineModel.warmup ? "on" : "off");
+    for (int i = 0; i < engineModelConfig.cylinders; i++) {
+        ConsoleReply("Cylinder %d: lambda %u (x1000), fuel %lu μg, injector %u cc/min", i + 1,
+                     engineModel.cylinderLambda[i], engineModel.fuel[i], engineModelConfig.injectorFlowCcMin[i]);
+    }
+    ConsoleReply("Engine model: %lu steps, %lu overruns", engineModel.steps, engineModelOverruns);
+    ConsoleReply("Engine: %s", engineParams.engineRunning ? "On" : "Off");
+    uint32_t widths[PULSE_CHANNEL_COUNT];
+    GetLastPulseWidths(widths);
+    for (int i = PULSE_CHANNEL_INJ1; i < PULSE_INJECTOR_COUNT; i++) {
+        ConsoleReply("Injector %d: %lu μs", i + 1, widths[i]);
+    }
+    ConsoleReply("Coil Dwell: %lu μs", widths[PULSE_CHANNEL_COIL]);
+    ConsoleReply("Report period: %lu ms", statsReportPeriodMs);
+    ConsoleReply("Console: %lu commands, %lu overruns, %lu lines too long",
+                 consoleCommandCount, consoleOverruns, consoleLine.overflowCount);
+    return true;
+}
+
+static bool CmdRule(int32_t value, const char* text)
+{
+    return ConfigureAnomalyRule(text);
+}
+
+static bool CmdRules(int32_t value, const char* text)
+{
+    PrintAnomalyRules();
+    return true;
+}
+
+static bool CmdStart(int32_t value, const char* text)
+{
+    engineParams.engineRunning = true;
+    ESP_LOGI(TAG, "Engine started");
+    return true;
+}
+
+static bool CmdStop(int32_t value, const char* text)
+{
+    engineParams.engineRunning = false;
+    ESP_LOGI(TAG, "Engine stopped");
+    return true;
+}
+
+static bool CmdScript(int32_t value, const char* text)
+{
+    if (strcmp(text, "on") == 0) {
+        // Informative logs would limit the command rate to the console speed
+        ESP_LOGI(TAG, "Script mode: no echo, one ok/err line per command");
+        esp_log_level_set(TAG, ESP_LOG_WARN);
+        scriptMode = true;
+    } else if (strcmp(text, "off") == 0) {
+        scriptMode = false;
+        esp_log_level_set(TAG, ESP_LOG_INFO);
+        ESP_LOGI(TAG, "Interactive mode");
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool CmdHelp(int32_t value, const char* text);
+
+// Command table, searched by name for every received command
+static const CommandDef commandTable[] = {
+    // name        argument         min                   max                     handler              usage               help
+    { "rpm",       CMD_ARG_INT,     RPM_MIN,              RPM_MAX,                CmdSetRpm,           "rpm:VALUE",        "Set RPM (800-6000)" },
+    { "tps",       CMD_ARG_INT,     TPS_MIN,              TPS_MAX,                CmdSetTps,           "tps:VALUE",        "Set throttle position (0-100%)" },
+    { "ect",       CMD_ARG_INT,     ECT_MIN,              ECT_MAX,                CmdSetEct,           "ect:VALUE",        "Set coolant temperature (-40 to 120°C)" },
+    { "iat",       CMD_ARG_INT,     ECT_MIN,              ECT_MAX,                CmdSetIat,           "iat:VALUE",        "Set intake air temperature (-40 to 120°C)" },
+    { "warmup",    CMD_ARG_TEXT,    0,                    0,                      CmdWarmup,           "warmup:on|off",    "Coolant warm-up model, off holds the ECT value" },
+    { "o2",        CMD_ARG_INT,     O2_MIN,               O2_MAX,                 CmdSetO2,            "o2:MV",            "Set O2 sensor voltage (0-1000 mV), open loop" },
+    { "o2sensor",  CMD_ARG_TEXT,    0,                    0,                      CmdSetO2Sensor,      "o2sensor:TYPE",    "O2 signal: manual, narrowband or wideband (closed loop)" },
+    { "injflow",   CMD_ARG_TEXT,    0,                    0,                      CmdSetInjectorFlow,  "injflow:N:CCMIN",  "Static flow of the cylinder N injector (50-2000 cc/min)" },
+    { "ntc",       CMD_ARG_TEXT,    0,                    0,                      CmdSetNtcCurve,      "ntc:CURVE",        "ECT/IAT sensor curve (bosch, denso, gm, custom)" },
+    { "output",    CMD_ARG_TEXT,    0,                    0,                      CmdSetOutputMode,    "output:S:MODE",    "MAP or MAF signal type (voltage, frequency)" },
+    { "outputs",   CMD_ARG_NONE,    0,                    0,                      CmdOutputs,          "outputs",          "Show channel, mode and value of every analog output" },
+    { "report",    CMD_ARG_INT,     STATS_REPORT_MIN_MS,  STATS_REPORT_MAX_MS,    CmdSetReportPeriod,  "report:MS",        "Set pulse statistics period (100-60000 ms)" },
+    { "tdc",       CMD_ARG_DECIMAL, 0,                    CRANK_CYCLE_ANGLE - 1,  CmdSetTdc,           "tdc:DEG",          "Set cylinder 1 TDC after the first tooth (0-719.9°)" },
+    { "timing",    CMD_ARG_NONE,    0,                    0,                      CmdTiming,           "timing",           "Show SOI/EOI and spark advance per cylinder" },
+    { "telemetry", CMD_ARG_TEXT,    0,                    0,                      CmdTelemetry,        "telemetry:on|off", "Binary telemetry on UART1 instead of text summaries" },
+    { "rules",     CMD_ARG_NONE,    0,                    0,                      CmdRules,            "rules",            "List anomaly rules" },
+    { "rule",      CMD_ARG_TEXT,    0,                    0,                      CmdRule,             "rule:N:on|off",    "Enable or disable rule N, or rule:N:A,B,C to set its parameters" },
+    { "start",     CMD_ARG_NONE,    0,                    0,                      CmdStart,            "start",            "Start engine (begin signals)" },
+    { "stop",      CMD_ARG_NONE,    0,                    0,                      CmdStop,             "stop",             "Stop engine (halt signals)" },
+    { "status",    CMD_ARG_NONE,    0,                    0,                      CmdStatus,           "status",           "Show current status" },
+    { "script",    CMD_ARG_TEXT,    0,                    0,                      CmdScript,           "script:on|off",    "Fast mode for command files and host programs" },
+    { "help",      CMD_ARG_NONE,    0,                    0,                      CmdHelp,             "help",             "Show this help" }
+};
+
+#define COMMAND_COUNT (sizeof(commandTable) / sizeof(commandTable[0]))
+
+static bool CmdHelp(int32_t value, const char* text)
+{
+    ConsoleReply("Available commands (several per line separated by ';'):");
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        ConsoleReply("  %-16s - %s", commandTable[i].usage, commandTable[i].help);
+    }
+    return true;
+}
+
+/**
+ * Reports the result of one command
+ * Script mode answers every command, interactive mode only the failures
+ * 
+ * @param command Executed command
+ * @param result Execution result
+ * @param context Not used
+ */
+static void ReportCommandResult(const char* command, CommandResult result, void* context)
+{
+    consoleCommandCount++;
+    
+    if (scriptMode) {
+        char reply[COMMAND_MAX_LINE + 32];
+        int length = (result == CMD_OK)
+            ? snprintf(reply, sizeof(reply), "ok\n")
+            : snprintf(reply, sizeof(reply), "err %s: %s\n", CommandResultName(result), command);
+        uart_write_bytes(UART_NUM_0, reply, length < (int)sizeof(reply) ? length : (int)sizeof(reply) - 1);
+    } else if (result != CMD_OK) {
+        ESP_LOGW(TAG, "Command '%s' failed: %s", command, CommandResultName(result));
+    }
+}
+
+/**
+ * Executes every command of a received line
+ * 
+ * @param line Complete line without terminator
+ * @param context Not used
+ */
+static void HandleCommandLine(char* line, void* context)
+{
+    CommandExecuteLine(commandTable, COMMAND_COUNT, line, ReportCommandResult, NULL);
+}
+
+/**
+ * Echoes received characters in interactive mode
+ * 
+ * @param data Received bytes
+ * @param length Number of bytes
+ */
+static void EchoInput(const uint8_t* data, size_t length)
+{
+    size_t start = 0;
+    
+    // Terminals send only CR, the echo also needs LF to move to a new line
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '\r') {
+            uart_write_bytes(UART_NUM_0, (const char*)data + start, i - start);
+            uart_write_bytes(UART_NUM_0, "\r\n", 2);
+            start = i + 1;
+        }
+    }
+    uart_write_bytes(UART_NUM_0, (const char*)data + start, length - start);
 }
 
 /**
  * Task to handle user interface via serial port
+ * Waits for UART driver events and processes every byte available at once
  * 
  * @param pvParameters Task parameters (not used)
  */
 static void SerialInterfaceTask(void *pvParameters)
 {
-    char cmdBuffer[64];
-    size_t cmdIndex = 0;
+    uint8_t data[CONSOLE_READ_CHUNK];
+    uart_event_t event;
     
+    CommandLineInit(&consoleLine);
     ESP_LOGI(TAG, "\n=== ECU Test Bench - Control Interface ===");
     ESP_LOGI(TAG, "Type 'help' to see available commands");
     
     while (1) {
-        // Read data from serial port
-        uint8_t c;
-        int len = uart_read_bytes(UART_NUM_0, &c, 1, 20 / portTICK_PERIOD_MS);
-        
-        if (len > 0) {
-            // Local echo of character
-            uart_write_bytes(UART_NUM_0, (const char*)&c, 1);
-            
-            if (c == '\n' || c == '\r') {
-                // End of command
-                uart_write_bytes(UART_NUM_0, "\n", 1);
-                if (cmdIndex > 0) {
-                    cmdBuffer[cmdIndex] = '\0';
-                    if (!ProcessCommand(cmdBuffer, cmdIndex)) {
-                        ESP_LOGW(TAG, "Unrecognized command: %s", cmdBuffer);
+        if (!xQueueReceive(consoleEventQueue, &event, portMAX_DELAY)) {
+            continue;
+        }
+    
+        switch (event.type) {
+            case UART_DATA: {
+                // Drain everything buffered, not only the bytes of this event
+                size_t available = 0;
+                uart_get_buffered_data_len(UART_NUM_0, &available);
+                while (available > 0) {
+                    size_t chunk = available < sizeof(data) ? available : sizeof(data);
+                    int len = uart_read_bytes(UART_NUM_0, data, chunk, 0);
+                    if (len <= 0) {
+                        break;
                     }
-                    cmdIndex = 0;
+                    if (!scriptMode) {
+                        EchoInput(data, len);
+                    }
+                    CommandLineFeed(&consoleLine, data, len, HandleCommandLine, NULL);
+                    available -= len;
                 }
-            } else if (cmdIndex < sizeof(cmdBuffer) - 1) {
-                // Add character to buffer
-                cmdBuffer[cmdIndex++] = c;
+                break;
             }
+    
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // Input arrived faster than it was processed, the partial line is lost
+                consoleOverruns++;
+                uart_flush_input(UART_NUM_0);
+                xQueueReset(consoleEventQueue);
+                CommandLineDiscard(&consoleLine);
+                ESP_LOGW(TAG, "Console input overrun, pending input discarded");
+                break;
+    
+            default:
+                break;
         }
-        
-        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 }
 
 /**
- * Task to update engine simulation
+ * Wakes the engine simulation task every model step
+ * 
+ * @param arg Not used
+ */
+static void EngineModelTimerCallback(void *arg)
+{
+    xTaskNotifyGive(engineSimulationTaskHandle);
+}
+
+/**
+ * Task running the engine model at a fixed step of ENGINE_MODEL_STEP_US
+ * Steps missed while the task was delayed are run back to back, so the
+ * simulated time never drifts from real time
  * 
  * @param pvParameters Task parameters (not used)
  */
 static void EngineSimulationTask(void *pvParameters)
 {
+    uint32_t outputSteps = 0;
+    
     while (1) {
-        // Update relationships between sensors
-        CalculateSensorRelationships();
-        
-        // Update all sensors
-        UpdateAllSensors();
-        
-        // Wait before next update
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (pending > 1) {
+            engineModelOverruns += pending - 1;
+        }
+    
+        EngineModelInputs inputs = {
+            .rpm = engineParams.engineRunning ? engineParams.rpm : 0,
+            .tps = engineParams.tps,
+            .iat = engineParams.iat
+        };
+        GetInjectorPulses(esp_timer_get_time(), inputs.injectorPulseUs);
+    
+        xSemaphoreTake(engineModelMutex, portMAX_DELAY);
+        for (uint32_t i = 0; i < pending; i++) {
+            EngineModelStep(&engineModel, &inputs);
+        }
+        xSemaphoreGive(engineModelMutex);
+    
+        // Sensor outputs follow the model every ENGINE_OUTPUT_STEPS
+        outputSteps += pending;
+        if (outputSteps >= ENGINE_OUTPUT_STEPS) {
+            outputSteps = 0;
+            PublishEngineModel();
+            UpdateAllSensors();
+        }
+    }
+}
+
+/**
+ * Task to report the emulated engine state
+ * 
+ * @param pvParameters Task parameters (not used)
+ */
+static void EngineReportTask(void *pvParameters)
+{
+    while (1) {
+        LogEngineState();
+        SendEngineTelemetry();
+    
+        // Wait before next report
+        vTaskDelay(ENGINE_REPORT_MS / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * Starts the periodic timer of the engine model
+ * 
+ * @return ESP_OK if the timer was started
+ */
+static esp_err_t StartEngineModelTimer(void)
+{
+    const esp_timer_create_args_t timerArgs = {
+        .callback = EngineModelTimerCallback,
+        .name = "engine_model"
+    };
+    esp_timer_handle_t timer;
+    
+    esp_err_t ret = esp_timer_create(&timerArgs, &timer);
+    if (ret != ESP_OK) {
+        return ret;
     }
+    return esp_timer_start_periodic(timer, ENGINE_MODEL_STEP_US);
 }
 
 /**
@@ -814,6 +1711,29 @@ static esp_err_t InitializeSystem(void)
 {
     esp_err_t ret;
     
+    // Initialize pulse measurements
+    PulseStatsInit(&pulseStats, esp_timer_get_time());
+    
+    // Initialize anomaly detection with the default rule table
+    AnomalyEngineInit(&anomalyEngine, defaultAnomalyRules,
+                      sizeof(defaultAnomalyRules) / sizeof(defaultAnomalyRules[0]));
+    anomalyEngineMutex = xSemaphoreCreateMutex();
+    if (!anomalyEngineMutex) {
+        ESP_LOGE(TAG, "Error creating anomaly engine mutex");
+        return ESP_FAIL;
+    }
+    
+    // Initialize the engine model with the coolant at its default temperature
+    EngineModelInit(&engineModel, &engineModelConfig, ECT_DEFAULT);
+    engineModelMutex = xSemaphoreCreateMutex();
+    if (!engineModelMutex) {
+        ESP_LOGE(TAG, "Error creating engine model mutex");
+        return ESP_FAIL;
+    }
+    
+    // Initialize crank angle referenced timing
+    CrankTimingInit(&crankTiming, TDC_OFFSET_DEFAULT, firingOrder);
+    
     // Initialize event queue
     pulseEventQueue = xQueueCreate(QUEUE_SIZE, sizeof(PulseEvent));
     if (!pulseEventQueue) {
@@ -821,6 +1741,18 @@ static esp_err_t InitializeSystem(void)
         return ESP_FAIL;
     }
     
+    // Initialize telemetry ring (byte buffer, frames are written whole or dropped)
+    telemetryRing = xRingbufferCreate(TELEMETRY_RING_SIZE, RINGBUF_TYPE_BYTEBUF);
+    if (!telemetryRing) {
+        ESP_LOGE(TAG, "Error creating telemetry ring buffer");
+        return ESP_FAIL;
+    }
+    telemetryMutex = xSemaphoreCreateMutex();
+    if (!telemetryMutex) {
+        ESP_LOGE(TAG, "Error creating telemetry mutex");
+        return ESP_FAIL;
+    }
+    
     // Configure GPIO
     ret = ConfigureGPIO();
     if (ret != ESP_OK) {
@@ -849,12 +1781,10 @@ static esp_err_t InitializeSystem(void)
         return ret;
     }
     
-    // Attach interrupt handlers for monitoring pins
-    gpio_isr_handler_add(PIN_MON_INJ1, GpioIsrHandler, (void*) PIN_MON_INJ1);
-    gpio_isr_handler_add(PIN_MON_INJ2, GpioIsrHandler, (void*) PIN_MON_INJ2);
-    gpio_isr_handler_add(PIN_MON_INJ3, GpioIsrHandler, (void*) PIN_MON_INJ3);
-    gpio_isr_handler_add(PIN_MON_INJ4, GpioIsrHandler, (void*) PIN_MON_INJ4);
-    gpio_isr_handler_add(PIN_MON_COIL, GpioIsrHandler, (void*) PIN_MON_COIL);
+    // Attach interrupt handlers for monitoring pins (argument = channel index)
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+        gpio_isr_handler_add(monitorPins[i], GpioIsrHandler, (void*)(uintptr_t)i);
+    }
     
     return ESP_OK;
 }
@@ -876,7 +1806,15 @@ void app_main(void)
     // Create application tasks
     xTaskCreate(PulseMonitorTask, "pulse_monitor", 4096, NULL, 10, NULL);
     xTaskCreate(SerialInterfaceTask, "serial_interface", 4096, NULL, 5, NULL);
-    xTaskCreate(EngineSimulationTask, "engine_simulation", 4096, NULL, 5, NULL);
+    xTaskCreate(EngineSimulationTask, "engine_simulation", 4096, NULL, 6, &engineSimulationTaskHandle);
+    xTaskCreate(EngineReportTask, "engine_report", 4096, NULL, 4, NULL);
+    xTaskCreate(StatsReportTask, "stats_report", 4096, NULL, 2, NULL);
+    xTaskCreate(TelemetryTask, "telemetry", 2048, NULL, 3, NULL);
+    
+    // The model steps start once its task exists
+    if (StartEngineModelTimer() != ESP_OK) {
+        ESP_LOGE(TAG, "Error starting the engine model timer");
+    }
     
     ESP_LOGI(TAG, "ECU test bench system started successfully");
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+/**
+ * @file command_parser.c
+ * @brief Line assembly and table-driven command parsing for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Bytes can arrive in blocks of any size: partial lines are kept between
+ * calls and several lines in one block are all processed. Arguments are
+ * validated against the table before the handler runs, so handlers only
+ * receive values inside their range.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "command_parser.h"
+
+static const char* const resultNames[CMD_RESULT_COUNT] = {
+    "ok", "unknown command", "missing argument", "unexpected argument",
+    "invalid number", "out of range", "rejected"
+};
+
+/**
+ * Parses a signed integer, the whole text must be consumed
+ *
+ * @param text Text to parse
+ * @param value Output value
+ * @return true if the text is a valid integer
+ */
+static bool ParseInteger(const char* text, int32_t* value)
+{
+    bool negative = false;
+    int64_t result = 0;
+
+    if (*text == '-' || *text == '+') {
+        negative = (*text == '-');
+        text++;
+    }
+    if (!isdigit((unsigned char)*text)) {
+        return false;
+    }
+
+    while (isdigit((unsigned char)*text)) {
+        result = result * 10 + (*text++ - '0');
+        if (result > INT32_MAX) {
+            return false;
+        }
+    }
+
+    *value = (int32_t)(negative ? -result : result);
+    return *text == '\0';
+}
+
+/**
+ * Parses a number with up to one decimal into tenths ("117.5" -> 1175)
+ *
+ * @param text Text to parse
+ * @param value Output value in tenths
+ * @return true if the text is a valid number
+ */
+static bool ParseTenths(const char* text, int32_t* value)
+{
+    char integerPart[12];
+    const char* dot = strchr(text, '.');
+    int32_t whole;
+    int32_t tenths = 0;
+
+    if (!dot) {
+        if (!ParseInteger(text, &whole) || whole > INT32_MAX / 10 || whole < INT32_MIN / 10) {
+            return false;
+        }
+        *value = whole * 10;
+        return true;
+    }
+
+    size_t length = (size_t)(dot - text);
+    if (length == 0 || length >= sizeof(integerPart)) {
+        return false;
+    }
+    memcpy(integerPart, text, length);
+    integerPart[length] = '\0';
+
+    // "-0.5" must keep its sign even though the integer part is zero
+    bool negative = (integerPart[0] == '-');
+    if (!ParseInteger(integerPart, &whole) || whole > INT32_MAX / 10 || whole < INT32_MIN / 10) {
+        return false;
+    }
+    if (dot[1] != '\0') {
+        if (!isdigit((unsigned char)dot[1]) || dot[2] != '\0') {
+            return false;
+        }
+        tenths = dot[1] - '0';
+    }
+
+    *value = whole * 10 + (negative ? -tenths : tenths);
+    return true;
+}
+
+/**
+ * Removes leading and trailing spaces, modifying the text
+ *
+ * @param text Text to trim
+ * @return Start of the trimmed text
+ */
+static char* Trim(char* text)
+{
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+
+    size_t length = strlen(text);
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) {
+        text[--length] = '\0';
+    }
+
+    return text;
+}
+
+void CommandLineInit(CommandLineBuffer* buffer)
+{
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void CommandLineDiscard(CommandLineBuffer* buffer)
+{
+    buffer->length = 0;
+    buffer->overflow = false;
+}
+
+size_t CommandLineFeed(CommandLineBuffer* buffer, const uint8_t* data, size_t length,
+                       CommandLineHandler handler, void* context)
+{
+    size_t lines = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+
+        if (c == '\r' || c == '\n') {
+            // Line complete, an empty line (second half of CR+LF) is ignored
+            if (buffer->overflow) {
+                buffer->overflowCount++;
+            } else if (buffer->length > 0) {
+                buffer->line[buffer->length] = '\0';
+                handler(buffer->line, context);
+                lines++;
+            }
+            buffer->length = 0;
+            buffer->overflow = false;
+        } else if (c == '\b' || c == 0x7F) {
+            if (buffer->length > 0) {
+                buffer->length--;
+            }
+        } else if (buffer->length < COMMAND_MAX_LINE) {
+            buffer->line[buffer->length++] = (char)c;
+        } else {
+            buffer->overflow = true;
+        }
+    }
+
+    return lines;
+}
+
+CommandResult CommandExecute(const CommandDef* table, size_t count, const char* command)
+{
+    const char* colon = strchr(command, ':');
+    size_t nameLength = colon ? (size_t)(colon - command) : strlen(command);
+    const char* argument = colon ? colon + 1 : "";
+
+    for (size_t i = 0; i < count; i++) {
+        const CommandDef* def = &table[i];
+        if (strlen(def->name) != nameLength || strncmp(def->name, command, nameLength) != 0) {
+            continue;
+        }
+
+        int32_t value = 0;
+        switch (def->argType) {
+            case CMD_ARG_NONE:
+                if (colon) {
+                    return CMD_UNEXPECTED_ARG;
+                }
+                break;
+
+            case CMD_ARG_INT:
+            case CMD_ARG_DECIMAL: {
+                if (*argument == '\0') {
+                    return CMD_MISSING_ARG;
+                }
+                bool valid = (def->argType == CMD_ARG_INT) ? ParseInteger(argument, &value)
+                                                           : ParseTenths(argument, &value);
+                if (!valid) {
+                    return CMD_BAD_NUMBER;
+                }
+                if (value < def->min || value > def->max) {
+                    return CMD_OUT_OF_RANGE;
+                }
+                break;
+            }
+
+            case CMD_ARG_TEXT:
+                if (*argument == '\0') {
+                    return CMD_MISSING_ARG;
+                }
+                break;
+        }
+
+        return def->handler(value, argument) ? CMD_OK : CMD_REJECTED;
+    }
+
+    return CMD_UNKNOWN;
+}
+
+size_t CommandExecuteLine(const CommandDef* table, size_t count, char* line,
+                          CommandReport report, void* context)
+{
+    size_t executed = 0;
+
+    char* comment = strchr(line, '#');
+    if (comment) {
+        *comment = '\0';
+    }
+
+    char* command = line;
+    while (command) {
+        char* next = strchr(command, COMMAND_SEPARATOR);
+        if (next) {
+            *next++ = '\0';
+        }
+
+        command = Trim(command);
+        if (*command != '\0') {
+            CommandResult result = CommandExecute(table, count, command);
+            if (report) {
+                report(command, result, context);
+            }
+            executed++;
+        }
+        command = next;
+    }
+
+    return executed;
+}
+
+const char* CommandResultName(CommandResult result)
+{
+    return result < CMD_RESULT_COUNT ? resultNames[result] : "?";
+}
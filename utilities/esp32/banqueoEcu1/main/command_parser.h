@@ -0,0 +1,98 @@
+/**
+ * @file command_parser.h
+ * @brief Line assembly and table-driven command parsing for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest command line accepted (characters, without terminator)
+#define COMMAND_MAX_LINE        127
+
+// Separator of several commands in one line
+#define COMMAND_SEPARATOR       ';'
+
+// Argument expected after "name:"
+typedef enum {
+    CMD_ARG_NONE,                // Command without argument, e.g. "status"
+    CMD_ARG_INT,                 // Integer within [min, max], e.g. "rpm:2500"
+    CMD_ARG_DECIMAL,             // Number with up to one decimal, passed in tenths, e.g. "tdc:117.5"
+    CMD_ARG_TEXT                 // Free text validated by the handler, e.g. "rule:2:on"
+} CommandArgType;
+
+// Result of executing one command
+typedef enum {
+    CMD_OK,
+    CMD_UNKNOWN,                 // Name not found in the table
+    CMD_MISSING_ARG,             // Argument required but not given
+    CMD_UNEXPECTED_ARG,          // Argument given to a command without argument
+    CMD_BAD_NUMBER,              // Argument is not a valid number
+    CMD_OUT_OF_RANGE,            // Number outside [min, max]
+    CMD_REJECTED,                // The handler refused the argument
+    CMD_RESULT_COUNT
+} CommandResult;
+
+// Handler of a command: value holds the number, text the raw argument ("" when none)
+typedef bool (*CommandHandler)(int32_t value, const char* text);
+
+// One entry of the command table
+typedef struct {
+    const char* name;            // Text before ':'
+    CommandArgType argType;
+    int32_t min;                 // Valid range for numeric arguments (tenths for CMD_ARG_DECIMAL)
+    int32_t max;
+    CommandHandler handler;
+    const char* usage;           // Syntax shown by help
+    const char* help;            // Description shown by help
+} CommandDef;
+
+// Accumulates received bytes until a complete line is available
+typedef struct {
+    char line[COMMAND_MAX_LINE + 1];
+    size_t length;
+    bool overflow;               // Current line exceeded COMMAND_MAX_LINE and will be discarded
+    uint32_t overflowCount;      // Lines discarded for being too long
+} CommandLineBuffer;
+
+// Called for every complete line
+typedef void (*CommandLineHandler)(char* line, void* context);
+
+// Called after every command executed from a line
+typedef void (*CommandReport)(const char* command, CommandResult result, void* context);
+
+// Clears the line buffer
+void CommandLineInit(CommandLineBuffer* buffer);
+
+// Discards the partial line, keeping the counters
+void CommandLineDiscard(CommandLineBuffer* buffer);
+
+// Feeds received bytes, calling handler for every complete non-empty line
+// CR, LF and CR+LF end a line, backspace deletes the last character
+// Returns the number of complete lines found
+size_t CommandLineFeed(CommandLineBuffer* buffer, const uint8_t* data, size_t length,
+                       CommandLineHandler handler, void* context);
+
+// Executes one command ("name" or "name:argument") against the table
+CommandResult CommandExecute(const CommandDef* table, size_t count, const char* command);
+
+// Executes every command of a line separated by COMMAND_SEPARATOR, modifying the line
+// Text after '#' is a comment. Returns the number of commands executed
+size_t CommandExecuteLine(const CommandDef* table, size_t count, char* line,
+                          CommandReport report, void* context);
+
+// Returns a short description of a result
+const char* CommandResultName(CommandResult result);
+
+#endif // COMMAND_PARSER_H
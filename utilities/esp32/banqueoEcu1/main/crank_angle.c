@@ -0,0 +1,126 @@
+/**
+ * @file crank_angle.c
+ * @brief Crank angle reference and per-cylinder timing for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The angle of an edge is the angle of the tooth being generated plus
+ * the fraction of that tooth already elapsed. Injector edges are paired
+ * into SOI/EOI of their own cylinder, and every spark is assigned to the
+ * cylinder whose firing TDC comes next. All figures are expressed in
+ * tenths of degree before the firing TDC of the cylinder.
+ */
+
+#include "crank_angle.h"
+
+/**
+ * Normalizes an angle to the range [0, 720°)
+ *
+ * @param angle Angle (tenths of degree)
+ * @return Normalized angle
+ */
+static int32_t WrapCycleAngle(int32_t angle)
+{
+    angle %= CRANK_CYCLE_ANGLE;
+    return angle < 0 ? angle + CRANK_CYCLE_ANGLE : angle;
+}
+
+/**
+ * Marks every figure of a cycle as not measured
+ *
+ * @param cylinders Per-cylinder figures
+ */
+static void ClearCycle(CylinderTiming cylinders[CRANK_CYLINDERS])
+{
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        cylinders[i].soi = CRANK_ANGLE_UNKNOWN;
+        cylinders[i].eoi = CRANK_ANGLE_UNKNOWN;
+        cylinders[i].sparkAdvance = CRANK_ANGLE_UNKNOWN;
+    }
+}
+
+int16_t CrankAngleAt(const CrankPosition* position, uint64_t timestamp)
+{
+    int32_t toothAngle = 3600 / position->teethPerRev;
+    int32_t fraction = 0;
+
+    // Interpolate within the tooth, never reaching the next one
+    if (timestamp > position->toothTime && position->toothPeriodUs > 0) {
+        uint64_t elapsed = timestamp - position->toothTime;
+        fraction = (int32_t)(elapsed * toothAngle / position->toothPeriodUs);
+        if (fraction >= toothAngle) {
+            fraction = toothAngle - 1;
+        }
+    }
+
+    return (int16_t)WrapCycleAngle(position->tooth * toothAngle + fraction);
+}
+
+void CrankTimingInit(CrankTiming* timing, int16_t tdcOffset, const uint8_t firingOrder[CRANK_CYLINDERS])
+{
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        timing->firingOrder[i] = firingOrder[i];
+        timing->pendingSoi[i] = CRANK_ANGLE_UNKNOWN;
+    }
+    ClearCycle(timing->current);
+    ClearCycle(timing->last);
+    timing->cycleCount = 0;
+    CrankTimingSetTdcOffset(timing, tdcOffset);
+}
+
+void CrankTimingSetTdcOffset(CrankTiming* timing, int16_t tdcOffset)
+{
+    timing->tdcOffset = (int16_t)WrapCycleAngle(tdcOffset);
+
+    // Firing TDCs are evenly spaced over the cycle in firing order
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        int32_t tdc = timing->tdcOffset + i * (CRANK_CYCLE_ANGLE / CRANK_CYLINDERS);
+        timing->tdcAngle[timing->firingOrder[i]] = (int16_t)WrapCycleAngle(tdc);
+    }
+}
+
+void CrankTimingProcessEdge(CrankTiming* timing, PulseChannel channel, bool rising, int16_t angle)
+{
+    if (channel < PULSE_INJECTOR_COUNT) {
+        if (rising) {
+            timing->pendingSoi[channel] = angle;
+        } else if (timing->pendingSoi[channel] != CRANK_ANGLE_UNKNOWN) {
+            // The pulse belongs to the cycle in which it ends
+            int16_t tdc = timing->tdcAngle[channel];
+            timing->current[channel].soi = (int16_t)WrapCycleAngle(tdc - timing->pendingSoi[channel]);
+            timing->current[channel].eoi = (int16_t)WrapCycleAngle(tdc - angle);
+            timing->pendingSoi[channel] = CRANK_ANGLE_UNKNOWN;
+        }
+        return;
+    }
+
+    if (channel == PULSE_CHANNEL_COIL && !rising) {
+        // The spark happens at the end of the dwell
+        int best = -1;
+        int32_t bestAdvance = 0;
+        for (int i = 0; i < CRANK_CYLINDERS; i++) {
+            int32_t advance = WrapCycleAngle(timing->tdcAngle[i] - angle + CRANK_MAX_SPARK_RETARD)
+                              - CRANK_MAX_SPARK_RETARD;
+            if (best < 0 || advance < bestAdvance) {
+                best = i;
+                bestAdvance = advance;
+            }
+        }
+        timing->current[best].sparkAdvance = (int16_t)bestAdvance;
+    }
+}
+
+void CrankTimingEndCycle(CrankTiming* timing)
+{
+    for (int i = 0; i < CRANK_CYLINDERS; i++) {
+        timing->last[i] = timing->current[i];
+    }
+    ClearCycle(timing->current);
+    timing->cycleCount++;
+}
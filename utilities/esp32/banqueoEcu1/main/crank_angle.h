@@ -0,0 +1,74 @@
+/**
+ * @file crank_angle.h
+ * @brief Crank angle reference and per-cylinder timing for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef CRANK_ANGLE_H
+#define CRANK_ANGLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pulse_stats.h"
+
+// Full engine cycle in tenths of degree (720°)
+#define CRANK_CYCLE_ANGLE       7200
+
+// Number of cylinders, one injector channel per cylinder
+#define CRANK_CYLINDERS         PULSE_INJECTOR_COUNT
+
+// Value of a timing figure not measured in the last cycle
+#define CRANK_ANGLE_UNKNOWN     INT16_MIN
+
+// Spark retard accepted before the spark is assigned to the previous cylinder (tenths of degree)
+#define CRANK_MAX_SPARK_RETARD  300
+
+// Position of the emulated crankshaft, written by the CKP generator on every tooth
+typedef struct {
+    uint16_t tooth;              // Tooth index within the 720° cycle (0 to 2 * teethPerRev - 1)
+    uint16_t teethPerRev;        // Teeth per revolution, missing teeth included
+    uint32_t toothPeriodUs;      // Duration of the current tooth (μs)
+    uint64_t toothTime;          // Timestamp of the start of the current tooth (μs)
+} CrankPosition;
+
+// Timing figures of one cylinder, in tenths of degree before its firing TDC
+typedef struct {
+    int16_t soi;                 // Start of injection (0 to 7199)
+    int16_t eoi;                 // End of injection (0 to 7199)
+    int16_t sparkAdvance;        // Spark advance, negative when retarded after TDC
+} CylinderTiming;
+
+// Per-cylinder timing measurement state
+typedef struct {
+    int16_t tdcOffset;                       // Cylinder 1 firing TDC after tooth 0 (tenths of degree)
+    uint8_t firingOrder[CRANK_CYLINDERS];    // Cylinder indexes (0-based) in firing order
+    int16_t tdcAngle[CRANK_CYLINDERS];       // Firing TDC of every cylinder (tenths of degree)
+    int16_t pendingSoi[CRANK_CYLINDERS];     // Rising edge angle waiting for its falling edge
+    CylinderTiming current[CRANK_CYLINDERS]; // Figures of the cycle in progress
+    CylinderTiming last[CRANK_CYLINDERS];    // Figures of the last complete cycle
+    uint32_t cycleCount;
+} CrankTiming;
+
+// Returns the crank angle of a timestamp, interpolated within the current tooth (tenths of degree)
+int16_t CrankAngleAt(const CrankPosition* position, uint64_t timestamp);
+
+// Initializes the timing state, firingOrder holds 0-based cylinder indexes
+void CrankTimingInit(CrankTiming* timing, int16_t tdcOffset, const uint8_t firingOrder[CRANK_CYLINDERS]);
+
+// Changes the TDC reference and recomputes the TDC of every cylinder
+void CrankTimingSetTdcOffset(CrankTiming* timing, int16_t tdcOffset);
+
+// Feeds one edge of a monitored channel with its crank angle
+void CrankTimingProcessEdge(CrankTiming* timing, PulseChannel channel, bool rising, int16_t angle);
+
+// Publishes the figures of the cycle in progress and starts a new one
+void CrankTimingEndCycle(CrankTiming* timing);
+
+#endif // CRANK_ANGLE_H
@@ -0,0 +1,350 @@
+/**
+ * @file engine_model.c
+ * @brief Fixed-point mean-value engine model for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The manifold is a single volume filled through the throttle
+ * (compressible orifice flow) and emptied by the cylinders
+ * (speed-density with a volumetric efficiency table):
+ *
+ *   dP/dt = R*T/V * (throttle flow - cylinder flow)
+ *
+ * The pressure equation is integrated in 4 sub-steps per model step,
+ * since near wide open throttle its time constant falls below 1 ms.
+ * Only integer arithmetic is used, so the ESP32 and a host build give
+ * exactly the same results.
+ */
+
+#include <string.h>
+#include "engine_model.h"
+
+// Manifold sub-steps per model step
+#define MANIFOLD_SUBSTEPS       4
+#define SUBSTEP_US              (ENGINE_MODEL_STEP_US / MANIFOLD_SUBSTEPS)
+
+// Gas constant of air (J/(kg·K))
+#define AIR_GAS_CONSTANT        287
+
+// Gasoline density (mg/cc) and stoichiometric air/fuel ratio (× 10)
+#define FUEL_DENSITY_MG_CC      740
+#define STOICH_AFR_X10          147
+
+// Coolant heat balance
+#define HEAT_GAIN               73                // μ°C/s per mg/s of air burned
+#define HEAT_LOSS_TIME_S        2000              // Time constant of the losses with the thermostat closed
+#define RADIATOR_GAIN           83                // Radiator fully open (1/s × 1000)
+#define THERMOSTAT_RANGE_C      7                 // From starting to open to fully open (°C)
+
+// Lambda filter state is lambda × 1000 in Q16
+#define LAMBDA_STOICH_Q16       (1000 << 16)
+
+// Throttle flow function psi(P manifold / P ambient) in Q15, 33 points from 0 to 1
+// psi = sqrt(2k/(k-1) * (pr^(2/k) - pr^((k+1)/k))), k = 1.4, constant below 0.528 (choked flow)
+static const uint16_t throttleFlowFunction[33] = {
+    22437, 22437, 22437, 22437, 22437, 22437, 22437, 22437,
+    22437, 22437, 22437, 22437, 22437, 22437, 22437, 22437,
+    22437, 22437, 22379, 22224, 21968, 21608, 21137, 20548,
+    19830, 18967, 17939, 16715, 15248, 13458, 11191,  8054,
+        0
+};
+
+// Effective throttle area (mm²) every 5% of TPS, idle air bypass included
+static const uint16_t throttleArea[21] = {
+      12,   12,   14,   17,   25,   36,   54,   79,  112,  155,  208,
+     272,  350,  442,  548,  672,  813,  972, 1152, 1353, 1576
+};
+
+// Volumetric efficiency (%) every 1000 rpm (rows) and 20 kPa from 20 kPa (columns)
+#define VE_RPM_STEP             1000
+#define VE_RPM_POINTS           8
+#define VE_MAP_FIRST_PA         20000
+#define VE_MAP_STEP_PA          20000
+#define VE_MAP_POINTS           5
+static const uint8_t volumetricEfficiency[VE_RPM_POINTS][VE_MAP_POINTS] = {
+    //  20   40   60   80  100 kPa
+    {   40,  45,  50,  55,  55 },   //    0 rpm
+    {   55,  60,  65,  70,  72 },   // 1000 rpm
+    {   65,  72,  78,  82,  84 },   // 2000 rpm
+    {   70,  78,  84,  88,  90 },   // 3000 rpm
+    {   72,  80,  86,  90,  93 },   // 4000 rpm
+    {   70,  78,  85,  89,  92 },   // 5000 rpm
+    {   66,  74,  82,  86,  88 },   // 6000 rpm
+    {   60,  68,  76,  80,  82 }    // 7000 rpm
+};
+
+/**
+ * Integer square root
+ *
+ * @param value Radicand
+ * @return Largest integer whose square does not exceed value
+ */
+static uint32_t SquareRoot(uint64_t value)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+/**
+ * Interpolates an evenly spaced table
+ *
+ * @param table Table values
+ * @param points Number of points
+ * @param position Position in the table (Q10, 1024 = second point)
+ * @return Interpolated value
+ */
+static int32_t InterpolateTable(const uint16_t* table, int points, uint32_t position)
+{
+    uint32_t index = position >> 10;
+    if (index >= (uint32_t)(points - 1)) {
+        return table[points - 1];
+    }
+    int32_t frac = position & 1023;
+    return table[index] + (((int32_t)table[index + 1] - table[index]) * frac) / 1024;
+}
+
+/**
+ * Air flow through the throttle
+ *
+ * @param area Effective throttle area (mm²)
+ * @param mapPa Manifold pressure (Pa)
+ * @param sqrtRtQ8 sqrt(R*T) of the intake air (Q8)
+ * @return Mass flow (mg/s)
+ */
+static uint32_t ThrottleFlow(int32_t area, int32_t mapPa, uint32_t sqrtRtQ8)
+{
+    if (mapPa < 0) {
+        mapPa = 0;
+    }
+    // Pressure ratio in Q10 table positions (32 intervals)
+    uint32_t position = (uint32_t)((int64_t)mapPa * 32 * 1024 / ENGINE_MODEL_AMBIENT_PA);
+    int32_t psi = InterpolateTable(throttleFlowFunction, 33, position);
+
+    // m = A * P0 * psi / sqrt(R*T), mm² give mg/s directly
+    return (uint32_t)((int64_t)area * ENGINE_MODEL_AMBIENT_PA * psi * 256 / ((int64_t)sqrtRtQ8 * 32768));
+}
+
+/**
+ * Volumetric efficiency from the table (bilinear interpolation)
+ *
+ * @param rpm Engine speed
+ * @param mapPa Manifold pressure (Pa)
+ * @return Volumetric efficiency (tenths of %)
+ */
+static int32_t VolumetricEfficiency(uint16_t rpm, int32_t mapPa)
+{
+    int32_t r = rpm * 1024 / VE_RPM_STEP;
+    int32_t m = (mapPa - VE_MAP_FIRST_PA) * 1024 / VE_MAP_STEP_PA;
+    if (r > (VE_RPM_POINTS - 1) * 1024) r = (VE_RPM_POINTS - 1) * 1024;
+    if (m < 0) m = 0;
+    if (m > (VE_MAP_POINTS - 1) * 1024) m = (VE_MAP_POINTS - 1) * 1024;
+
+    int ri = r >> 10, mi = m >> 10;
+    int32_t rf = r & 1023, mf = m & 1023;
+    int ri1 = (ri < VE_RPM_POINTS - 1) ? ri + 1 : ri;
+    int mi1 = (mi < VE_MAP_POINTS - 1) ? mi + 1 : mi;
+
+    int32_t low = volumetricEfficiency[ri][mi] * (1024 - mf) + volumetricEfficiency[ri][mi1] * mf;
+    int32_t high = volumetricEfficiency[ri1][mi] * (1024 - mf) + volumetricEfficiency[ri1][mi1] * mf;
+    return (int32_t)(((int64_t)low * (1024 - rf) + (int64_t)high * rf) * 10 / (1024 * 1024));
+}
+
+/**
+ * Air flow into the cylinders (speed-density)
+ *
+ * @param config Engine constants
+ * @param rpm Engine speed
+ * @param mapPa Manifold pressure (Pa)
+ * @param temperatureK Intake air temperature (K)
+ * @return Mass flow (mg/s)
+ */
+static uint32_t CylinderFlow(const EngineModelConfig* config, uint16_t rpm, int32_t mapPa, int32_t temperatureK)
+{
+    if (rpm == 0 || mapPa <= 0) {
+        return 0;
+    }
+    // m = VE * P * Vd * n / (120 * R * T), cc and Pa give mg/s directly
+    int64_t numerator = (int64_t)VolumetricEfficiency(rpm, mapPa) * mapPa * config->displacementCc * rpm;
+    return (uint32_t)(numerator / ((int64_t)1000 * 120 * AIR_GAS_CONSTANT * temperatureK));
+}
+
+/**
+ * Coolant heat balance over one step
+ *
+ * @param model Engine model
+ * @param ambientC Ambient temperature (°C)
+ */
+static void UpdateCoolant(EngineModel* model, int16_t ambientC)
+{
+    int64_t aboveAmbient = (int64_t)model->coolant - (int64_t)ambientC * 1000000;
+    int64_t open = ((int64_t)model->coolant - (int64_t)model->config->thermostatC * 1000000) * 256
+                   / (THERMOSTAT_RANGE_C * 1000000);
+    if (open < 0) open = 0;
+    if (open > 256) open = 256;
+
+    // Rates in μ°C/s
+    int64_t rate = (int64_t)HEAT_GAIN * model->cylinderFlow
+                 - aboveAmbient / HEAT_LOSS_TIME_S
+                 - aboveAmbient * open * RADIATOR_GAIN / (256 * 1000);
+
+    model->coolant += (int32_t)(rate * ENGINE_MODEL_STEP_US / 1000000);
+}
+
+/**
+ * Lambda of a mixture
+ *
+ * @param air Air mass (μg)
+ * @param fuel Fuel mass (μg)
+ * @return Lambda (× 1000), the lean limit when there is no fuel
+ */
+static uint16_t MixtureLambda(uint64_t air, uint64_t fuel)
+{
+    if (fuel == 0) {
+        return ENGINE_LAMBDA_MAX;
+    }
+    uint64_t lambda = air * 1000 * 10 / (fuel * STOICH_AFR_X10);
+    if (lambda < ENGINE_LAMBDA_MIN) lambda = ENGINE_LAMBDA_MIN;
+    if (lambda > ENGINE_LAMBDA_MAX) lambda = ENGINE_LAMBDA_MAX;
+    return (uint16_t)lambda;
+}
+
+/**
+ * Mixture of every cylinder from the trapped air and the measured fuel,
+ * then exhaust transport to the sensor and sensor response
+ *
+ * @param model Engine model
+ * @param inputs Step inputs
+ */
+static void UpdateLambda(EngineModel* model, const EngineModelInputs* inputs)
+{
+    const EngineModelConfig* config = model->config;
+
+    // No exhaust flow, the sensor keeps its last reading
+    if (inputs->rpm == 0) {
+        model->airPerCylinder = 0;
+        memset(model->fuel, 0, sizeof(model->fuel));
+        return;
+    }
+
+    // One intake stroke per cylinder every two revolutions
+    model->airPerCylinder = (uint32_t)((uint64_t)model->cylinderFlow * 120 * 1000
+                                       / ((uint32_t)inputs->rpm * config->cylinders));
+
+    uint64_t totalFuel = 0;
+    for (int c = 0; c < config->cylinders; c++) {
+        uint32_t effectiveUs = inputs->injectorPulseUs[c] > config->injectorDeadTimeUs
+                             ? inputs->injectorPulseUs[c] - config->injectorDeadTimeUs : 0;
+        model->fuel[c] = (uint32_t)((uint64_t)effectiveUs * config->injectorFlowCcMin[c]
+                                    * FUEL_DENSITY_MG_CC / 60000);
+        model->cylinderLambda[c] = MixtureLambda(model->airPerCylinder, model->fuel[c]);
+        totalFuel += model->fuel[c];
+    }
+
+    // The exhaust of every cylinder mixes before reaching the sensor
+    model->exhaustLambda = MixtureLambda((uint64_t)model->airPerCylinder * config->cylinders, totalFuel);
+
+    // About one engine cycle from injection to the exhaust valve, then the pipe, slower at low flow
+    uint32_t flow = model->cylinderFlow > 0 ? model->cylinderFlow : 1;
+    uint32_t delayMs = 120000 / inputs->rpm + (uint32_t)config->exhaustDelayMs * 4000 / flow;
+    uint32_t delay = delayMs * 1000 / ENGINE_MODEL_STEP_US;
+    if (delay > ENGINE_EXHAUST_DELAY_STEPS - 1) {
+        delay = ENGINE_EXHAUST_DELAY_STEPS - 1;
+    }
+    model->exhaustDelay = (uint16_t)delay;
+
+    model->exhaust[model->exhaustHead] = model->exhaustLambda;
+    uint16_t delayed = model->exhaust[(model->exhaustHead - delay) & (ENGINE_EXHAUST_DELAY_STEPS - 1)];
+    model->exhaustHead = (model->exhaustHead + 1) & (ENGINE_EXHAUST_DELAY_STEPS - 1);
+
+    // First order sensor response, step / time constant
+    int32_t tauSteps = config->sensorResponseMs * 1000 / ENGINE_MODEL_STEP_US;
+    if (tauSteps < 1) tauSteps = 1;
+    model->lambdaQ16 += (((int32_t)delayed << 16) - model->lambdaQ16) / tauSteps;
+}
+
+void EngineModelInit(EngineModel* model, const EngineModelConfig* config, int16_t coolantC)
+{
+    memset(model, 0, sizeof(*model));
+    model->config = config;
+    model->mapQ8 = ENGINE_MODEL_AMBIENT_PA * 256;
+    model->coolant = (int32_t)coolantC * 1000000;
+    model->lambdaQ16 = LAMBDA_STOICH_Q16;
+    for (int i = 0; i < ENGINE_EXHAUST_DELAY_STEPS; i++) {
+        model->exhaust[i] = 1000;
+    }
+    model->warmup = true;
+}
+
+void EngineModelSetCoolant(EngineModel* model, int16_t coolantC)
+{
+    model->coolant = (int32_t)coolantC * 1000000;
+}
+
+void EngineModelStep(EngineModel* model, const EngineModelInputs* inputs)
+{
+    const EngineModelConfig* config = model->config;
+    int32_t temperatureK = inputs->iat + 273;
+    uint32_t sqrtRtQ8 = SquareRoot((uint64_t)AIR_GAS_CONSTANT * temperatureK * 65536);
+
+    uint32_t tps = inputs->tps > 100 ? 100 : inputs->tps;
+    int32_t area = InterpolateTable(throttleArea, 21, tps * 1024 / 5);
+
+    // dP = R*T/V * dm, with cc and mg: dP (Pa) = 287 * T / V * dm
+    int64_t pressureGain = (int64_t)AIR_GAS_CONSTANT * temperatureK * SUBSTEP_US * 256;
+    int64_t pressureScale = (int64_t)config->manifoldVolumeCc * 1000000;
+
+    for (int i = 0; i < MANIFOLD_SUBSTEPS; i++) {
+        int32_t mapPa = model->mapQ8 >> 8;
+        model->throttleFlow = ThrottleFlow(area, mapPa, sqrtRtQ8);
+        model->cylinderFlow = CylinderFlow(config, inputs->rpm, mapPa, temperatureK);
+
+        int64_t netFlow = (int64_t)model->throttleFlow - model->cylinderFlow;
+        model->mapQ8 += (int32_t)(netFlow * pressureGain / pressureScale);
+        if (model->mapQ8 > ENGINE_MODEL_AMBIENT_PA * 256) {
+            model->mapQ8 = ENGINE_MODEL_AMBIENT_PA * 256;
+        } else if (model->mapQ8 < 0) {
+            model->mapQ8 = 0;
+        }
+    }
+
+    if (model->warmup) {
+        UpdateCoolant(model, inputs->iat);
+    }
+    UpdateLambda(model, inputs);
+    model->steps++;
+}
+
+uint16_t EngineModelMap(const EngineModel* model)
+{
+    return (uint16_t)(((model->mapQ8 >> 8) + 50) / 100);
+}
+
+int16_t EngineModelCoolant(const EngineModel* model)
+{
+    return (int16_t)(model->coolant / 100000);
+}
+
+uint16_t EngineModelLambda(const EngineModel* model)
+{
+    return (uint16_t)((model->lambdaQ16 + 0x8000) >> 16);
+}
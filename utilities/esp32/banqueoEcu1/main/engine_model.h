@@ -0,0 +1,93 @@
+/**
+ * @file engine_model.h
+ * @brief Fixed-point mean-value engine model for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef ENGINE_MODEL_H
+#define ENGINE_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed integration step of the model (μs)
+#define ENGINE_MODEL_STEP_US    1000
+
+// Ambient pressure upstream of the throttle (Pa)
+#define ENGINE_MODEL_AMBIENT_PA 101325
+
+// Lambda limits (× 1000), no fuel reads as the lean limit
+#define ENGINE_LAMBDA_MIN       500
+#define ENGINE_LAMBDA_MAX       3000
+
+// Largest supported engine
+#define ENGINE_MAX_CYLINDERS    8
+
+// Longest exhaust transport delay (model steps, power of two)
+#define ENGINE_EXHAUST_DELAY_STEPS  512
+
+// Engine constants
+typedef struct {
+    uint16_t displacementCc;     // Total displacement
+    uint16_t manifoldVolumeCc;   // Intake manifold volume (throttle to valves)
+    uint8_t cylinders;
+    uint16_t injectorFlowCcMin[ENGINE_MAX_CYLINDERS];    // Static flow of each injector (cc/min of gasoline)
+    uint16_t injectorDeadTimeUs; // Part of the pulse that delivers no fuel
+    uint16_t exhaustDelayMs;     // Transport delay from exhaust valve to sensor at 4 g/s of air
+    uint16_t sensorResponseMs;   // Time constant of the O2 sensor
+    int16_t thermostatC;         // Thermostat opening temperature (°C)
+} EngineModelConfig;
+
+// Values applied to the model on every step
+typedef struct {
+    uint16_t rpm;                // 0 when the engine is stopped
+    uint8_t tps;                 // Throttle opening (0-100%)
+    int16_t iat;                 // Intake air and ambient temperature (°C)
+    uint32_t injectorPulseUs[ENGINE_MAX_CYLINDERS];      // Measured pulse width per cylinder, 0 when not injecting
+} EngineModelInputs;
+
+// Model state
+typedef struct {
+    const EngineModelConfig* config;
+    int32_t mapQ8;               // Manifold pressure (Pa × 256)
+    uint32_t throttleFlow;       // Air through the throttle, what a MAF sensor reads (mg/s)
+    uint32_t cylinderFlow;       // Air into the cylinders from speed-density (mg/s)
+    uint32_t airPerCylinder;     // Air trapped per cylinder and cycle (μg)
+    uint32_t fuel[ENGINE_MAX_CYLINDERS];                 // Fuel delivered per injection (μg)
+    uint16_t cylinderLambda[ENGINE_MAX_CYLINDERS];       // Lambda of each cylinder (× 1000)
+    uint16_t exhaustLambda;      // Lambda of the mixed exhaust gas at the valves (× 1000)
+    uint16_t exhaustDelay;       // Current transport delay (model steps)
+    uint16_t exhaust[ENGINE_EXHAUST_DELAY_STEPS];        // Exhaust lambda history, one entry per step
+    uint16_t exhaustHead;
+    int32_t coolant;             // Coolant temperature (μ°C)
+    int32_t lambdaQ16;           // Lambda seen by the sensor (× 1000, Q16)
+    bool warmup;                 // Coolant temperature follows the heat balance
+    uint32_t steps;
+} EngineModel;
+
+// Starts with the manifold at ambient pressure and stoichiometric lambda
+void EngineModelInit(EngineModel* model, const EngineModelConfig* config, int16_t coolantC);
+
+// Sets the coolant temperature (°C), the warm-up continues from there
+void EngineModelSetCoolant(EngineModel* model, int16_t coolantC);
+
+// Advances the model by ENGINE_MODEL_STEP_US
+void EngineModelStep(EngineModel* model, const EngineModelInputs* inputs);
+
+// Manifold pressure (tenths of kPa)
+uint16_t EngineModelMap(const EngineModel* model);
+
+// Coolant temperature (tenths of °C)
+int16_t EngineModelCoolant(const EngineModel* model);
+
+// Lambda seen by the sensor, after transport delay and sensor response (× 1000)
+uint16_t EngineModelLambda(const EngineModel* model);
+
+#endif // ENGINE_MODEL_H
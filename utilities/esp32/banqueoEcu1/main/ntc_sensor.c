@@ -0,0 +1,79 @@
+/**
+ * @file ntc_sensor.c
+ * @brief Table-based NTC temperature sensor emulation for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The tables in ntc_tables.c are generated by tools/ntc_table_gen.py.
+ * Values between two table points are linearly interpolated with
+ * integer arithmetic only.
+ */
+
+#include <string.h>
+#include "ntc_sensor.h"
+
+// Table step in tenths of °C
+#define NTC_STEP_TENTHS         (NTC_TABLE_T_STEP * 10)
+
+/**
+ * Linear interpolation between two table points
+ *
+ * @param v0 Value at the lower point
+ * @param v1 Value at the upper point
+ * @param frac Position between the points (0 to NTC_STEP_TENTHS)
+ * @return Interpolated value
+ */
+static uint32_t Interpolate(uint32_t v0, uint32_t v1, int32_t frac)
+{
+    if (v1 >= v0) {
+        return v0 + (v1 - v0) * (uint32_t)frac / NTC_STEP_TENTHS;
+    }
+    return v0 - (v0 - v1) * (uint32_t)frac / NTC_STEP_TENTHS;
+}
+
+void NtcLookup(NtcCurve curve, int16_t tempTenths, NtcReading* reading)
+{
+    const int32_t lastOffset = (NTC_TABLE_POINTS - 1) * NTC_STEP_TENTHS;
+    int32_t offset = tempTenths - NTC_TABLE_T_MIN * 10;
+
+    if (curve >= NTC_CURVE_COUNT) {
+        curve = NTC_CURVE_CUSTOM;
+    }
+    if (offset < 0) {
+        offset = 0;
+    } else if (offset > lastOffset) {
+        offset = lastOffset;
+    }
+
+    int32_t index = offset / NTC_STEP_TENTHS;
+    int32_t frac = offset % NTC_STEP_TENTHS;
+    if (index >= NTC_TABLE_POINTS - 1) {
+        reading->resistance = ntcResistance[curve][NTC_TABLE_POINTS - 1];
+        reading->output = ntcOutput[curve][NTC_TABLE_POINTS - 1];
+        return;
+    }
+
+    reading->resistance = Interpolate(ntcResistance[curve][index], ntcResistance[curve][index + 1], frac);
+    reading->output = (uint16_t)Interpolate(ntcOutput[curve][index], ntcOutput[curve][index + 1], frac);
+}
+
+uint32_t NtcOutputToDuty(uint16_t output, uint8_t resolutionBits)
+{
+    return (uint32_t)output >> (16 - resolutionBits);
+}
+
+NtcCurve NtcCurveFromName(const char* name)
+{
+    for (int i = 0; i < NTC_CURVE_COUNT; i++) {
+        if (strcmp(ntcCurveNames[i], name) == 0) {
+            return (NtcCurve)i;
+        }
+    }
+    return NTC_CURVE_COUNT;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file ntc_sensor.h
+ * @brief Table-based NTC temperature sensor emulation for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef NTC_SENSOR_H
+#define NTC_SENSOR_H
+
+#include <stdint.h>
+#include "ntc_tables.h"
+
+// Emulated sensor value for one temperature
+typedef struct {
+    uint32_t resistance;         // NTC resistance (ohms)
+    uint16_t output;             // ECU input voltage (Q16 fraction of 5 V)
+} NtcReading;
+
+// Interpolates the curve tables for a temperature in tenths of °C
+// Temperatures outside the table are clamped to its ends
+void NtcLookup(NtcCurve curve, int16_t tempTenths, NtcReading* reading);
+
+// Scales a Q16 output to a duty cycle of the given resolution (bits)
+uint32_t NtcOutputToDuty(uint16_t output, uint8_t resolutionBits);
+
+// Finds a curve by name, returns NTC_CURVE_COUNT if not found
+NtcCurve NtcCurveFromName(const char* name);
+
+#endif // NTC_SENSOR_H
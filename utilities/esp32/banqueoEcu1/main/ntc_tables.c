@@ -0,0 +1,79 @@
+/**
+ * Generated by tools/ntc_table_gen.py - do not edit by hand
+ *
+ * Range -40 to 150 °C every 5 °C, pull-up 2490 ohms to 5 V
+ * bosch   A=1.281516e-03 B=2.636218e-04 C=1.401345e-07
+ * denso   A=1.286031e-03 B=2.633474e-04 C=1.474376e-07
+ * gm      A=1.475265e-03 B=2.298086e-04 C=1.088757e-07
+ * custom  A=1.039210e-03 B=2.958580e-04 C=0.000000e+00
+ */
+
+#include "ntc_tables.h"
+
+const char* const ntcCurveNames[NTC_CURVE_COUNT] = {
+    "bosch", "denso", "gm", "custom"
+};
+
+// NTC resistance (ohms)
+const uint32_t ntcResistance[NTC_CURVE_COUNT][NTC_TABLE_POINTS] = {
+    { // bosch
+         46562,  34853,  26342,  20093,  15462,  11999,   9386,   7399,
+          5876,   4699,   3784,   3066,   2500,   2051,   1692,   1403,
+          1170,    981,    826,    699,    594,    507,    434,    374,
+           323,    280,    244,    213,    187,    164,    145,    128,
+           113,    101,     90,     80,     72,     65,     58
+    },
+    { // denso
+         45013,  33752,  25550,  19518,  15040,  11686,   9152,   7222,
+          5741,   4595,   3703,   3003,   2450,   2011,   1660,   1377,
+          1149,    963,    812,    687,    584,    499,    428,    368,
+           318,    276,    240,    210,    184,    162,    142,    126,
+           112,     99,     89,     79,     71,     64,     58
+    },
+    { // gm
+        100700,  72311,  52491,  38498,  28517,  21324,  16090,  12246,
+          9399,   7271,   5668,   4451,   3520,   2803,   2246,   1811,
+          1469,   1199,    984,    811,    673,    560,    469,    395,
+           333,    283,    241,    206,    177,    153,    132,    115,
+           100,     87,     76,     67,     59,     52,     46
+    },
+    { // custom
+         58958,  43487,  32479,  24545,  18755,  14482,  11292,   8887,
+          7056,   5649,   4558,   3705,   3033,   2500,   2074,   1730,
+          1452,   1226,   1040,    887,    760,    654,    565,    491,
+           428,    374,    329,    290,    256,    227,    202,    180,
+           162,    145,    131,    118,    107,     97,     88
+    }
+};
+
+// ECU input voltage (Q16 fraction of 5 V)
+const uint16_t ntcOutput[NTC_CURVE_COUNT][NTC_TABLE_POINTS] = {
+    { // bosch
+         62209,  61166,  59876,  58310,  56446,  54273,  51795,  49034,
+         46030,  42837,  39526,  36165,  32834,  29600,  26515,  23619,
+         20950,  18522,  16325,  14365,  12623,  11087,   9727,   8558,
+          7525,   6625,   5849,   5164,   4578,   4050,   3606,   3204,
+          2845,   2555,   2286,   2040,   1842,   1667,   1492
+    },
+    { // denso
+         62101,  61033,  59716,  58121,  56227,  54025,  51519,  48734,
+         45710,  42504,  39186,  35828,  32503,  29281,  26214,  23337,
+         20693,  18277,  16116,  14172,  12451,  10941,   9613,   8439,
+          7422,   6539,   5761,   5097,   4510,   4003,   3536,   3157,
+          2821,   2506,   2262,   2015,   1817,   1642,   1492
+    },
+    { // gm
+         63955,  63354,  62568,  61555,  60273,  58684,  56753,  54462,
+         51810,  48818,  45533,  42026,  38384,  34706,  31080,  27595,
+         24317,  21301,  18563,  16101,  13944,  12033,  10387,   8973,
+          7731,   6688,   5783,   5008,   4349,   3794,   3299,   2893,
+          2530,   2213,   1941,   1717,   1517,   1341,   1189
+    },
+    { // custom
+         62880,  61987,  60869,  59500,  57855,  55921,  53696,  51193,
+         48441,  45486,  42383,  39195,  35990,  32834,  29781,  26867,
+         24140,  21622,  19308,  17214,  15325,  13632,  12120,  10794,
+          9613,   8558,   7649,   6836,   6110,   5475,   4918,   4418,
+          4003,   3606,   3276,   2965,   2700,   2457,   2237
+    }
+};
@@ -0,0 +1,34 @@
+/**
+ * Generated by tools/ntc_table_gen.py - do not edit by hand
+ *
+ * Range -40 to 150 °C every 5 °C, pull-up 2490 ohms to 5 V
+ * bosch   A=1.281516e-03 B=2.636218e-04 C=1.401345e-07
+ * denso   A=1.286031e-03 B=2.633474e-04 C=1.474376e-07
+ * gm      A=1.475265e-03 B=2.298086e-04 C=1.088757e-07
+ * custom  A=1.039210e-03 B=2.958580e-04 C=0.000000e+00
+ */
+
+#ifndef NTC_TABLES_H
+#define NTC_TABLES_H
+
+#include <stdint.h>
+
+#define NTC_TABLE_T_MIN         -40
+#define NTC_TABLE_T_STEP        5
+#define NTC_TABLE_POINTS        39
+#define NTC_PULLUP_OHMS         2490
+
+// Selectable sensor curves
+typedef enum {
+    NTC_CURVE_BOSCH,
+    NTC_CURVE_DENSO,
+    NTC_CURVE_GM,
+    NTC_CURVE_CUSTOM,
+    NTC_CURVE_COUNT
+} NtcCurve;
+
+extern const char* const ntcCurveNames[NTC_CURVE_COUNT];
+extern const uint32_t ntcResistance[NTC_CURVE_COUNT][NTC_TABLE_POINTS];
+extern const uint16_t ntcOutput[NTC_CURVE_COUNT][NTC_TABLE_POINTS];
+
+#endif // NTC_TABLES_H
@@ -0,0 +1,90 @@
+/**
+ * @file o2_sensor.c
+ * @brief Oxygen sensor signal emulation for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * A narrowband sensor jumps between ~0.1 V (lean) and ~0.9 V (rich)
+ * within ±0.5% of stoichiometric, so an ECU correcting around lambda 1
+ * sees the signal switch. The curve is a table with its points closer
+ * together around lambda 1.
+ */
+
+#include <string.h>
+#include "o2_sensor.h"
+
+// Wideband controller scale
+#define WIDEBAND_LAMBDA_LOW     680
+#define WIDEBAND_LAMBDA_HIGH    1360
+#define WIDEBAND_MV_LOW         500
+#define WIDEBAND_MV_HIGH        4500
+
+// Point of the narrowband curve
+typedef struct {
+    uint16_t lambda;             // × 1000
+    uint16_t millivolts;
+} O2CurvePoint;
+
+static const O2CurvePoint narrowbandCurve[] = {
+    {  700, 920 }, {  900, 880 }, {  970, 850 }, {  985, 800 }, {  995, 700 },
+    { 1000, 450 }, { 1005, 200 }, { 1015, 120 }, { 1050,  70 }, { 1200,  40 },
+    { 3000,  20 }
+};
+
+#define NARROWBAND_POINTS (sizeof(narrowbandCurve) / sizeof(narrowbandCurve[0]))
+
+static const char* const typeNames[O2_SENSOR_TYPE_COUNT] = {
+    "manual", "narrowband", "wideband"
+};
+
+uint16_t O2NarrowbandMillivolts(uint16_t lambda)
+{
+    if (lambda <= narrowbandCurve[0].lambda) {
+        return narrowbandCurve[0].millivolts;
+    }
+
+    for (size_t i = 1; i < NARROWBAND_POINTS; i++) {
+        const O2CurvePoint* p0 = &narrowbandCurve[i - 1];
+        const O2CurvePoint* p1 = &narrowbandCurve[i];
+        if (lambda <= p1->lambda) {
+            // Voltage falls with lambda
+            return p0->millivolts - (uint32_t)(p0->millivolts - p1->millivolts) * (lambda - p0->lambda)
+                                    / (p1->lambda - p0->lambda);
+        }
+    }
+
+    return narrowbandCurve[NARROWBAND_POINTS - 1].millivolts;
+}
+
+uint16_t O2WidebandMillivolts(uint16_t lambda)
+{
+    if (lambda <= WIDEBAND_LAMBDA_LOW) {
+        return WIDEBAND_MV_LOW;
+    }
+    if (lambda >= WIDEBAND_LAMBDA_HIGH) {
+        return WIDEBAND_MV_HIGH;
+    }
+    return WIDEBAND_MV_LOW + (uint32_t)(lambda - WIDEBAND_LAMBDA_LOW) * (WIDEBAND_MV_HIGH - WIDEBAND_MV_LOW)
+                             / (WIDEBAND_LAMBDA_HIGH - WIDEBAND_LAMBDA_LOW);
+}
+
+O2SensorType O2SensorTypeFromName(const char* name)
+{
+    for (int i = 0; i < O2_SENSOR_TYPE_COUNT; i++) {
+        if (strcmp(typeNames[i], name) == 0) {
+            return (O2SensorType)i;
+        }
+    }
+    return O2_SENSOR_TYPE_COUNT;
+}
+
+const char* O2SensorTypeName(O2SensorType type)
+{
+    return type < O2_SENSOR_TYPE_COUNT ? typeNames[type] : "?";
+}
@@ -0,0 +1,40 @@
+/**
+ * @file o2_sensor.h
+ * @brief Oxygen sensor signal emulation for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef O2_SENSOR_H
+#define O2_SENSOR_H
+
+#include <stdint.h>
+
+// Source of the O2 signal
+typedef enum {
+    O2_SENSOR_MANUAL,            // Fixed voltage set by command (open loop)
+    O2_SENSOR_NARROWBAND,        // Zirconia switching sensor, 0-1 V (closed loop)
+    O2_SENSOR_WIDEBAND,          // Wideband controller analog output, 0.5-4.5 V (closed loop)
+    O2_SENSOR_TYPE_COUNT
+} O2SensorType;
+
+// Narrowband sensor voltage for a lambda (× 1000), in mV
+uint16_t O2NarrowbandMillivolts(uint16_t lambda);
+
+// Wideband controller output for a lambda (× 1000), in mV
+// 0.5 V at lambda 0.68 (AFR 10) to 4.5 V at lambda 1.36 (AFR 20)
+uint16_t O2WidebandMillivolts(uint16_t lambda);
+
+// Finds a sensor type by name, returns O2_SENSOR_TYPE_COUNT if not found
+O2SensorType O2SensorTypeFromName(const char* name);
+
+// Returns the name of a sensor type
+const char* O2SensorTypeName(O2SensorType type);
+
+#endif // O2_SENSOR_H
@@ -0,0 +1,148 @@
+/**
+ * @file pulse_stats.c
+ * @brief Channel-indexed pulse measurement engine for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The same rising/falling logic serves every channel. Only integer
+ * arithmetic is used so the engine does not depend on the FPU and
+ * can be compiled on any platform.
+ */
+
+#include <string.h>
+#include "pulse_stats.h"
+
+/**
+ * Integer square root (floor) of a 64-bit value
+ *
+ * @param value Input value
+ * @return Largest integer whose square does not exceed value
+ */
+static uint32_t IntegerSqrt(uint64_t value)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)result;
+}
+
+/**
+ * Clears the window fields of one channel
+ *
+ * @param channel Channel statistics to clear
+ */
+static void ClearChannelWindow(PulseChannelStats* channel)
+{
+    channel->count = 0;
+    channel->minWidth = UINT32_MAX;
+    channel->maxWidth = 0;
+    channel->sumWidth = 0;
+    channel->sumWidthSq = 0;
+    channel->periodCount = 0;
+    channel->sumPeriod = 0;
+}
+
+void PulseStatsInit(PulseStats* stats, uint64_t now)
+{
+    memset(stats, 0, sizeof(*stats));
+    PulseStatsResetWindow(stats, now);
+}
+
+void PulseStatsProcessEdge(PulseStats* stats, PulseChannel channel, bool rising, uint64_t timestamp)
+{
+    if (channel >= PULSE_CHANNEL_COUNT) {
+        return;
+    }
+
+    PulseChannelStats* ch = &stats->channels[channel];
+    stats->eventCount++;
+
+    if (rising) {
+        // Period is measured between consecutive rising edges
+        if (ch->lastRiseTime > 0 && timestamp > ch->lastRiseTime) {
+            uint32_t period = (uint32_t)(timestamp - ch->lastRiseTime);
+            ch->lastPeriod = period;
+            ch->sumPeriod += period;
+            ch->periodCount++;
+        }
+        ch->lastRiseTime = timestamp;
+        ch->active = true;
+        return;
+    }
+
+    // Falling edge: close the pulse if a rising edge was seen
+    if (ch->active && timestamp > ch->lastRiseTime) {
+        uint32_t width = (uint32_t)(timestamp - ch->lastRiseTime);
+        if (width > MIN_VALID_PULSE_US) {
+            ch->lastWidth = width;
+            ch->count++;
+            ch->sumWidth += width;
+            ch->sumWidthSq += (uint64_t)width * width;
+            if (width < ch->minWidth) ch->minWidth = width;
+            if (width > ch->maxWidth) ch->maxWidth = width;
+        }
+    }
+    ch->active = false;
+}
+
+void PulseStatsSummarize(const PulseStats* stats, PulseChannel channel, PulseChannelSummary* summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    if (channel >= PULSE_CHANNEL_COUNT) {
+        return;
+    }
+
+    const PulseChannelStats* ch = &stats->channels[channel];
+    summary->last = ch->lastWidth;
+    summary->count = ch->count;
+
+    if (ch->count > 0) {
+        uint64_t mean = ch->sumWidth / ch->count;
+        uint64_t spread = ch->count * ch->sumWidthSq;
+        uint64_t square = ch->sumWidth * ch->sumWidth;
+
+        summary->min = ch->minWidth;
+        summary->max = ch->maxWidth;
+        summary->mean = (uint32_t)mean;
+        // Variance = (n·Σx² - (Σx)²) / n², guarded against rounding below zero
+        summary->stddev = (spread > square) ? IntegerSqrt((spread - square) / ((uint64_t)ch->count * ch->count)) : 0;
+    }
+
+    if (ch->periodCount > 0 && ch->sumPeriod > 0) {
+        uint64_t meanPeriod = ch->sumPeriod / ch->periodCount;
+        summary->freqCentiHz = (uint32_t)(100000000ULL / meanPeriod);
+        if (ch->count > 0 && meanPeriod > 0) {
+            uint64_t duty = (ch->sumWidth / ch->count) * 1000 / meanPeriod;
+            summary->dutyPermille = (uint16_t)(duty > 1000 ? 1000 : duty);
+        }
+    }
+}
+
+void PulseStatsResetWindow(PulseStats* stats, uint64_t now)
+{
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++) {
+        ClearChannelWindow(&stats->channels[i]);
+    }
+    stats->eventCount = 0;
+    stats->windowStart = now;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file pulse_stats.h
+ * @brief Channel-indexed pulse measurement engine for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef PULSE_STATS_H
+#define PULSE_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Monitored ECU output channels (index into every per-channel array)
+typedef enum {
+    PULSE_CHANNEL_INJ1,
+    PULSE_CHANNEL_INJ2,
+    PULSE_CHANNEL_INJ3,
+    PULSE_CHANNEL_INJ4,
+    PULSE_CHANNEL_COIL,
+    PULSE_CHANNEL_COUNT
+} PulseChannel;
+
+// Number of injector channels (they come first in PulseChannel)
+#define PULSE_INJECTOR_COUNT    4
+
+// Minimum valid pulse (μs), shorter pulses are treated as noise
+#define MIN_VALID_PULSE_US      50
+
+// Accumulated measurements of one channel
+// The window fields are cleared on every report, the "last" fields are kept
+typedef struct {
+    uint64_t lastRiseTime;       // Timestamp of the last rising edge (μs)
+    uint32_t lastWidth;          // Last valid pulse width (μs)
+    uint32_t lastPeriod;         // Last rising-to-rising period (μs)
+    bool active;                 // Current output state
+    uint32_t count;              // Valid pulses in the window
+    uint32_t minWidth;           // Minimum width in the window (μs)
+    uint32_t maxWidth;           // Maximum width in the window (μs)
+    uint64_t sumWidth;           // Sum of widths in the window (μs)
+    uint64_t sumWidthSq;         // Sum of squared widths in the window (μs²)
+    uint32_t periodCount;        // Periods measured in the window
+    uint64_t sumPeriod;          // Sum of periods in the window (μs)
+} PulseChannelStats;
+
+// Measurement state for all channels
+typedef struct {
+    PulseChannelStats channels[PULSE_CHANNEL_COUNT];
+    uint32_t eventCount;         // Edges processed in the window
+    uint64_t windowStart;        // Start of the current window (μs)
+} PulseStats;
+
+// Summary of one channel computed by the reporting stage
+typedef struct {
+    uint32_t count;              // Valid pulses in the window
+    uint32_t last;               // Last width (μs)
+    uint32_t min;                // Minimum width (μs)
+    uint32_t max;                // Maximum width (μs)
+    uint32_t mean;               // Mean width (μs)
+    uint32_t stddev;             // Standard deviation of the width (μs)
+    uint16_t dutyPermille;       // Duty cycle (0-1000 ‰)
+    uint32_t freqCentiHz;        // Pulse frequency (Hz x 100)
+} PulseChannelSummary;
+
+// Clears all measurements and starts a new window at the given time
+void PulseStatsInit(PulseStats* stats, uint64_t now);
+
+// Processes one edge of a channel, this is the hot path and does no I/O
+void PulseStatsProcessEdge(PulseStats* stats, PulseChannel channel, bool rising, uint64_t timestamp);
+
+// Computes the summary of one channel for the current window
+void PulseStatsSummarize(const PulseStats* stats, PulseChannel channel, PulseChannelSummary* summary);
+
+// Starts a new window keeping the "last" values of every channel
+void PulseStatsResetWindow(PulseStats* stats, uint64_t now);
+
+#endif // PULSE_STATS_H
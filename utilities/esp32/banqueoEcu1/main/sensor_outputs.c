@@ -0,0 +1,179 @@
+/**
+ * @file sensor_outputs.c
+ * @brief Output channel manager for the emulated analog sensors of the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The simulation stages the value of every sensor and then commits them
+ * once per step. The commit first writes the frequencies and duties that
+ * changed and then latches all the duties one after another, so the ECU
+ * never sees a mix of old and new values for longer than one PWM period.
+ * Unchanged outputs are not written at all.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "sensor_outputs.h"
+
+// Q16 full scale
+#define LEVEL_FULL_SCALE        65535
+
+/**
+ * Duty that generates a Q16 level with the given resolution
+ *
+ * @param level Voltage as a Q16 fraction of full scale
+ * @param resolutionBits Timer resolution
+ * @return Duty value (0 to 2^bits - 1)
+ */
+static uint32_t LevelToDuty(uint16_t level, uint8_t resolutionBits)
+{
+    return (uint32_t)level >> (16 - resolutionBits);
+}
+
+bool SensorOutputsInit(SensorOutputs* outputs, const SensorOutputConfig* config,
+                       const SensorOutputTimer* timers, uint8_t timerCount,
+                       const SensorOutputDriver* driver)
+{
+    memset(outputs, 0, sizeof(*outputs));
+    outputs->config = config;
+    outputs->timers = timers;
+    outputs->driver = driver;
+
+    // A frequency change would move every other output of the same timer
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        if (config[i].timer >= timerCount) {
+            return false;
+        }
+        for (int j = 0; j < SENSOR_OUT_COUNT; j++) {
+            if (i != j && config[i].frequencyCapable && config[i].timer == config[j].timer) {
+                return false;
+            }
+        }
+    }
+
+    for (uint8_t t = 0; t < timerCount; t++) {
+        driver->configureTimer(t, timers[t].frequencyHz, timers[t].resolutionBits);
+    }
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        driver->configureChannel(config[i].channel, config[i].timer, config[i].gpio);
+        outputs->outputs[i].mode = OUTPUT_MODE_VOLTAGE;
+        outputs->outputs[i].appliedMode = OUTPUT_MODE_VOLTAGE;
+        outputs->outputs[i].appliedFrequency = timers[config[i].timer].frequencyHz;
+    }
+
+    return true;
+}
+
+bool SensorOutputsSetMode(SensorOutputs* outputs, SensorOutputId id, SensorOutputMode mode)
+{
+    if (id >= SENSOR_OUT_COUNT) {
+        return false;
+    }
+    if (mode == OUTPUT_MODE_FREQUENCY && !outputs->config[id].frequencyCapable) {
+        return false;
+    }
+    outputs->outputs[id].mode = mode;
+    return true;
+}
+
+void SensorOutputsSetMillivolts(SensorOutputs* outputs, SensorOutputId id, uint32_t millivolts)
+{
+    if (millivolts > SENSOR_OUTPUT_FULL_SCALE_MV) {
+        millivolts = SENSOR_OUTPUT_FULL_SCALE_MV;
+    }
+    SensorOutputsSetLevel(outputs, id,
+                          (uint16_t)(millivolts * LEVEL_FULL_SCALE / SENSOR_OUTPUT_FULL_SCALE_MV));
+}
+
+void SensorOutputsSetLevel(SensorOutputs* outputs, SensorOutputId id, uint16_t level)
+{
+    if (id < SENSOR_OUT_COUNT) {
+        outputs->outputs[id].level = level;
+    }
+}
+
+void SensorOutputsSetFrequency(SensorOutputs* outputs, SensorOutputId id, uint32_t frequencyHz)
+{
+    if (id < SENSOR_OUT_COUNT) {
+        outputs->outputs[id].frequencyHz = frequencyHz;
+    }
+}
+
+uint8_t SensorOutputsCommit(SensorOutputs* outputs)
+{
+    const SensorOutputDriver* driver = outputs->driver;
+    bool latch[SENSOR_OUT_COUNT] = { false };
+    uint8_t changed = 0;
+
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        const SensorOutputConfig* config = &outputs->config[i];
+        const SensorOutputTimer* timer = &outputs->timers[config->timer];
+        SensorOutputState* state = &outputs->outputs[i];
+
+        // Read once, the console task may change it at any time
+        SensorOutputMode mode = state->mode;
+        uint32_t frequency = timer->frequencyHz;
+        uint32_t duty;
+
+        if (mode == OUTPUT_MODE_FREQUENCY && state->frequencyHz > 0) {
+            frequency = state->frequencyHz;
+            duty = 1u << (timer->resolutionBits - 1);
+        } else {
+            // Back to the carrier frequency when leaving frequency mode
+            mode = OUTPUT_MODE_VOLTAGE;
+            duty = LevelToDuty(state->level, timer->resolutionBits);
+        }
+
+        if (frequency != state->appliedFrequency) {
+            driver->setFrequency(config->timer, frequency);
+            state->appliedFrequency = frequency;
+            latch[i] = true;
+        }
+        if (!state->applied || duty != state->appliedDuty) {
+            driver->setDuty(config->channel, duty);
+            state->appliedDuty = duty;
+            latch[i] = true;
+        }
+        state->appliedMode = mode;
+        state->applied = true;
+    }
+
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        if (latch[i]) {
+            driver->updateDuty(outputs->config[i].channel);
+            changed++;
+        }
+    }
+
+    if (changed > 0) {
+        outputs->commits++;
+        outputs->writes += changed;
+    }
+    return changed;
+}
+
+uint32_t SensorOutputLevelToMillivolts(uint16_t level)
+{
+    return ((uint32_t)level * SENSOR_OUTPUT_FULL_SCALE_MV + LEVEL_FULL_SCALE / 2) / LEVEL_FULL_SCALE;
+}
+
+SensorOutputId SensorOutputFromName(const SensorOutputs* outputs, const char* name)
+{
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        if (strcasecmp(outputs->config[i].name, name) == 0) {
+            return (SensorOutputId)i;
+        }
+    }
+    return SENSOR_OUT_COUNT;
+}
+
+const char* SensorOutputModeName(SensorOutputMode mode)
+{
+    return mode == OUTPUT_MODE_FREQUENCY ? "frequency" : "voltage";
+}
@@ -0,0 +1,118 @@
+/**
+ * @file sensor_outputs.h
+ * @brief Output channel manager for the emulated analog sensors of the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef SENSOR_OUTPUTS_H
+#define SENSOR_OUTPUTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Emulated analog sensors (index into every per-output array)
+typedef enum {
+    SENSOR_OUT_TPS,
+    SENSOR_OUT_MAP,
+    SENSOR_OUT_MAF,
+    SENSOR_OUT_ECT,
+    SENSOR_OUT_IAT,
+    SENSOR_OUT_O2,
+    SENSOR_OUT_COUNT
+} SensorOutputId;
+
+// How the ECU reads the sensor
+typedef enum {
+    OUTPUT_MODE_VOLTAGE,         // Filtered PWM, duty proportional to the voltage
+    OUTPUT_MODE_FREQUENCY        // Square wave, 50% duty, value is the frequency
+} SensorOutputMode;
+
+// Full scale of a voltage output (mV)
+#define SENSOR_OUTPUT_FULL_SCALE_MV  5000
+
+// Hardware resources of one output
+typedef struct {
+    const char* name;
+    uint8_t gpio;
+    uint8_t timer;               // Frequency capable outputs need a timer of their own
+    uint8_t channel;
+    bool frequencyCapable;       // Output can be switched to OUTPUT_MODE_FREQUENCY
+} SensorOutputConfig;
+
+// Settings of one PWM timer (carrier of the voltage outputs)
+typedef struct {
+    uint32_t frequencyHz;
+    uint8_t resolutionBits;
+} SensorOutputTimer;
+
+// Hardware access: the LEDC peripheral on the ESP32, a recording fake on a host
+typedef struct {
+    void (*configureTimer)(uint8_t timer, uint32_t frequencyHz, uint8_t resolutionBits);
+    void (*configureChannel)(uint8_t channel, uint8_t timer, uint8_t gpio);
+    void (*setFrequency)(uint8_t timer, uint32_t frequencyHz);
+    void (*setDuty)(uint8_t channel, uint32_t duty);     // Takes effect on updateDuty
+    void (*updateDuty)(uint8_t channel);
+} SensorOutputDriver;
+
+// State of one output
+// Both values are staged every step, the mode selects which one is driven
+typedef struct {
+    SensorOutputMode mode;       // Requested mode, may be written by another task
+    uint16_t level;              // Voltage as a Q16 fraction of full scale
+    uint32_t frequencyHz;        // Frequency for OUTPUT_MODE_FREQUENCY
+    SensorOutputMode appliedMode;
+    uint32_t appliedFrequency;   // Timer frequency written last (Hz)
+    uint32_t appliedDuty;        // Duty written last
+    bool applied;                // Output written at least once
+} SensorOutputState;
+
+// Every emulated analog output
+typedef struct {
+    const SensorOutputConfig* config;    // SENSOR_OUT_COUNT entries
+    const SensorOutputTimer* timers;     // Indexed by timer number
+    const SensorOutputDriver* driver;
+    SensorOutputState outputs[SENSOR_OUT_COUNT];
+    uint32_t commits;            // Steps that changed at least one output
+    uint32_t writes;             // Outputs written to the hardware
+} SensorOutputs;
+
+// Configures every timer and channel, all outputs start in voltage mode at 0 V
+// Returns false if a frequency capable output shares its timer with another output
+bool SensorOutputsInit(SensorOutputs* outputs, const SensorOutputConfig* config,
+                       const SensorOutputTimer* timers, uint8_t timerCount,
+                       const SensorOutputDriver* driver);
+
+// Selects voltage or frequency mode, applied on the next commit
+// Returns false if the output cannot generate a frequency
+bool SensorOutputsSetMode(SensorOutputs* outputs, SensorOutputId id, SensorOutputMode mode);
+
+// Stages the voltage of an output (mV, clamped to full scale)
+void SensorOutputsSetMillivolts(SensorOutputs* outputs, SensorOutputId id, uint32_t millivolts);
+
+// Stages the voltage of an output as a Q16 fraction of full scale
+void SensorOutputsSetLevel(SensorOutputs* outputs, SensorOutputId id, uint16_t level);
+
+// Stages the frequency of an output (Hz)
+void SensorOutputsSetFrequency(SensorOutputs* outputs, SensorOutputId id, uint32_t frequencyHz);
+
+// Writes every staged change to the hardware, all duties are latched together at the end
+// Returns the number of outputs that changed
+uint8_t SensorOutputsCommit(SensorOutputs* outputs);
+
+// Voltage (mV) represented by a Q16 level
+uint32_t SensorOutputLevelToMillivolts(uint16_t level);
+
+// Finds an output by name ("tps", "map"...), returns SENSOR_OUT_COUNT if not found
+SensorOutputId SensorOutputFromName(const SensorOutputs* outputs, const char* name);
+
+// Returns "voltage" or "frequency"
+const char* SensorOutputModeName(SensorOutputMode mode);
+
+#endif // SENSOR_OUTPUTS_H
@@ -0,0 +1,160 @@
+/**
+ * @file telemetry.c
+ * @brief Framed binary telemetry protocol for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * COBS (Consistent Overhead Byte Stuffing) removes every 0x00 byte from
+ * the frame, so 0x00 can be used as delimiter and a receiver that joins
+ * the stream at any point resynchronizes on the next frame. This file
+ * has no ESP-IDF dependencies and is also built into the host decoder.
+ */
+
+#include <string.h>
+#include "telemetry.h"
+
+// Largest frame before COBS encoding: header + payload + CRC
+#define TELEMETRY_MAX_RAW   (sizeof(TelemetryHeader) + TELEMETRY_MAX_PAYLOAD + 2)
+
+uint16_t TelemetryCrc16(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * COBS encodes a buffer
+ *
+ * @param in Data to encode
+ * @param length Data length
+ * @param out Output buffer, at least length + length / 254 + 1 bytes
+ * @return Encoded length
+ */
+static size_t CobsEncode(const uint8_t* in, size_t length, uint8_t* out)
+{
+    size_t codeIndex = 0;
+    size_t outIndex = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[outIndex++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[codeIndex] = code;
+            codeIndex = outIndex++;
+            code = 1;
+        }
+    }
+    out[codeIndex] = code;
+
+    return outIndex;
+}
+
+/**
+ * COBS decodes a buffer
+ *
+ * @param in Encoded data, without delimiter
+ * @param length Encoded length
+ * @param out Output buffer
+ * @param outSize Output buffer size
+ * @return Decoded length, or -1 if the data is malformed or too long
+ */
+static int CobsDecode(const uint8_t* in, size_t length, uint8_t* out, size_t outSize)
+{
+    size_t inIndex = 0;
+    size_t outIndex = 0;
+
+    while (inIndex < length) {
+        uint8_t code = in[inIndex++];
+        if (code == 0 || inIndex + code - 1 > length) {
+            return -1;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            if (outIndex >= outSize || in[inIndex] == 0) {
+                return -1;
+            }
+            out[outIndex++] = in[inIndex++];
+        }
+        // A code below 0xFF implies a zero, except at the end of the frame
+        if (code < 0xFF && inIndex < length) {
+            if (outIndex >= outSize) {
+                return -1;
+            }
+            out[outIndex++] = 0;
+        }
+    }
+
+    return (int)outIndex;
+}
+
+size_t TelemetryEncodeFrame(uint8_t type, uint16_t sequence, const void* payload, size_t length,
+                            uint8_t* out, size_t outSize)
+{
+    uint8_t raw[TELEMETRY_MAX_RAW];
+    TelemetryHeader header = {
+        .version = TELEMETRY_SCHEMA_VERSION,
+        .type = type,
+        .sequence = sequence
+    };
+
+    if (length > TELEMETRY_MAX_PAYLOAD || outSize < TELEMETRY_MAX_FRAME) {
+        return 0;
+    }
+
+    memcpy(raw, &header, sizeof(header));
+    memcpy(raw + sizeof(header), payload, length);
+    size_t rawLength = sizeof(header) + length;
+    uint16_t crc = TelemetryCrc16(raw, rawLength);
+    raw[rawLength++] = (uint8_t)(crc & 0xFF);
+    raw[rawLength++] = (uint8_t)(crc >> 8);
+
+    size_t encoded = CobsEncode(raw, rawLength, out);
+    out[encoded++] = 0x00;
+
+    return encoded;
+}
+
+int TelemetryDecodeFrame(const uint8_t* frame, size_t length, TelemetryHeader* header,
+                         uint8_t* payload, size_t payloadSize)
+{
+    uint8_t raw[TELEMETRY_MAX_RAW];
+    int rawLength = CobsDecode(frame, length, raw, sizeof(raw));
+
+    if (rawLength < (int)(sizeof(TelemetryHeader) + 2)) {
+        return TELEMETRY_ERROR_COBS;
+    }
+
+    uint16_t crc = (uint16_t)(raw[rawLength - 2] | (raw[rawLength - 1] << 8));
+    if (TelemetryCrc16(raw, rawLength - 2) != crc) {
+        return TELEMETRY_ERROR_CRC;
+    }
+
+    memcpy(header, raw, sizeof(*header));
+    if (header->version != TELEMETRY_SCHEMA_VERSION) {
+        return TELEMETRY_ERROR_VERSION;
+    }
+
+    int payloadLength = rawLength - 2 - (int)sizeof(TelemetryHeader);
+    if (payloadLength > (int)payloadSize) {
+        return TELEMETRY_ERROR_COBS;
+    }
+    memcpy(payload, raw + sizeof(TelemetryHeader), payloadLength);
+
+    return payloadLength;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file telemetry.h
+ * @brief Framed binary telemetry protocol for the ECU test bench
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Frame layout before encoding: TelemetryHeader + payload + CRC16 (LSB first).
+ * The whole frame is COBS encoded and terminated with a 0x00 byte.
+ * All fields are little-endian. This header is shared with the host decoder.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Schema version, increase on any change to the records below
+#define TELEMETRY_SCHEMA_VERSION    1
+
+// Largest payload of a record (bytes)
+#define TELEMETRY_MAX_PAYLOAD       48
+
+// Largest encoded frame: header + payload + CRC, COBS overhead and delimiter
+#define TELEMETRY_MAX_FRAME         64
+
+// Record types
+typedef enum {
+    TELEMETRY_PULSE_EDGE = 1,    // TelemetryPulseEdge, one per monitored edge
+    TELEMETRY_CHANNEL_STATS,     // TelemetryChannelStats, one per channel and report
+    TELEMETRY_ENGINE_STATE,      // TelemetryEngineState, emulated sensor values
+    TELEMETRY_CYLINDER_TIMING,   // TelemetryCylinderTiming, one per cylinder and engine cycle
+    TELEMETRY_LINK_STATS         // TelemetryLinkStats, counters of the telemetry link itself
+} TelemetryRecordType;
+
+// Decoding results (negative values are errors)
+typedef enum {
+    TELEMETRY_ERROR_COBS = -1,   // Malformed COBS data or frame too long
+    TELEMETRY_ERROR_CRC = -2,    // CRC mismatch
+    TELEMETRY_ERROR_VERSION = -3 // Frame written with another schema version
+} TelemetryError;
+
+#pragma pack(push, 1)
+
+// Header at the start of every frame
+typedef struct {
+    uint8_t version;             // TELEMETRY_SCHEMA_VERSION
+    uint8_t type;                // TelemetryRecordType
+    uint16_t sequence;           // Incremented on every frame, gaps mean lost frames
+} TelemetryHeader;
+
+typedef struct {
+    uint64_t timestamp;          // Edge time (μs)
+    uint8_t channel;             // PulseChannel
+    uint8_t rising;              // 1 = rising edge, 0 = falling edge
+    int16_t angle;               // Crank angle (tenths of degree)
+} TelemetryPulseEdge;
+
+typedef struct {
+    uint64_t timestamp;          // End of the statistics window (μs)
+    uint32_t windowUs;           // Length of the statistics window (μs)
+    uint8_t channel;             // PulseChannel
+    uint32_t count;              // Valid pulses in the window
+    uint32_t last;               // Widths (μs)
+    uint32_t min;
+    uint32_t max;
+    uint32_t mean;
+    uint32_t stddev;
+    uint16_t dutyPermille;       // Duty cycle (‰)
+    uint32_t freqCentiHz;        // Pulse frequency (Hz × 100)
+} TelemetryChannelStats;
+
+typedef struct {
+    uint64_t timestamp;          // Sample time (μs)
+    uint16_t rpm;
+    uint8_t tps;                 // %
+    uint8_t map;                 // kPa
+    uint8_t maf;                 // g/s
+    int8_t ect;                  // °C
+    int8_t iat;                  // °C
+    uint8_t running;             // 1 = engine running
+} TelemetryEngineState;
+
+typedef struct {
+    uint64_t timestamp;          // End of the engine cycle (μs)
+    uint32_t cycle;              // Engine cycle number
+    uint8_t cylinder;            // 0-based cylinder index
+    int16_t soi;                 // Tenths of degree BTDC, INT16_MIN when not measured
+    int16_t eoi;
+    int16_t sparkAdvance;
+} TelemetryCylinderTiming;
+
+typedef struct {
+    uint64_t timestamp;          // Sample time (μs)
+    uint32_t framesQueued;       // Frames accepted for transmission
+    uint32_t framesDropped;      // Frames discarded because the TX ring was full
+    uint32_t edgesDropped;       // Edges lost before reaching the monitor task
+} TelemetryLinkStats;
+
+#pragma pack(pop)
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t TelemetryCrc16(const uint8_t* data, size_t length);
+
+// Builds a complete frame ready to transmit, delimiter included
+// Returns the frame length, or 0 if the payload or output buffer is too large/small
+size_t TelemetryEncodeFrame(uint8_t type, uint16_t sequence, const void* payload, size_t length,
+                            uint8_t* out, size_t outSize);
+
+// Decodes one frame without its 0x00 delimiter
+// Returns the payload length, or a TelemetryError
+int TelemetryDecodeFrame(const uint8_t* frame, size_t length, TelemetryHeader* header,
+                         uint8_t* payload, size_t payloadSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
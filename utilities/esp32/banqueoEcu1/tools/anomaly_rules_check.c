@@ -0,0 +1,292 @@
+/**
+ * @file anomaly_rules_check.c
+ * @brief Host check of the anomaly rules with good and faulty edge traces
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Builds the edges of a 4-cylinder ECU cycle by cycle (one injection per
+ * cylinder and one coil pulse per cycle, as the default rule table
+ * expects), feeds them to anomaly_rules.c through AnomalyEngineProcessEdge
+ * and closes every cycle with AnomalyEngineEndCycle, exactly as the pulse
+ * task does. Each scenario injects one fault from a given cycle on and
+ * checks which rule is raised, on which channel, after how many cycles,
+ * and that it is cleared when the fault goes away. A healthy ECU must
+ * not raise anything.
+ *
+ * The rule table is the same as defaultAnomalyRules of banqueoEcu1_main.c.
+ *
+ * The parameter ranges that rule:N:A,B,C accepts are checked too: the
+ * default table must fit them, and each bounded parameter must stop at
+ * its physical limit (pulses in 8 bits, dwell tolerance below 100%,
+ * angles within the 720° cycle, TPS up to 100%).
+ *
+ * Build and run:
+ *   cc -O2 -I../main anomaly_rules_check.c ../main/anomaly_rules.c -o anomaly_rules_check
+ *   ./anomaly_rules_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "anomaly_rules.h"
+
+#define CYCLES                  20
+#define FAULT_FROM              6       // First faulty cycle
+#define FAULT_TO                12      // First healthy cycle again
+
+// Same table as defaultAnomalyRules of the firmware
+static const AnomalyRule rules[] = {
+    // type                  channels               cycles  on  paramA  paramB  paramC
+    { RULE_PULSE_COUNT,      INJECTOR_CHANNEL_MASK,  1,     1,  1,      0,      0 },    // 1 injection per cycle
+    { RULE_PULSE_COUNT,      COIL_CHANNEL_MASK,      1,     1,  1,      0,      0 },    // 1 spark per cycle
+    { RULE_IMBALANCE,        INJECTOR_CHANNEL_MASK,  2,     1,  150,    0,      0 },    // 15% between injectors
+    { RULE_DWELL_CURVE,      COIL_CHANNEL_MASK,      2,     1,  150,    0,      0 },    // 15% around dwell curve
+    { RULE_INJECTION_PHASE,  INJECTOR_CHANNEL_MASK,  2,     1,  30,     0,      0 },    // SOI stable within 30°
+    { RULE_LOAD_RESPONSE,    INJECTOR_CHANNEL_MASK,  4,     1,  50,     3000,   0 }     // TPS > 50% needs >= 3 ms
+};
+
+#define RULE_COUNT              (sizeof(rules) / sizeof(rules[0]))
+#define NO_RULE                 0xFF
+
+// Faults a scenario can inject on one channel
+typedef enum {
+    FAULT_NONE,
+    FAULT_MISSING_PULSE,                // No pulse on the channel
+    FAULT_EXTRA_PULSE,                  // A second pulse on the channel
+    FAULT_WIDE_PULSE,                   // Width +40% on the channel
+    FAULT_SHORT_DWELL,                  // Coil dwell of 900 μs
+    FAULT_SOI_JITTER,                   // SOI moved ±30° every other cycle
+    FAULT_SHORT_AT_HIGH_TPS             // TPS 80% with the idle injection time
+} FaultType;
+
+// Rule expected to fire on a set of channels
+typedef struct {
+    uint8_t rule;                       // Index in the rule table, NO_RULE ends the list
+    uint8_t channelMask;
+    uint8_t cycle;                      // Cycle in which the anomaly must be raised
+} Expectation;
+
+typedef struct {
+    const char* name;
+    FaultType fault;
+    uint8_t channel;                    // Channel of the fault
+    uint16_t rpm;
+    uint32_t widthUs;                   // Healthy injection time
+    uint8_t tps;
+    Expectation expected[2];            // Nothing else may fire
+} Scenario;
+
+// The windowed rules fire once the mean of the last ANOMALY_WINDOW_CYCLES cycles
+// crosses the limit, then after minCycles failing cycles
+static const Scenario scenarios[] = {
+    { "healthy idle",          FAULT_NONE,              0,                  800,  2500, 5,
+      { { NO_RULE, 0, 0 }, { NO_RULE, 0, 0 } } },
+    { "healthy full load",     FAULT_NONE,              0,                  6000, 9000, 90,
+      { { NO_RULE, 0, 0 }, { NO_RULE, 0, 0 } } },
+    { "missing injection",     FAULT_MISSING_PULSE,     PULSE_CHANNEL_INJ3, 2000, 3000, 20,
+      { { 0, CHANNEL_MASK(PULSE_CHANNEL_INJ3), FAULT_FROM }, { NO_RULE, 0, 0 } } },
+    // The short extra pulse also lowers the mean width of the channel
+    { "extra injection",       FAULT_EXTRA_PULSE,       PULSE_CHANNEL_INJ1, 2000, 3000, 20,
+      { { 0, CHANNEL_MASK(PULSE_CHANNEL_INJ1), FAULT_FROM }, { 2, CHANNEL_MASK(PULSE_CHANNEL_INJ1), FAULT_FROM + 2 } } },
+    { "missing spark",         FAULT_MISSING_PULSE,     PULSE_CHANNEL_COIL, 2000, 3000, 20,
+      { { 1, COIL_CHANNEL_MASK, FAULT_FROM }, { NO_RULE, 0, 0 } } },
+    { "injector imbalance",    FAULT_WIDE_PULSE,        PULSE_CHANNEL_INJ2, 2000, 3000, 20,
+      { { 2, CHANNEL_MASK(PULSE_CHANNEL_INJ2), FAULT_FROM + 2 }, { NO_RULE, 0, 0 } } },
+    { "short dwell",           FAULT_SHORT_DWELL,       PULSE_CHANNEL_COIL, 3000, 3000, 20,
+      { { 3, COIL_CHANNEL_MASK, FAULT_FROM + 4 }, { NO_RULE, 0, 0 } } },
+    { "unstable SOI",          FAULT_SOI_JITTER,        PULSE_CHANNEL_INJ4, 2000, 3000, 20,
+      { { 4, CHANNEL_MASK(PULSE_CHANNEL_INJ4), FAULT_FROM + 2 }, { NO_RULE, 0, 0 } } },
+    { "no enrichment at WOT",  FAULT_SHORT_AT_HIGH_TPS, PULSE_CHANNEL_INJ1, 2000, 2500, 20,
+      { { 5, INJECTOR_CHANNEL_MASK, FAULT_FROM + 3 }, { NO_RULE, 0, 0 } } },
+};
+
+static uint32_t failures = 0;
+
+static void Fail(const Scenario* scenario, const char* message, int value, int expected)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s: %s (%d, expected %d)\n", scenario->name, message, value, expected);
+    }
+}
+
+static void Pulse(AnomalyEngine* engine, PulseChannel channel, uint64_t start, uint32_t width,
+                  int16_t angle)
+{
+    AnomalyEngineProcessEdge(engine, channel, true, start, angle);
+    AnomalyEngineProcessEdge(engine, channel, false, start + width, angle);
+}
+
+/**
+ * Feeds the edges of one 720° cycle
+ *
+ * Firing order 1-3-4-2: cylinder n fires at 180° steps, its injection starts
+ * 360° before its TDC and the coil pulse ends 15° before the TDC of cylinder 1.
+ */
+static void FeedCycle(AnomalyEngine* engine, const Scenario* scenario, uint32_t cycle, bool faulty)
+{
+    static const uint16_t tdc[PULSE_INJECTOR_COUNT] = { 0, 540, 180, 360 };
+    uint32_t cycleUs = 120000000u / scenario->rpm;
+    uint64_t start = (uint64_t)cycle * cycleUs + 1000;
+    FaultType fault = faulty ? scenario->fault : FAULT_NONE;
+
+    for (int ch = 0; ch < PULSE_INJECTOR_COUNT; ch++) {
+        int32_t soi = (tdc[ch] + 360) % 720;
+        uint32_t width = scenario->widthUs;
+        if (ch == scenario->channel) {
+            if (fault == FAULT_MISSING_PULSE) {
+                continue;
+            }
+            if (fault == FAULT_WIDE_PULSE) {
+                width = width * 140 / 100;
+            }
+            if (fault == FAULT_SOI_JITTER) {
+                soi += (cycle % 2) ? 30 : -30;
+            }
+        }
+        uint64_t at = start + (uint64_t)soi * cycleUs / 720;
+        Pulse(engine, (PulseChannel)ch, at, width, (int16_t)(soi * 10));
+        if (fault == FAULT_EXTRA_PULSE && ch == scenario->channel) {
+            Pulse(engine, (PulseChannel)ch, at + width + 1000, width / 4, (int16_t)(soi * 10));
+        }
+    }
+
+    if (!(fault == FAULT_MISSING_PULSE && scenario->channel == PULSE_CHANNEL_COIL)) {
+        int32_t minUs = scenario->rpm >= 6000 ? 1200 : 1500;
+        uint32_t dwell = fault == FAULT_SHORT_DWELL ? 900 : (uint32_t)minUs + 1000;
+        uint64_t end = start + (uint64_t)(720 - 15) * cycleUs / 720;
+        Pulse(engine, PULSE_CHANNEL_COIL, end - dwell, dwell, 0);
+    }
+}
+
+// Expected range of the bounded parameters
+typedef struct {
+    uint8_t type;
+    uint8_t param;                      // 0-2 = A-C
+    int16_t min;
+    int16_t max;
+} ParamRange;
+
+static const ParamRange paramRanges[] = {
+    { RULE_PULSE_COUNT,     0, 0, 255 },
+    { RULE_IMBALANCE,       0, 0, INT16_MAX },
+    { RULE_DWELL_CURVE,     0, 0, 1000 },
+    { RULE_INJECTION_PHASE, 0, 0, 720 },
+    { RULE_INJECTION_PHASE, 1, 0, 720 },
+    { RULE_INJECTION_PHASE, 2, 0, 720 },
+    { RULE_LOAD_RESPONSE,   0, 0, 100 },
+    { RULE_LOAD_RESPONSE,   1, 0, INT16_MAX },
+};
+
+static void CheckParamRanges(void)
+{
+    static const Scenario check = { .name = "parameter ranges" };
+    int16_t min, max;
+
+    for (unsigned i = 0; i < RULE_COUNT; i++) {
+        const int16_t params[ANOMALY_RULE_PARAMS] = { rules[i].paramA, rules[i].paramB, rules[i].paramC };
+        for (int p = 0; p < ANOMALY_RULE_PARAMS; p++) {
+            if (!AnomalyRuleParamRange(rules[i].type, p, &min, &max) || params[p] < min || params[p] > max) {
+                Fail(&check, "default rule out of range", (int)i, p);
+            }
+        }
+    }
+    for (unsigned i = 0; i < sizeof(paramRanges) / sizeof(paramRanges[0]); i++) {
+        const ParamRange* range = &paramRanges[i];
+        if (!AnomalyRuleParamRange(range->type, range->param, &min, &max)) {
+            Fail(&check, "no range for rule type", range->type, range->param);
+        } else if (min != range->min || max != range->max) {
+            Fail(&check, "range limit", min != range->min ? min : max, min != range->min ? range->min : range->max);
+        }
+    }
+    if (AnomalyRuleParamRange(RULE_TYPE_COUNT, 0, &min, &max) || AnomalyRuleParamRange(RULE_IMBALANCE, 3, &min, &max)) {
+        Fail(&check, "range of an unknown rule type or parameter", 1, 0);
+    }
+    printf("%-22s %u bounded parameters\n", check.name, (unsigned)(sizeof(paramRanges) / sizeof(paramRanges[0])));
+}
+
+static void Run(const Scenario* scenario)
+{
+    static AnomalyEngine engine;
+    AnomalyDetection detections[RULE_COUNT * PULSE_CHANNEL_COUNT];
+    int raisedAt[RULE_COUNT][PULSE_CHANNEL_COUNT];
+    int clearedAt[RULE_COUNT][PULSE_CHANNEL_COUNT];
+    uint8_t expectedMask[RULE_COUNT] = {0};
+
+    memset(raisedAt, 0xFF, sizeof(raisedAt));
+    memset(clearedAt, 0xFF, sizeof(clearedAt));
+    for (int e = 0; e < 2 && scenario->expected[e].rule != NO_RULE; e++) {
+        expectedMask[scenario->expected[e].rule] = scenario->expected[e].channelMask;
+    }
+
+    AnomalyEngineInit(&engine, rules, RULE_COUNT);
+    for (uint32_t cycle = 0; cycle < CYCLES; cycle++) {
+        bool faulty = cycle >= FAULT_FROM && cycle < FAULT_TO;
+        AnomalyContext context = {
+            .rpm = scenario->rpm,
+            .tps = (faulty && scenario->fault == FAULT_SHORT_AT_HIGH_TPS) ? 80 : scenario->tps
+        };
+
+        FeedCycle(&engine, scenario, cycle, faulty);
+        uint8_t count = AnomalyEngineEndCycle(&engine, &context, detections, RULE_COUNT * PULSE_CHANNEL_COUNT);
+
+        for (uint8_t i = 0; i < count; i++) {
+            const AnomalyDetection* det = &detections[i];
+            if (!(expectedMask[det->ruleIndex] & CHANNEL_MASK(det->channel))) {
+                Fail(scenario, det->raised ? "unexpected rule raised" : "unexpected rule cleared", det->ruleIndex,
+                     det->channel);
+                continue;
+            }
+            // The snapshot taken under the lock must describe the rule that fired
+            if (det->ruleType != rules[det->ruleIndex].type || det->limit != rules[det->ruleIndex].paramA) {
+                Fail(scenario, "rule type or limit not copied to the detection", det->ruleType,
+                     rules[det->ruleIndex].type);
+            }
+            if (det->raised && raisedAt[det->ruleIndex][det->channel] < 0) {
+                raisedAt[det->ruleIndex][det->channel] = (int)cycle;
+            } else if (!det->raised && clearedAt[det->ruleIndex][det->channel] < 0) {
+                clearedAt[det->ruleIndex][det->channel] = (int)cycle;
+            }
+        }
+    }
+
+    if (scenario->expected[0].rule == NO_RULE) {
+        printf("%-22s nothing raised\n", scenario->name);
+        return;
+    }
+    for (int e = 0; e < 2 && scenario->expected[e].rule != NO_RULE; e++) {
+        const Expectation* expected = &scenario->expected[e];
+        for (int ch = 0; ch < PULSE_CHANNEL_COUNT; ch++) {
+            if (!(expected->channelMask & CHANNEL_MASK(ch))) {
+                continue;
+            }
+            int raised = raisedAt[expected->rule][ch];
+            int cleared = clearedAt[expected->rule][ch];
+            if (raised != expected->cycle) {
+                Fail(scenario, "raised in cycle", raised, expected->cycle);
+            }
+            // Cleared once the faulty cycles leave the window at the latest
+            if (cleared < FAULT_TO || cleared > FAULT_TO + ANOMALY_WINDOW_CYCLES) {
+                Fail(scenario, "cleared in cycle", cleared, FAULT_TO);
+            }
+            printf("%-22s rule %u (%s) on channel %d: raised in cycle %d, cleared in cycle %d\n", scenario->name,
+                   expected->rule, AnomalyRuleTypeName(rules[expected->rule].type), ch, raised, cleared);
+        }
+    }
+}
+
+int main(void)
+{
+    printf("Faults from cycle %u to cycle %u, %u cycles per scenario\n", FAULT_FROM, FAULT_TO - 1, CYCLES);
+    for (unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        Run(&scenarios[i]);
+    }
+    CheckParamRanges();
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
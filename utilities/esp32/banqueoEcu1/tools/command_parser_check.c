@@ -0,0 +1,230 @@
+/**
+ * @file command_parser_check.c
+ * @brief Host check of the console line assembly and command parsing
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs command_parser.c against a small command table with one command
+ * of every argument type and checks:
+ *   - line endings (CR, LF, CR+LF), backspace, and input split in blocks
+ *     of any size, including one byte at a time
+ *   - several commands per line separated by ';', blanks and '#' comments
+ *   - integer and decimal arguments, range, arity and unknown commands
+ *   - lines longer than COMMAND_MAX_LINE discarded whole and counted, and
+ *     CommandLineDiscard() after an overrun keeping that count
+ *   - the script mode replies, one "ok" or "err <reason>: <command>" line
+ *     per command, as ReportCommandResult writes them
+ *
+ * Build and run:
+ *   cc -O2 -I../main command_parser_check.c ../main/command_parser.c -o command_parser_check
+ *   ./command_parser_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "command_parser.h"
+
+static uint32_t failures = 0;
+
+// What the handlers received, in order (the raw text only for text arguments)
+static char calls[1024];
+static char replies[1024];
+
+static void Fail(const char* input, const char* what, const char* value, const char* expected)
+{
+    if (failures++ < 20) {
+        printf("FAIL \"%s\": %s\n     got      \"%s\"\n     expected \"%s\"\n", input, what, value, expected);
+    }
+}
+
+static void Record(const char* name, int32_t value, const char* text)
+{
+    char call[64];
+    snprintf(call, sizeof(call), "%s(%ld,%s) ", name, (long)value, text);
+    strncat(calls, call, sizeof(calls) - strlen(calls) - 1);
+}
+
+static bool CmdRpm(int32_t value, const char* text)
+{
+    (void)text;
+    Record("rpm", value, "");
+    return true;
+}
+
+static bool CmdTdc(int32_t value, const char* text)
+{
+    (void)text;
+    Record("tdc", value, "");
+    return true;
+}
+
+static bool CmdRule(int32_t value, const char* text)
+{
+    Record("rule", value, text);
+    // As ConfigureAnomalyRule, the handler validates free text
+    return strchr(text, ':') != NULL;
+}
+
+static bool CmdStatus(int32_t value, const char* text)
+{
+    Record("status", value, text);
+    return true;
+}
+
+static const CommandDef table[] = {
+    { "rpm",    CMD_ARG_INT,     800, 6000, CmdRpm,    "rpm:VALUE",     "Set RPM" },
+    { "tdc",    CMD_ARG_DECIMAL, 0,   7199, CmdTdc,    "tdc:DEG",       "Set TDC" },
+    { "rule",   CMD_ARG_TEXT,    0,   0,    CmdRule,   "rule:N:on|off", "Set rule" },
+    { "status", CMD_ARG_NONE,    0,   0,    CmdStatus, "status",        "Show status" },
+};
+
+#define TABLE_COUNT             (sizeof(table) / sizeof(table[0]))
+
+// Same reply format as ReportCommandResult in script mode
+static void ScriptReport(const char* command, CommandResult result, void* context)
+{
+    char reply[COMMAND_MAX_LINE + 32];
+    (void)context;
+    if (result == CMD_OK) {
+        snprintf(reply, sizeof(reply), "ok\n");
+    } else {
+        snprintf(reply, sizeof(reply), "err %s: %s\n", CommandResultName(result), command);
+    }
+    strncat(replies, reply, sizeof(replies) - strlen(replies) - 1);
+}
+
+static void HandleLine(char* line, void* context)
+{
+    CommandExecuteLine(table, TABLE_COUNT, line, ScriptReport, context);
+}
+
+/**
+ * Feeds input in blocks of a given size and compares handler calls and replies
+ */
+static void Check(const char* input, size_t block, const char* expectedCalls, const char* expectedReplies)
+{
+    CommandLineBuffer buffer;
+    size_t length = strlen(input);
+
+    calls[0] = '\0';
+    replies[0] = '\0';
+    CommandLineInit(&buffer);
+    for (size_t i = 0; i < length; i += block) {
+        size_t chunk = length - i < block ? length - i : block;
+        CommandLineFeed(&buffer, (const uint8_t*)input + i, chunk, HandleLine, NULL);
+    }
+
+    if (strcmp(calls, expectedCalls) != 0) {
+        Fail(input, "handler calls", calls, expectedCalls);
+    }
+    if (strcmp(replies, expectedReplies) != 0) {
+        Fail(input, "script replies", replies, expectedReplies);
+    }
+}
+
+// Every input fed whole, one byte at a time and in blocks of 3
+static void CheckAllBlocks(const char* input, const char* expectedCalls, const char* expectedReplies)
+{
+    static const size_t blocks[] = { 1024, 1, 3 };
+    for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+        Check(input, blocks[i], expectedCalls, expectedReplies);
+    }
+}
+
+static void CheckOverlong(void)
+{
+    CommandLineBuffer buffer;
+    char input[COMMAND_MAX_LINE * 2 + 64];
+    char text[16];
+
+    // The longest accepted line, then one character longer
+    memset(input, ' ', sizeof(input));
+    memcpy(input, "status", 6);
+    input[COMMAND_MAX_LINE] = '\n';
+    memcpy(input + COMMAND_MAX_LINE + 1, "status", 6);
+    input[2 * COMMAND_MAX_LINE + 2] = '\n';
+    memcpy(input + 2 * COMMAND_MAX_LINE + 3, "rpm:900\n", 9);
+
+    calls[0] = '\0';
+    replies[0] = '\0';
+    CommandLineInit(&buffer);
+    size_t lines = CommandLineFeed(&buffer, (const uint8_t*)input, strlen(input), HandleLine, NULL);
+    if (lines != 2 || strcmp(calls, "status(0,) rpm(900,) ") != 0) {
+        Fail("overlong line", "only the line of COMMAND_MAX_LINE characters and the next one run", calls,
+             "status(0,) rpm(900,) ");
+    }
+    snprintf(text, sizeof(text), "%lu", (unsigned long)buffer.overflowCount);
+    if (buffer.overflowCount != 1) {
+        Fail("overlong line", "lines too long", text, "1");
+    }
+
+    // UART overrun in the middle of a line: the partial line is lost, the counters stay
+    CommandLineFeed(&buffer, (const uint8_t*)"rpm:12", 6, HandleLine, NULL);
+    CommandLineDiscard(&buffer);
+    calls[0] = '\0';
+    CommandLineFeed(&buffer, (const uint8_t*)"00\nrpm:1500\n", 12, HandleLine, NULL);
+    if (strcmp(calls, "rpm(1500,) ") != 0) {
+        Fail("overrun", "partial line discarded", calls, "rpm(1500,) ");
+    }
+    snprintf(text, sizeof(text), "%lu", (unsigned long)buffer.overflowCount);
+    if (buffer.overflowCount != 1) {
+        Fail("overrun", "lines too long kept after the discard", text, "1");
+    }
+
+    // Discarding an overflowing line must not count it twice nor drop the next one
+    memset(input, 'x', COMMAND_MAX_LINE + 10);
+    CommandLineFeed(&buffer, (const uint8_t*)input, COMMAND_MAX_LINE + 10, HandleLine, NULL);
+    CommandLineDiscard(&buffer);
+    calls[0] = '\0';
+    CommandLineFeed(&buffer, (const uint8_t*)"status\n", 7, HandleLine, NULL);
+    if (strcmp(calls, "status(0,) ") != 0) {
+        Fail("overrun", "line after a discarded overflow", calls, "status(0,) ");
+    }
+    snprintf(text, sizeof(text), "%lu", (unsigned long)buffer.overflowCount);
+    if (buffer.overflowCount != 1) {
+        Fail("overrun", "lines too long after discarding an overflow", text, "1");
+    }
+}
+
+int main(void)
+{
+    // Line endings, blank lines and backspace
+    CheckAllBlocks("rpm:900\rrpm:1000\nrpm:1100\r\n\r\n\n", "rpm(900,) rpm(1000,) rpm(1100,) ", "ok\nok\nok\n");
+    CheckAllBlocks("rpm:25X\b00\n", "rpm(2500,) ", "ok\n");
+    CheckAllBlocks("status", "", "");
+
+    // Separators, blanks and comments
+    CheckAllBlocks("rpm:2000;tdc:117.5 ; status\n", "rpm(2000,) tdc(1175,) status(0,) ", "ok\nok\nok\n");
+    CheckAllBlocks(";;  rpm:3000 ;\t;\n", "rpm(3000,) ", "ok\n");
+    CheckAllBlocks("# whole line comment\n", "", "");
+    CheckAllBlocks("rpm:4000 # rpm:5000; status\n", "rpm(4000,) ", "ok\n");
+    CheckAllBlocks("rule:2:on;rule:3:80,0,0\n", "rule(0,2:on) rule(0,3:80,0,0) ", "ok\nok\n");
+
+    // Numbers
+    CheckAllBlocks("tdc:0;tdc:719.9;tdc:.5;tdc:1.25;tdc:-0.5;tdc:5.\n", "tdc(0,) tdc(7199,) tdc(50,) ",
+                   "ok\nok\nerr invalid number: tdc:.5\nerr invalid number: tdc:1.25\n"
+                   "err out of range: tdc:-0.5\nok\n");
+    CheckAllBlocks("rpm:+900;rpm:9x;rpm:99999999999;rpm: 900\n", "rpm(900,) ",
+                   "ok\nerr invalid number: rpm:9x\nerr invalid number: rpm:99999999999\n"
+                   "err invalid number: rpm: 900\n");
+
+    // Range and arity
+    CheckAllBlocks("rpm:799;rpm:800;rpm:6000;rpm:6001\n", "rpm(800,) rpm(6000,) ",
+                   "err out of range: rpm:799\nok\nok\nerr out of range: rpm:6001\n");
+    CheckAllBlocks("rpm;rpm:;status:1;rule;rule:2\n", "rule(0,2) ",
+                   "err missing argument: rpm\nerr missing argument: rpm:\nerr unexpected argument: status:1\n"
+                   "err missing argument: rule\nerr rejected: rule:2\n");
+    CheckAllBlocks("stat;statuses;RPM:900;status\n", "status(0,) ",
+                   "err unknown command: stat\nerr unknown command: statuses\nerr unknown command: RPM:900\nok\n");
+
+    CheckOverlong();
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
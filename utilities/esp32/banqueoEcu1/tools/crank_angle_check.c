@@ -0,0 +1,195 @@
+/**
+ * @file crank_angle_check.c
+ * @brief Host check of the SOI/EOI/spark angles measured against a synthetic ECU
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Emulates the 60-2 generator of the firmware: every tooth is TIMER_SCALE
+ * ticks apart as CkpToothTicks() computes, and at the start of every tooth
+ * the CrankPosition is published with the microsecond timestamp of
+ * esp_timer, as TimerGroupIsr does. A synthetic ECU drives each injector
+ * and the coil at known angles before the firing TDC of its cylinder
+ * (firing order 1-3-4-2). Every edge gets its angle from CrankAngleAt()
+ * and is fed to CrankTimingProcessEdge(), and every second revolution
+ * closes the cycle with CrankTimingEndCycle(), as PulseMonitorTask does.
+ *
+ * The published SOI, EOI and spark advance of every cylinder must be
+ * within 0.5° of what the synthetic ECU commanded, from idle to 6500 RPM,
+ * with retarded sparks, injections that end after the TDC and a
+ * TDC reference that is not a whole tooth.
+ *
+ * Build and run:
+ *   cc -O2 -I../main crank_angle_check.c ../main/crank_angle.c -o crank_angle_check -lm
+ *   ./crank_angle_check
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "crank_angle.h"
+
+#define TIMER_SCALE             5000000           // 80 MHz APB clock / TIMER_DIVIDER 16
+#define TOTAL_TEETH             60
+#define CYCLES                  12
+#define TOLERANCE               5                 // 0.5° in tenths of degree
+
+// Cylinder indexes in firing order, as firingOrder of the firmware
+static const uint8_t firingOrder[CRANK_CYLINDERS] = { 0, 2, 3, 1 };
+
+// What the synthetic ECU commands, in degrees before the firing TDC of each cylinder
+typedef struct {
+    const char* name;
+    uint16_t rpm;
+    double tdcOffset;                   // Cylinder 1 TDC after the first tooth (degrees)
+    double soi;                         // Start of injection
+    double eoi;                         // End of injection
+    double advance;                     // End of the dwell, negative after the TDC
+    double dwellUs;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    { "idle",                     800, 120.0, 380.0, 350.4,  10.0, 3000 },
+    { "cruise",                  2500, 120.0, 420.0, 361.3,  28.5, 2500 },
+    { "full load",               6500, 120.0, 460.0, 250.0,  34.0, 1800 },
+    { "retarded spark",          1200, 120.0, 360.0, 330.0,  -8.0, 3000 },
+    { "injection across TDC",    3000, 117.5,  30.0, 700.0,  12.3, 2200 },
+    { "open valve injection",    4000,  63.2, 300.0, 120.0,  22.2, 2000 },
+};
+
+// Edge produced by the synthetic ECU
+typedef struct {
+    double time;                        // Exact time (μs)
+    uint8_t channel;
+    bool rising;
+} Edge;
+
+static uint32_t failures = 0;
+
+static void Fail(const Scenario* scenario, const char* what, int cylinder, int value, int expected)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s: cylinder %d %s %.1f°, expected %.1f°\n", scenario->name, cylinder + 1, what,
+               value / 10.0, expected / 10.0);
+    }
+}
+
+static int CompareEdges(const void* a, const void* b)
+{
+    const Edge* x = a;
+    const Edge* y = b;
+    return x->time < y->time ? -1 : x->time > y->time;
+}
+
+// Difference of two cycle angles, wrapped to [-360°, 360°)
+static int AngleError(int value, int expected)
+{
+    int diff = (value - expected) % CRANK_CYCLE_ANGLE;
+    if (diff >= CRANK_CYCLE_ANGLE / 2) diff -= CRANK_CYCLE_ANGLE;
+    if (diff < -CRANK_CYCLE_ANGLE / 2) diff += CRANK_CYCLE_ANGLE;
+    return diff;
+}
+
+static void Run(const Scenario* scenario)
+{
+    static Edge edges[CYCLES * CRANK_CYLINDERS * 4];
+    uint32_t toothTicks = (uint32_t)((uint64_t)TIMER_SCALE * 60 / ((uint32_t)scenario->rpm * TOTAL_TEETH));
+    double toothUs = (double)toothTicks * 1000000 / TIMER_SCALE;
+    double degreeUs = toothUs / 6.0;
+    double cycleUs = toothUs * TOTAL_TEETH * 2;
+    size_t count = 0;
+    CrankTiming timing;
+    CrankPosition position = { 0, TOTAL_TEETH, 0, 0 };
+    int worst = 0;
+    uint32_t checked = 0;
+
+    // The synthetic ECU: edges of every cylinder, from cycle 1 on so none starts before time 0
+    for (int cycle = 1; cycle < CYCLES; cycle++) {
+        for (int i = 0; i < CRANK_CYLINDERS; i++) {
+            int cylinder = firingOrder[i];
+            double tdc = cycle * cycleUs + (scenario->tdcOffset + i * 180.0) * degreeUs;
+            double eoi = tdc - scenario->eoi * degreeUs;
+            double soi = tdc - scenario->soi * degreeUs;
+            double spark = tdc - scenario->advance * degreeUs;
+            edges[count++] = (Edge){ soi, (uint8_t)cylinder, true };
+            edges[count++] = (Edge){ eoi, (uint8_t)cylinder, false };
+            // A single coil channel is monitored: one dwell for every cylinder
+            edges[count++] = (Edge){ spark - scenario->dwellUs, PULSE_CHANNEL_COIL, true };
+            edges[count++] = (Edge){ spark, PULSE_CHANNEL_COIL, false };
+        }
+    }
+    qsort(edges, count, sizeof(Edge), CompareEdges);
+
+    CrankTimingInit(&timing, (int16_t)lround(scenario->tdcOffset * 10), firingOrder);
+
+    // Teeth, cycle ends and edges in time order
+    size_t next = 0;
+    uint64_t totalTeeth = (uint64_t)(CYCLES + 2) * TOTAL_TEETH * 2;
+    for (uint64_t tooth = 0; tooth < totalTeeth; tooth++) {
+        double toothStart = tooth * toothUs;
+        double toothEnd = toothStart + toothUs;
+
+        position.tooth = (uint16_t)(tooth % (TOTAL_TEETH * 2));
+        position.toothPeriodUs = (uint32_t)((uint64_t)toothTicks * 1000000 / TIMER_SCALE);
+        position.toothTime = (uint64_t)toothStart;
+
+        if (position.tooth == 0 && tooth > 0) {
+            CrankTimingEndCycle(&timing);
+
+            // Figures of the cycle just closed, once the first complete one is out
+            uint32_t cycle = timing.cycleCount;
+            for (int cylinder = 0; cycle >= 3 && cycle < CYCLES && cylinder < CRANK_CYLINDERS; cylinder++) {
+                const CylinderTiming* measured = &timing.last[cylinder];
+                int expected[3] = {
+                    (int)lround(scenario->soi * 10) % CRANK_CYCLE_ANGLE,
+                    (int)lround(scenario->eoi * 10) % CRANK_CYCLE_ANGLE,
+                    (int)lround(scenario->advance * 10)
+                };
+                checked++;
+                int values[3] = { measured->soi, measured->eoi, measured->sparkAdvance };
+                static const char* const names[3] = { "SOI", "EOI", "advance" };
+                for (int f = 0; f < 3; f++) {
+                    if (values[f] == CRANK_ANGLE_UNKNOWN) {
+                        Fail(scenario, "not measured", cylinder, 0, expected[f]);
+                        continue;
+                    }
+                    int error = abs(f == 2 ? values[f] - expected[f] : AngleError(values[f], expected[f]));
+                    if (error > worst) worst = error;
+                    if (error > TOLERANCE) {
+                        Fail(scenario, names[f], cylinder, values[f], expected[f]);
+                    }
+                }
+            }
+        }
+
+        // The GPIO ISR reads esp_timer in whole microseconds
+        while (next < count && edges[next].time < toothEnd) {
+            uint64_t timestamp = (uint64_t)edges[next].time;
+            int16_t angle = CrankAngleAt(&position, timestamp);
+            CrankTimingProcessEdge(&timing, (PulseChannel)edges[next].channel, edges[next].rising, angle);
+            next++;
+        }
+    }
+
+    if (checked == 0) {
+        Fail(scenario, "no cycle checked", 0, 0, 0);
+    }
+    printf("%-24s %4u RPM, tooth %6.1f us: %2u cylinder cycles, worst error %.1f°\n", scenario->name,
+           scenario->rpm, toothUs, checked, worst / 10.0);
+}
+
+int main(void)
+{
+    printf("60-2 wheel, firing order 1-3-4-2, tolerance %.1f°\n", TOLERANCE / 10.0);
+    for (unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        Run(&scenarios[i]);
+    }
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
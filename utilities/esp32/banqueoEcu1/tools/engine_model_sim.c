@@ -0,0 +1,393 @@
+/**
+ * @file engine_model_sim.c
+ * @brief Host check and runner of the bench engine model, faster than real time
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs the same engine_model.c and o2_sensor.c as the firmware and checks
+ * them against values computed by hand.
+ *
+ * Steady state: at fixed speed and throttle the manifold must settle
+ * where the throttle flow equals the cylinder flow. The expected MAP and
+ * air flow of every point were computed by hand from the same equations
+ * in floating point (exact psi function with k = 1.4, bilinear VE, intake
+ * air at 25 °C), solving throttle flow = cylinder flow by bisection:
+ *   - MAP within 1.5 kPa, throttle flow within 3%
+ *   - throttle and cylinder flow within 1% of each other
+ *
+ * Scripted test: idle, a throttle step, high load and back to idle, while
+ * a simple ECU calculates the injection from the trapped air once per
+ * engine cycle. In closed loop the ECU also trims the fuel with the
+ * narrowband O2 signal, like a real ECU would on the bench. Injector 2
+ * flows 10% less than the others, so the trim has something to correct.
+ * Over the last seconds of idle:
+ *   - open loop: the mixed exhaust is as lean as the missing fuel says
+ *     (mean injector flow 243.75 of 250 cc/min, lambda 1.026)
+ *   - closed loop: the O2 signal switches between 0.5 and 5 times per
+ *     second and the trim never reaches its limit
+ *   - closed loop: the mean trim adds the missing fuel (+2.6%), the mixed
+ *     exhaust averages lambda 1 and every cylinder converges to the
+ *     lambda its injector flow gives (0.974 and 1.082 for injector 2)
+ *
+ * With no arguments only the checks run. With a mode (open or closed)
+ * and/or a duration in seconds the script is also run that way and the
+ * model state is written as CSV every 10 ms to stdout, while the check
+ * results go to stderr. Results are exactly repeatable, so they can be
+ * compared between versions.
+ *
+ * Build and run:
+ *   cc -O2 -I../main engine_model_sim.c ../main/engine_model.c ../main/o2_sensor.c -o engine_model_sim
+ *   ./engine_model_sim
+ *   ./engine_model_sim closed 20 > model.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "engine_model.h"
+#include "o2_sensor.h"
+
+// Injector flow the ECU is calibrated for (cc/min)
+#define NOMINAL_INJECTOR_FLOW   250
+
+// Steady state tolerances
+#define MAP_TOLERANCE           15                // Tenths of kPa
+#define FLOW_TOLERANCE_PCT      3
+#define BALANCE_TOLERANCE_PCT   1
+#define SETTLE_MS               3000
+
+// Narrowband switching point and trim steps of the ECU (‰)
+#define O2_SWITCH_MV            450
+#define TRIM_JUMP               20                // Applied when the O2 signal switches
+#define TRIM_RAMP               2                 // Applied every cycle while it does not
+#define TRIM_LIMIT              250
+
+// Scripted test checks, over the idle at the end of the script
+#define CHECK_SECONDS           15
+#define CHECK_WINDOW_MS         12000             // The idle starts at 9 s, the trim needs time to settle
+#define SWITCH_RATE_MIN         5                 // Tenths of Hz
+#define SWITCH_RATE_MAX         50
+#define TRIM_TOLERANCE          10                // ‰
+#define LAMBDA_TOLERANCE        10                // × 1000
+
+#define DEFAULT_SECONDS         12
+
+// Firmware engine, with injector 2 flowing 10% less
+static const EngineModelConfig config = {
+    .displacementCc = 1600,
+    .manifoldVolumeCc = 2500,
+    .cylinders = 4,
+    .injectorFlowCcMin = { 250, 225, 250, 250 },
+    .injectorDeadTimeUs = 1000,
+    .exhaustDelayMs = 80,
+    .sensorResponseMs = 60,
+    .thermostatC = 88
+};
+
+// Speed and throttle with the MAP and air flow calculated by hand
+typedef struct {
+    uint16_t rpm;
+    uint8_t tps;
+    uint16_t map;                // Tenths of kPa
+    uint32_t flow;               // mg/s
+} SteadyPoint;
+
+static const SteadyPoint steadyPoints[] = {
+    {  800,   5, 400,  2847 },   // Idle with the bypass air
+    { 1000,  15, 427,  4033 },
+    { 2500,  25, 307,  8541 },   // Cruise, the VE rises faster than the throttle opens
+    { 3000,  60, 955, 39976 },
+    { 5500, 100, 1003, 77398 },  // Full load
+};
+
+// One step of the test: from time onwards apply rpm and tps
+typedef struct {
+    uint32_t timeMs;
+    uint16_t rpm;
+    uint8_t tps;
+} ScriptStep;
+
+static const ScriptStep script[] = {
+    {     0, 1000, 15 },             // Idle
+    {  2000, 1000, 60 },             // Throttle step at low speed
+    {  3000, 3000, 60 },
+    {  6000, 5500, 100 },            // Full load
+    {  9000, 1000, 15 },             // Back to idle
+};
+
+#define SCRIPT_STEPS (sizeof(script) / sizeof(script[0]))
+
+static uint32_t failures = 0;
+static FILE* report;
+
+static void Fail(const char* test, const char* what, long value, long expected)
+{
+    if (failures++ < 20) {
+        fprintf(report, "FAIL %s: %s %ld, expected %ld\n", test, what, value, expected);
+    }
+}
+
+static long Percent(long value, long reference)
+{
+    return labs(value - reference) * 100 / (reference > 0 ? reference : 1);
+}
+
+/**
+ * Injection of a speed-density ECU aiming at lambda 1
+ *
+ * @param model Engine model, the air of the previous cycle is used
+ * @param trim Fuel correction (‰)
+ * @return Injector pulse (μs)
+ */
+static uint32_t EcuInjectorPulse(const EngineModel* model, int32_t trim)
+{
+    // Fuel for lambda 1 plus the injector dead time
+    uint64_t fuel = (uint64_t)model->airPerCylinder * 10 * (1000 + trim) / (147 * 1000);
+    return (uint32_t)(fuel * 60000 / ((uint64_t)NOMINAL_INJECTOR_FLOW * 740)) + config.injectorDeadTimeUs;
+}
+
+static void CheckSteadyState(void)
+{
+    EngineModel model;
+
+    for (size_t p = 0; p < sizeof(steadyPoints) / sizeof(steadyPoints[0]); p++) {
+        const SteadyPoint* point = &steadyPoints[p];
+        EngineModelInputs inputs = { .rpm = point->rpm, .tps = point->tps, .iat = 25 };
+        char test[32];
+
+        EngineModelInit(&model, &config, 88);
+        for (uint32_t i = 0; i < SETTLE_MS * 1000 / ENGINE_MODEL_STEP_US; i++) {
+            EngineModelStep(&model, &inputs);
+        }
+
+        uint16_t map = EngineModelMap(&model);
+        snprintf(test, sizeof(test), "%u rpm %u%% TPS", point->rpm, point->tps);
+        if (abs((int)map - (int)point->map) > MAP_TOLERANCE) {
+            Fail(test, "MAP (tenths of kPa)", map, point->map);
+        }
+        if (Percent(model.throttleFlow, point->flow) > FLOW_TOLERANCE_PCT) {
+            Fail(test, "throttle flow (mg/s)", model.throttleFlow, point->flow);
+        }
+        if (Percent(model.cylinderFlow, model.throttleFlow) > BALANCE_TOLERANCE_PCT) {
+            Fail(test, "cylinder flow against throttle flow (mg/s)", model.cylinderFlow, model.throttleFlow);
+        }
+        fprintf(report, "%-18s MAP %3u.%u kPa (hand %3u.%u), throttle %5u mg/s (hand %5u), cylinders %5u mg/s\n",
+                test, map / 10, map % 10, point->map / 10, point->map % 10, model.throttleFlow, point->flow,
+                model.cylinderFlow);
+    }
+}
+
+// Averages of the scripted test over the check window
+typedef struct {
+    uint32_t switches;
+    uint32_t cycles;
+    int32_t trimMin;
+    int32_t trimMax;
+    int64_t trimSum;
+    uint64_t exhaustLambdaSum;
+    uint64_t cylinderLambdaSum[ENGINE_MAX_CYLINDERS];
+    uint32_t samples;
+} ScriptResult;
+
+/**
+ * Runs the scripted test
+ *
+ * @param closedLoop Trim the fuel with the O2 signal
+ * @param seconds Simulated time
+ * @param csv CSV output, NULL for none
+ * @param result Averages from CHECK_WINDOW_MS to the end
+ */
+static void RunScript(bool closedLoop, uint32_t seconds, FILE* csv, ScriptResult* result)
+{
+    uint32_t steps = seconds * (1000000 / ENGINE_MODEL_STEP_US);
+    EngineModel model;
+    EngineModelInputs inputs = { .rpm = 0, .tps = 0, .iat = 25 };
+    size_t scriptIndex = 0;
+    uint32_t nextInjectionMs = 0;
+    int32_t trim = 0;
+    bool rich = false;
+
+    memset(result, 0, sizeof(*result));
+    result->trimMin = TRIM_LIMIT;
+    result->trimMax = -TRIM_LIMIT;
+    EngineModelInit(&model, &config, 20);
+
+    if (csv) {
+        fprintf(csv, "time_ms,rpm,tps,map_kpa,throttle_mg_s,cylinder_mg_s,injector_us,lambda,o2_mv,trim_pct,ect_c\n");
+    }
+
+    for (uint32_t i = 0; i < steps; i++) {
+        uint32_t timeMs = i * ENGINE_MODEL_STEP_US / 1000;
+        bool inWindow = timeMs >= CHECK_WINDOW_MS;
+        while (scriptIndex < SCRIPT_STEPS && script[scriptIndex].timeMs <= timeMs) {
+            inputs.rpm = script[scriptIndex].rpm;
+            inputs.tps = script[scriptIndex].tps;
+            scriptIndex++;
+        }
+
+        uint16_t lambda = EngineModelLambda(&model);
+        uint16_t o2 = O2NarrowbandMillivolts(lambda);
+
+        // The ECU recalculates the injection once per engine cycle
+        if (timeMs >= nextInjectionMs) {
+            if (closedLoop) {
+                bool nowRich = o2 > O2_SWITCH_MV;
+                if (nowRich != rich) {
+                    trim += nowRich ? -TRIM_JUMP : TRIM_JUMP;
+                    if (inWindow) {
+                        result->switches++;
+                    }
+                } else {
+                    trim += nowRich ? -TRIM_RAMP : TRIM_RAMP;
+                }
+                rich = nowRich;
+                if (trim > TRIM_LIMIT) trim = TRIM_LIMIT;
+                if (trim < -TRIM_LIMIT) trim = -TRIM_LIMIT;
+            }
+            uint32_t pulse = EcuInjectorPulse(&model, trim);
+            for (int c = 0; c < config.cylinders; c++) {
+                inputs.injectorPulseUs[c] = pulse;
+            }
+            nextInjectionMs = timeMs + (inputs.rpm > 0 ? 120000 / inputs.rpm : 1);
+
+            if (inWindow) {
+                result->cycles++;
+                result->trimSum += trim;
+                if (trim < result->trimMin) result->trimMin = trim;
+                if (trim > result->trimMax) result->trimMax = trim;
+            }
+        }
+
+        EngineModelStep(&model, &inputs);
+
+        if (inWindow) {
+            result->samples++;
+            result->exhaustLambdaSum += model.exhaustLambda;
+            for (int c = 0; c < config.cylinders; c++) {
+                result->cylinderLambdaSum[c] += model.cylinderLambda[c];
+            }
+        }
+
+        if (csv && (i * ENGINE_MODEL_STEP_US) % 10000 == 0) {
+            uint16_t map = EngineModelMap(&model);
+            int16_t ect = EngineModelCoolant(&model);
+            fprintf(csv, "%u,%u,%u,%u.%u,%u,%u,%u,%u.%03u,%u,%d.%d,%d.%d\n", timeMs, inputs.rpm, inputs.tps,
+                    map / 10, map % 10, model.throttleFlow, model.cylinderFlow, inputs.injectorPulseUs[0],
+                    lambda / 1000, lambda % 1000, o2, trim / 10, abs(trim % 10), ect / 10, abs(ect % 10));
+        }
+    }
+}
+
+static void CheckScript(bool closedLoop)
+{
+    const char* test = closedLoop ? "closed loop" : "open loop";
+    ScriptResult result;
+    uint32_t flowSum = 0;
+
+    RunScript(closedLoop, CHECK_SECONDS, NULL, &result);
+    if (result.samples == 0 || result.cycles == 0) {
+        Fail(test, "samples in the check window", 0, 1);
+        return;
+    }
+
+    // Trim that makes up for the missing flow: nominal over mean flow
+    for (int c = 0; c < config.cylinders; c++) {
+        flowSum += config.injectorFlowCcMin[c];
+    }
+    int32_t expectedTrim = closedLoop ?
+        (int32_t)((NOMINAL_INJECTOR_FLOW * config.cylinders * 1000 + flowSum / 2) / flowSum) - 1000 : 0;
+    int32_t meanTrim = (int32_t)(result.trimSum / (int64_t)result.cycles);
+    uint32_t windowMs = CHECK_SECONDS * 1000 - CHECK_WINDOW_MS;
+    uint32_t switchRate = result.switches * 10000 / windowMs;
+
+    // Every cylinder gets the fuel of its own injector, the mix averages them
+    uint32_t exhaustLambda = (uint32_t)(result.exhaustLambdaSum / result.samples);
+    uint32_t expectedExhaust = (uint32_t)((uint64_t)NOMINAL_INJECTOR_FLOW * config.cylinders * 1000 * 1000 /
+                                          ((uint64_t)flowSum * (1000 + expectedTrim)));
+    uint32_t lambdas[ENGINE_MAX_CYLINDERS];
+    uint32_t expected[ENGINE_MAX_CYLINDERS];
+    fprintf(report, "%-18s %u O2 switches in %u ms, trim %d to %d mean %d (expected %d) ‰, exhaust lambda %u (expected %u), per cylinder",
+            test, result.switches, windowMs, result.trimMin, result.trimMax, meanTrim, expectedTrim,
+            exhaustLambda, expectedExhaust);
+    for (int c = 0; c < config.cylinders; c++) {
+        lambdas[c] = (uint32_t)(result.cylinderLambdaSum[c] / result.samples);
+        expected[c] = (uint32_t)((uint64_t)NOMINAL_INJECTOR_FLOW * 1000 * 1000 /
+                                 ((uint64_t)config.injectorFlowCcMin[c] * (1000 + expectedTrim)));
+        fprintf(report, " %u (%u)", lambdas[c], expected[c]);
+    }
+    fprintf(report, "\n");
+
+    if (closedLoop) {
+        if (switchRate < SWITCH_RATE_MIN || switchRate > SWITCH_RATE_MAX) {
+            Fail(test, "O2 switches per second (tenths)", switchRate, SWITCH_RATE_MIN);
+        }
+        if (result.trimMax >= TRIM_LIMIT || result.trimMin <= -TRIM_LIMIT) {
+            Fail(test, "trim reached its limit (‰)", result.trimMax >= TRIM_LIMIT ? result.trimMax : result.trimMin,
+                 TRIM_LIMIT - 1);
+        }
+        if (abs(meanTrim - expectedTrim) > TRIM_TOLERANCE) {
+            Fail(test, "mean trim (‰)", meanTrim, expectedTrim);
+        }
+    }
+
+    if (abs((int)exhaustLambda - (int)expectedExhaust) > LAMBDA_TOLERANCE) {
+        Fail(test, "mean exhaust lambda (x 1000)", exhaustLambda, expectedExhaust);
+    }
+    for (int c = 0; c < config.cylinders; c++) {
+        if (abs((int)lambdas[c] - (int)expected[c]) > LAMBDA_TOLERANCE) {
+            Fail(test, "mean cylinder lambda (x 1000)", lambdas[c], expected[c]);
+        }
+    }
+}
+
+static int Usage(void)
+{
+    fprintf(stderr, "Usage: engine_model_sim [open|closed] [SECONDS]\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seconds = DEFAULT_SECONDS;
+    bool csv = false;
+    bool closedLoop = false;
+
+    // The mode and the duration are separate arguments, in any order
+    for (int i = 1; i < argc; i++) {
+        char* end;
+        long value = strtol(argv[i], &end, 10);
+        if (strcmp(argv[i], "open") == 0 || strcmp(argv[i], "closed") == 0) {
+            closedLoop = argv[i][0] == 'c';
+        } else if (end != argv[i] && *end == '\0' && value > 0 && value <= 3600) {
+            seconds = (uint32_t)value;
+        } else {
+            return Usage();
+        }
+        csv = true;
+    }
+    report = csv ? stderr : stdout;
+
+    CheckSteadyState();
+    CheckScript(false);
+    CheckScript(true);
+
+    if (csv) {
+        ScriptResult result;
+        clock_t start = clock();
+        RunScript(closedLoop, seconds, stdout, &result);
+        double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+        fprintf(report, "%s loop: %u steps (%u s simulated) in %.3f s, %.0fx real time\n",
+                closedLoop ? "Closed" : "Open", seconds * (1000000 / ENGINE_MODEL_STEP_US), seconds, elapsed,
+                elapsed > 0 ? seconds / elapsed : 0.0);
+    }
+
+    fprintf(report, "%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file ntc_lookup_check.c
+ * @brief Host check and timing of the NTC table lookup against Steinhart-Hart
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Links the same ntc_tables.c and ntc_sensor.c as the firmware and calls
+ * NtcLookup() every 0.1 °C over the whole table range for every curve.
+ * Each reading is compared with the Steinhart-Hart curve the tables were
+ * generated from (the coefficients are read from the header comment of
+ * ntc_tables.h, so the check follows the tables when they are generated
+ * again):
+ *   - resistance error (%)
+ *   - ECU input voltage error (mV)
+ *   - temperature the ECU computes back from the emulated voltage, which
+ *     must be within 0.5 °C
+ * Temperatures outside the table must be clamped to its ends.
+ *
+ * Then the time of NtcLookup() is compared with evaluating the curve
+ * directly in double precision (what the lookup table replaces).
+ *
+ * Build and run:
+ *   cc -O2 -I../main ntc_lookup_check.c ../main/ntc_tables.c ../main/ntc_sensor.c -o ntc_lookup_check -lm
+ *   ./ntc_lookup_check [../main/ntc_tables.h]
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ntc_sensor.h"
+
+#define KELVIN                  273.15
+#define T_MAX                   (NTC_TABLE_T_MIN + (NTC_TABLE_POINTS - 1) * NTC_TABLE_T_STEP)
+#define MAX_ECU_ERROR_C         0.5
+#define TIMING_ROUNDS           200
+
+typedef struct {
+    double a, b, c;
+} SteinhartHart;
+
+static SteinhartHart coefficients[NTC_CURVE_COUNT];
+static uint32_t failures = 0;
+
+static void Fail(const char* curve, const char* what, double tempC, double value, double expected)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s at %.1f °C: %s %.3f, expected %.3f\n", curve, tempC, what, value, expected);
+    }
+}
+
+/**
+ * Reads the coefficients of every curve from the generated header
+ * Lines look like " * bosch   A=1.281516e-03 B=2.636218e-04 C=1.401345e-07"
+ */
+static bool ReadCoefficients(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char line[256];
+    bool found[NTC_CURVE_COUNT] = {false};
+
+    if (file == NULL) {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char name[16];
+        SteinhartHart sh;
+        if (sscanf(line, " * %15s A=%lf B=%lf C=%lf", name, &sh.a, &sh.b, &sh.c) != 4) {
+            continue;
+        }
+        NtcCurve curve = NtcCurveFromName(name);
+        if (curve < NTC_CURVE_COUNT) {
+            coefficients[curve] = sh;
+            found[curve] = true;
+        }
+    }
+    fclose(file);
+
+    for (int i = 0; i < NTC_CURVE_COUNT; i++) {
+        if (!found[i]) {
+            printf("No coefficients for curve %s in %s\n", ntcCurveNames[i], path);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Inverse Steinhart-Hart: resistance at a temperature, as tools/ntc_table_gen.py
+ */
+static double Resistance(const SteinhartHart* sh, double celsius)
+{
+    if (fabs(sh->c) < 1e-12) {
+        return exp((1 / (celsius + KELVIN) - sh->a) / sh->b);
+    }
+    double x = (sh->a - 1 / (celsius + KELVIN)) / sh->c;
+    double y = sqrt(pow(sh->b / (3 * sh->c), 3) + x * x / 4);
+    return exp(cbrt(y - x / 2) - cbrt(y + x / 2));
+}
+
+// Temperature an ECU with the same curve computes from a resistance
+static double Temperature(const SteinhartHart* sh, double ohms)
+{
+    double l = log(ohms);
+    return 1 / (sh->a + sh->b * l + sh->c * l * l * l) - KELVIN;
+}
+
+static double Seconds(const struct timespec* start, const struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void CheckCurve(NtcCurve curve)
+{
+    const SteinhartHart* sh = &coefficients[curve];
+    const char* name = ntcCurveNames[curve];
+    double worstR = 0, worstV = 0, worstC = 0;
+    NtcReading reading;
+
+    for (int tenths = NTC_TABLE_T_MIN * 10; tenths <= T_MAX * 10; tenths++) {
+        double celsius = tenths / 10.0;
+        double exactR = Resistance(sh, celsius);
+        double exactV = 5.0 * exactR / (exactR + NTC_PULLUP_OHMS);
+
+        NtcLookup(curve, (int16_t)tenths, &reading);
+        double errorR = fabs(reading.resistance - exactR) / exactR * 100;
+        double tableV = 5.0 * reading.output / 65536;
+        double errorV = fabs(tableV - exactV) * 1000;
+        if (errorR > worstR) worstR = errorR;
+        if (errorV > worstV) worstV = errorV;
+
+        // Temperature the ECU would compute from the emulated voltage
+        if (tableV > 0.01 && tableV < 4.99) {
+            double seen = Temperature(sh, NTC_PULLUP_OHMS * tableV / (5.0 - tableV));
+            double errorC = fabs(seen - celsius);
+            if (errorC > worstC) worstC = errorC;
+            if (errorC > MAX_ECU_ERROR_C) {
+                Fail(name, "temperature seen by the ECU", celsius, seen, celsius);
+            }
+        }
+    }
+
+    // Outside the table the ends are held
+    NtcReading end;
+    NtcLookup(curve, NTC_TABLE_T_MIN * 10 - 300, &reading);
+    NtcLookup(curve, NTC_TABLE_T_MIN * 10, &end);
+    if (reading.resistance != end.resistance || reading.output != end.output) {
+        Fail(name, "reading below the table not held", NTC_TABLE_T_MIN - 30, reading.resistance, end.resistance);
+    }
+    NtcLookup(curve, T_MAX * 10 + 300, &reading);
+    NtcLookup(curve, T_MAX * 10, &end);
+    if (reading.resistance != end.resistance || reading.output != end.output) {
+        Fail(name, "reading above the table not held", T_MAX + 30, reading.resistance, end.resistance);
+    }
+
+    printf("%-7s max resistance error %5.2f %%, voltage %5.1f mV, temperature seen by the ECU %4.2f °C\n",
+           name, worstR, worstV, worstC);
+}
+
+static void TimeLookups(void)
+{
+    const int count = (T_MAX - NTC_TABLE_T_MIN) * 10 + 1;
+    struct timespec start, end;
+    volatile uint32_t sink = 0;
+    NtcReading reading;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < TIMING_ROUNDS; round++) {
+        for (int curve = 0; curve < NTC_CURVE_COUNT; curve++) {
+            for (int tenths = NTC_TABLE_T_MIN * 10; tenths <= T_MAX * 10; tenths++) {
+                NtcLookup((NtcCurve)curve, (int16_t)tenths, &reading);
+                sink += reading.output;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double table = Seconds(&start, &end) * 1e9 / ((double)TIMING_ROUNDS * NTC_CURVE_COUNT * count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < TIMING_ROUNDS; round++) {
+        for (int curve = 0; curve < NTC_CURVE_COUNT; curve++) {
+            for (int tenths = NTC_TABLE_T_MIN * 10; tenths <= T_MAX * 10; tenths++) {
+                double ohms = Resistance(&coefficients[curve], tenths / 10.0);
+                sink += (uint32_t)(65536 * ohms / (ohms + NTC_PULLUP_OHMS));
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double direct = Seconds(&start, &end) * 1e9 / ((double)TIMING_ROUNDS * NTC_CURVE_COUNT * count);
+
+    (void)sink;
+    printf("Per lookup on the host: table %.1f ns, Steinhart-Hart in double %.1f ns (%.0fx)\n", table, direct,
+           direct / table);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* header = argc > 1 ? argv[1] : "../main/ntc_tables.h";
+
+    if (!ReadCoefficients(header)) {
+        return 1;
+    }
+
+    printf("%d to %d °C every 0.1 °C, pull-up %d ohms\n", NTC_TABLE_T_MIN, T_MAX, NTC_PULLUP_OHMS);
+    for (int curve = 0; curve < NTC_CURVE_COUNT; curve++) {
+        CheckCurve((NtcCurve)curve);
+    }
+    TimeLookups();
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
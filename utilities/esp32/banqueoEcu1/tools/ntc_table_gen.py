@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+ntc_table_gen.py - NTC lookup table generator for the ECU test bench
+
+This file is part of the AutomotiveGuide_es project.
+https://github.com/edgarefraindp/AutomotiveGuide_es
+
+Generates, for every supported sensor curve, the NTC resistance and the
+voltage the ECU reads (NTC to ground, pull-up resistor to 5 V) as a Q16
+fraction of the output full scale. The firmware only interpolates the
+table, so no exp/log is evaluated on the microcontroller.
+
+Each curve is a Steinhart-Hart model fitted to three points of the
+sensor datasheet: 1/T = A + B*ln(R) + C*ln(R)^3
+
+Usage:
+  ntc_table_gen.py --target esp32 --output ../main/ntc_tables
+  ntc_table_gen.py --target avr --output ../../../arduino/banqueoEcu1/ntc_tables.h
+  ntc_table_gen.py --verify
+  ntc_table_gen.py --custom 1.4e-3,2.37e-4,9.9e-8 --target esp32 --output ../main/ntc_tables
+"""
+
+import argparse
+import math
+
+# Temperature range of the tables (°C)
+T_MIN = -40
+T_MAX = 150
+T_STEP = 5
+
+# Typical ECU pull-up resistor (ohms)
+PULLUP_OHMS = 2490
+
+KELVIN = 273.15
+
+# Three datasheet points (°C, ohms) per curve
+CURVE_POINTS = {
+    "bosch": [(-20, 15462), (20, 2500), (80, 323)],
+    "denso": [(-20, 15040), (20, 2450), (80, 318)],
+    "gm":    [(-40, 100700), (20, 3520), (100, 177)],
+}
+
+
+def fit_steinhart_hart(points):
+    """Solves A, B, C from three (°C, ohms) points"""
+    (t1, r1), (t2, r2), (t3, r3) = points
+    l1, l2, l3 = math.log(r1), math.log(r2), math.log(r3)
+    y1, y2, y3 = 1 / (t1 + KELVIN), 1 / (t2 + KELVIN), 1 / (t3 + KELVIN)
+    g2 = (y2 - y1) / (l2 - l1)
+    g3 = (y3 - y1) / (l3 - l1)
+    c = (g3 - g2) / (l3 - l2) / (l1 + l2 + l3)
+    if abs(c) < 1e-15:
+        # Points of a Beta model, C is only rounding noise
+        c = 0.0
+    b = g2 - c * (l1 * l1 + l1 * l2 + l2 * l2)
+    a = y1 - (b + l1 * l1 * c) * l1
+    return a, b, c
+
+
+def beta_points(r25, beta):
+    """Three points of a Beta model curve, used for the default custom curve"""
+    return [(t, r25 * math.exp(beta * (1 / (t + KELVIN) - 1 / (25 + KELVIN)))) for t in (-20, 25, 100)]
+
+
+def resistance(coeffs, celsius):
+    """Inverse Steinhart-Hart: resistance (ohms) at a temperature"""
+    a, b, c = coeffs
+    if abs(c) < 1e-12:
+        # Pure Beta model (C = 0)
+        return math.exp((1 / (celsius + KELVIN) - a) / b)
+    x = (a - 1 / (celsius + KELVIN)) / c
+    y = math.sqrt((b / (3 * c)) ** 3 + x * x / 4)
+    return math.exp(math.copysign(abs(y - x / 2) ** (1 / 3), y - x / 2)
+                    - math.copysign(abs(y + x / 2) ** (1 / 3), y + x / 2))
+
+
+def output_fraction(ohms, pullup):
+    """ECU input voltage as a Q16 fraction of 5 V"""
+    return min(65535, round(65536 * ohms / (ohms + pullup)))
+
+
+def build_curves(custom):
+    curves = {name: fit_steinhart_hart(points) for name, points in CURVE_POINTS.items()}
+    # By default the custom curve is the 2.5 kOhm / B3380 sensor used before the tables
+    curves["custom"] = custom if custom else fit_steinhart_hart(beta_points(2500, 3380))
+    return curves
+
+
+def build_tables(curves, pullup):
+    temps = list(range(T_MIN, T_MAX + 1, T_STEP))
+    tables = {}
+    for name, coeffs in curves.items():
+        ohms = [round(resistance(coeffs, t)) for t in temps]
+        tables[name] = (ohms, [output_fraction(r, pullup) for r in ohms])
+    return temps, tables
+
+
+def format_rows(values, per_line=8):
+    rows = []
+    for i in range(0, len(values), per_line):
+        rows.append("        " + ", ".join(f"{v:6d}" for v in values[i:i + per_line]))
+    return ",\n".join(rows)
+
+
+def header_comment(curves, pullup, extra=""):
+    lines = [
+        "/**",
+        " * Generated by tools/ntc_table_gen.py - do not edit by hand",
+        " *",
+        f" * Range {T_MIN} to {T_MAX} °C every {T_STEP} °C, pull-up {pullup} ohms to 5 V",
+    ]
+    for name, (a, b, c) in curves.items():
+        lines.append(f" * {name:7s} A={a:.6e} B={b:.6e} C={c:.6e}")
+    if extra:
+        lines.append(" *")
+        lines.append(f" * {extra}")
+    lines.append(" */")
+    return "\n".join(lines)
+
+
+def common_defines(temps, pullup, names):
+    enum = "\n".join(f"    NTC_CURVE_{n.upper()}," for n in names)
+    return (f"#define NTC_TABLE_T_MIN         {T_MIN}\n"
+            f"#define NTC_TABLE_T_STEP        {T_STEP}\n"
+            f"#define NTC_TABLE_POINTS        {len(temps)}\n"
+            f"#define NTC_PULLUP_OHMS         {pullup}\n\n"
+            "// Selectable sensor curves\n"
+            "typedef enum {\n"
+            f"{enum}\n"
+            "    NTC_CURVE_COUNT\n"
+            "} NtcCurve;\n")
+
+
+def write_esp32(path, curves, temps, tables, pullup):
+    names = list(tables)
+    with open(path + ".h", "w", encoding="utf-8") as h:
+        h.write(header_comment(curves, pullup) + "\n\n")
+        h.write("#ifndef NTC_TABLES_H\n#define NTC_TABLES_H\n\n#include <stdint.h>\n\n")
+        h.write(common_defines(temps, pullup, names) + "\n")
+        h.write("extern const char* const ntcCurveNames[NTC_CURVE_COUNT];\n")
+        h.write("extern const uint32_t ntcResistance[NTC_CURVE_COUNT][NTC_TABLE_POINTS];\n")
+        h.write("extern const uint16_t ntcOutput[NTC_CURVE_COUNT][NTC_TABLE_POINTS];\n\n")
+        h.write("#endif // NTC_TABLES_H\n")
+
+    with open(path + ".c", "w", encoding="utf-8") as c:
+        c.write(header_comment(curves, pullup) + "\n\n")
+        c.write('#include "ntc_tables.h"\n\n')
+        c.write("const char* const ntcCurveNames[NTC_CURVE_COUNT] = {\n    "
+                + ", ".join(f'"{n}"' for n in names) + "\n};\n\n")
+        c.write("// NTC resistance (ohms)\nconst uint32_t ntcResistance[NTC_CURVE_COUNT][NTC_TABLE_POINTS] = {\n")
+        c.write(",\n".join(f"    {{ // {n}\n{format_rows(tables[n][0])}\n    }}" for n in names))
+        c.write("\n};\n\n")
+        c.write("// ECU input voltage (Q16 fraction of 5 V)\nconst uint16_t ntcOutput[NTC_CURVE_COUNT][NTC_TABLE_POINTS] = {\n")
+        c.write(",\n".join(f"    {{ // {n}\n{format_rows(tables[n][1])}\n    }}" for n in names))
+        c.write("\n};\n")
+
+
+def write_avr(path, curves, temps, tables, pullup):
+    names = list(tables)
+    with open(path, "w", encoding="utf-8") as h:
+        h.write(header_comment(curves, pullup, "Tables are stored in flash (PROGMEM)") + "\n\n")
+        h.write("#ifndef NTC_TABLES_H\n#define NTC_TABLES_H\n\n#include <avr/pgmspace.h>\n\n")
+        h.write(common_defines(temps, pullup, names) + "\n")
+        for n in names:
+            h.write(f'const char ntcName{n.capitalize()}[] PROGMEM = "{n}";\n')
+        h.write("const char* const ntcCurveNames[NTC_CURVE_COUNT] PROGMEM = {\n    "
+                + ", ".join(f"ntcName{n.capitalize()}" for n in names) + "\n};\n\n")
+        h.write("// NTC resistance (ohms)\nconst uint32_t ntcResistance[NTC_CURVE_COUNT][NTC_TABLE_POINTS] PROGMEM = {\n")
+        h.write(",\n".join(f"    {{ // {n}\n{format_rows(tables[n][0])}\n    }}" for n in names))
+        h.write("\n};\n\n")
+        h.write("// ECU input voltage (Q16 fraction of 5 V)\nconst uint16_t ntcOutput[NTC_CURVE_COUNT][NTC_TABLE_POINTS] PROGMEM = {\n")
+        h.write(",\n".join(f"    {{ // {n}\n{format_rows(tables[n][1])}\n    }}" for n in names))
+        h.write("\n};\n\n#endif // NTC_TABLES_H\n")
+
+
+def lookup(temps, values, tenths):
+    """Same integer interpolation as the firmware (temperature in tenths of °C)"""
+    offset = max(0, min(tenths - T_MIN * 10, (len(temps) - 1) * T_STEP * 10))
+    index = offset // (T_STEP * 10)
+    frac = offset % (T_STEP * 10)
+    if index >= len(temps) - 1:
+        return values[-1]
+    v0, v1 = values[index], values[index + 1]
+    return v0 + (v1 - v0) * frac // (T_STEP * 10) if v1 >= v0 else v0 - (v0 - v1) * frac // (T_STEP * 10)
+
+
+def verify(curves, temps, tables, pullup):
+    """Compares the interpolated tables against the analytic curves every 0.1 °C"""
+    ok = True
+    for name, coeffs in curves.items():
+        ohms, output = tables[name]
+        worst_r = worst_v = worst_c = 0.0
+        for tenths in range(T_MIN * 10, T_MAX * 10 + 1):
+            exact_r = resistance(coeffs, tenths / 10)
+            exact_v = 5.0 * exact_r / (exact_r + pullup)
+            worst_r = max(worst_r, abs(lookup(temps, ohms, tenths) - exact_r) / exact_r * 100)
+            table_v = 5.0 * lookup(temps, output, tenths) / 65536
+            worst_v = max(worst_v, abs(table_v - exact_v) * 1000)
+            # Temperature the ECU would compute from the emulated voltage
+            if 0.01 < table_v < 4.99:
+                r = pullup * table_v / (5.0 - table_v)
+                l = math.log(r)
+                a, b, c = coeffs
+                seen = 1 / (a + b * l + c * l ** 3) - KELVIN
+                worst_c = max(worst_c, abs(seen - tenths / 10))
+        print(f"{name:7s} max resistance error {worst_r:5.2f} %, voltage {worst_v:5.1f} mV, "
+              f"temperature seen by the ECU {worst_c:4.2f} °C")
+        ok = ok and worst_c < 0.5
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description="NTC lookup table generator")
+    parser.add_argument("--target", choices=["esp32", "avr"], help="Output format")
+    parser.add_argument("--output", help="Output path (without extension for esp32)")
+    parser.add_argument("--pullup", type=int, default=PULLUP_OHMS, help="ECU pull-up resistor (ohms)")
+    parser.add_argument("--custom", help="Steinhart-Hart coefficients A,B,C of the custom curve")
+    parser.add_argument("--verify", action="store_true", help="Check the tables against the analytic curves")
+    args = parser.parse_args()
+
+    custom = tuple(float(v) for v in args.custom.split(",")) if args.custom else None
+    curves = build_curves(custom)
+    temps, tables = build_tables(curves, args.pullup)
+
+    if args.target == "esp32" and args.output:
+        write_esp32(args.output, curves, temps, tables, args.pullup)
+    elif args.target == "avr" and args.output:
+        write_avr(args.output, curves, temps, tables, args.pullup)
+
+    if args.verify:
+        return 0 if verify(curves, temps, tables, args.pullup) else 1
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
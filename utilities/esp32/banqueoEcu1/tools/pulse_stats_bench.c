@@ -0,0 +1,319 @@
+/**
+ * @file pulse_stats_bench.c
+ * @brief Host benchmark of the pulse measurement engine against the old per-pulse logging
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Feeds the edges of a 4-cylinder engine at 6000 RPM (4 injectors and the
+ * coil, with a few percent of jitter on every width) to two versions of
+ * the pulse processing:
+ *   - before: the old ProcessPulseEvent, a switch with one case per edge
+ *     and an ESP_LOGI line formatted for every valid pulse (written to a
+ *     sink here, so only its CPU cost is counted)
+ *   - after: the same pulse_stats.c as the firmware, with a summary of
+ *     every channel every 1000 ms as StatsReportTask does
+ * and prints the edges per second of each. On the ESP32 the old version
+ * is bounded well below its CPU figure by the console UART: every log
+ * line waits for 115200 baud, so that bound is printed too.
+ *
+ * The summaries of the engine are checked against the widths and periods
+ * the trace was built with: count, last, min, max, mean, deviation, duty
+ * and frequency of every channel.
+ *
+ * Build and run:
+ *   cc -O2 -I../main pulse_stats_bench.c ../main/pulse_stats.c -o pulse_stats_bench -lm
+ *   ./pulse_stats_bench
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pulse_stats.h"
+
+#define BENCH_RPM               6000
+#define BENCH_SECONDS           600               // Engine time simulated
+#define INJECTOR_WIDTH_US       3000
+#define COIL_DWELL_US           2500
+#define JITTER_US               60
+#define REPORT_PERIOD_US        1000000
+#define CONSOLE_BAUD            115200
+
+// Edge of the trace
+typedef struct {
+    uint64_t timestamp;
+    uint8_t channel;
+    bool rising;
+} BenchEdge;
+
+// Old event types, one per channel and edge
+typedef enum {
+    EVENT_INJ1_RISING, EVENT_INJ1_FALLING, EVENT_INJ2_RISING, EVENT_INJ2_FALLING,
+    EVENT_INJ3_RISING, EVENT_INJ3_FALLING, EVENT_INJ4_RISING, EVENT_INJ4_FALLING,
+    EVENT_COIL_RISING, EVENT_COIL_FALLING
+} OldEventType;
+
+// Old output state
+typedef struct {
+    uint32_t injPulseWidth[4];
+    uint32_t coilDwell;
+    bool injActive[4];
+    bool coilActive;
+} OldOutputs;
+
+static FILE* logSink;
+static uint64_t logBytes;
+static uint32_t failures = 0;
+
+/**
+ * ESP_LOGI of the firmware: level, time and tag before the message
+ */
+static void OldLog(uint64_t timestamp, const char* name, uint64_t width)
+{
+    char line[96];
+    int length = snprintf(line, sizeof(line), "I (%llu) BANQUEO_ECU: %s: %llu μs\n",
+                          (unsigned long long)(timestamp / 1000), name, (unsigned long long)width);
+    fwrite(line, 1, (size_t)length, logSink);
+    logBytes += (uint64_t)length;
+}
+
+/**
+ * Old ProcessPulseEvent: the same rising/falling logic repeated for every channel
+ */
+static void OldProcessPulseEvent(OldEventType type, uint64_t timestamp, OldOutputs* state)
+{
+    static uint64_t injStartTimes[4] = {0};
+    static uint64_t coilStartTime = 0;
+    static const char* const names[4] = { "Injector 1", "Injector 2", "Injector 3", "Injector 4" };
+    uint64_t pulseWidth = 0;
+
+    switch (type) {
+        case EVENT_INJ1_RISING:
+        case EVENT_INJ2_RISING:
+        case EVENT_INJ3_RISING:
+        case EVENT_INJ4_RISING:
+            injStartTimes[type / 2] = timestamp;
+            state->injActive[type / 2] = true;
+            break;
+
+        case EVENT_INJ1_FALLING:
+        case EVENT_INJ2_FALLING:
+        case EVENT_INJ3_FALLING:
+        case EVENT_INJ4_FALLING:
+            if (injStartTimes[type / 2] > 0) {
+                pulseWidth = timestamp - injStartTimes[type / 2];
+                if (pulseWidth > MIN_VALID_PULSE_US) {
+                    state->injPulseWidth[type / 2] = (uint32_t)pulseWidth;
+                    OldLog(timestamp, names[type / 2], pulseWidth);
+                }
+            }
+            state->injActive[type / 2] = false;
+            break;
+
+        case EVENT_COIL_RISING:
+            coilStartTime = timestamp;
+            state->coilActive = true;
+            break;
+
+        case EVENT_COIL_FALLING:
+            if (coilStartTime > 0) {
+                pulseWidth = timestamp - coilStartTime;
+                if (pulseWidth > MIN_VALID_PULSE_US) {
+                    state->coilDwell = (uint32_t)pulseWidth;
+                    OldLog(timestamp, "Coil Dwell", pulseWidth);
+                }
+            }
+            state->coilActive = false;
+            break;
+    }
+}
+
+static int CompareEdges(const void* a, const void* b)
+{
+    const BenchEdge* x = a;
+    const BenchEdge* y = b;
+    return x->timestamp < y->timestamp ? -1 : x->timestamp > y->timestamp;
+}
+
+/**
+ * Builds the edges of the engine, sorted by time
+ *
+ * @param count Number of edges written
+ * @return Edge array (malloc)
+ */
+static BenchEdge* BuildTrace(size_t* count)
+{
+    uint64_t cycleUs = 120000000ULL / BENCH_RPM;
+    uint64_t cycles = (uint64_t)BENCH_SECONDS * 1000000 / cycleUs;
+    size_t capacity = (size_t)cycles * (PULSE_INJECTOR_COUNT + 2) * 2;
+    BenchEdge* edges = malloc(capacity * sizeof(BenchEdge));
+    size_t n = 0;
+
+    srand(1);
+    for (uint64_t c = 0; c < cycles; c++) {
+        uint64_t start = 1000 + c * cycleUs;
+        for (int i = 0; i < PULSE_INJECTOR_COUNT; i++) {
+            uint64_t rise = start + (uint64_t)i * cycleUs / PULSE_INJECTOR_COUNT;
+            uint32_t width = INJECTOR_WIDTH_US + (uint32_t)(rand() % (2 * JITTER_US + 1)) - JITTER_US;
+            edges[n++] = (BenchEdge){ rise, (uint8_t)i, true };
+            edges[n++] = (BenchEdge){ rise + width, (uint8_t)i, false };
+        }
+        // Wasted spark: the coil fires every turn
+        for (int t = 0; t < 2; t++) {
+            uint64_t rise = start + (uint64_t)t * cycleUs / 2 + 500;
+            uint32_t width = COIL_DWELL_US + (uint32_t)(rand() % (2 * JITTER_US + 1)) - JITTER_US;
+            edges[n++] = (BenchEdge){ rise, PULSE_CHANNEL_COIL, true };
+            edges[n++] = (BenchEdge){ rise + width, PULSE_CHANNEL_COIL, false };
+        }
+    }
+    qsort(edges, n, sizeof(BenchEdge), CompareEdges);
+    *count = n;
+    return edges;
+}
+
+static double Seconds(const struct timespec* start, const struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void Check(const char* what, int channel, double value, double expected, double tolerance)
+{
+    if (fabs(value - expected) > tolerance) {
+        if (failures++ < 20) {
+            printf("FAIL channel %d %s: %.1f, expected %.1f\n", channel, what, value, expected);
+        }
+    }
+}
+
+/**
+ * Checks the summaries of one window against the trace it was built from
+ */
+static void CheckWindow(const PulseStats* stats, const BenchEdge* edges, size_t first, size_t last)
+{
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++) {
+        uint64_t rise = 0, previousRise = 0, periodSum = 0;
+        uint32_t count = 0, periods = 0, minWidth = UINT32_MAX, maxWidth = 0, lastWidth = 0;
+        double sum = 0, sumSq = 0;
+
+        // Rising edge before the window, for the first width and period
+        for (size_t i = first; i-- > 0;) {
+            if (edges[i].channel == channel && edges[i].rising) {
+                rise = previousRise = edges[i].timestamp;
+                break;
+            }
+        }
+        for (size_t i = first; i < last; i++) {
+            if (edges[i].channel != channel) continue;
+            if (edges[i].rising) {
+                if (previousRise > 0) {
+                    periodSum += edges[i].timestamp - previousRise;
+                    periods++;
+                }
+                rise = previousRise = edges[i].timestamp;
+            } else if (rise > 0) {
+                uint32_t width = (uint32_t)(edges[i].timestamp - rise);
+                count++;
+                sum += width;
+                sumSq += (double)width * width;
+                lastWidth = width;
+                if (width < minWidth) minWidth = width;
+                if (width > maxWidth) maxWidth = width;
+            }
+        }
+
+        PulseChannelSummary summary;
+        PulseStatsSummarize(stats, (PulseChannel)channel, &summary);
+        double mean = sum / count;
+        double meanPeriod = (double)periodSum / periods;
+        Check("count", channel, summary.count, count, 0);
+        Check("last", channel, summary.last, lastWidth, 0);
+        Check("min", channel, summary.min, minWidth, 0);
+        Check("max", channel, summary.max, maxWidth, 0);
+        Check("mean", channel, summary.mean, mean, 1);
+        Check("deviation", channel, summary.stddev, sqrt(sumSq / count - mean * mean), 1);
+        Check("duty (‰)", channel, summary.dutyPermille, mean * 1000 / meanPeriod, 1);
+        Check("frequency (Hz x 100)", channel, summary.freqCentiHz, 100000000.0 / meanPeriod, 1);
+    }
+}
+
+int main(void)
+{
+    size_t count;
+    BenchEdge* edges = BuildTrace(&count);
+    struct timespec start, end;
+    PulseStats stats;
+    OldOutputs outputs;
+    double engineSeconds = (double)edges[count - 1].timestamp / 1e6;
+
+    logSink = fopen("/dev/null", "w");
+    if (logSink == NULL) {
+        fprintf(stderr, "Cannot open /dev/null\n");
+        return 1;
+    }
+
+    // Before: switch and one log line per valid pulse
+    memset(&outputs, 0, sizeof(outputs));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        OldProcessPulseEvent((OldEventType)(edges[i].channel * 2 + (edges[i].rising ? 0 : 1)),
+                             edges[i].timestamp, &outputs);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double before = count / Seconds(&start, &end);
+    double logPerSecond = logBytes / engineSeconds;
+    // 10 bits per byte on the console, every edge waits for its share of the log
+    double uartBound = count / (logBytes * 10.0 / CONSOLE_BAUD);
+
+    // After: the engine, with a summary of every channel per report period
+    PulseChannelSummary summary;
+    uint64_t nextReport = REPORT_PERIOD_US;
+    size_t windowFirst = 0;
+    uint32_t reports = 0;
+    PulseStatsInit(&stats, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        if (edges[i].timestamp >= nextReport) {
+            for (int c = 0; c < PULSE_CHANNEL_COUNT; c++) {
+                PulseStatsSummarize(&stats, (PulseChannel)c, &summary);
+            }
+            PulseStatsResetWindow(&stats, nextReport);
+            nextReport += REPORT_PERIOD_US;
+            reports++;
+        }
+        PulseStatsProcessEdge(&stats, (PulseChannel)edges[i].channel, edges[i].rising, edges[i].timestamp);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double after = count / Seconds(&start, &end);
+
+    // Correctness: the last window, replayed and compared with the trace
+    PulseStatsInit(&stats, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (edges[i].timestamp >= nextReport - REPORT_PERIOD_US && windowFirst == 0) {
+            PulseStatsResetWindow(&stats, edges[i].timestamp);
+            windowFirst = i;
+        }
+        PulseStatsProcessEdge(&stats, (PulseChannel)edges[i].channel, edges[i].rising, edges[i].timestamp);
+    }
+    CheckWindow(&stats, edges, windowFirst, count);
+
+    printf("Trace: %zu edges, %.0f s of engine at %u RPM (%.0f edges/s)\n", count, engineSeconds, BENCH_RPM,
+           count / engineSeconds);
+    printf("Before (switch + ESP_LOGI per pulse): %10.0f edges/s on the host CPU, %.0f log bytes/s\n", before,
+           logPerSecond);
+    printf("                                      %10.0f edges/s at most with the console at %u baud\n", uartBound,
+           CONSOLE_BAUD);
+    printf("After (pulse_stats.c, %u reports):   %10.0f edges/s on the host CPU, %.1fx\n", reports, after,
+           after / before);
+
+    fclose(logSink);
+    free(edges);
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
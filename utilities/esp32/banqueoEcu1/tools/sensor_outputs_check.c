@@ -0,0 +1,330 @@
+/**
+ * @file sensor_outputs_check.c
+ * @brief Host check of the analog sensor output manager with a fake LEDC driver
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * A fake SensorOutputDriver keeps the timer frequencies and the duties
+ * written and latched per channel, as the LEDC peripheral does (a duty
+ * set with setDuty is only output after updateDuty), and records every
+ * call of a commit in order. With the output table of the firmware it
+ * checks:
+ *   - SensorOutputsInit rejects a frequency capable output sharing its
+ *     timer, and a timer number outside the table
+ *   - voltage and frequency modes of MAP and MAF, the switch back to the
+ *     carrier, and that TPS cannot be switched to frequency
+ *   - only outputs whose value changed are written, and nothing at all
+ *     when the step changed nothing
+ *   - every commit writes all its frequencies and duties first and then
+ *     latches each changed channel exactly once
+ *
+ * Build and run:
+ *   cc -O2 -I../main sensor_outputs_check.c ../main/sensor_outputs.c -o sensor_outputs_check
+ *   ./sensor_outputs_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "sensor_outputs.h"
+
+// Same resources as the firmware
+#define VOLTAGE_TIMER           0
+#define MAP_TIMER               1
+#define MAF_TIMER               2
+#define TIMER_COUNT             3
+#define CARRIER_HZ              5000
+#define VOLTAGE_RES             13
+#define FREQUENCY_RES           10
+#define CHANNELS                8
+
+static const SensorOutputConfig config[SENSOR_OUT_COUNT] = {
+    // name   gpio  timer          channel  frequency capable
+    { "TPS",  19,   VOLTAGE_TIMER, 0,       false },
+    { "MAP",  18,   MAP_TIMER,     4,       true  },
+    { "MAF",  21,   MAF_TIMER,     5,       true  },
+    { "ECT",  22,   VOLTAGE_TIMER, 1,       false },
+    { "IAT",  23,   VOLTAGE_TIMER, 2,       false },
+    { "O2",   4,    VOLTAGE_TIMER, 3,       false }
+};
+
+static const SensorOutputTimer timers[TIMER_COUNT] = {
+    { CARRIER_HZ, VOLTAGE_RES },
+    { CARRIER_HZ, FREQUENCY_RES },
+    { CARRIER_HZ, FREQUENCY_RES }
+};
+
+// Fake LEDC peripheral
+static struct {
+    uint32_t timerHz[TIMER_COUNT];
+    uint8_t timerBits[TIMER_COUNT];
+    uint8_t channelTimer[CHANNELS];
+    bool channelConfigured[CHANNELS];
+    uint32_t pendingDuty[CHANNELS];       // Written with setDuty
+    uint32_t duty[CHANNELS];              // Output after updateDuty
+    // Calls of the current commit
+    uint32_t writes;                      // setFrequency and setDuty
+    uint32_t latches[CHANNELS];
+    bool writeAfterLatch;
+} ledc;
+
+static uint32_t failures = 0;
+
+static void Fail(const char* step, const char* what, long value, long expected)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s: %s (%ld, expected %ld)\n", step, what, value, expected);
+    }
+}
+
+static bool AnyLatch(void)
+{
+    for (int c = 0; c < CHANNELS; c++) {
+        if (ledc.latches[c] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void FakeConfigureTimer(uint8_t timer, uint32_t frequencyHz, uint8_t resolutionBits)
+{
+    ledc.timerHz[timer] = frequencyHz;
+    ledc.timerBits[timer] = resolutionBits;
+}
+
+static void FakeConfigureChannel(uint8_t channel, uint8_t timer, uint8_t gpio)
+{
+    (void)gpio;
+    ledc.channelTimer[channel] = timer;
+    ledc.channelConfigured[channel] = true;
+}
+
+static void FakeSetFrequency(uint8_t timer, uint32_t frequencyHz)
+{
+    ledc.timerHz[timer] = frequencyHz;
+    ledc.writes++;
+    ledc.writeAfterLatch |= AnyLatch();
+}
+
+static void FakeSetDuty(uint8_t channel, uint32_t duty)
+{
+    ledc.pendingDuty[channel] = duty;
+    ledc.writes++;
+    ledc.writeAfterLatch |= AnyLatch();
+}
+
+static void FakeUpdateDuty(uint8_t channel)
+{
+    ledc.duty[channel] = ledc.pendingDuty[channel];
+    ledc.latches[channel]++;
+}
+
+static const SensorOutputDriver driver = {
+    FakeConfigureTimer, FakeConfigureChannel, FakeSetFrequency, FakeSetDuty, FakeUpdateDuty
+};
+
+/**
+ * Commits a step and checks the order of the calls and which channels were latched
+ *
+ * @param expectedMask Outputs (bit per SensorOutputId) that must be written
+ */
+static void Commit(SensorOutputs* outputs, const char* step, uint32_t expectedMask)
+{
+    uint32_t expectedCount = 0;
+
+    memset(ledc.latches, 0, sizeof(ledc.latches));
+    ledc.writes = 0;
+    ledc.writeAfterLatch = false;
+
+    uint8_t changed = SensorOutputsCommit(outputs);
+
+    if (ledc.writeAfterLatch) {
+        Fail(step, "frequency or duty written after the first latch", 1, 0);
+    }
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        uint8_t channel = config[i].channel;
+        bool expected = (expectedMask >> i) & 1;
+        expectedCount += expected;
+        if (ledc.latches[channel] != (expected ? 1u : 0u)) {
+            Fail(step, config[i].name, (long)ledc.latches[channel], expected ? 1 : 0);
+        }
+    }
+    if (changed != expectedCount) {
+        Fail(step, "outputs reported as changed", changed, (long)expectedCount);
+    }
+    if (expectedMask == 0 && ledc.writes != 0) {
+        Fail(step, "hardware written in a step without changes", (long)ledc.writes, 0);
+    }
+}
+
+// Checks what the fake peripheral outputs for one sensor
+static void CheckOutput(const char* step, SensorOutputId id, uint32_t frequencyHz, uint32_t duty)
+{
+    uint8_t timer = config[id].timer;
+    uint8_t channel = config[id].channel;
+    char what[48];
+
+    if (ledc.timerHz[timer] != frequencyHz) {
+        snprintf(what, sizeof(what), "%s timer frequency", config[id].name);
+        Fail(step, what, (long)ledc.timerHz[timer], (long)frequencyHz);
+    }
+    if (ledc.duty[channel] != duty) {
+        snprintf(what, sizeof(what), "%s duty", config[id].name);
+        Fail(step, what, (long)ledc.duty[channel], (long)duty);
+    }
+}
+
+static void CheckInit(void)
+{
+    SensorOutputs outputs;
+    SensorOutputConfig shared[SENSOR_OUT_COUNT];
+
+    memset(&ledc, 0, sizeof(ledc));
+    if (!SensorOutputsInit(&outputs, config, timers, TIMER_COUNT, &driver)) {
+        Fail("init", "firmware table rejected", 0, 1);
+    }
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        if (!ledc.channelConfigured[config[i].channel] || ledc.channelTimer[config[i].channel] != config[i].timer) {
+            Fail("init", config[i].name, ledc.channelTimer[config[i].channel], config[i].timer);
+        }
+    }
+    for (int t = 0; t < TIMER_COUNT; t++) {
+        if (ledc.timerHz[t] != CARRIER_HZ || ledc.timerBits[t] != timers[t].resolutionBits) {
+            Fail("init", "timer configuration", (long)ledc.timerHz[t], CARRIER_HZ);
+        }
+    }
+
+    // MAF moved to the voltage timer: a MAF frequency would move TPS, ECT, IAT and O2
+    memcpy(shared, config, sizeof(shared));
+    shared[SENSOR_OUT_MAF].timer = VOLTAGE_TIMER;
+    if (SensorOutputsInit(&outputs, shared, timers, TIMER_COUNT, &driver)) {
+        Fail("init", "MAF sharing the voltage timer accepted", 1, 0);
+    }
+
+    // MAP and MAF sharing one timer
+    memcpy(shared, config, sizeof(shared));
+    shared[SENSOR_OUT_MAF].timer = MAP_TIMER;
+    if (SensorOutputsInit(&outputs, shared, timers, TIMER_COUNT, &driver)) {
+        Fail("init", "MAP and MAF sharing a timer accepted", 1, 0);
+    }
+
+    // Voltage-only outputs may share a timer with a frequency capable one that is not switched
+    memcpy(shared, config, sizeof(shared));
+    shared[SENSOR_OUT_MAF].frequencyCapable = false;
+    shared[SENSOR_OUT_MAF].timer = VOLTAGE_TIMER;
+    if (!SensorOutputsInit(&outputs, shared, timers, TIMER_COUNT, &driver)) {
+        Fail("init", "voltage-only outputs on a shared timer rejected", 0, 1);
+    }
+
+    memcpy(shared, config, sizeof(shared));
+    shared[SENSOR_OUT_O2].timer = TIMER_COUNT;
+    if (SensorOutputsInit(&outputs, shared, timers, TIMER_COUNT, &driver)) {
+        Fail("init", "timer outside the table accepted", 1, 0);
+    }
+}
+
+static void CheckModesAndCommits(void)
+{
+    static SensorOutputs outputs;
+    const uint32_t all = (1u << SENSOR_OUT_COUNT) - 1;
+
+    memset(&ledc, 0, sizeof(ledc));
+    SensorOutputsInit(&outputs, config, timers, TIMER_COUNT, &driver);
+
+    // First commit writes every output, even at 0 V
+    Commit(&outputs, "first commit", all);
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        CheckOutput("first commit", (SensorOutputId)i, CARRIER_HZ, 0);
+    }
+    Commit(&outputs, "nothing staged", 0);
+
+    // Voltages: 5000 mV is full scale, duty follows the resolution of each timer
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_TPS, 2500);
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_MAP, 6000);
+    Commit(&outputs, "TPS and MAP voltage", (1u << SENSOR_OUT_TPS) | (1u << SENSOR_OUT_MAP));
+    CheckOutput("TPS and MAP voltage", SENSOR_OUT_TPS, CARRIER_HZ, 32767u >> (16 - VOLTAGE_RES));
+    CheckOutput("TPS and MAP voltage", SENSOR_OUT_MAP, CARRIER_HZ, 65535u >> (16 - FREQUENCY_RES));
+
+    // Same values staged again: no write
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_TPS, 2500);
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_MAP, 5000);
+    Commit(&outputs, "same values", 0);
+
+    // A change below one duty step is not written either
+    SensorOutputsSetLevel(&outputs, SENSOR_OUT_ECT, 3);
+    Commit(&outputs, "change below one duty step", 0);
+
+    // Frequencies are staged every step but only output in frequency mode
+    SensorOutputsSetFrequency(&outputs, SENSOR_OUT_MAP, 160);
+    SensorOutputsSetFrequency(&outputs, SENSOR_OUT_MAF, 2000);
+    Commit(&outputs, "frequencies staged in voltage mode", 0);
+
+    if (SensorOutputsSetMode(&outputs, SENSOR_OUT_TPS, OUTPUT_MODE_FREQUENCY)) {
+        Fail("TPS to frequency", "accepted", 1, 0);
+    }
+    if (!SensorOutputsSetMode(&outputs, SENSOR_OUT_MAP, OUTPUT_MODE_FREQUENCY)) {
+        Fail("MAP to frequency", "rejected", 0, 1);
+    }
+    Commit(&outputs, "MAP to frequency", 1u << SENSOR_OUT_MAP);
+    CheckOutput("MAP to frequency", SENSOR_OUT_MAP, 160, 1u << (FREQUENCY_RES - 1));
+    CheckOutput("MAP to frequency", SENSOR_OUT_TPS, CARRIER_HZ, 32767u >> (16 - VOLTAGE_RES));
+    CheckOutput("MAP to frequency", SENSOR_OUT_MAF, CARRIER_HZ, 0);
+    if (outputs.outputs[SENSOR_OUT_MAP].appliedMode != OUTPUT_MODE_FREQUENCY) {
+        Fail("MAP to frequency", "applied mode", outputs.outputs[SENSOR_OUT_MAP].appliedMode, OUTPUT_MODE_FREQUENCY);
+    }
+
+    // In frequency mode the voltage is ignored and a new frequency is one write
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_MAP, 1000);
+    Commit(&outputs, "MAP voltage in frequency mode", 0);
+    SensorOutputsSetFrequency(&outputs, SENSOR_OUT_MAP, 1000);
+    Commit(&outputs, "MAP frequency change", 1u << SENSOR_OUT_MAP);
+    CheckOutput("MAP frequency change", SENSOR_OUT_MAP, 1000, 1u << (FREQUENCY_RES - 1));
+
+    // Both frequency outputs and a voltage change in the same step
+    SensorOutputsSetMode(&outputs, SENSOR_OUT_MAF, OUTPUT_MODE_FREQUENCY);
+    SensorOutputsSetFrequency(&outputs, SENSOR_OUT_MAF, 6000);
+    SensorOutputsSetMillivolts(&outputs, SENSOR_OUT_O2, 450);
+    Commit(&outputs, "MAF to frequency and O2", (1u << SENSOR_OUT_MAF) | (1u << SENSOR_OUT_O2));
+    CheckOutput("MAF to frequency and O2", SENSOR_OUT_MAF, 6000, 1u << (FREQUENCY_RES - 1));
+    CheckOutput("MAF to frequency and O2", SENSOR_OUT_O2, CARRIER_HZ,
+                (450u * 65535 / 5000) >> (16 - VOLTAGE_RES));
+
+    // A frequency of 0 Hz falls back to the voltage on the carrier
+    SensorOutputsSetFrequency(&outputs, SENSOR_OUT_MAF, 0);
+    Commit(&outputs, "MAF at 0 Hz", 1u << SENSOR_OUT_MAF);
+    CheckOutput("MAF at 0 Hz", SENSOR_OUT_MAF, CARRIER_HZ, 0);
+    if (outputs.outputs[SENSOR_OUT_MAF].appliedMode != OUTPUT_MODE_VOLTAGE) {
+        Fail("MAF at 0 Hz", "applied mode", outputs.outputs[SENSOR_OUT_MAF].appliedMode, OUTPUT_MODE_VOLTAGE);
+    }
+
+    // Back to voltage: carrier frequency and the staged voltage in the same latch
+    SensorOutputsSetMode(&outputs, SENSOR_OUT_MAP, OUTPUT_MODE_VOLTAGE);
+    Commit(&outputs, "MAP back to voltage", 1u << SENSOR_OUT_MAP);
+    CheckOutput("MAP back to voltage", SENSOR_OUT_MAP, CARRIER_HZ, (1000u * 65535 / 5000) >> (16 - FREQUENCY_RES));
+    Commit(&outputs, "after switching back", 0);
+
+    // Every output changing in one step: one latch pass after all the writes
+    for (int i = 0; i < SENSOR_OUT_COUNT; i++) {
+        SensorOutputsSetMillivolts(&outputs, (SensorOutputId)i, 3000 + i * 100);
+    }
+    Commit(&outputs, "every output", all);
+    Commit(&outputs, "every output again", 0);
+
+    printf("%lu steps with changes, %lu outputs written\n", (unsigned long)outputs.commits,
+           (unsigned long)outputs.writes);
+}
+
+int main(void)
+{
+    CheckInit();
+    CheckModesAndCommits();
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file telemetry_decoder.cpp
+ * @brief Host decoder for the ECU test bench binary telemetry
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Reads a raw capture of the telemetry UART and writes one CSV file per
+ * record type (one column per field), then prints link statistics and
+ * throughput. Build:
+ *
+ *   cc -O2 -c ../main/telemetry.c -o telemetry.o
+ *   c++ -O2 -std=c++17 -I../main telemetry_decoder.cpp telemetry.o -o telemetry_decoder
+ *
+ * Usage: telemetry_decoder capture.bin [output_prefix]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "telemetry.h"
+
+namespace {
+
+// Output file of one record type
+struct RecordSink {
+    const char* name;
+    const char* columns;
+    std::FILE* file;
+    uint64_t count;
+};
+
+// Counters of the whole capture
+struct DecodeSummary {
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    uint64_t cobsErrors = 0;
+    uint64_t crcErrors = 0;
+    uint64_t versionErrors = 0;
+    uint64_t unknownRecords = 0;
+    uint64_t lostFrames = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+};
+
+enum SinkIndex {
+    SINK_EDGES,
+    SINK_STATS,
+    SINK_ENGINE,
+    SINK_TIMING,
+    SINK_LINK,
+    SINK_COUNT
+};
+
+RecordSink sinks[SINK_COUNT] = {
+    { "edges",  "timestamp_us,channel,rising,angle_deg", nullptr, 0 },
+    { "stats",  "timestamp_us,window_us,channel,count,last_us,min_us,max_us,mean_us,stddev_us,duty_pct,freq_hz", nullptr, 0 },
+    { "engine", "timestamp_us,rpm,tps,map_kpa,maf_gs,ect_c,iat_c,running", nullptr, 0 },
+    { "timing", "timestamp_us,cycle,cylinder,soi_deg,eoi_deg,advance_deg", nullptr, 0 },
+    { "link",   "timestamp_us,frames_queued,frames_dropped,edges_dropped", nullptr, 0 }
+};
+
+/**
+ * Copies a payload into a record, checking its size
+ *
+ * @param payload Decoded payload
+ * @param length Payload length
+ * @param record Output record
+ * @return true if the payload has the size of the record
+ */
+template <typename T>
+bool ReadRecord(const uint8_t* payload, int length, T* record)
+{
+    if (length != static_cast<int>(sizeof(T))) {
+        return false;
+    }
+    std::memcpy(record, payload, sizeof(T));
+    return true;
+}
+
+/**
+ * Writes an angle in tenths of degree, empty when not measured
+ *
+ * @param file Output file
+ * @param angle Angle (tenths of degree)
+ */
+void WriteAngle(std::FILE* file, int16_t angle)
+{
+    if (angle != INT16_MIN) {
+        std::fprintf(file, "%.1f", angle / 10.0);
+    }
+}
+
+/**
+ * Writes one decoded record to its CSV file
+ *
+ * @param type Record type
+ * @param payload Decoded payload
+ * @param length Payload length
+ * @param summary Capture counters
+ */
+void WriteRecord(uint8_t type, const uint8_t* payload, int length, DecodeSummary& summary)
+{
+    uint64_t timestamp = 0;
+
+    switch (type) {
+        case TELEMETRY_PULSE_EDGE: {
+            TelemetryPulseEdge r;
+            if (!ReadRecord(payload, length, &r)) break;
+            std::fprintf(sinks[SINK_EDGES].file, "%llu,%u,%u,%.1f\n", (unsigned long long)r.timestamp,
+                         r.channel, r.rising, r.angle / 10.0);
+            sinks[SINK_EDGES].count++;
+            timestamp = r.timestamp;
+            break;
+        }
+        case TELEMETRY_CHANNEL_STATS: {
+            TelemetryChannelStats r;
+            if (!ReadRecord(payload, length, &r)) break;
+            std::fprintf(sinks[SINK_STATS].file, "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%.1f,%.2f\n",
+                         (unsigned long long)r.timestamp, r.windowUs, r.channel, r.count, r.last,
+                         r.min, r.max, r.mean, r.stddev, r.dutyPermille / 10.0, r.freqCentiHz / 100.0);
+            sinks[SINK_STATS].count++;
+            timestamp = r.timestamp;
+            break;
+        }
+        case TELEMETRY_ENGINE_STATE: {
+            TelemetryEngineState r;
+            if (!ReadRecord(payload, length, &r)) break;
+            std::fprintf(sinks[SINK_ENGINE].file, "%llu,%u,%u,%u,%u,%d,%d,%u\n", (unsigned long long)r.timestamp,
+                         r.rpm, r.tps, r.map, r.maf, r.ect, r.iat, r.running);
+            sinks[SINK_ENGINE].count++;
+            timestamp = r.timestamp;
+            break;
+        }
+        case TELEMETRY_CYLINDER_TIMING: {
+            TelemetryCylinderTiming r;
+            if (!ReadRecord(payload, length, &r)) break;
+            std::FILE* file = sinks[SINK_TIMING].file;
+            std::fprintf(file, "%llu,%u,%u,", (unsigned long long)r.timestamp, r.cycle, r.cylinder + 1);
+            WriteAngle(file, r.soi);
+            std::fputc(',', file);
+            WriteAngle(file, r.eoi);
+            std::fputc(',', file);
+            WriteAngle(file, r.sparkAdvance);
+            std::fputc('\n', file);
+            sinks[SINK_TIMING].count++;
+            timestamp = r.timestamp;
+            break;
+        }
+        case TELEMETRY_LINK_STATS: {
+            TelemetryLinkStats r;
+            if (!ReadRecord(payload, length, &r)) break;
+            std::fprintf(sinks[SINK_LINK].file, "%llu,%u,%u,%u\n", (unsigned long long)r.timestamp,
+                         r.framesQueued, r.framesDropped, r.edgesDropped);
+            sinks[SINK_LINK].count++;
+            timestamp = r.timestamp;
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (timestamp == 0) {
+        summary.unknownRecords++;
+        return;
+    }
+    if (summary.firstTimestamp == 0 || timestamp < summary.firstTimestamp) {
+        summary.firstTimestamp = timestamp;
+    }
+    if (timestamp > summary.lastTimestamp) {
+        summary.lastTimestamp = timestamp;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " capture.bin [output_prefix]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> capture((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::string prefix = argc > 2 ? argv[2] : "telemetry";
+
+    for (auto& sink : sinks) {
+        std::string path = prefix + "_" + sink.name + ".csv";
+        sink.file = std::fopen(path.c_str(), "w");
+        if (!sink.file) {
+            std::cerr << "Cannot create " << path << std::endl;
+            return 1;
+        }
+        std::fprintf(sink.file, "%s\n", sink.columns);
+    }
+
+    DecodeSummary summary;
+    summary.bytes = capture.size();
+    bool haveSequence = false;
+    uint16_t expectedSequence = 0;
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    auto start = std::chrono::steady_clock::now();
+
+    // Frames are separated by 0x00, the data before the first delimiter may be a partial frame
+    size_t frameStart = 0;
+    for (size_t i = 0; i < capture.size(); i++) {
+        if (capture[i] != 0) {
+            continue;
+        }
+        size_t length = i - frameStart;
+        const uint8_t* frame = capture.data() + frameStart;
+        frameStart = i + 1;
+        if (length == 0) {
+            continue;
+        }
+
+        TelemetryHeader header;
+        int result = TelemetryDecodeFrame(frame, length, &header, payload, sizeof(payload));
+        if (result == TELEMETRY_ERROR_COBS) {
+            summary.cobsErrors++;
+            continue;
+        } else if (result == TELEMETRY_ERROR_CRC) {
+            summary.crcErrors++;
+            continue;
+        } else if (result == TELEMETRY_ERROR_VERSION) {
+            summary.versionErrors++;
+            continue;
+        }
+
+        // Frames are queued in sequence order, a forward jump is lost frames and a
+        // backward jump a restart of the device
+        uint16_t gap = static_cast<uint16_t>(header.sequence - expectedSequence);
+        if (haveSequence && gap > 0 && gap < 0x8000) {
+            summary.lostFrames += gap;
+        }
+        if (!haveSequence || gap < 0x8000) {
+            expectedSequence = static_cast<uint16_t>(header.sequence + 1);
+        }
+        haveSequence = true;
+
+        summary.frames++;
+        WriteRecord(header.type, payload, result, summary);
+    }
+
+    double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto& sink : sinks) {
+        std::fclose(sink.file);
+    }
+
+    double deviceSeconds = (summary.lastTimestamp - summary.firstTimestamp) / 1e6;
+    std::printf("Capture: %llu bytes, %llu frames\n", (unsigned long long)summary.bytes,
+                (unsigned long long)summary.frames);
+    for (const auto& sink : sinks) {
+        std::printf("  %-7s %llu records -> %s_%s.csv\n", sink.name, (unsigned long long)sink.count,
+                    prefix.c_str(), sink.name);
+    }
+    std::printf("Errors: %llu COBS, %llu CRC, %llu schema version, %llu unknown records\n",
+                (unsigned long long)summary.cobsErrors, (unsigned long long)summary.crcErrors,
+                (unsigned long long)summary.versionErrors, (unsigned long long)summary.unknownRecords);
+    std::printf("Lost frames (sequence gaps): %llu\n", (unsigned long long)summary.lostFrames);
+    if (deviceSeconds > 0) {
+        std::printf("Link throughput: %.1f s, %.0f frames/s, %.0f bytes/s\n", deviceSeconds,
+                    summary.frames / deviceSeconds, summary.bytes / deviceSeconds);
+    }
+    if (hostSeconds > 0) {
+        std::printf("Decode speed: %.1f MB/s\n", summary.bytes / hostSeconds / 1e6);
+    }
+
+    return 0;
+}
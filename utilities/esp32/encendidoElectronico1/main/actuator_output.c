@@ -0,0 +1,103 @@
+/**
+ * @file actuator_output.c
+ * @brief PWM outputs of the IAC valve and throttle body, written only on change
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The idle controller asks for an opening every period, most of the time
+ * the same duty or one a few steps away. Only a change larger than the
+ * deadband reaches the hardware. A large change (start or stop of the
+ * idle, change of output mode) is ramped by the LEDC fade hardware, so
+ * the valve does not slam and the CPU does not write the steps.
+ */
+
+#include <stddef.h>
+#include "actuator_output.h"
+
+void ActuatorOutputInit(ActuatorOutput* output, const ActuatorDriver* driver, uint8_t channel, uint8_t resolutionBits,
+                        uint32_t deadband, uint32_t fadeMs, uint32_t fadeThreshold)
+{
+    output->driver = driver;
+    output->channel = channel;
+    output->maxDuty = (1u << resolutionBits) - 1;
+    output->deadband = deadband;
+    output->fadeMs = fadeMs;
+    output->fadeThreshold = fadeThreshold;
+    output->duty = 0;
+    output->fading = false;
+    output->fadeEnd = 0;
+    output->writes = 0;
+    output->fades = 0;
+    output->skipped = 0;
+}
+
+uint32_t ActuatorOutputDuty(const ActuatorOutput* output, float opening)
+{
+    if (opening <= 0.0f) {
+        return 0;
+    }
+    if (opening >= 100.0f) {
+        return output->maxDuty;
+    }
+    return (uint32_t)(opening * output->maxDuty / 100.0f + 0.5f);
+}
+
+bool ActuatorOutputSet(ActuatorOutput* output, float opening, uint32_t nowMs)
+{
+    uint32_t duty = ActuatorOutputDuty(output, opening);
+    uint32_t change = duty > output->duty ? duty - output->duty : output->duty - duty;
+
+    // A running ramp is not interrupted
+    if (output->fading) {
+        if ((int32_t)(nowMs - output->fadeEnd) < 0) {
+            output->skipped++;
+            return false;
+        }
+        output->fading = false;
+    }
+
+    if (change <= output->deadband) {
+        output->skipped++;
+        return false;
+    }
+
+    if (output->fadeMs > 0 && output->driver->fade != NULL && change >= output->fadeThreshold) {
+        output->driver->fade(output->driver->context, output->channel, duty, output->fadeMs);
+        output->fading = true;
+        output->fadeEnd = nowMs + output->fadeMs;
+        output->fades++;
+    } else {
+        output->driver->setDuty(output->driver->context, output->channel, duty);
+        output->writes++;
+    }
+    output->duty = duty;
+    return true;
+}
+
+void DiagnosticInit(DiagnosticChannel* channel, uint32_t intervalMs)
+{
+    channel->intervalMs = intervalMs;
+    channel->lastMs = 0;
+    channel->started = false;
+    channel->suppressed = 0;
+}
+
+bool DiagnosticAllow(DiagnosticChannel* channel, uint32_t nowMs, uint32_t* suppressed)
+{
+    if (channel->started && nowMs - channel->lastMs < channel->intervalMs) {
+        channel->suppressed++;
+        return false;
+    }
+
+    *suppressed = channel->suppressed;
+    channel->suppressed = 0;
+    channel->lastMs = nowMs;
+    channel->started = true;
+    return true;
+}
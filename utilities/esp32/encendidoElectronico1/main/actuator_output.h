@@ -0,0 +1,68 @@
+/**
+ * @file actuator_output.h
+ * @brief PWM outputs of the IAC valve and throttle body, written only on change
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef ACTUATOR_OUTPUT_H
+#define ACTUATOR_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// PWM hardware of the outputs: the LEDC driver on the ESP32, a fake on the host
+typedef struct {
+    void (*setDuty)(void* context, uint8_t channel, uint32_t duty);                   // Immediate change
+    void (*fade)(void* context, uint8_t channel, uint32_t duty, uint32_t timeMs);     // Ramp done by the hardware
+    void* context;
+} ActuatorDriver;
+
+// One PWM output
+typedef struct {
+    const ActuatorDriver* driver;
+    uint8_t channel;
+    uint32_t maxDuty;            // Duty at 100% opening, (1 << resolution) - 1
+    uint32_t deadband;           // Changes of this many duty steps or less are not written
+    uint32_t fadeMs;             // Ramp time of a large change, 0 writes every change at once
+    uint32_t fadeThreshold;      // Changes of this many duty steps or more are ramped
+    uint32_t duty;               // Duty written to the hardware (end of the ramp while fading)
+    bool fading;
+    uint32_t fadeEnd;            // Time the ramp ends (ms)
+    uint32_t writes;             // Immediate changes written
+    uint32_t fades;              // Ramps started
+    uint32_t skipped;            // Requests that did not change the hardware
+} ActuatorOutput;
+
+// Rate limit of a diagnostics channel: one message per interval, the rest are counted
+typedef struct {
+    uint32_t intervalMs;
+    uint32_t lastMs;
+    bool started;
+    uint32_t suppressed;         // Messages dropped since the last one allowed
+} DiagnosticChannel;
+
+// Prepares an output whose hardware channel was configured with duty 0
+void ActuatorOutputInit(ActuatorOutput* output, const ActuatorDriver* driver, uint8_t channel, uint8_t resolutionBits,
+                        uint32_t deadband, uint32_t fadeMs, uint32_t fadeThreshold);
+
+// Duty of an opening in % (0-100), rounded and clamped
+uint32_t ActuatorOutputDuty(const ActuatorOutput* output, float opening);
+
+// Requests an opening in %, returns true if the hardware was written
+// Requests that arrive while a ramp runs are dropped, the first one after it is written
+bool ActuatorOutputSet(ActuatorOutput* output, float opening, uint32_t nowMs);
+
+// Prepares a diagnostics channel
+void DiagnosticInit(DiagnosticChannel* channel, uint32_t intervalMs);
+
+// Returns true if a message may be logged now, with the number of messages dropped before it
+bool DiagnosticAllow(DiagnosticChannel* channel, uint32_t nowMs, uint32_t* suppressed);
+
+#endif // ACTUATOR_OUTPUT_H
@@ -0,0 +1,211 @@
+/**
+ * @file bt_protocol.c
+ * @brief Framed command and telemetry protocol of the Bluetooth serial link
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The frames are text with an NMEA style checksum, so a terminal app can
+ * still send plain commands and read the telemetry. A framed command
+ * carries a sequence number that its reply repeats: an app knows which
+ * command was taken and can measure the round trip. Bytes are parsed one
+ * by one with no allocation; a line longer than the buffer is dropped up
+ * to its end instead of being cut into two commands.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bt_protocol.h"
+
+/**
+ * @brief XOR checksum of a part of a line
+ * @param text First byte
+ * @param length Number of bytes
+ * @return Checksum
+ */
+static uint8_t Checksum(const char* text, size_t length)
+{
+    uint8_t checksum = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        checksum ^= (uint8_t)text[i];
+    }
+    return checksum;
+}
+
+/**
+ * @brief Value of a hexadecimal digit
+ * @param digit Character
+ * @return 0-15, or -1 if it is not a digit
+ */
+static int HexValue(char digit)
+{
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads the sequence number after the '$' of a frame
+ * @param line Line starting with '$'
+ * @param length Length of the line
+ * @param command Its sequence is set when the number is valid
+ * @return Position after the number, 0 if there is no valid number
+ */
+static size_t ParseSequence(const char* line, size_t length, ProtocolCommand* command)
+{
+    size_t position = 1;
+    int32_t sequence = 0;
+
+    while (position < length && line[position] >= '0' && line[position] <= '9' && sequence <= 65535) {
+        sequence = sequence * 10 + (line[position++] - '0');
+    }
+    if (position == 1 || sequence > 65535) {
+        return 0;
+    }
+    command->sequence = sequence;
+    return position;
+}
+
+/**
+ * @brief Takes the command out of a complete framed line
+ * @param line Line without its end, starting with '$'
+ * @param length Length of the line
+ * @param command Filled with the sequence and text, or the error
+ * @return PROTOCOL_COMMAND or PROTOCOL_ERROR
+ */
+static ProtocolResult ParseFrame(const char* line, size_t length, ProtocolCommand* command)
+{
+    const char* star = memchr(line, '*', length);
+    size_t position = ParseSequence(line, length, command);
+
+    // $<seq>,<text>*HH, the sequence is kept when it was read so the reply can be matched
+    if (position == 0 || position >= length || line[position] != ',' || star == NULL ||
+        star < line + position || (size_t)(star - line) + 3 != length) {
+        command->error = "FORMAT";
+        return PROTOCOL_ERROR;
+    }
+
+    int high = HexValue(star[1]);
+    int low = HexValue(star[2]);
+    if (high < 0 || low < 0 || Checksum(line + 1, (size_t)(star - line) - 1) != (uint8_t)(high * 16 + low)) {
+        command->error = "CHECKSUM";
+        return PROTOCOL_ERROR;
+    }
+
+    size_t textLength = (size_t)(star - line) - position - 1;
+    if (textLength == 0) {
+        command->error = "EMPTY";
+        return PROTOCOL_ERROR;
+    }
+    memcpy(command->text, line + position + 1, textLength);
+    command->text[textLength] = '\0';
+    return PROTOCOL_COMMAND;
+}
+
+void ProtocolParserInit(ProtocolParser* parser)
+{
+    parser->length = 0;
+    parser->overflow = false;
+    parser->commands = 0;
+    parser->errors = 0;
+}
+
+ProtocolResult ProtocolParse(ProtocolParser* parser, uint8_t byte, ProtocolCommand* command)
+{
+    ProtocolResult result;
+
+    if (byte == '\r') {
+        return PROTOCOL_NONE;
+    }
+    if (byte != '\n') {
+        if (parser->length < PROTOCOL_MAX_LINE - 1) {
+            parser->line[parser->length++] = (char)byte;
+        } else {
+            parser->overflow = true;
+        }
+        return PROTOCOL_NONE;
+    }
+
+    // End of line
+    command->sequence = PROTOCOL_UNFRAMED;
+    command->error = NULL;
+    if (parser->overflow) {
+        // The sequence of a frame is kept when it was received, so the reply can be matched
+        if (parser->line[0] == '$') {
+            ParseSequence(parser->line, parser->length, command);
+        }
+        command->error = "LENGTH";
+        result = PROTOCOL_ERROR;
+    } else if (parser->length == 0) {
+        return PROTOCOL_NONE;
+    } else if (parser->line[0] == '$') {
+        result = ParseFrame(parser->line, parser->length, command);
+    } else {
+        memcpy(command->text, parser->line, parser->length);
+        command->text[parser->length] = '\0';
+        result = PROTOCOL_COMMAND;
+    }
+
+    if (result == PROTOCOL_COMMAND) {
+        parser->commands++;
+    } else {
+        parser->errors++;
+    }
+    parser->length = 0;
+    parser->overflow = false;
+    return result;
+}
+
+size_t ProtocolFormatReply(char* buffer, size_t size, int32_t sequence, bool ok, const char* reason)
+{
+    char body[PROTOCOL_MAX_LINE];
+    int length;
+
+    if (ok) {
+        length = snprintf(body, sizeof(body), "OK");
+    } else {
+        length = snprintf(body, sizeof(body), "ERR,%s", reason != NULL ? reason : "UNKNOWN");
+    }
+    if (length < 0 || (size_t)length >= sizeof(body)) {
+        return 0;
+    }
+
+    if (sequence == PROTOCOL_UNFRAMED) {
+        length = snprintf(buffer, size, "%s\r\n", body);
+    } else {
+        char frame[PROTOCOL_MAX_LINE];
+        int frameLength = snprintf(frame, sizeof(frame), "%ld,%s", (long)sequence, body);
+        if (frameLength < 0 || (size_t)frameLength >= sizeof(frame)) {
+            return 0;
+        }
+        length = snprintf(buffer, size, "$%s*%02X\r\n", frame, Checksum(frame, (size_t)frameLength));
+    }
+    return length < 0 || (size_t)length >= size ? 0 : (size_t)length;
+}
+
+size_t ProtocolFormatTelemetry(char* buffer, size_t size, const Telemetry* telemetry)
+{
+    char frame[PROTOCOL_MAX_LINE];
+    int frameLength = snprintf(frame, sizeof(frame), "T,%lu,%ld,%u,%u,%u", (unsigned long)telemetry->timeMs,
+                               (long)telemetry->mapKpa, telemetry->rpm, telemetry->opening, telemetry->state);
+    int length;
+
+    if (frameLength < 0 || (size_t)frameLength >= sizeof(frame)) {
+        return 0;
+    }
+    length = snprintf(buffer, size, "$%s*%02X\r\n", frame, Checksum(frame, (size_t)frameLength));
+    return length < 0 || (size_t)length >= size ? 0 : (size_t)length;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file bt_protocol.h
+ * @brief Framed command and telemetry protocol of the Bluetooth serial link
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Text lines ended by '\n' ('\r' is ignored):
+ *   $<seq>,<COMMAND>*<HH>   Framed command, HH is the XOR of the bytes between '$' and '*' in hex
+ *   <COMMAND>               Plain command, as typed in a terminal app
+ * Replies:
+ *   $<seq>,OK*<HH>  or  $<seq>,ERR,<reason>*<HH>   to a framed command
+ *   OK  or  ERR,<reason>                           to a plain command
+ * Telemetry:
+ *   $T,<ms>,<MAP kPa x100>,<RPM>,<opening % x10>,<state>*<HH>
+ */
+
+#ifndef BT_PROTOCOL_H
+#define BT_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest line, with the frame and checksum
+#define PROTOCOL_MAX_LINE       80
+
+// Sequence of a plain command, which is not framed
+#define PROTOCOL_UNFRAMED       (-1)
+
+// What a received byte completed
+typedef enum {
+    PROTOCOL_NONE,               // Line not finished yet
+    PROTOCOL_COMMAND,            // Valid command
+    PROTOCOL_ERROR               // Damaged line, the reply carries the reason
+} ProtocolResult;
+
+// Command taken from a line
+typedef struct {
+    int32_t sequence;            // Sequence of the frame, PROTOCOL_UNFRAMED for a plain command
+    char text[PROTOCOL_MAX_LINE];
+    const char* error;           // Reason of a PROTOCOL_ERROR
+} ProtocolCommand;
+
+// Line being received
+typedef struct {
+    char line[PROTOCOL_MAX_LINE];
+    uint8_t length;
+    bool overflow;               // The line is longer than PROTOCOL_MAX_LINE, it is dropped at its end
+    uint32_t commands;           // Valid commands
+    uint32_t errors;             // Damaged lines
+} ProtocolParser;
+
+// Values sent by the telemetry stream
+typedef struct {
+    uint32_t timeMs;
+    int32_t mapKpa;              // Hundredths of kPa
+    uint16_t rpm;
+    uint16_t opening;            // Tenths of % of the IAC output
+    uint8_t state;
+} Telemetry;
+
+// Starts with an empty line
+void ProtocolParserInit(ProtocolParser* parser);
+
+// Adds one received byte, fills the command when a line is complete
+ProtocolResult ProtocolParse(ProtocolParser* parser, uint8_t byte, ProtocolCommand* command);
+
+// Writes the reply to a command, returns its length (0 if it does not fit)
+size_t ProtocolFormatReply(char* buffer, size_t size, int32_t sequence, bool ok, const char* reason);
+
+// Writes a telemetry frame, returns its length (0 if it does not fit)
+size_t ProtocolFormatTelemetry(char* buffer, size_t size, const Telemetry* telemetry);
+
+#endif // BT_PROTOCOL_H
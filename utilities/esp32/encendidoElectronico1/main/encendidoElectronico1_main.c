@@ -16,6 +16,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/stream_buffer.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
 #include "esp_wifi.h"
@@ -31,6 +32,11 @@
 #include "esp_bt_device.h"
 #include "esp_spp_api.h"
 #include "driver/ledc.h"
+#include "esp_timer.h"
+#include "idle_control.h"
+#include "map_sensor.h"
+#include "actuator_output.h"
+#include "bt_protocol.h"
 
 // Pin definitions 
 #define PIN_MAP_SENSOR       34  // Analog input pin for MAP sensor
@@ -39,14 +45,19 @@
 #define PIN_IDLE_RELAY       27  // Output pin for idle control relay (via TIP120)
 #define PIN_START_BUTTON     33  // Physical start/stop button
 #define PIN_STATUS_LED       2   // Onboard status LED
+#define PIN_RPM_INPUT        32  // Ignition pulse input for engine speed (via optocoupler)
 
 // PWM Configuration 
 #define LEDC_TIMER          LEDC_TIMER_0
 #define LEDC_MODE           LEDC_LOW_SPEED_MODE
 #define LEDC_CHANNEL_IAC    LEDC_CHANNEL_0
 #define LEDC_CHANNEL_THROTTLE LEDC_CHANNEL_1
-#define LEDC_RESOLUTION     LEDC_TIMER_8_BIT  // 8-bit resolution (0-255)
+#define LEDC_RESOLUTION     LEDC_TIMER_14_BIT // 14-bit resolution (0-16383), 0.006% per step
 #define LEDC_FREQUENCY      50               // 50 Hz PWM frequency for IAC
+#define PWM_DEADBAND        8                // Duty changes of 8 steps (0.05%) or less are not written
+#define PWM_FADE_MS         200              // Hardware ramp time of large changes
+#define PWM_FADE_THRESHOLD  1638             // Changes of 10% or more are ramped
+#define PWM_LOG_INTERVAL_MS 1000             // At most one PWM diagnostics line per second
 
 // MAP sensor constants
 #define MAP_MIN_PRESSURE     20      // Minimum safe pressure in kPa
@@ -55,14 +66,42 @@
 #define PRESSURE_HYSTERESIS  5       // Hysteresis to prevent oscillations (kPa)
 #define ADC_VREF             3300    // ADC reference voltage in mV
 
+// MAP acquisition (ADC continuous mode)
+#define MAP_SAMPLE_FREQ_HZ   20000   // Conversion rate, the ESP32 runs continuous mode at 20 kHz
+#define MAP_FRAME_BYTES      128     // Bytes of each read, 64 samples (3.2 ms)
+#define MAP_WINDOW_MS        140     // Averaging window without the crank trigger, one engine cycle at 850 RPM
+#define MAP_CYCLE_SYNC       1       // 1: Average over each engine cycle using PIN_RPM_INPUT, 0: Fixed MAP_WINDOW_MS windows
+#define MAP_CYCLE_TIMEOUT_MS 300     // Longest engine cycle averaged (400 RPM), then the window closes anyway
+#define MAP_REPORT_CHANGE    50      // Smallest change that is logged (hundredths of kPa)
+#define MAP_DIVIDER_PERMILLE 1000    // Sensor voltage / ADC pin voltage x 1000 (1000: no divider)
+
 // IAC valve constants
-#define IAC_MIN_OPENING      0       // Minimum IAC valve opening (0%)
-#define IAC_MAX_OPENING      255     // Maximum IAC valve opening (100%)
+#define IAC_MIN_OPENING      0       // PWM duty at 0% opening of the controller (%)
+#define IAC_MAX_OPENING      100     // PWM duty at 100% opening of the controller (%)
 
 // IAC control options
 #define IAC_CONTROL_MODE     1       // 1: Direct control, 2: "Y" connection control
 #define USE_TIP120_FOR_IAC   1       // 1: Use TIP120 for IAC, 0: Direct control
 
+// Idle speed control
+#define IDLE_CONTROL_PERIOD_MS 20    // Controller period (50 Hz)
+#define IDLE_SAFETY_DIVIDER  5       // Safety checks every 5 controller periods (100 ms)
+#define IDLE_TARGET_MAP      35.0f   // Default target manifold pressure (kPa)
+#define IDLE_TARGET_RPM      850.0f  // Default target engine speed (RPM)
+#define USE_RPM_INPUT        1       // 1: Hold the engine speed from PIN_RPM_INPUT, 0: Hold the MAP pressure
+#define RPM_PULSES_PER_REV   2       // Ignition pulses per crankshaft turn (4 cylinders)
+#define RPM_TIMEOUT_US       500000  // No ignition pulse for this long means the engine is stopped
+
+// Bluetooth link
+#define BT_DEVICE_NAME       "IdleControl-ESP32"
+#define BT_PIN_CODE          "1234"  // PIN of phones without Secure Simple Pairing
+#define BT_PAIRING_WINDOW_MS 60000   // New phones may pair this long after power-up with the start button held
+#define BT_CORE              0       // Core of the Bluetooth stack and the protocol task
+#define CONTROL_CORE         1       // Core of the MAP acquisition and the idle controller
+#define BT_RX_BUFFER_BYTES   512     // Received bytes waiting for the protocol task
+#define TELEMETRY_PERIOD_MS  100     // Default telemetry rate (10 Hz), 0 disables it
+#define TELEMETRY_MIN_MS     20      // Fastest telemetry rate allowed (50 Hz)
+
 // System states
 #define STATE_OFF            0
 #define STATE_ON             1
@@ -77,19 +116,60 @@ static uint32_t idleStartTime = 0;
 static esp_adc_cal_characteristics_t adcCharacteristics;
 static bool remoteControlActive = false;
 static int iacControlMode = IAC_CONTROL_MODE;
+static IdleController idleController;
+static IdleController idleTuning[2];                            // Target and tuning of each IdleInput, kept while the other is used
+static volatile bool rpmFallback = false;                       // Holding the MAP until the ignition pulses return
+static portMUX_TYPE idleMux = portMUX_INITIALIZER_UNLOCKED;     // Guards idleController against Bluetooth changes
+static portMUX_TYPE rpmMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile int64_t lastRpmPulse = 0;                       // Time of the last ignition pulse (us)
+static volatile uint32_t rpmPeriodUs = 0;                       // Time between the last two ignition pulses
+static volatile uint32_t ignitionPulses = 0;                    // Ignition pulses counted, closes the MAP windows
+static MapSensor mapSensor;
+static adc1_channel_t mapChannel;
+static volatile int32_t averagedPressure = 0;                   // Last averaged pressure (hundredths of kPa)
+static ActuatorOutput iacOutput;
+static ActuatorOutput throttleOutput;
+static DiagnosticChannel pwmDiagnostics;
+static StreamBufferHandle_t btRxBuffer;                          // Bytes of the SPP callback, read by BluetoothTask
+static volatile uint32_t sppHandle = 0;                         // Connection of the SPP client, 0 when none
+static volatile int64_t pairingDeadline = 0;                    // New phones may pair until then (us), 0 when closed
+static int bondedDevices = 0;                                   // Phones bonded when the pairing window opened
+static volatile bool sppCongested = false;                      // Telemetry is dropped while the link is congested
+static volatile uint32_t btDroppedBytes = 0;                    // Received bytes lost because the buffer was full
+static uint32_t telemetryPeriodMs = TELEMETRY_PERIOD_MS;
+static uint32_t telemetryDropped = 0;                           // Telemetry frames not sent while congested
 
 // Function prototypes
 void ConfigureGPIO(void);
 void ConfigureADC(void);
 void ConfigurePWM(void);
 void ConfigureBluetooth(void);
-uint32_t ReadMAPSensor(void);
-void ControlIACValve(uint32_t mapPressure);
-void SendPWM(ledc_channel_t channel, uint8_t value);
-void ControlEngineIdle(uint32_t mapPressure);
+float ReadMAPSensor(void);
+float ReadEngineSpeed(void);
+void ControlIACValve(float opening);
+void SendPWM(ActuatorOutput *output, float opening);
+void ControlEngineIdle(float mapPressure);
+void SelectIdleInput(IdleInput input);
+void SetIdleParameter(const char* name, float* parameter, float value);
 void StopIdle(const char* reason);
 void StartIdle(void);
-void ProcessBluetoothCommand(char *command);
+bool ProcessBluetoothCommand(char *command);
+void SendTelemetry(void);
+
+/**
+ * @brief Measures the time between two ignition pulses
+ * @param arg Not used
+ */
+static void IRAM_ATTR RPMPulseISR(void* arg)
+{
+    int64_t now = esp_timer_get_time();
+    
+    portENTER_CRITICAL_ISR(&rpmMux);
+    rpmPeriodUs = (uint32_t)(now - lastRpmPulse);
+    lastRpmPulse = now;
+    ignitionPulses++;
+    portEXIT_CRITICAL_ISR(&rpmMux);
+}
 
 /**
  * @brief Configures GPIOs used in the project
@@ -113,11 +193,45 @@ void ConfigureGPIO(void)
     io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
     gpio_config(&io_conf);
     
+    // Configure ignition pulse input for engine speed (falling edge from the optocoupler)
+    io_conf.intr_type = GPIO_INTR_NEGEDGE;
+    io_conf.pin_bit_mask = (1ULL << PIN_RPM_INPUT);
+    gpio_config(&io_conf);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(PIN_RPM_INPUT, RPMPulseISR, NULL);
+    
     // Initial pin states
     gpio_set_level(PIN_IDLE_RELAY, 0);
     gpio_set_level(PIN_STATUS_LED, 0);
 }
 
+/**
+ * @brief Writes a duty to an LEDC channel at once
+ * @param context Not used
+ * @param channel LEDC channel
+ * @param duty Duty in steps of LEDC_RESOLUTION
+ */
+static void LEDCSetDuty(void *context, uint8_t channel, uint32_t duty)
+{
+    ledc_set_duty(LEDC_MODE, (ledc_channel_t)channel, duty);
+    ledc_update_duty(LEDC_MODE, (ledc_channel_t)channel);
+}
+
+/**
+ * @brief Starts a hardware ramp of an LEDC channel, returns without waiting
+ * @param context Not used
+ * @param channel LEDC channel
+ * @param duty Duty at the end of the ramp
+ * @param timeMs Ramp time
+ */
+static void LEDCFade(void *context, uint8_t channel, uint32_t duty, uint32_t timeMs)
+{
+    ledc_set_fade_with_time(LEDC_MODE, (ledc_channel_t)channel, duty, timeMs);
+    ledc_fade_start(LEDC_MODE, (ledc_channel_t)channel, LEDC_FADE_NO_WAIT);
+}
+
+static const ActuatorDriver ledcDriver = { LEDCSetDuty, LEDCFade, NULL };
+
 /**
  * @brief Configures PWM module to control IAC valve and throttle body
  */
@@ -157,22 +271,192 @@ void ConfigurePWM(void)
     };
     ledc_channel_config(&throttle_conf);
     
+    // Hardware ramps and the outputs that only write changes
+    ledc_fade_func_install(0);
+    ActuatorOutputInit(&iacOutput, &ledcDriver, LEDC_CHANNEL_IAC, LEDC_RESOLUTION, PWM_DEADBAND, PWM_FADE_MS,
+                       PWM_FADE_THRESHOLD);
+    ActuatorOutputInit(&throttleOutput, &ledcDriver, LEDC_CHANNEL_THROTTLE, LEDC_RESOLUTION, PWM_DEADBAND,
+                       PWM_FADE_MS, PWM_FADE_THRESHOLD);
+    DiagnosticInit(&pwmDiagnostics, PWM_LOG_INTERVAL_MS);
+    
     ESP_LOGI(TAG, "PWM configured for IAC valve and throttle body");
 }
 
 /**
- * @brief Configures the ADC to read the MAP sensor
+ * @brief Finds the ADC1 channel of a GPIO
+ * @param pin GPIO number
+ * @return ADC1 channel, or ADC1_CHANNEL_MAX if the GPIO has none
+ */
+static adc1_channel_t ADCChannelFromPin(int pin)
+{
+    for (int channel = 0; channel < ADC1_CHANNEL_MAX; channel++) {
+        int gpio;
+        if (adc1_pad_get_io_num((adc1_channel_t)channel, &gpio) == ESP_OK && gpio == pin) {
+            return (adc1_channel_t)channel;
+        }
+    }
+    return ADC1_CHANNEL_MAX;
+}
+
+/**
+ * @brief Configures the ADC to sample the MAP sensor in continuous mode
+ *
+ * The ADC converts at MAP_SAMPLE_FREQ_HZ into a DMA buffer without the
+ * CPU, MAPAcquisitionTask averages the samples.
  */
 void ConfigureADC(void)
 {
-    // Configure ADC
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(ADC1_CHANNEL_6, ADC_ATTEN_DB_11); // ADC1 channel 6 = GPIO34
+    mapChannel = ADCChannelFromPin(PIN_MAP_SENSOR);
+    if (mapChannel == ADC1_CHANNEL_MAX) {
+        ESP_LOGE(TAG, "GPIO%d has no ADC1 channel, MAP sensor disabled", PIN_MAP_SENSOR);
+        return;
+    }
+    
+    adc_digi_init_config_t dma_conf = {
+        .max_store_buf_size = 1024,
+        .conv_num_each_intr = MAP_FRAME_BYTES,
+        .adc1_chan_mask = 1 << mapChannel,
+        .adc2_chan_mask = 0,
+    };
+    ESP_ERROR_CHECK(adc_digi_initialize(&dma_conf));
+    
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_11,
+        .channel = mapChannel,
+        .unit = 0,                   // ADC1
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_digi_configuration_t digi_conf = {
+        .conv_limit_en = true,       // Always enabled on the ESP32
+        .conv_limit_num = 250,
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = MAP_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    ESP_ERROR_CHECK(adc_digi_controller_configure(&digi_conf));
     
     // Characterize ADC
     esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, ADC_VREF, &adcCharacteristics);
     
-    ESP_LOGI(TAG, "ADC configured for MAP sensor reading");
+    // Averaging windows, the transfer function of the sensor with the divider of the input
+    MapTransfer transfer = MAP_TRANSFER_DEFAULT;
+    transfer.dividerPermille = MAP_DIVIDER_PERMILLE;
+    MapSensorInit(&mapSensor, &transfer,
+                  (MAP_CYCLE_SYNC ? MAP_CYCLE_TIMEOUT_MS : MAP_WINDOW_MS) * (MAP_SAMPLE_FREQ_HZ / 1000),
+                  MAP_CYCLE_SYNC, MAP_REPORT_CHANGE);
+    
+    ESP_ERROR_CHECK(adc_digi_start());
+    ESP_LOGI(TAG, "ADC configured for MAP sensor reading (ADC1 channel %d, %d Hz)", mapChannel, MAP_SAMPLE_FREQ_HZ);
+}
+
+/**
+ * @brief Whether a new phone may pair now
+ * @return true while the pairing window is open
+ *
+ * Bonded phones reconnect with the link key stored in NVS and are not
+ * asked again, so outside the window only they can send commands.
+ */
+static bool PairingAllowed(void)
+{
+    return pairingDeadline != 0 && esp_timer_get_time() < pairingDeadline;
+}
+
+/**
+ * @brief Closes the pairing window and hides the ESP32 from new phones
+ * @param reason Reason for closing
+ */
+static void ClosePairing(const char *reason)
+{
+    pairingDeadline = 0;
+    esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
+    ESP_LOGI(TAG, "Pairing closed: %s", reason);
+}
+
+/**
+ * @brief Pairing events of the Bluetooth stack
+ * @param event GAP event
+ * @param param Event parameters
+ */
+static void BluetoothGAPCallback(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_BT_GAP_AUTH_CMPL_EVT:
+        if (param->auth_cmpl.stat == ESP_BT_STATUS_SUCCESS) {
+            ESP_LOGI(TAG, "Paired with %s", param->auth_cmpl.device_name);
+            // One new phone per window, a bonded phone reconnecting leaves it open
+            if (pairingDeadline != 0 && esp_bt_gap_get_bond_device_num() > bondedDevices) {
+                ClosePairing("phone bonded");
+            }
+        } else {
+            ESP_LOGW(TAG, "Pairing failed, status %d", param->auth_cmpl.stat);
+        }
+        break;
+    case ESP_BT_GAP_PIN_REQ_EVT: {
+        // Legacy pairing, the phone asks for the PIN
+        esp_bt_pin_code_t pin;
+        memcpy(pin, BT_PIN_CODE, sizeof(BT_PIN_CODE) - 1);
+        if (!PairingAllowed()) {
+            ESP_LOGW(TAG, "Pairing rejected, hold the start button at power-up to pair a new phone");
+        }
+        esp_bt_gap_pin_reply(param->pin_req.bda, PairingAllowed(), sizeof(BT_PIN_CODE) - 1, pin);
+        break;
+    }
+#if CONFIG_BT_SSP_ENABLED
+    case ESP_BT_GAP_CFM_REQ_EVT:
+        // Secure Simple Pairing without display, accepted only inside the window
+        if (!PairingAllowed()) {
+            ESP_LOGW(TAG, "Pairing rejected, hold the start button at power-up to pair a new phone");
+        }
+        esp_bt_gap_ssp_confirm_reply(param->cfm_req.bda, PairingAllowed());
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Serial Port Profile events, runs in the Bluetooth task
+ * @param event SPP event
+ * @param param Event parameters
+ *
+ * Only copies the received bytes to btRxBuffer, without waiting: the
+ * commands are parsed and run by BluetoothTask.
+ */
+static void BluetoothSPPCallback(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_SPP_INIT_EVT:
+        esp_bt_dev_set_device_name(BT_DEVICE_NAME);
+        esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE,
+                                 PairingAllowed() ? ESP_BT_GENERAL_DISCOVERABLE : ESP_BT_NON_DISCOVERABLE);
+        esp_spp_start_srv(ESP_SPP_SEC_AUTHENTICATE, ESP_SPP_ROLE_SLAVE, 0, "IdleControl");
+        break;
+    case ESP_SPP_SRV_OPEN_EVT:
+        sppCongested = false;
+        sppHandle = param->srv_open.handle;
+        ESP_LOGI(TAG, "Bluetooth client connected");
+        break;
+    case ESP_SPP_CLOSE_EVT:
+        sppHandle = 0;
+        ESP_LOGI(TAG, "Bluetooth client disconnected");
+        break;
+    case ESP_SPP_DATA_IND_EVT: {
+        size_t sent = xStreamBufferSend(btRxBuffer, param->data_ind.data, param->data_ind.len, 0);
+        btDroppedBytes += param->data_ind.len - sent;
+        break;
+    }
+    case ESP_SPP_CONG_EVT:
+        sppCongested = param->cong.cong;
+        break;
+    case ESP_SPP_WRITE_EVT:
+        sppCongested = param->write.cong;
+        break;
+    default:
+        break;
+    }
 }
 
 /**
@@ -219,90 +503,117 @@ void ConfigureBluetooth(void)
         return;
     }
     
-    // TODO: Implement callbacks for SPP (Serial Port Profile)
-    // and discovery/pairing configuration
+    // Pairing window: until the first phone bonds, or with the start button held at power-up
+    bondedDevices = esp_bt_gap_get_bond_device_num();
+    if (bondedDevices == 0) {
+        pairingDeadline = INT64_MAX;
+        ESP_LOGI(TAG, "No bonded phone, pairing open until the first one bonds");
+    } else if (gpio_get_level(PIN_START_BUTTON) == 0) {
+        pairingDeadline = esp_timer_get_time() + BT_PAIRING_WINDOW_MS * 1000LL;
+        ESP_LOGI(TAG, "Start button held, pairing open for %d s", BT_PAIRING_WINDOW_MS / 1000);
+    } else {
+        ESP_LOGI(TAG, "Pairing closed, only the %d bonded phones can connect", bondedDevices);
+    }
+    
+    // Pairing: fixed PIN for legacy phones, no display for Secure Simple Pairing
+    esp_bt_pin_code_t pin;
+    memcpy(pin, BT_PIN_CODE, sizeof(BT_PIN_CODE) - 1);
+    esp_bt_gap_register_callback(BluetoothGAPCallback);
+#if CONFIG_BT_SSP_ENABLED
+    esp_bt_io_cap_t ioCapability = ESP_BT_IO_CAP_NONE;
+    esp_bt_gap_set_security_param(ESP_BT_SP_IOCAP_MODE, &ioCapability, sizeof(ioCapability));
+#endif
+    esp_bt_gap_set_pin(ESP_BT_PIN_TYPE_FIXED, sizeof(BT_PIN_CODE) - 1, pin);
     
-    // Set Bluetooth device name
-    esp_bt_dev_set_device_name("IdleControl-ESP32");
+    // Serial Port Profile, the server starts on ESP_SPP_INIT_EVT
+    btRxBuffer = xStreamBufferCreate(BT_RX_BUFFER_BYTES, 1);
+    ret = esp_spp_register_callback(BluetoothSPPCallback);
+    if (ret == ESP_OK) {
+        ret = esp_spp_init(ESP_SPP_MODE_CB);
+    }
+    if (ret) {
+        ESP_LOGE(TAG, "SPP initialization failed: %s", esp_err_to_name(ret));
+        return;
+    }
     
     ESP_LOGI(TAG, "Bluetooth configured successfully");
 }
 
 /**
- * @brief Reads the MAP sensor and converts value to kPa
+ * @brief Returns the last averaged MAP pressure
  * @return MAP pressure in kPa
  */
-uint32_t ReadMAPSensor(void)
+float ReadMAPSensor(void)
 {
-    uint32_t adc_reading = 0;
+    return (float)averagedPressure / MAP_KPA_SCALE;
+}
+
+/**
+ * @brief Publishes the pressure of a closed window, logged only when it changes
+ */
+static void PublishMAP(void)
+{
+    int32_t pressure;
     
-    // Take multiple readings for stability
-    for (int i = 0; i < 10; i++) {
-        adc_reading += adc1_get_raw(ADC1_CHANNEL_6);
+    averagedPressure = mapSensor.pressure;
+    if (MapSensorChanged(&mapSensor, &pressure)) {
+        ESP_LOGI(TAG, "MAP: %.2f kPa", (double)pressure / MAP_KPA_SCALE);
     }
-    adc_reading /= 10;
-    
-    // Convert reading to voltage in mV
-    uint32_t voltage = esp_adc_cal_raw_to_voltage(adc_reading, &adcCharacteristics);
-    
-    // Convert voltage to kPa (depends on specific sensor calibration)
-    // Assuming typical MAP sensor: 0.5V = 10 kPa, 4.5V = 105 kPa
-    uint32_t pressure_kpa = ((voltage - 500) * 95) / 4000 + 10;
-    
-    ESP_LOGI(TAG, "MAP reading: ADC=%d, Voltage=%dmV, Pressure=%dkPa", adc_reading, voltage, pressure_kpa);
-    
-    return pressure_kpa;
 }
 
 /**
- * @brief Sends a PWM value to the specified channel
- * @param channel LEDC channel to use
- * @param value PWM value from 0-255
+ * @brief Calculates the engine speed from the time between ignition pulses
+ * @return Engine speed in RPM, 0 when no pulse arrived for RPM_TIMEOUT_US
  */
-void SendPWM(ledc_channel_t channel, uint8_t value)
+float ReadEngineSpeed(void)
 {
-    // Convert 8-bit value (0-255) to duty cycle value (0-255 for 8-bit resolution)
-    uint32_t duty = value;
-    
-    // Set duty cycle
-    ledc_set_duty(LEDC_MODE, channel, duty);
-    ledc_update_duty(LEDC_MODE, channel);
+    portENTER_CRITICAL(&rpmMux);
+    int64_t lastPulse = lastRpmPulse;
+    uint32_t period = rpmPeriodUs;
+    portEXIT_CRITICAL(&rpmMux);
     
-    ESP_LOGI(TAG, "PWM configured: Channel=%d, Value=%d", channel, value);
+    if (period == 0 || esp_timer_get_time() - lastPulse > RPM_TIMEOUT_US) {
+        return 0.0f;
+    }
+    return 60000000.0f / ((float)period * RPM_PULSES_PER_REV);
 }
 
 /**
- * @brief Controls IAC valve opening based on MAP pressure
- * @param mapPressure Current manifold pressure in kPa
+ * @brief Sends an opening to a PWM output, the hardware is written only when the duty changes
+ * @param output IAC valve or throttle body output
+ * @param opening PWM duty in % (0-100)
  */
-void ControlIACValve(uint32_t mapPressure)
+void SendPWM(ActuatorOutput *output, float opening)
 {
-    uint8_t opening;
+    uint32_t now = esp_timer_get_time() / 1000;
+    uint32_t suppressed;
     
-    // If pressure is below minimum, open valve to allow more air
-    if (mapPressure < MAP_MIN_PRESSURE) {
-        opening = IAC_MAX_OPENING;  // Full open
-        ESP_LOGI(TAG, "Low pressure: Maximum IAC opening");
-    } 
-    // If pressure is above minimum but still low, partial opening
-    else if (mapPressure < MAP_MIN_PRESSURE + 10) {
-        // Proportional adjustment: closer to minimum = more opening
-        opening = (uint8_t)(IAC_MAX_OPENING * (1 - (mapPressure - MAP_MIN_PRESSURE) / 10.0));
-        ESP_LOGI(TAG, "Acceptable pressure: Partial IAC opening (%d%%)", (opening * 100) / 255);
-    } 
-    // If pressure is adequate, close valve
-    else {
-        opening = IAC_MIN_OPENING;  // Closed
-        ESP_LOGI(TAG, "Optimal pressure: IAC closed");
+    if (!ActuatorOutputSet(output, opening, now)) {
+        return;
     }
     
+    // Rate-limited diagnostics, the changes in between are counted
+    if (DiagnosticAllow(&pwmDiagnostics, now, &suppressed)) {
+        ESP_LOGI(TAG, "PWM channel %d: duty %u/%u%s, %u changes not logged", output->channel, output->duty,
+                 output->maxDuty, output->fading ? " (ramp)" : "", suppressed);
+    }
+}
+
+/**
+ * @brief Sets the IAC valve opening requested by the idle controller
+ * @param opening Valve opening in % (0-100)
+ */
+void ControlIACValve(float opening)
+{
+    float duty = IAC_MIN_OPENING + (IAC_MAX_OPENING - IAC_MIN_OPENING) * opening / 100.0f;
+    
     // Control valve using PWM according to configured mode
     if (iacControlMode == 1) {
         // Mode 1: Direct IAC valve control
-        SendPWM(LEDC_CHANNEL_IAC, opening);
+        SendPWM(&iacOutput, duty);
     } else {
         // Mode 2: Control with "Y" connection to throttle body
-        SendPWM(LEDC_CHANNEL_THROTTLE, opening);
+        SendPWM(&throttleOutput, duty);
     }
 }
 
@@ -310,7 +621,7 @@ void ControlIACValve(uint32_t mapPressure)
  * @brief Controls engine idle activation/deactivation based on MAP pressure
  * @param mapPressure Current manifold pressure in kPa
  */
-void ControlEngineIdle(uint32_t mapPressure)
+void ControlEngineIdle(float mapPressure)
 {
     // If pressure is outside safe range, stop idle
     if (mapPressure < MAP_MIN_PRESSURE - PRESSURE_HYSTERESIS) {
@@ -374,6 +685,11 @@ void StartIdle(void)
         // Activate idle relay
         gpio_set_level(PIN_IDLE_RELAY, 1);
         
+        // The controller starts from its feedforward opening with no history
+        portENTER_CRITICAL(&idleMux);
+        IdleControlReset(&idleController, idleController.gains.feedForward);
+        portEXIT_CRITICAL(&idleMux);
+        
         // Record start time
         idleStartTime = esp_timer_get_time() / 1000; // Convert to milliseconds
         
@@ -390,12 +706,78 @@ void StartIdle(void)
     }
 }
 
+/**
+ * @brief Changes the measurement the idle controller holds
+ * @param input IDLE_INPUT_MAP or IDLE_INPUT_RPM
+ *
+ * The target and tuning of the current input (including the Bluetooth
+ * changes) are kept, and the new input continues with the ones it had
+ * when it was last used.
+ */
+static void SwitchIdleInput(IdleInput input)
+{
+    portENTER_CRITICAL(&idleMux);
+    if (idleController.input != input) {
+        float opening = idleController.opening;
+        idleTuning[idleController.input] = idleController;
+        IdleControlInit(&idleController, input, idleTuning[input].target, &idleTuning[input].gains);
+        // Continue from the current opening so the valve does not jump
+        IdleControlReset(&idleController, opening);
+    }
+    portEXIT_CRITICAL(&idleMux);
+}
+
+/**
+ * @brief Selects the measurement the idle controller holds (Bluetooth command)
+ * @param input IDLE_INPUT_MAP or IDLE_INPUT_RPM
+ */
+void SelectIdleInput(IdleInput input)
+{
+    rpmFallback = false;
+    SwitchIdleInput(input);
+    
+    ESP_LOGI(TAG, "Idle controller holds %s", IdleInputName(input));
+}
+
+/**
+ * @brief Changes one parameter of the idle controller while it runs
+ * @param name Parameter name for the log
+ * @param parameter Field of idleController to change
+ * @param value New value
+ */
+void SetIdleParameter(const char* name, float* parameter, float value)
+{
+    portENTER_CRITICAL(&idleMux);
+    *parameter = value;
+    portEXIT_CRITICAL(&idleMux);
+    
+    ESP_LOGI(TAG, "Bluetooth command received: %s=%.4f", name, value);
+}
+
+/**
+ * @brief Reads the value of a "NAME=value" command
+ * @param command Received command
+ * @param name Command name including the '='
+ * @param value Filled with the value
+ * @return true if the command has this name and a valid number
+ */
+static bool ParseIdleValue(const char *command, const char *name, float *value)
+{
+    size_t length = strlen(name);
+    
+    return strncmp(command, name, length) == 0 && sscanf(command + length, "%f", value) == 1;
+}
+
 /**
  * @brief Processes commands received via Bluetooth
  * @param command Received command
+ * @return true if the command is known, false otherwise
  */
-void ProcessBluetoothCommand(char *command)
+bool ProcessBluetoothCommand(char *command)
 {
+    float value;
+    
+
     if (strcmp(command, "STOP") == 0) {
         ESP_LOGI(TAG, "Bluetooth command received: STOP");
         StopIdle("Remote command via Bluetooth");
@@ -417,28 +799,238 @@ void ProcessBluetoothCommand(char *command)
     }
     else if (strcmp(command, "STATUS") == 0) {
         ESP_LOGI(TAG, "Bluetooth command received: STATUS");
-        // Send current status via Bluetooth (implementation pending)
+        ESP_LOGI(TAG, "Bluetooth link: %u received bytes lost, %u telemetry frames dropped while congested",
+                 btDroppedBytes, telemetryDropped);
+        SendTelemetry();
+    }
+    else if (ParseIdleValue(command, "TELEMETRY=", &value)) {
+        // Period in ms, 0 stops the stream
+        telemetryPeriodMs = value <= 0.0f ? 0 : value < TELEMETRY_MIN_MS ? TELEMETRY_MIN_MS : (uint32_t)value;
+        ESP_LOGI(TAG, "Bluetooth command received: TELEMETRY=%u", telemetryPeriodMs);
+    }
+    else if (strcmp(command, "IDLE_INPUT_MAP") == 0) {
+        SelectIdleInput(IDLE_INPUT_MAP);
+    }
+    else if (strcmp(command, "IDLE_INPUT_RPM") == 0) {
+        SelectIdleInput(IDLE_INPUT_RPM);
+    }
+    else if (ParseIdleValue(command, "IDLE_TARGET=", &value)) {
+        SetIdleParameter("IDLE_TARGET", &idleController.target, value);
+    }
+    else if (ParseIdleValue(command, "IDLE_KP=", &value)) {
+        SetIdleParameter("IDLE_KP", &idleController.gains.kp, value);
+    }
+    else if (ParseIdleValue(command, "IDLE_KI=", &value)) {
+        SetIdleParameter("IDLE_KI", &idleController.gains.ki, value);
+    }
+    else if (ParseIdleValue(command, "IDLE_KD=", &value)) {
+        SetIdleParameter("IDLE_KD", &idleController.gains.kd, value);
+    }
+    else if (ParseIdleValue(command, "IDLE_FF=", &value)) {
+        SetIdleParameter("IDLE_FF", &idleController.gains.feedForward, value);
+    }
+    else if (ParseIdleValue(command, "IDLE_SLEW=", &value)) {
+        SetIdleParameter("IDLE_SLEW", &idleController.gains.slewRate, value);
+    }
+    else if (strcmp(command, "IDLE_GAINS") == 0) {
+        portENTER_CRITICAL(&idleMux);
+        IdleController snapshot = idleController;
+        portEXIT_CRITICAL(&idleMux);
+        ESP_LOGI(TAG, "Idle %s: target=%.1f KP=%.4f KI=%.4f KD=%.4f FF=%.1f%% SLEW=%.1f%%/s opening=%.1f%%",
+                 IdleInputName(snapshot.input), snapshot.target, snapshot.gains.kp, snapshot.gains.ki,
+                 snapshot.gains.kd, snapshot.gains.feedForward, snapshot.gains.slewRate, snapshot.opening);
+    }
+    else {
+        ESP_LOGW(TAG, "Unknown Bluetooth command: %s", command);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a line to the Bluetooth client, without waiting for the radio
+ * @param line Text of the line
+ * @param length Length of the line
+ */
+static void SendBluetoothLine(char *line, size_t length)
+{
+    uint32_t handle = sppHandle;
+    
+    // The stack copies the data, the write is sent from its own task
+    if (handle != 0 && length > 0) {
+        esp_spp_write(handle, (int)length, (uint8_t *)line);
     }
 }
 
 /**
- * @brief Task handling MAP sensor monitoring
+ * @brief Sends a telemetry frame with the MAP pressure, engine speed, opening and state
+ */
+void SendTelemetry(void)
+{
+    ActuatorOutput *output = iacControlMode == 1 ? &iacOutput : &throttleOutput;
+    char line[PROTOCOL_MAX_LINE];
+    Telemetry telemetry;
+    
+    if (sppCongested) {
+        telemetryDropped++;
+        return;
+    }
+    
+    // Single 32-bit reads, the control loop is never locked
+    telemetry.timeMs = esp_timer_get_time() / 1000;
+    telemetry.mapKpa = averagedPressure;
+    telemetry.rpm = (uint16_t)(ReadEngineSpeed() + 0.5f);
+    telemetry.opening = (uint16_t)((output->duty * 1000 + output->maxDuty / 2) / output->maxDuty);
+    telemetry.state = (uint8_t)systemState;
+    SendBluetoothLine(line, ProtocolFormatTelemetry(line, sizeof(line), &telemetry));
+}
+
+/**
+ * @brief Task running the Bluetooth commands and the telemetry stream
+ * @param pvParameters Task parameters (not used)
+ *
+ * Runs on BT_CORE with the Bluetooth stack, so neither the radio nor a
+ * slow command (STOP blinks the LED for one second) delays the MAP
+ * acquisition and the idle controller on CONTROL_CORE. The wait for
+ * received bytes ends when the next telemetry frame is due.
+ */
+void BluetoothTask(void *pvParameters)
+{
+    ProtocolParser parser;
+    ProtocolCommand command;
+    uint8_t received[64];
+    char reply[PROTOCOL_MAX_LINE];
+    TickType_t lastTelemetry = xTaskGetTickCount();
+    
+    ProtocolParserInit(&parser);
+    
+    while(1) {
+        TickType_t wait;
+        if (telemetryPeriodMs > 0 && sppHandle != 0) {
+            TickType_t elapsed = xTaskGetTickCount() - lastTelemetry;
+            TickType_t period = pdMS_TO_TICKS(telemetryPeriodMs);
+            wait = elapsed < period ? period - elapsed : 0;
+        } else {
+            // Checks again for a client or a new rate
+            wait = pdMS_TO_TICKS(TELEMETRY_PERIOD_MS);
+        }
+        
+        size_t length = xStreamBufferReceive(btRxBuffer, received, sizeof(received), wait);
+        for (size_t i = 0; i < length; i++) {
+            ProtocolResult result = ProtocolParse(&parser, received[i], &command);
+            if (result == PROTOCOL_NONE) {
+                continue;
+            }
+            bool ok = result == PROTOCOL_COMMAND && ProcessBluetoothCommand(command.text);
+            const char *reason = result == PROTOCOL_ERROR ? command.error : "UNKNOWN";
+            SendBluetoothLine(reply, ProtocolFormatReply(reply, sizeof(reply), command.sequence, ok, reason));
+        }
+        
+        if (telemetryPeriodMs > 0 && sppHandle != 0 &&
+            xTaskGetTickCount() - lastTelemetry >= pdMS_TO_TICKS(telemetryPeriodMs)) {
+            lastTelemetry = xTaskGetTickCount();
+            SendTelemetry();
+        }
+        
+        if (pairingDeadline != 0 && !PairingAllowed()) {
+            ClosePairing("window expired");
+        }
+    }
+}
+
+/**
+ * @brief Task averaging the MAP samples of the ADC
+ * @param pvParameters Task parameters (not used)
+ *
+ * With MAP_CYCLE_SYNC the window closes every engine cycle (two turns,
+ * 2 * RPM_PULSES_PER_REV ignition pulses), checked after every read, so
+ * a window differs from the cycle by one read at most (3.2 ms).
+ */
+void MAPAcquisitionTask(void *pvParameters)
+{
+    static uint8_t frame[MAP_FRAME_BYTES];
+    uint32_t cyclePulses = ignitionPulses;
+    
+    while(1) {
+        uint32_t length = 0;
+        
+        // ESP_ERR_INVALID_STATE means the buffer overflowed, the data read is still valid
+        esp_err_t ret = adc_digi_read_bytes(frame, sizeof(frame), &length, portMAX_DELAY);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            continue;
+        }
+        
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            adc_digi_output_data_t *sample = (adc_digi_output_data_t *)&frame[i];
+            if (sample->type1.channel != mapChannel) {
+                continue;
+            }
+            if (MapSensorAddSample(&mapSensor, esp_adc_cal_raw_to_voltage(sample->type1.data, &adcCharacteristics))) {
+                PublishMAP();
+            }
+        }
+        
+        // One engine cycle since the last window
+        if (MAP_CYCLE_SYNC && ignitionPulses - cyclePulses >= 2 * RPM_PULSES_PER_REV) {
+            cyclePulses = ignitionPulses;
+            if (MapSensorCycle(&mapSensor)) {
+                PublishMAP();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Task handling MAP sensor monitoring and the idle controller
  * @param pvParameters Task parameters (not used)
+ *
+ * The controller runs every IDLE_CONTROL_PERIOD_MS on a fixed schedule
+ * (vTaskDelayUntil), so its integral sees a constant period. The safety
+ * checks keep their original 100 ms rate.
  */
 void MAPMonitorTask(void *pvParameters)
 {
+    TickType_t lastWake = xTaskGetTickCount();
+    uint32_t period = 0;
+    
     while(1) {
-        // Read current pressure
-        uint32_t mapPressure = ReadMAPSensor();
+        // Last averaged pressure
+        float mapPressure = ReadMAPSensor();
+        float opening;
         
-        // Control IAC valve based on pressure
-        ControlIACValve(mapPressure);
+        // Hold the target while idling, otherwise wait at the feedforward opening
+        if (systemState == STATE_ON) {
+            float measurement = idleController.input == IDLE_INPUT_RPM ? ReadEngineSpeed() : mapPressure;
+            
+            // Without ignition pulses an RPM of 0 would open the valve fully, hold the MAP
+            // until they return, keeping the RPM target and tuning for then
+            if (idleController.input == IDLE_INPUT_RPM && measurement == 0.0f) {
+                ESP_LOGW(TAG, "No ignition pulses on GPIO %d, holding the MAP", PIN_RPM_INPUT);
+                SwitchIdleInput(IDLE_INPUT_MAP);
+                rpmFallback = true;
+                measurement = mapPressure;
+            } else if (rpmFallback && ReadEngineSpeed() > 0.0f) {
+                ESP_LOGI(TAG, "Ignition pulses back, holding the RPM");
+                rpmFallback = false;
+                SwitchIdleInput(IDLE_INPUT_RPM);
+                measurement = ReadEngineSpeed();
+            }
+            portENTER_CRITICAL(&idleMux);
+            opening = IdleControlStep(&idleController, measurement, IDLE_CONTROL_PERIOD_MS / 1000.0f);
+            portEXIT_CRITICAL(&idleMux);
+        } else {
+            opening = idleController.gains.feedForward;
+        }
+        ControlIACValve(opening);
         
         // Control idle state
-        ControlEngineIdle(mapPressure);
+        if (++period >= IDLE_SAFETY_DIVIDER) {
+            period = 0;
+            ControlEngineIdle(mapPressure);
+        }
         
-        // Sampling period (100ms)
-        vTaskDelay(pdMS_TO_TICKS(100));
+        // Fixed controller period (20ms)
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(IDLE_CONTROL_PERIOD_MS));
     }
 }
 
@@ -448,7 +1040,8 @@ void MAPMonitorTask(void *pvParameters)
  */
 void StartButtonTask(void *pvParameters)
 {
-    int previousState = 1; // Assuming pull-up (1=not pressed)
+    // Assuming pull-up (1=not pressed), a button held at power-up opens the pairing window instead
+    int previousState = gpio_get_level(PIN_START_BUTTON);
     
     while(1) {
         // Read current button state
@@ -503,6 +1096,11 @@ void app_main(void)
     // Initialize timer
     esp_timer_init();
     
+    // Idle controller with the default input, each input starts with its default target and tuning
+    IdleControlInit(&idleTuning[IDLE_INPUT_MAP], IDLE_INPUT_MAP, IDLE_TARGET_MAP, &IDLE_GAINS_MAP);
+    IdleControlInit(&idleTuning[IDLE_INPUT_RPM], IDLE_INPUT_RPM, IDLE_TARGET_RPM, &IDLE_GAINS_RPM);
+    idleController = idleTuning[USE_RPM_INPUT ? IDLE_INPUT_RPM : IDLE_INPUT_MAP];
+    
     // Configure components
     ConfigureGPIO();
     ESP_LOGI(TAG, "GPIOs configured");
@@ -520,8 +1118,13 @@ void app_main(void)
     ESP_LOGW(TAG, "⚠️ IMPORTANT: For manual transmission vehicles, ensure vehicle is in neutral with parking brake engaged before using this system to prevent accidents");
     
     // Create tasks
-    xTaskCreate(MAPMonitorTask, "map_monitor", 4096, NULL, 5, NULL);
+    // The control tasks run on their own core, the Bluetooth stack and its task on the other
+    xTaskCreatePinnedToCore(MAPAcquisitionTask, "map_acquisition", 4096, NULL, 6, NULL, CONTROL_CORE);
+    xTaskCreatePinnedToCore(MAPMonitorTask, "map_monitor", 4096, NULL, 5, NULL, CONTROL_CORE);
     xTaskCreate(StartButtonTask, "start_button", 2048, NULL, 5, NULL);
+    if (btRxBuffer != NULL) {
+        xTaskCreatePinnedToCore(BluetoothTask, "bluetooth", 4096, NULL, 4, NULL, BT_CORE);
+    }
     
     ESP_LOGI(TAG, "System started, monitoring MAP pressure");
 }
\ No newline at end of file
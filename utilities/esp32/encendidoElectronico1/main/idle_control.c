@@ -0,0 +1,95 @@
+/**
+ * @file idle_control.c
+ * @brief Idle speed controller: PI with feedforward, anti-windup and slew limit
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The feedforward opening is what the engine needs at the target, so the
+ * PI part only corrects what the feedforward misses. The integral stops
+ * while the output is held at a limit or by the slew rate and the error
+ * would push it further (conditional integration), so it never winds up
+ * while the valve cannot follow. The derivative acts on the measurement,
+ * filtered, so a change of target does not kick the valve.
+ */
+
+#include "idle_control.h"
+
+// Time constant of the derivative filter (s)
+#define DERIVATIVE_FILTER_S  0.05f
+
+// Tuned on the engine model of tools/idle_plant_sim.c, a starting point for a real engine
+const IdleGains IDLE_GAINS_MAP = { 1.5f, 10.0f, 0.0f, 36.0f, 100.0f, 0.0f, 100.0f };
+const IdleGains IDLE_GAINS_RPM = { 0.03f, 0.08f, 0.001f, 36.0f, 100.0f, 0.0f, 100.0f };
+
+/**
+ * @brief Limits a value to a range
+ * @param value Value to limit
+ * @param low Lowest value
+ * @param high Highest value
+ * @return Limited value
+ */
+static float Clamp(float value, float low, float high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+void IdleControlInit(IdleController* controller, IdleInput input, float target, const IdleGains* gains)
+{
+    controller->gains = *gains;
+    controller->input = input;
+    controller->target = target;
+    IdleControlReset(controller, gains->feedForward);
+}
+
+void IdleControlReset(IdleController* controller, float opening)
+{
+    const IdleGains* gains = &controller->gains;
+
+    controller->opening = Clamp(opening, gains->minOpening, gains->maxOpening);
+    controller->integral = controller->opening - gains->feedForward;
+    controller->derivative = 0.0f;
+    controller->hasMeasurement = false;
+}
+
+float IdleControlStep(IdleController* controller, float measurement, float dt)
+{
+    const IdleGains* gains = &controller->gains;
+    float error = controller->target - measurement;
+
+    if (dt <= 0.0f) {
+        return controller->opening;
+    }
+
+    if (controller->hasMeasurement) {
+        float change = (measurement - controller->lastMeasurement) / dt;
+        controller->derivative += (change - controller->derivative) * dt / (DERIVATIVE_FILTER_S + dt);
+    }
+    controller->lastMeasurement = measurement;
+    controller->hasMeasurement = true;
+
+    float integral = controller->integral + gains->ki * error * dt;
+    float wanted = gains->feedForward + gains->kp * error + integral - gains->kd * controller->derivative;
+
+    float step = gains->slewRate * dt;
+    float opening = Clamp(wanted, gains->minOpening, gains->maxOpening);
+    opening = Clamp(opening, controller->opening - step, controller->opening + step);
+
+    // The integral only moves when the valve follows it or the error pulls the output back
+    if (opening == wanted || (wanted > opening && error < 0.0f) || (wanted < opening && error > 0.0f)) {
+        controller->integral = integral;
+    }
+
+    controller->opening = opening;
+    return opening;
+}
+
+const char* IdleInputName(IdleInput input)
+{
+    return input == IDLE_INPUT_RPM ? "RPM" : "MAP";
+}
@@ -0,0 +1,64 @@
+/**
+ * @file idle_control.h
+ * @brief Idle speed controller: PI with feedforward, anti-windup and slew limit
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef IDLE_CONTROL_H
+#define IDLE_CONTROL_H
+
+#include <stdbool.h>
+
+// Measurement the controller holds at its target
+typedef enum {
+    IDLE_INPUT_MAP,              // Manifold pressure in kPa
+    IDLE_INPUT_RPM               // Engine speed in RPM
+} IdleInput;
+
+// Tuning of the controller, all openings in % of the IAC valve
+typedef struct {
+    float kp;                    // Opening per unit of error
+    float ki;                    // Opening per unit of error and second
+    float kd;                    // Opening per unit of measurement change per second (on the measurement, no kick on target steps)
+    float feedForward;           // Opening that holds the target with no error
+    float slewRate;              // Largest change of the opening (% per second)
+    float minOpening;
+    float maxOpening;
+} IdleGains;
+
+// Controller state
+typedef struct {
+    IdleGains gains;
+    IdleInput input;
+    float target;                // kPa or RPM, depending on input
+    float integral;              // Integral part of the opening (%)
+    float derivative;            // Filtered change of the measurement per second
+    float lastMeasurement;
+    bool hasMeasurement;
+    float opening;               // Last output (%)
+} IdleController;
+
+// Default tuning for each input
+extern const IdleGains IDLE_GAINS_MAP;
+extern const IdleGains IDLE_GAINS_RPM;
+
+// Starts the controller at the feedforward opening
+void IdleControlInit(IdleController* controller, IdleInput input, float target, const IdleGains* gains);
+
+// Restarts from the given opening with no integral or derivative history (bumpless start)
+void IdleControlReset(IdleController* controller, float opening);
+
+// Runs one period of dt seconds and returns the new opening (%)
+float IdleControlStep(IdleController* controller, float measurement, float dt);
+
+// Returns "MAP" or "RPM"
+const char* IdleInputName(IdleInput input);
+
+#endif // IDLE_CONTROL_H
@@ -0,0 +1,132 @@
+/**
+ * @file map_sensor.c
+ * @brief MAP sensor averaging, transfer function and change reporting
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The manifold pressure pulses with every intake stroke. Averaging over
+ * one whole engine cycle (two turns, closed by the crank trigger) removes
+ * the pulsation whatever the speed; a fixed window of samples only removes
+ * it when the window spans whole cycles. The average is taken on the
+ * voltages and converted once per window, in signed 64-bit integer math:
+ * a voltage below the low point of the sensor gives a pressure below it
+ * (then clamped) instead of wrapping around.
+ */
+
+#include "map_sensor.h"
+
+const MapTransfer MAP_TRANSFER_DEFAULT = {
+    .lowMv = 500,
+    .lowKpa = 10 * MAP_KPA_SCALE,
+    .highMv = 4500,
+    .highKpa = 105 * MAP_KPA_SCALE,
+    .minKpa = 0,
+    .maxKpa = 120 * MAP_KPA_SCALE,
+    .dividerPermille = 1000
+};
+
+/**
+ * @brief Closes the open window and converts its average
+ * @param sensor Sensor state
+ * @return false if the window had no samples
+ */
+static bool CloseWindow(MapSensor* sensor)
+{
+    if (sensor->count == 0) {
+        return false;
+    }
+
+    uint32_t average = (uint32_t)((sensor->sum + sensor->count / 2) / sensor->count);
+    sensor->pressure = MapSensorConvert(&sensor->transfer, average);
+    sensor->valid = true;
+    sensor->windows++;
+    sensor->sum = 0;
+    sensor->count = 0;
+    return true;
+}
+
+void MapSensorInit(MapSensor* sensor, const MapTransfer* transfer, uint32_t windowSamples, bool cycleSync,
+                   int32_t changeKpa)
+{
+    sensor->transfer = *transfer;
+    sensor->windowSamples = windowSamples > 0 ? windowSamples : 1;
+    sensor->cycleSync = cycleSync;
+    sensor->changeKpa = changeKpa;
+    sensor->sum = 0;
+    sensor->count = 0;
+    sensor->pressure = 0;
+    sensor->reported = 0;
+    sensor->valid = false;
+    sensor->reportedValid = false;
+    sensor->windows = 0;
+    sensor->timeouts = 0;
+}
+
+bool MapSensorAddSample(MapSensor* sensor, uint32_t millivolts)
+{
+    sensor->sum += millivolts;
+    sensor->count++;
+    if (sensor->count < sensor->windowSamples) {
+        return false;
+    }
+
+    // With the crank trigger a full window means the engine is stopped or turning too slowly
+    if (sensor->cycleSync) {
+        sensor->timeouts++;
+    }
+    return CloseWindow(sensor);
+}
+
+bool MapSensorCycle(MapSensor* sensor)
+{
+    return CloseWindow(sensor);
+}
+
+int32_t MapSensorConvert(const MapTransfer* transfer, uint32_t millivolts)
+{
+    // Sensor voltage in microvolts, the divider does not lose the fraction of a millivolt
+    int64_t sensorUv = (int64_t)millivolts * transfer->dividerPermille;
+    int64_t span = (int64_t)(transfer->highMv - transfer->lowMv) * 1000;
+    int64_t pressure = transfer->lowKpa;
+
+    if (span != 0) {
+        int64_t scaled = (sensorUv - (int64_t)transfer->lowMv * 1000) * (transfer->highKpa - transfer->lowKpa);
+        if (span < 0) {
+            span = -span;
+            scaled = -scaled;
+        }
+        // Rounded to the nearest step, also below the low point
+        pressure += (scaled + (scaled >= 0 ? span / 2 : -span / 2)) / span;
+    }
+
+    if (pressure < transfer->minKpa) {
+        return transfer->minKpa;
+    }
+    if (pressure > transfer->maxKpa) {
+        return transfer->maxKpa;
+    }
+    return (int32_t)pressure;
+}
+
+bool MapSensorChanged(MapSensor* sensor, int32_t* pressure)
+{
+    int32_t change = sensor->pressure - sensor->reported;
+
+    if (!sensor->valid) {
+        return false;
+    }
+    if (sensor->reportedValid && change < sensor->changeKpa && change > -sensor->changeKpa) {
+        return false;
+    }
+
+    sensor->reported = sensor->pressure;
+    sensor->reportedValid = true;
+    *pressure = sensor->pressure;
+    return true;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file map_sensor.h
+ * @brief MAP sensor averaging, transfer function and change reporting
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef MAP_SENSOR_H
+#define MAP_SENSOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed point pressures: hundredths of kPa, signed so a faulty sensor below its range shows as it is
+#define MAP_KPA_SCALE           100
+
+// Sensor voltage to pressure: a straight line through two points, clamped to a range
+typedef struct {
+    int32_t lowMv;               // Sensor voltage at lowKpa
+    int32_t lowKpa;              // Fixed point
+    int32_t highMv;              // Sensor voltage at highKpa
+    int32_t highKpa;             // Fixed point
+    int32_t minKpa;              // Clamping range, fixed point
+    int32_t maxKpa;
+    uint32_t dividerPermille;    // Sensor voltage per ADC pin voltage x 1000 (1000 without a divider)
+} MapTransfer;
+
+// Averaging of the ADC samples and last reported pressure
+typedef struct {
+    MapTransfer transfer;
+    uint32_t windowSamples;      // Samples of a fixed window, or most samples of an engine cycle
+    bool cycleSync;              // true: the window closes at every engine cycle (MapSensorCycle)
+    int32_t changeKpa;           // Smallest change that is reported, fixed point
+    uint64_t sum;                // Millivolts of the open window
+    uint32_t count;
+    int32_t pressure;            // Pressure of the last closed window, fixed point
+    int32_t reported;            // Last pressure reported by MapSensorChanged
+    bool valid;                  // A window has been closed
+    bool reportedValid;
+    uint32_t windows;            // Windows closed
+    uint32_t timeouts;           // Engine cycles closed by windowSamples instead of the crank trigger
+} MapSensor;
+
+// Typical MAP sensor: 0.5V = 10 kPa, 4.5V = 105 kPa, clamped to 0-120 kPa
+extern const MapTransfer MAP_TRANSFER_DEFAULT;
+
+// Starts with an empty window and no pressure
+void MapSensorInit(MapSensor* sensor, const MapTransfer* transfer, uint32_t windowSamples, bool cycleSync,
+                   int32_t changeKpa);
+
+// Adds one ADC sample in millivolts, returns true when it closed a window
+bool MapSensorAddSample(MapSensor* sensor, uint32_t millivolts);
+
+// Closes the window at the end of an engine cycle, returns false if it was empty
+bool MapSensorCycle(MapSensor* sensor);
+
+// Converts an ADC pin voltage to pressure with the transfer function (fixed point kPa)
+int32_t MapSensorConvert(const MapTransfer* transfer, uint32_t millivolts);
+
+// Returns true once for each change of at least changeKpa since the last report, with the new pressure
+bool MapSensorChanged(MapSensor* sensor, int32_t* pressure);
+
+#endif // MAP_SENSOR_H
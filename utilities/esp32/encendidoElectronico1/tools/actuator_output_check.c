@@ -0,0 +1,221 @@
+/**
+ * @file actuator_output_check.c
+ * @brief Host check of the PWM outputs against a fake LEDC that counts register writes
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs one minute of the firmware control loop at 50 Hz: the same
+ * idle_control.c holds a MAP pressure that is averaged over each engine
+ * cycle (a new value every 140 ms, with noise), with a load step, a new
+ * feedforward sent with a fast slew rate and a change to the throttle body
+ * output. The openings go to the same actuator_output.c as the firmware,
+ * which drives a fake LEDC.
+ *
+ * The fake counts the register writes the ESP-IDF LEDC driver does for
+ * each call and follows the hardware ramps. The same openings are sent the
+ * previous way (ledc_set_duty and ledc_update_duty plus one log line every
+ * period, as SendPWM did) to compare. The check fails if the hardware duty
+ * ends more than the deadband away from the last request, if a write
+ * repeats the duty of the hardware, if a ramp is interrupted or if more
+ * diagnostics lines are printed than the rate limit allows.
+ *
+ * Build and run:
+ *   cc -O2 -I../main actuator_output_check.c ../main/actuator_output.c ../main/idle_control.c -lm -o actuator_output_check
+ *   ./actuator_output_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "actuator_output.h"
+#include "idle_control.h"
+
+// Same outputs as the firmware
+#define RESOLUTION_BITS     14
+#define DEADBAND            8
+#define FADE_MS             200
+#define FADE_THRESHOLD      1638
+#define LOG_INTERVAL_MS     1000
+#define PERIOD_MS           20
+
+// Register writes of the ESP-IDF LEDC driver
+#define REGS_SET_DUTY       6                    // hpoint, duty, direction, number, cycle, scale
+#define REGS_UPDATE_DUTY    2                    // Duty start and update strobe
+#define REGS_FADE           9                    // Ramp parameters, update and fade interrupt
+
+#define CHANNELS            2
+#define DURATION_MS         60000
+
+// Fake LEDC channel
+typedef struct {
+    uint32_t duty;               // Duty at the start of the ramp, or the duty when not ramping
+    uint32_t target;
+    uint32_t fadeStart;
+    uint32_t fadeMs;
+    uint32_t registerWrites;
+    uint32_t calls;
+} FakeChannel;
+
+static FakeChannel fake[CHANNELS];
+static uint32_t now = 0;
+static uint32_t failures = 0;
+
+/**
+ * @brief Duty of a fake channel at the current time, following its ramp
+ * @param channel Fake channel
+ * @return Duty
+ */
+static uint32_t FakeDuty(const FakeChannel* channel)
+{
+    if (channel->fadeMs == 0 || now >= channel->fadeStart + channel->fadeMs) {
+        return channel->target;
+    }
+    double done = (double)(now - channel->fadeStart) / channel->fadeMs;
+    return (uint32_t)(channel->duty + ((double)channel->target - channel->duty) * done);
+}
+
+/**
+ * @brief Reports a failed check, only the first ones are printed
+ * @param message What is wrong
+ * @param value Value found
+ */
+static void Fail(const char* message, uint32_t value)
+{
+    if (failures++ < 20) {
+        printf("FAIL at %u ms: %s (%u)\n", now, message, value);
+    }
+}
+
+/**
+ * @brief ledc_set_duty and ledc_update_duty on the fake
+ * @param context Not used
+ * @param channel LEDC channel
+ * @param duty New duty
+ */
+static void FakeSetDuty(void* context, uint8_t channel, uint32_t duty)
+{
+    FakeChannel* fakeChannel = &fake[channel];
+
+    (void)context;
+    if (fakeChannel->fadeMs != 0 && now < fakeChannel->fadeStart + fakeChannel->fadeMs) {
+        Fail("ramp interrupted", channel);
+    }
+    if (duty == FakeDuty(fakeChannel)) {
+        Fail("duty written again", duty);
+    }
+    fakeChannel->duty = fakeChannel->target = duty;
+    fakeChannel->fadeMs = 0;
+    fakeChannel->registerWrites += REGS_SET_DUTY + REGS_UPDATE_DUTY;
+    fakeChannel->calls++;
+}
+
+/**
+ * @brief ledc_set_fade_with_time and ledc_fade_start on the fake
+ * @param context Not used
+ * @param channel LEDC channel
+ * @param duty Duty at the end of the ramp
+ * @param timeMs Ramp time
+ */
+static void FakeFade(void* context, uint8_t channel, uint32_t duty, uint32_t timeMs)
+{
+    FakeChannel* fakeChannel = &fake[channel];
+
+    (void)context;
+    if (fakeChannel->fadeMs != 0 && now < fakeChannel->fadeStart + fakeChannel->fadeMs) {
+        Fail("ramp interrupted", channel);
+    }
+    fakeChannel->duty = FakeDuty(fakeChannel);
+    fakeChannel->target = duty;
+    fakeChannel->fadeStart = now;
+    fakeChannel->fadeMs = timeMs;
+    fakeChannel->registerWrites += REGS_FADE;
+    fakeChannel->calls++;
+}
+
+static const ActuatorDriver FAKE_DRIVER = { FakeSetDuty, FakeFade, NULL };
+
+int main(void)
+{
+    ActuatorOutput outputs[CHANNELS];
+    DiagnosticChannel diagnostics;
+    IdleController controller;
+    IdleGains gains = IDLE_GAINS_MAP;
+    uint32_t previousWrites = 0;
+    uint32_t previousLogs = 0;
+    uint32_t logs = 0;
+    uint32_t suppressed;
+    uint32_t suppressedTotal = 0;
+    float measurement = 35.0f;
+    int active = 0;
+    float opening = 0.0f;
+
+    srand(1);
+    for (int i = 0; i < CHANNELS; i++) {
+        ActuatorOutputInit(&outputs[i], &FAKE_DRIVER, (uint8_t)i, RESOLUTION_BITS, DEADBAND, FADE_MS, FADE_THRESHOLD);
+    }
+    DiagnosticInit(&diagnostics, LOG_INTERVAL_MS);
+    IdleControlInit(&controller, IDLE_INPUT_MAP, 35.0f, &gains);
+
+    for (now = 0; now < DURATION_MS; now += PERIOD_MS) {
+        // Events of the run
+        if (now == 30000) {
+            controller.gains.slewRate = 1000.0f;     // IDLE_SLEW=1000
+            controller.gains.feedForward = 50.0f;    // IDLE_FF=50
+        }
+        if (now == 45000) {
+            active = 1;                              // IAC_MODE_2
+        }
+
+        // A new cycle average every 140 ms (850 RPM), 3 kPa more while the load is on
+        if (now % 140 == 0) {
+            float load = now >= 15000 && now < 20000 ? 3.0f : 0.0f;
+            measurement = 35.0f + load + 0.05f * (2.0f * rand() / RAND_MAX - 1.0f);
+        }
+        if (now >= 2000) {
+            opening = IdleControlStep(&controller, measurement, PERIOD_MS / 1000.0f);
+        } else {
+            opening = controller.gains.feedForward;  // Engine off, waiting at the feedforward opening
+        }
+
+        // Previous way: duty written and logged every period
+        previousWrites += REGS_SET_DUTY + REGS_UPDATE_DUTY;
+        previousLogs++;
+
+        // Output layer with rate-limited diagnostics
+        if (ActuatorOutputSet(&outputs[active], opening, now) && DiagnosticAllow(&diagnostics, now, &suppressed)) {
+            logs++;
+            suppressedTotal += suppressed;
+        }
+    }
+
+    // The hardware must end at the last request, after the last ramp
+    now += FADE_MS;
+    uint32_t wanted = ActuatorOutputDuty(&outputs[active], opening);
+    uint32_t actual = FakeDuty(&fake[active]);
+    if ((actual > wanted ? actual - wanted : wanted - actual) > DEADBAND) {
+        Fail("hardware away from the last request", actual);
+    }
+    if (outputs[0].fades < 2 || outputs[1].fades < 1) {
+        Fail("large changes not ramped", outputs[0].fades + outputs[1].fades);
+    }
+    if (logs > DURATION_MS / LOG_INTERVAL_MS + 1) {
+        Fail("too many diagnostics lines", logs);
+    }
+
+    uint32_t writes = fake[0].registerWrites + fake[1].registerWrites;
+    uint32_t periods = DURATION_MS / PERIOD_MS;
+    printf("%u periods of %u ms, %u-bit duty, deadband %u steps (%.2f%%)\n", periods, PERIOD_MS, RESOLUTION_BITS,
+           DEADBAND, DEADBAND * 100.0 / ((1 << RESOLUTION_BITS) - 1));
+    printf("Previous: %6u register writes, %4u log lines (8-bit duty, every period)\n", previousWrites, previousLogs);
+    printf("Now:      %6u register writes, %4u log lines (%u immediate, %u ramps, %u requests skipped, "
+           "%u changes counted in the logs)\n", writes, logs, outputs[0].writes + outputs[1].writes,
+           outputs[0].fades + outputs[1].fades, outputs[0].skipped + outputs[1].skipped, suppressedTotal);
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,447 @@
+/**
+ * @file bt_protocol_bench.c
+ * @brief Host check of the Bluetooth protocol over a socket pair standing in for the SPP link
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * A device thread does what BluetoothTask does in the firmware with the
+ * same bt_protocol.c: reads the bytes in chunks of up to 64, parses them,
+ * replies to each command and sends a telemetry frame every period. The
+ * commands are only checked against the names the firmware knows. The
+ * main thread is the phone app:
+ *   1. Latency: one framed command at a time, round trip of each reply
+ *   2. Throughput: commands sent without waiting, replies must come in order
+ *   3. Telemetry: frames counted over two seconds, gaps between them
+ *   4. Damaged lines: bad checksum, no checksum, too long, empty, unknown,
+ *      plain command, each with the expected reply
+ * Every line received must carry a valid checksum.
+ *
+ * An optional link rate (bytes per second, both ways) models the radio,
+ * e.g. 11000 for a slow phone; 0 or nothing runs at the speed of the socket.
+ *
+ * Build and run:
+ *   cc -O2 -pthread -I../main bt_protocol_bench.c ../main/bt_protocol.c -o bt_protocol_bench
+ *   ./bt_protocol_bench [bytes_per_second]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "bt_protocol.h"
+
+#define TELEMETRY_PERIOD_MS 100      // Firmware default
+#define LATENCY_COMMANDS    2000
+#define THROUGHPUT_COMMANDS 20000
+#define REPLY_TIMEOUT_MS    2000
+
+// Device end of the link
+typedef struct {
+    int fd;
+    volatile int stop;
+    uint32_t commands;
+    uint32_t errors;
+} Device;
+
+// Phone end of the link
+typedef struct {
+    int fd;
+    char buffer[4096];
+    size_t length;
+    uint32_t telemetry;              // Telemetry frames received
+    double lastTelemetry;
+    double longestGap;               // Longest time between telemetry frames (ms)
+} Client;
+
+static uint32_t rateBytes = 0;
+static uint32_t failures = 0;
+
+// Commands of ProcessBluetoothCommand
+static const char* const COMMANDS[] = {
+    "STOP", "START", "IAC_MODE_1", "IAC_MODE_2", "STATUS", "IDLE_INPUT_MAP", "IDLE_INPUT_RPM", "IDLE_GAINS"
+};
+static const char* const VALUE_COMMANDS[] = {
+    "IDLE_TARGET=", "IDLE_KP=", "IDLE_KI=", "IDLE_KD=", "IDLE_FF=", "IDLE_SLEW=", "TELEMETRY="
+};
+
+/**
+ * @brief Monotonic time
+ * @return Time in ms
+ */
+static double Now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Reports a failed check, only the first ones are printed
+ * @param message What is wrong
+ * @param detail Line or value found
+ */
+static void Fail(const char* message, const char* detail)
+{
+    if (failures++ < 20) {
+        printf("FAIL: %s (%s)\n", message, detail);
+    }
+}
+
+/**
+ * @brief Writes all the bytes, at the link rate if one is set
+ * @param fd Socket
+ * @param data Bytes to write
+ * @param length Number of bytes
+ */
+static void WriteAll(int fd, const char* data, size_t length)
+{
+    if (rateBytes > 0) {
+        usleep((useconds_t)(length * 1000000ull / rateBytes));
+    }
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+}
+
+/**
+ * @brief Stand-in of ProcessBluetoothCommand, only checks the name
+ * @param text Command
+ * @return true if the firmware knows the command
+ */
+static bool KnownCommand(const char* text)
+{
+    for (size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++) {
+        if (strcmp(text, COMMANDS[i]) == 0) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < sizeof(VALUE_COMMANDS) / sizeof(VALUE_COMMANDS[0]); i++) {
+        size_t length = strlen(VALUE_COMMANDS[i]);
+        float value;
+        if (strncmp(text, VALUE_COMMANDS[i], length) == 0 && sscanf(text + length, "%f", &value) == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Device loop, as BluetoothTask
+ * @param argument Device
+ * @return NULL
+ */
+static void* DeviceThread(void* argument)
+{
+    Device* device = argument;
+    ProtocolParser parser;
+    ProtocolCommand command;
+    uint8_t received[64];
+    char line[PROTOCOL_MAX_LINE];
+    double start = Now();
+    double nextTelemetry = start + TELEMETRY_PERIOD_MS;
+
+    ProtocolParserInit(&parser);
+    while (!device->stop) {
+        struct pollfd poller = { device->fd, POLLIN, 0 };
+        double wait = nextTelemetry - Now();
+
+        if (poll(&poller, 1, wait > 0 ? (int)wait + 1 : 0) > 0) {
+            ssize_t length = read(device->fd, received, sizeof(received));
+            if (length <= 0) {
+                break;
+            }
+            for (ssize_t i = 0; i < length; i++) {
+                ProtocolResult result = ProtocolParse(&parser, received[i], &command);
+                if (result == PROTOCOL_NONE) {
+                    continue;
+                }
+                bool ok = result == PROTOCOL_COMMAND && KnownCommand(command.text);
+                const char* reason = result == PROTOCOL_ERROR ? command.error : "UNKNOWN";
+                WriteAll(device->fd, line, ProtocolFormatReply(line, sizeof(line), command.sequence, ok, reason));
+            }
+        }
+
+        if (Now() >= nextTelemetry) {
+            Telemetry telemetry = { (uint32_t)(Now() - start), 3512, 850, 362, 1 };
+            nextTelemetry += TELEMETRY_PERIOD_MS;
+            WriteAll(device->fd, line, ProtocolFormatTelemetry(line, sizeof(line), &telemetry));
+        }
+    }
+    device->commands = parser.commands;
+    device->errors = parser.errors;
+    return NULL;
+}
+
+/**
+ * @brief Checks the checksum of a framed line
+ * @param line Line without its end
+ * @return true if it is a plain line or a frame with a valid checksum
+ */
+static bool ValidLine(const char* line)
+{
+    const char* star = strchr(line, '*');
+    uint8_t checksum = 0;
+    unsigned int expected;
+
+    if (line[0] != '$') {
+        return true;
+    }
+    if (star == NULL || strlen(star) != 3 || sscanf(star + 1, "%2X", &expected) != 1) {
+        return false;
+    }
+    for (const char* c = line + 1; c < star; c++) {
+        checksum ^= (uint8_t)*c;
+    }
+    return checksum == expected;
+}
+
+/**
+ * @brief Reads the next reply, telemetry frames are counted and skipped
+ * @param client Phone end
+ * @param line Filled with the reply without its end
+ * @param size Size of the line
+ * @return true if a reply arrived before REPLY_TIMEOUT_MS
+ */
+static bool ReadReply(Client* client, char* line, size_t size)
+{
+    double deadline = Now() + REPLY_TIMEOUT_MS;
+
+    while (1) {
+        char* end = memchr(client->buffer, '\n', client->length);
+        if (end != NULL) {
+            size_t length = (size_t)(end - client->buffer);
+            if (length > 0 && client->buffer[length - 1] == '\r') {
+                length--;
+            }
+            if (length >= size) {
+                length = size - 1;
+            }
+            memcpy(line, client->buffer, length);
+            line[length] = '\0';
+            client->length -= (size_t)(end + 1 - client->buffer);
+            memmove(client->buffer, end + 1, client->length);
+
+            if (!ValidLine(line)) {
+                Fail("bad checksum received", line);
+            }
+            if (strncmp(line, "$T,", 3) == 0) {
+                double now = Now();
+                if (client->telemetry > 0 && now - client->lastTelemetry > client->longestGap) {
+                    client->longestGap = now - client->lastTelemetry;
+                }
+                client->lastTelemetry = now;
+                client->telemetry++;
+                continue;
+            }
+            return true;
+        }
+
+        struct pollfd poller = { client->fd, POLLIN, 0 };
+        double wait = deadline - Now();
+        if (wait <= 0 || poll(&poller, 1, (int)wait + 1) <= 0) {
+            return false;
+        }
+        ssize_t length = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length);
+        if (length <= 0) {
+            return false;
+        }
+        client->length += (size_t)length;
+    }
+}
+
+/**
+ * @brief Writes a framed command with its checksum
+ * @param buffer Filled with the line
+ * @param size Size of the buffer
+ * @param sequence Sequence number
+ * @param text Command
+ * @return Length of the line
+ */
+static size_t FrameCommand(char* buffer, size_t size, uint32_t sequence, const char* text)
+{
+    char body[PROTOCOL_MAX_LINE];
+    uint8_t checksum = 0;
+    int length = snprintf(body, sizeof(body), "%u,%s", sequence, text);
+
+    for (int i = 0; i < length; i++) {
+        checksum ^= (uint8_t)body[i];
+    }
+    return (size_t)snprintf(buffer, size, "$%s*%02X\r\n", body, checksum);
+}
+
+/**
+ * @brief Sorts the round trips
+ */
+static int CompareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Writer of the throughput phase, sends the commands without waiting
+ * @param argument Client
+ * @return NULL
+ */
+static void* ThroughputWriter(void* argument)
+{
+    Client* client = argument;
+    char frames[4096];
+    size_t length = 0;
+
+    // Several frames per write, as a phone app that queues them
+    for (uint32_t i = 0; i < THROUGHPUT_COMMANDS; i++) {
+        char frame[PROTOCOL_MAX_LINE];
+        size_t frameLength = FrameCommand(frame, sizeof(frame), i % 65536, i % 2 ? "IDLE_FF=36.5" : "IDLE_GAINS");
+        if (length + frameLength > sizeof(frames)) {
+            WriteAll(client->fd, frames, length);
+            length = 0;
+        }
+        memcpy(frames + length, frame, frameLength);
+        length += frameLength;
+    }
+    WriteAll(client->fd, frames, length);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int sockets[2];
+    Device device = { 0 };
+    Client client = { 0 };
+    pthread_t deviceThread;
+    pthread_t writerThread;
+    static double roundTrips[LATENCY_COMMANDS];
+    char frame[PROTOCOL_MAX_LINE * 2];
+    char reply[PROTOCOL_MAX_LINE * 2];
+    char expected[PROTOCOL_MAX_LINE];
+
+    if (argc > 1) {
+        rateBytes = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    device.fd = sockets[1];
+    client.fd = sockets[0];
+    pthread_create(&deviceThread, NULL, DeviceThread, &device);
+
+    // 1. Latency
+    for (uint32_t i = 0; i < LATENCY_COMMANDS; i++) {
+        double sent = Now();
+        WriteAll(client.fd, frame, FrameCommand(frame, sizeof(frame), i, "IDLE_KP=1.5"));
+        ProtocolFormatReply(expected, sizeof(expected), (int32_t)i, true, NULL);
+        expected[strlen(expected) - 2] = '\0';
+        if (!ReadReply(&client, reply, sizeof(reply))) {
+            Fail("no reply", "latency");
+            break;
+        }
+        roundTrips[i] = Now() - sent;
+        if (strcmp(reply, expected) != 0) {
+            Fail("wrong reply", reply);
+        }
+    }
+    qsort(roundTrips, LATENCY_COMMANDS, sizeof(double), CompareDouble);
+    printf("Latency:    %u commands, round trip median %.3f ms, p99 %.3f ms, max %.3f ms\n", LATENCY_COMMANDS,
+           roundTrips[LATENCY_COMMANDS / 2], roundTrips[LATENCY_COMMANDS * 99 / 100], roundTrips[LATENCY_COMMANDS - 1]);
+
+    // 2. Throughput
+    double start = Now();
+    uint64_t replyBytes = 0;
+    pthread_create(&writerThread, NULL, ThroughputWriter, &client);
+    for (uint32_t i = 0; i < THROUGHPUT_COMMANDS; i++) {
+        if (!ReadReply(&client, reply, sizeof(reply))) {
+            Fail("no reply", "throughput");
+            break;
+        }
+        ProtocolFormatReply(expected, sizeof(expected), (int32_t)(i % 65536), true, NULL);
+        replyBytes += strlen(expected);
+        expected[strlen(expected) - 2] = '\0';
+        if (strcmp(reply, expected) != 0) {
+            Fail("reply out of order", reply);
+        }
+    }
+    pthread_join(writerThread, NULL);
+    double elapsed = Now() - start;
+    printf("Throughput: %u commands in %.1f ms, %.0f commands/s, %.1f kB/s of replies\n", THROUGHPUT_COMMANDS,
+           elapsed, THROUGHPUT_COMMANDS * 1000.0 / elapsed, replyBytes / elapsed);
+
+    // 3. Telemetry, counted while the link is quiet
+    uint32_t telemetryBefore = client.telemetry;
+    client.longestGap = 0.0;
+    ReadReply(&client, reply, sizeof(reply));               // Times out after REPLY_TIMEOUT_MS
+    uint32_t frames = client.telemetry - telemetryBefore;
+    uint32_t wanted = REPLY_TIMEOUT_MS / TELEMETRY_PERIOD_MS;
+    printf("Telemetry:  %u frames in %u ms (%u expected), longest gap %.1f ms\n", frames, REPLY_TIMEOUT_MS,
+           wanted, client.longestGap);
+    if (frames + 2 < wanted || frames > wanted + 2) {
+        Fail("telemetry rate", "frames");
+    }
+    if (client.longestGap > 2.0 * TELEMETRY_PERIOD_MS) {
+        Fail("telemetry gap", "ms");
+    }
+
+    // 4. Damaged lines
+    char longLine[PROTOCOL_MAX_LINE * 2];
+    memset(longLine, 'A', sizeof(longLine));
+    memcpy(longLine, "$7,IDLE_KP=", 11);
+    strcpy(longLine + sizeof(longLine) - 3, "\r\n");
+    struct {
+        const char* line;
+        int32_t sequence;
+        const char* reason;
+    } damaged[] = {
+        { "$5,STOP*00\r\n", 5, "CHECKSUM" },
+        { "$6,STOP\r\n", 6, "FORMAT" },
+        { longLine, 7, "LENGTH" },
+        { "$8,*14\r\n", 8, "EMPTY" },
+        { NULL, 9, "UNKNOWN" },
+        { "STATUS\r\n", PROTOCOL_UNFRAMED, NULL },
+        { "FOO\r\n", PROTOCOL_UNFRAMED, "UNKNOWN" },
+        { "$X,STOP*00\r\n", PROTOCOL_UNFRAMED, "FORMAT" },
+    };
+    for (size_t i = 0; i < sizeof(damaged) / sizeof(damaged[0]); i++) {
+        if (damaged[i].line != NULL) {
+            WriteAll(client.fd, damaged[i].line, strlen(damaged[i].line));
+        } else {
+            WriteAll(client.fd, frame, FrameCommand(frame, sizeof(frame), (uint32_t)damaged[i].sequence, "FOO"));
+        }
+        ProtocolFormatReply(expected, sizeof(expected), damaged[i].sequence, damaged[i].reason == NULL,
+                            damaged[i].reason);
+        expected[strlen(expected) - 2] = '\0';
+        if (!ReadReply(&client, reply, sizeof(reply))) {
+            Fail("no reply", expected);
+        } else if (strcmp(reply, expected) != 0) {
+            Fail("wrong reply to a damaged line", reply);
+        }
+    }
+
+    device.stop = 1;
+    shutdown(client.fd, SHUT_RDWR);
+    pthread_join(deviceThread, NULL);
+    printf("Device:     %u commands, %u damaged lines, link %s\n", device.commands, device.errors,
+           rateBytes > 0 ? "rate-limited" : "unlimited");
+    if (device.errors != 5) {
+        Fail("damaged lines counted", "device");
+    }
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
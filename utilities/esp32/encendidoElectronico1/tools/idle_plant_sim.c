@@ -0,0 +1,398 @@
+/**
+ * @file idle_plant_sim.c
+ * @brief Host benchmark of the idle controller on an engine model
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Engine model of a 1.6 L four cylinder at idle, integrated every 0.1 ms:
+ * - IAC valve: solenoid with a 30 ms lag, the air flow through it and the
+ *   closed throttle follows the compressible flow through an orifice.
+ * - Manifold filling: the pressure rises with the air that comes in and
+ *   falls with the air the cylinders pump out (speed density).
+ * - Torque: proportional to the air of each cycle, produced one cycle
+ *   after the intake, against friction that grows with speed and a load
+ *   that can be switched on (air conditioning compressor).
+ * - Sensors: MAP with noise, RPM measured once per ignition.
+ *
+ * Each scenario runs the same idle_control.c as the firmware, at the
+ * firmware rate, and the three-band rule it replaced (100 ms, whole kPa)
+ * as a reference. For every step of the target and every load step the
+ * overshoot, settling time (2% band) and final error are printed, plus
+ * the lowest RPM after the event and the peak to peak ripple of the RPM
+ * in steady state, which shows the hunting. Passing a file name writes
+ * the traces as CSV.
+ *
+ * Build and run:
+ *   cc -O2 -I../main idle_plant_sim.c ../main/idle_control.c -lm -o idle_plant_sim
+ *   ./idle_plant_sim [trace.csv]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "idle_control.h"
+
+// Engine
+#define DISPLACEMENT_M3     0.0016f
+#define MANIFOLD_M3         0.0025f
+#define VOLUMETRIC_EFF      0.80f
+#define INERTIA_KGM2        0.15f
+#define TORQUE_PER_KG       71500.0f         // Torque per kg of air of each cycle: 44 MJ/kg / 14.7 AFR, 30% efficiency, over 4π rad (Nm)
+#define FRICTION_NM         20.0f
+#define FRICTION_PER_RPM    0.02f
+#define LOAD_STEP_NM        8.0f
+
+// Air
+#define ATMOSPHERE_PA       101325.0f
+#define AIR_R               287.0f
+#define AIR_T               300.0f
+#define DISCHARGE_COEFF     0.8f
+#define LEAK_AREA_M2        0.5e-5f          // Closed throttle
+#define IAC_AREA_M2         4.0e-5f          // IAC valve fully open
+#define IAC_LAG_S           0.030f
+
+// Simulation
+#define STEP_S              0.0001f
+#define TORQUE_DELAY        1400             // Steps between intake and torque (one cycle at 850 RPM)
+#define MAP_NOISE_KPA       0.3f
+
+// Firmware
+#define CONTROL_PERIOD_S    0.020f           // 50 Hz
+#define LEGACY_PERIOD_S     0.100f
+#define MAP_MIN_PRESSURE    20
+#define MAX_SAMPLES         4096
+#define IGNITIONS_PER_REV   2
+
+// Engine state
+typedef struct {
+    float mapPa;
+    float rpm;
+    float valve;                 // Opening the valve has reached (%)
+    float torque[TORQUE_DELAY];  // Torque of the cycles on their way
+    int torqueIndex;
+    float angle;                 // Crank angle since the last ignition (revolutions)
+    float measuredRpm;
+    float lastIgnition;
+    float load;                  // Nm
+} Engine;
+
+// Events of a scenario
+typedef struct {
+    float time;
+    float target;                // 0 keeps the target
+    float load;                  // <0 keeps the load
+} ScenarioEvent;
+
+// Result of one response
+typedef struct {
+    float overshoot;             // % of the step, or deviation of a disturbance in units
+    float settling;              // s
+    float finalError;            // units
+} Response;
+
+static FILE* trace = NULL;
+
+/**
+ * @brief Mass flow of air through an orifice from the atmosphere to the manifold
+ * @param area Effective area (m²)
+ * @param manifoldPa Manifold pressure
+ * @return Air flow (kg/s)
+ */
+static float OrificeFlow(float area, float manifoldPa)
+{
+    float ratio = manifoldPa / ATMOSPHERE_PA;
+    float psi = ratio < 0.5f ? 1.0f : 2.0f * sqrtf(ratio * (1.0f - ratio));
+
+    if (ratio >= 1.0f) {
+        return 0.0f;
+    }
+    return DISCHARGE_COEFF * area * ATMOSPHERE_PA / sqrtf(AIR_R * AIR_T) * 0.6847f * psi;
+}
+
+/**
+ * @brief Advances the engine one simulation step
+ * @param engine Engine state
+ * @param opening Opening commanded to the IAC valve (%)
+ */
+static void EngineStep(Engine* engine, float opening)
+{
+    float airIn;
+    float airOut;
+    float cycleAir;
+    float torque;
+
+    engine->valve += (opening - engine->valve) * STEP_S / IAC_LAG_S;
+    airIn = OrificeFlow(LEAK_AREA_M2 + IAC_AREA_M2 * engine->valve / 100.0f, engine->mapPa);
+
+    // Speed density: the cylinders take their volume at manifold pressure every two turns
+    cycleAir = VOLUMETRIC_EFF * DISPLACEMENT_M3 * engine->mapPa / (AIR_R * AIR_T);
+    airOut = cycleAir * engine->rpm / 120.0f;
+    engine->mapPa += (airIn - airOut) * AIR_R * AIR_T / MANIFOLD_M3 * STEP_S;
+
+    // The air taken now burns one cycle later
+    torque = engine->torque[engine->torqueIndex];
+    engine->torque[engine->torqueIndex] = TORQUE_PER_KG * cycleAir;
+    engine->torqueIndex = (engine->torqueIndex + 1) % TORQUE_DELAY;
+
+    torque -= FRICTION_NM + FRICTION_PER_RPM * engine->rpm + engine->load;
+    engine->rpm += torque / INERTIA_KGM2 * 60.0f / (2.0f * (float)M_PI) * STEP_S;
+    if (engine->rpm < 0.0f) {
+        engine->rpm = 0.0f;
+    }
+
+    // The RPM input measures the time between two ignitions
+    engine->angle += engine->rpm / 60.0f * STEP_S;
+    engine->lastIgnition += STEP_S;
+    if (engine->angle >= 1.0f / IGNITIONS_PER_REV) {
+        engine->angle -= 1.0f / IGNITIONS_PER_REV;
+        engine->measuredRpm = 60.0f / (engine->lastIgnition * IGNITIONS_PER_REV);
+        engine->lastIgnition = 0.0f;
+    }
+}
+
+/**
+ * @brief Engine at a steady idle with the given opening
+ * @param engine Engine state to fill
+ * @param opening Opening of the IAC valve (%)
+ */
+static void EngineSettle(Engine* engine, float opening)
+{
+    *engine = (Engine){ .mapPa = 35000.0f, .rpm = 850.0f, .valve = opening, .measuredRpm = 850.0f };
+    for (int i = 0; i < TORQUE_DELAY; i++) {
+        engine->torque[i] = TORQUE_PER_KG * VOLUMETRIC_EFF * DISPLACEMENT_M3 * engine->mapPa / (AIR_R * AIR_T);
+    }
+    for (int i = 0; i < (int)(10.0f / STEP_S); i++) {
+        EngineStep(engine, opening);
+    }
+}
+
+/**
+ * @brief Noisy MAP reading
+ * @param engine Engine state
+ * @return Manifold pressure (kPa)
+ */
+static float ReadMap(const Engine* engine)
+{
+    return engine->mapPa / 1000.0f + MAP_NOISE_KPA * (2.0f * (float)rand() / RAND_MAX - 1.0f);
+}
+
+/**
+ * @brief Opening of the three-band rule the controller replaced
+ * @param mapPressure Whole kPa, as the old reading returned it
+ * @return Opening (%)
+ */
+static float LegacyOpening(unsigned int mapPressure)
+{
+    if (mapPressure < MAP_MIN_PRESSURE) {
+        return 100.0f;
+    }
+    if (mapPressure < MAP_MIN_PRESSURE + 10) {
+        return (float)(uint8_t)(255 * (1 - (mapPressure - MAP_MIN_PRESSURE) / 10.0)) * 100.0f / 255.0f;
+    }
+    return 0.0f;
+}
+
+/**
+ * @brief Measures the response of a signal after a change
+ * @param samples Signal every control period from the change on
+ * @param count Number of samples
+ * @param before Value before the change
+ * @param target Value the signal should reach
+ * @param period Time between samples (s)
+ * @return Overshoot, settling time and final error
+ */
+static Response MeasureResponse(const float* samples, int count, float before, float target, float period)
+{
+    Response response = { 0.0f, 0.0f, 0.0f };
+    float step = target - before;
+    float band = 0.02f * fabsf(target);
+    float peak = 0.0f;
+    int tail = count / 5;
+    float average = 0.0f;
+
+    for (int i = 0; i < count; i++) {
+        float beyond = step >= 0.0f ? samples[i] - target : target - samples[i];
+        if (step == 0.0f) {
+            beyond = fabsf(samples[i] - target);
+        }
+        if (beyond > peak) {
+            peak = beyond;
+        }
+        if (fabsf(samples[i] - target) > band) {
+            response.settling = (i + 1) * period;
+        }
+    }
+    for (int i = count - tail; i < count; i++) {
+        average += samples[i];
+    }
+    response.overshoot = step != 0.0f ? 100.0f * peak / fabsf(step) : peak;
+    response.finalError = average / tail - target;
+    return response;
+}
+
+/**
+ * @brief Average and peak to peak of a signal over its last samples
+ * @param samples Signal
+ * @param count Number of samples
+ * @param average Filled with the average of the last fifth
+ * @return Largest minus smallest value of the last fifth
+ */
+static float Ripple(const float* samples, int count, float* average)
+{
+    float low = samples[count - 1];
+    float high = low;
+    float sum = 0.0f;
+
+    for (int i = count - count / 5; i < count; i++) {
+        low = fminf(low, samples[i]);
+        high = fmaxf(high, samples[i]);
+        sum += samples[i];
+    }
+    *average = sum / (count / 5);
+    return high - low;
+}
+
+/**
+ * @brief Runs one scenario and prints the response to each event
+ * @param name Scenario name
+ * @param input Measurement the controller holds
+ * @param gains Tuning of the controller, NULL for the three-band rule
+ * @param target Initial target
+ * @param events Target and load changes
+ * @param eventCount Number of events
+ * @param segment Time after each event that is measured (s)
+ */
+static void RunScenario(const char* name, IdleInput input, const IdleGains* gains, float target,
+                        const ScenarioEvent* events, int eventCount, float segment)
+{
+    static float samples[MAX_SAMPLES];
+    static float rpmSamples[MAX_SAMPLES];
+    IdleController controller;
+    Engine engine;
+    float period = gains != NULL ? CONTROL_PERIOD_S : LEGACY_PERIOD_S;
+    int stepsPerPeriod = (int)(period / STEP_S + 0.5f);
+    int count = (int)(segment / period);
+    float opening = gains != NULL ? gains->feedForward : 36.0f;
+    float rpm;
+    float rpmRipple;
+    float rpmLow;
+
+    if (count > MAX_SAMPLES) {
+        count = MAX_SAMPLES;
+    }
+    EngineSettle(&engine, opening);
+    if (gains != NULL) {
+        IdleControlInit(&controller, input, target, gains);
+    }
+
+    printf("%s\n", name);
+    for (int e = 0; e < eventCount; e++) {
+        float before = input == IDLE_INPUT_RPM ? engine.rpm : engine.mapPa / 1000.0f;
+        char label[24];
+
+        if (events[e].target > 0.0f) {
+            target = events[e].target;
+            if (gains != NULL) {
+                controller.target = target;
+            }
+            snprintf(label, sizeof(label), "target %.0f", target);
+        }
+        if (events[e].load >= 0.0f) {
+            engine.load = events[e].load;
+            snprintf(label, sizeof(label), "load %.0f Nm", engine.load);
+        }
+        if (e == 0) {
+            snprintf(label, sizeof(label), "start");
+        }
+
+        for (int p = 0; p < count; p++) {
+            float measured = input == IDLE_INPUT_RPM ? engine.measuredRpm : ReadMap(&engine);
+            if (gains != NULL) {
+                opening = IdleControlStep(&controller, measured, period);
+            } else {
+                opening = LegacyOpening((unsigned int)measured);
+            }
+            for (int s = 0; s < stepsPerPeriod; s++) {
+                EngineStep(&engine, opening);
+            }
+            samples[p] = input == IDLE_INPUT_RPM ? engine.rpm : engine.mapPa / 1000.0f;
+            rpmSamples[p] = engine.rpm;
+            if (trace != NULL) {
+                fprintf(trace, "%s,%.3f,%.1f,%.2f,%.2f,%.1f\n", name, events[e].time + (p + 1) * period,
+                        engine.rpm, engine.mapPa / 1000.0f, opening, engine.load);
+            }
+        }
+        rpmRipple = Ripple(rpmSamples, count, &rpm);
+        rpmLow = rpmSamples[0];
+        for (int p = 1; p < count; p++) {
+            rpmLow = fminf(rpmLow, rpmSamples[p]);
+        }
+
+        if (gains == NULL) {
+            float map;
+            float mapRipple = Ripple(samples, count, &map);
+            printf("  %-12s MAP %5.1f kPa, ripple %5.2f | RPM %6.1f, lowest %6.1f, ripple %6.1f\n", label, map,
+                   mapRipple, rpm, rpmLow, rpmRipple);
+            continue;
+        }
+
+        // A load step is a disturbance: its deviation from the target is printed in units instead of %
+        bool disturbance = events[e].target <= 0.0f || e == 0;
+        Response response = MeasureResponse(samples, count, disturbance ? target : before, target, period);
+        printf("  %-12s %s %6.1f%s | settling %5.2f s | error %6.2f | RPM %6.1f, lowest %6.1f, ripple %6.1f\n",
+               label, disturbance ? "deviation" : "overshoot", response.overshoot, disturbance ? "  " : " %",
+               response.settling, response.finalError, rpm, rpmLow, rpmRipple);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    static const ScenarioEvent RPM_EVENTS[] = {
+        { 0.0f, 850.0f, 0.0f },
+        { 6.0f, 1000.0f, -1.0f },
+        { 12.0f, 800.0f, -1.0f },
+        { 18.0f, 0.0f, LOAD_STEP_NM },
+        { 24.0f, 0.0f, 0.0f },
+    };
+    static const ScenarioEvent MAP_EVENTS[] = {
+        { 0.0f, 35.0f, 0.0f },
+        { 6.0f, 40.0f, -1.0f },
+        { 12.0f, 32.0f, -1.0f },
+        { 18.0f, 0.0f, LOAD_STEP_NM },
+        { 24.0f, 0.0f, 0.0f },
+    };
+    static const ScenarioEvent LEGACY_EVENTS[] = {
+        { 0.0f, 0.0f, 0.0f },
+        { 6.0f, 0.0f, LOAD_STEP_NM },
+    };
+
+    if (argc > 1) {
+        trace = fopen(argv[1], "w");
+        if (trace == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+        fprintf(trace, "scenario,time_s,rpm,map_kpa,opening_pct,load_nm\n");
+    }
+
+    // The firmware holds the RPM by default (USE_RPM_INPUT), MAP only without the ignition signal
+    srand(1);
+    RunScenario("PI+FF on RPM, 50 Hz (default)", IDLE_INPUT_RPM, &IDLE_GAINS_RPM, 850.0f, RPM_EVENTS,
+                sizeof(RPM_EVENTS) / sizeof(RPM_EVENTS[0]), 6.0f);
+    RunScenario("PI+FF on MAP, 50 Hz", IDLE_INPUT_MAP, &IDLE_GAINS_MAP, 35.0f, MAP_EVENTS,
+                sizeof(MAP_EVENTS) / sizeof(MAP_EVENTS[0]), 6.0f);
+    RunScenario("Three-band rule on MAP, 10 Hz (previous firmware)", IDLE_INPUT_MAP, NULL, 0.0f, LEGACY_EVENTS,
+                sizeof(LEGACY_EVENTS) / sizeof(LEGACY_EVENTS[0]), 6.0f);
+
+    if (trace != NULL) {
+        fclose(trace);
+    }
+    return 0;
+}
@@ -0,0 +1,488 @@
+/**
+ * @file map_sensor_check.c
+ * @brief Host check of the MAP acquisition with voltage traces
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Feeds voltage traces to the same map_sensor.c as the firmware, read by
+ * frames of 64 samples as MAPAcquisitionTask does, with the crank trigger
+ * checked after every frame. Every window is compared with a reference
+ * calculated in double precision from the same samples (within 0.02 kPa),
+ * and every pressure must be inside the clamping range.
+ *
+ * A trace is a CSV file with one ADC sample per line at 20 kHz:
+ *   time_us,millivolts,crank
+ * millivolts is the voltage at the ADC pin and crank is 1 on the samples
+ * where an ignition pulse arrived (the column may be left out). Traces
+ * captured with an oscilloscope or a logic analyzer can be exported to
+ * this format and passed as arguments.
+ *
+ * With no arguments it checks the transfer function on fixed points
+ * (rounding, voltages below the sensor range, clamping, divider) and
+ * generates synthetic traces: idle at 850 and 1200 RPM with intake
+ * pulsation and noise, a pressure step, a disconnected sensor and an
+ * engine that stops. On them it also checks that averaging over each
+ * engine cycle removes the pulsation, that the fixed windows of the
+ * fallback (one idle cycle long) remove most of it at idle, that a steady
+ * pressure is reported once and that a stopped engine still closes
+ * windows. --write DIR saves the synthetic traces as CSV.
+ *
+ * Build and run:
+ *   cc -O2 -I../main map_sensor_check.c ../main/map_sensor.c -lm -o map_sensor_check
+ *   ./map_sensor_check [--write DIR] [trace.csv ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "map_sensor.h"
+
+// Same acquisition as the firmware
+#define SAMPLE_FREQ_HZ      20000
+#define FRAME_SAMPLES       64
+#define WINDOW_MS           140
+#define CYCLE_TIMEOUT_MS    300
+#define PULSES_PER_REV      2
+#define REPORT_CHANGE       50
+
+#define MAX_SAMPLES         (SAMPLE_FREQ_HZ * 10)
+#define TOLERANCE_KPA       0.02
+
+// One voltage trace
+typedef struct {
+    const char* name;
+    uint32_t count;
+    uint32_t* millivolts;
+    uint8_t* crank;
+} Trace;
+
+// Windows produced by one replay
+typedef struct {
+    uint32_t windows;
+    uint32_t reports;
+    uint32_t timeouts;
+    int32_t low;                 // Lowest and highest window pressure after the first 200 ms
+    int32_t high;
+    double average;
+    uint32_t averaged;           // Windows in the average
+} ReplayResult;
+
+static uint32_t failures = 0;
+
+/**
+ * @brief Reports a failed check, only the first ones are printed
+ * @param trace Trace being checked
+ * @param message What is wrong
+ * @param value Value found (kPa)
+ */
+static void Fail(const char* trace, const char* message, double value)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s: %s (%.3f)\n", trace, message, value);
+    }
+}
+
+/**
+ * @brief Reference transfer function in double precision, clamped as the firmware
+ * @param transfer Transfer function
+ * @param millivolts Average ADC pin voltage
+ * @return Pressure (kPa)
+ */
+static double ReferencePressure(const MapTransfer* transfer, double millivolts)
+{
+    double sensorMv = millivolts * transfer->dividerPermille / 1000.0;
+    double pressure = transfer->lowKpa + (sensorMv - transfer->lowMv) * (transfer->highKpa - transfer->lowKpa) /
+                                         (double)(transfer->highMv - transfer->lowMv);
+
+    pressure = fmax(transfer->minKpa, fmin(transfer->maxKpa, pressure));
+    return pressure / MAP_KPA_SCALE;
+}
+
+/**
+ * @brief Checks a window against the reference and the clamping range
+ * @param trace Trace name
+ * @param sensor Sensor with the window just closed
+ * @param sum Sum of the millivolts of the window
+ * @param count Samples of the window
+ */
+static void CheckWindow(const char* trace, const MapSensor* sensor, double sum, uint32_t count)
+{
+    double expected = ReferencePressure(&sensor->transfer, sum / count);
+    double pressure = (double)sensor->pressure / MAP_KPA_SCALE;
+
+    if (fabs(pressure - expected) > TOLERANCE_KPA) {
+        Fail(trace, "window differs from the reference", pressure - expected);
+    }
+    if (sensor->pressure < sensor->transfer.minKpa || sensor->pressure > sensor->transfer.maxKpa) {
+        Fail(trace, "pressure outside the clamping range", pressure);
+    }
+}
+
+/**
+ * @brief Takes the window just closed: range after the first 200 ms and change report
+ * @param result Result of the replay
+ * @param sensor Sensor with the window just closed
+ * @param sample Sample where the window closed
+ * @param print true to print the reports
+ */
+static void TakeWindow(ReplayResult* result, MapSensor* sensor, uint32_t sample, bool print)
+{
+    int32_t pressure;
+
+    if (sample >= SAMPLE_FREQ_HZ / 5) {
+        result->low = sensor->pressure < result->low ? sensor->pressure : result->low;
+        result->high = sensor->pressure > result->high ? sensor->pressure : result->high;
+        result->average += sensor->pressure;
+        result->averaged++;
+    }
+    if (MapSensorChanged(sensor, &pressure)) {
+        result->reports++;
+        if (print) {
+            printf("  %8.1f ms  %7.2f kPa\n", sample * 1000.0 / SAMPLE_FREQ_HZ, (double)pressure / MAP_KPA_SCALE);
+        }
+    }
+}
+
+/**
+ * @brief Feeds a trace as the acquisition task does and checks every window
+ * @param trace Voltage trace
+ * @param cycleSync true to close the windows with the crank trigger
+ * @param print true to print the reports
+ * @return Windows, reports and pressure range
+ */
+static ReplayResult Replay(const Trace* trace, bool cycleSync, bool print)
+{
+    ReplayResult result = { 0, 0, 0, INT32_MAX, INT32_MIN, 0.0, 0 };
+    MapSensor sensor;
+    uint32_t pulses = 0;
+    uint32_t cyclePulses = 0;
+    double sum = 0.0;
+    uint32_t count = 0;
+
+    MapSensorInit(&sensor, &MAP_TRANSFER_DEFAULT,
+                  (cycleSync ? CYCLE_TIMEOUT_MS : WINDOW_MS) * (SAMPLE_FREQ_HZ / 1000), cycleSync, REPORT_CHANGE);
+
+    for (uint32_t frame = 0; frame < trace->count; frame += FRAME_SAMPLES) {
+        uint32_t end = frame + FRAME_SAMPLES < trace->count ? frame + FRAME_SAMPLES : trace->count;
+
+        for (uint32_t i = frame; i < end; i++) {
+            pulses += trace->crank[i];
+            sum += trace->millivolts[i];
+            count++;
+            if (MapSensorAddSample(&sensor, trace->millivolts[i])) {
+                CheckWindow(trace->name, &sensor, sum, count);
+                TakeWindow(&result, &sensor, i, print);
+                sum = 0.0;
+                count = 0;
+            }
+        }
+
+        // The crank trigger is checked after every frame, as the firmware does
+        if (cycleSync && pulses - cyclePulses >= 2 * PULSES_PER_REV) {
+            cyclePulses = pulses;
+            if (MapSensorCycle(&sensor)) {
+                CheckWindow(trace->name, &sensor, sum, count);
+                TakeWindow(&result, &sensor, end, print);
+                sum = 0.0;
+                count = 0;
+            }
+        }
+    }
+
+    result.windows = sensor.windows;
+    result.timeouts = sensor.timeouts;
+    if (result.averaged > 0) {
+        result.average /= (double)result.averaged * MAP_KPA_SCALE;
+    } else {
+        result.low = result.high = 0;
+    }
+    return result;
+}
+
+/**
+ * @brief Allocates an empty trace
+ * @param name Trace name
+ * @return Trace with room for MAX_SAMPLES
+ */
+static Trace NewTrace(const char* name)
+{
+    Trace trace = { name, 0, calloc(MAX_SAMPLES, sizeof(uint32_t)), calloc(MAX_SAMPLES, sizeof(uint8_t)) };
+
+    if (trace.millivolts == NULL || trace.crank == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    return trace;
+}
+
+/**
+ * @brief Reads a CSV trace
+ * @param path File name
+ * @param trace Filled with the samples
+ * @return false if the file cannot be read or has no samples
+ */
+static bool ReadTrace(const char* path, Trace* trace)
+{
+    FILE* file = fopen(path, "r");
+    char line[128];
+    double lastTime = -1.0;
+
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    *trace = NewTrace(path);
+    while (fgets(line, sizeof(line), file) != NULL && trace->count < MAX_SAMPLES) {
+        double time;
+        double millivolts;
+        int crank = 0;
+        if (sscanf(line, "%lf,%lf,%d", &time, &millivolts, &crank) < 2) {
+            continue;                                    // Header or comment
+        }
+        if (lastTime >= 0.0 && fabs(time - lastTime - 1e6 / SAMPLE_FREQ_HZ) > 1.0) {
+            printf("NOTE %s: samples are not %d us apart at %.0f us, the windows assume %d Hz\n", path,
+                   1000000 / SAMPLE_FREQ_HZ, time, SAMPLE_FREQ_HZ);
+            lastTime = -2.0;                             // Noted once
+        } else if (lastTime != -2.0) {
+            lastTime = time;
+        }
+        trace->millivolts[trace->count] = millivolts < 0.0 ? 0 : (uint32_t)(millivolts + 0.5);
+        trace->crank[trace->count] = crank != 0;
+        trace->count++;
+    }
+    fclose(file);
+    return trace->count > 0;
+}
+
+/**
+ * @brief Writes a trace as CSV
+ * @param trace Trace
+ * @param directory Output directory
+ */
+static void WriteTrace(const Trace* trace, const char* directory)
+{
+    char path[256];
+    FILE* file;
+
+    snprintf(path, sizeof(path), "%s/%s.csv", directory, trace->name);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(file, "time_us,millivolts,crank\n");
+    for (uint32_t i = 0; i < trace->count; i++) {
+        fprintf(file, "%u,%u,%u\n", i * (1000000 / SAMPLE_FREQ_HZ), trace->millivolts[i], trace->crank[i]);
+    }
+    fclose(file);
+}
+
+/**
+ * @brief Voltage of the default sensor for a pressure
+ * @param kpa Pressure
+ * @return Millivolts at the ADC pin (no divider)
+ */
+static double SensorMillivolts(double kpa)
+{
+    return 500.0 + (kpa - 10.0) * 4000.0 / 95.0;
+}
+
+/**
+ * @brief Synthetic idle trace: mean pressure, intake pulsation at the firing rate and ADC noise
+ * @param name Trace name
+ * @param rpm Engine speed, 0 for a stopped engine
+ * @param kpa Mean pressure before and after stepAt
+ * @param stepKpa Pressure after stepAt
+ * @param stepAt Sample of the pressure step
+ * @param seconds Duration
+ * @param stopAt Sample where the engine stops (no pulses), 0 to keep running
+ * @return Trace
+ */
+static Trace Synthetic(const char* name, double rpm, double kpa, double stepKpa, uint32_t stepAt, double seconds,
+                       uint32_t stopAt)
+{
+    Trace trace = NewTrace(name);
+    double angle = 0.17;                             // Crank angle in turns, not aligned with the first sample
+    double mean = kpa;
+
+    trace.count = (uint32_t)(seconds * SAMPLE_FREQ_HZ);
+    for (uint32_t i = 0; i < trace.count; i++) {
+        bool running = stopAt == 0 || i < stopAt;
+        double turns = running ? rpm / 60.0 / SAMPLE_FREQ_HZ : 0.0;
+        double previous = angle;
+
+        angle += turns;
+        if (i >= stepAt) {
+            // The manifold fills in about 50 ms
+            mean += (stepKpa - mean) / (0.05 * SAMPLE_FREQ_HZ);
+        }
+
+        // Two intake strokes per turn on a four cylinder, with a harmonic
+        double pulsation = running ? 3.0 * sin(4.0 * M_PI * angle) + 1.0 * sin(8.0 * M_PI * angle + 0.6) : 0.0;
+        double noise = 8.0 * ((double)rand() / RAND_MAX - 0.5);
+        double millivolts = SensorMillivolts(mean + pulsation) + noise;
+
+        trace.millivolts[i] = millivolts < 0.0 ? 0 : (uint32_t)(millivolts + 0.5);
+        trace.crank[i] = floor(angle * PULSES_PER_REV) != floor(previous * PULSES_PER_REV);
+    }
+    return trace;
+}
+
+/**
+ * @brief Checks the transfer function on fixed points
+ */
+static void CheckTransfer(void)
+{
+    static const struct {
+        uint32_t millivolts;
+        uint32_t dividerPermille;
+        int32_t expected;
+    } POINTS[] = {
+        { 500, 1000, 1000 },     // Low point
+        { 4500, 1000, 10500 },   // High point
+        { 2500, 1000, 5750 },    // Middle
+        { 501, 1000, 1002 },     // 2.375 rounded
+        { 300, 1000, 525 },      // Below the sensor range: under 10 kPa, not wrapped around
+        { 79, 1000, 0 },         // Clamped to 0
+        { 0, 1000, 0 },          // Disconnected
+        { 5000, 1000, 11688 },   // 116.875 rounded
+        { 6000, 1000, 12000 },   // Clamped to 120
+        { 2000, 1500, 6938 },    // Divider: 3 V at the sensor
+        { 3300, 1515, 11686 },   // Divider: top of the ADC, 4999.5 mV at the sensor
+    };
+    MapTransfer inverted = MAP_TRANSFER_DEFAULT;
+    MapTransfer transfer = MAP_TRANSFER_DEFAULT;
+
+    for (size_t i = 0; i < sizeof(POINTS) / sizeof(POINTS[0]); i++) {
+        transfer.dividerPermille = POINTS[i].dividerPermille;
+        int32_t pressure = MapSensorConvert(&transfer, POINTS[i].millivolts);
+        if (pressure != POINTS[i].expected) {
+            printf("FAIL transfer: %u mV (divider %u) gives %d, expected %d\n", POINTS[i].millivolts,
+                   POINTS[i].dividerPermille, pressure, POINTS[i].expected);
+            failures++;
+        }
+    }
+
+    // A sensor whose voltage falls with the pressure
+    inverted.lowMv = 4500;
+    inverted.highMv = 500;
+    if (MapSensorConvert(&inverted, 4500) != 1000 || MapSensorConvert(&inverted, 501) != 10498) {
+        printf("FAIL transfer: inverted sensor\n");
+        failures++;
+    }
+}
+
+/**
+ * @brief Replays a trace with both window modes and prints the result
+ * @param trace Trace
+ * @param cycle Filled with the result of the engine cycle windows
+ * @param fixed Filled with the result of the fixed windows
+ */
+static void ReplayBoth(const Trace* trace, ReplayResult* cycle, ReplayResult* fixed)
+{
+    *cycle = Replay(trace, true, false);
+    *fixed = Replay(trace, false, false);
+    printf("%-22s cycle: %4u windows, %3u reports, %3u timeouts, %6.2f-%6.2f kPa | "
+           "%u ms: %4u windows, %3u reports, %6.2f-%6.2f kPa\n", trace->name, cycle->windows, cycle->reports,
+           cycle->timeouts, (double)cycle->low / MAP_KPA_SCALE, (double)cycle->high / MAP_KPA_SCALE, WINDOW_MS, fixed->windows,
+           fixed->reports, (double)fixed->low / MAP_KPA_SCALE, (double)fixed->high / MAP_KPA_SCALE);
+}
+
+int main(int argc, char** argv)
+{
+    const char* directory = NULL;
+    int first = 1;
+    ReplayResult cycle;
+    ReplayResult fixed;
+
+    if (argc > 2 && strcmp(argv[1], "--write") == 0) {
+        directory = argv[2];
+        first = 3;
+    }
+
+    // Recorded traces: every window checked, reports printed
+    if (first < argc) {
+        for (int i = first; i < argc; i++) {
+            Trace trace;
+            if (!ReadTrace(argv[i], &trace)) {
+                failures++;
+                continue;
+            }
+            printf("%s: %u samples, reports with the crank trigger\n", trace.name, trace.count);
+            cycle = Replay(&trace, true, true);
+            printf("%s: reports with %u ms windows\n", trace.name, WINDOW_MS);
+            fixed = Replay(&trace, false, true);
+            printf("%s: %u + %u windows checked, %u timeouts\n", trace.name, cycle.windows, fixed.windows,
+                   cycle.timeouts);
+        }
+        printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+        return failures == 0 ? 0 : 1;
+    }
+
+    CheckTransfer();
+
+    srand(1);
+    Trace traces[] = {
+        Synthetic("idle_850rpm_35kpa", 850.0, 35.0, 35.0, UINT32_MAX, 3.0, 0),
+        Synthetic("idle_1200rpm_30kpa", 1200.0, 30.0, 30.0, UINT32_MAX, 3.0, 0),
+        Synthetic("step_35_to_45kpa", 850.0, 35.0, 45.0, SAMPLE_FREQ_HZ, 3.0, 0),
+        Synthetic("engine_stops", 850.0, 35.0, 101.0, SAMPLE_FREQ_HZ, 3.0, SAMPLE_FREQ_HZ),
+    };
+    Trace disconnected = NewTrace("disconnected");
+    disconnected.count = SAMPLE_FREQ_HZ;
+
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+        ReplayBoth(&traces[i], &cycle, &fixed);
+        if (directory != NULL) {
+            WriteTrace(&traces[i], directory);
+        }
+
+        if (i < 2) {
+            double expected = i == 0 ? 35.0 : 30.0;
+            // The cycle average removes the pulsation, the fixed windows only when they match a cycle
+            if (fabs(cycle.average - expected) > 0.1) {
+                Fail(traces[i].name, "average away from the mean pressure", cycle.average);
+            }
+            if (cycle.high - cycle.low > 40) {
+                Fail(traces[i].name, "pulsation left in the cycle windows", (double)(cycle.high - cycle.low) / MAP_KPA_SCALE);
+            }
+            if (fixed.high - fixed.low <= cycle.high - cycle.low) {
+                Fail(traces[i].name, "fixed windows smoother than the cycle windows", 0.0);
+            }
+            if (i == 0 && fixed.high - fixed.low > 50) {
+                Fail(traces[i].name, "pulsation left in the fixed windows at idle", (double)(fixed.high - fixed.low) / MAP_KPA_SCALE);
+            }
+            // A steady pressure is reported once
+            if (cycle.reports != 1) {
+                Fail(traces[i].name, "steady pressure reported more than once", cycle.reports);
+            }
+            if (cycle.timeouts != 0) {
+                Fail(traces[i].name, "running engine closed windows by timeout", cycle.timeouts);
+            }
+        } else if (i == 2) {
+            if (fabs((double)cycle.high / MAP_KPA_SCALE - 45.0) > 0.1 || cycle.reports < 2) {
+                Fail(traces[i].name, "step not reported", (double)cycle.high / MAP_KPA_SCALE);
+            }
+        } else {
+            // The stopped engine still updates the pressure, every CYCLE_TIMEOUT_MS
+            if (cycle.timeouts < (2000 / CYCLE_TIMEOUT_MS) - 1 || fabs((double)cycle.high / MAP_KPA_SCALE - 101.0) > 1.0) {
+                Fail(traces[i].name, "stopped engine not followed", cycle.timeouts);
+            }
+        }
+    }
+
+    ReplayBoth(&disconnected, &cycle, &fixed);
+    if (fixed.high != 0 || fixed.reports != 1) {
+        Fail(disconnected.name, "disconnected sensor not reported as 0 kPa", (double)fixed.high / MAP_KPA_SCALE);
+    }
+
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file drive_profile.c
+ * @brief Saturated and peak-and-hold drive of the injector outputs
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Low impedance injectors need a high current to open and only a fraction
+ * of it to stay open. The opening edge of a peak-and-hold channel turns
+ * the output fully on, and the end of the peak is one more edge in the
+ * schedule, in the same absolute time as the opening and closing edges,
+ * that switches the output to the hold PWM. A pulse shorter than the peak
+ * closes without ever reaching the hold.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "drive_profile.h"
+
+const DriveProfile DRIVE_PROFILES[] = {
+    { "saturated", 0, 1000, 0 },                 // High impedance injectors (12-16 Ω)
+    { "peakhold", 1000, 250, 20000 },            // Low impedance injectors (2-3 Ω), 4 A peak and 1 A hold
+};
+
+const uint8_t DRIVE_PROFILE_COUNT = sizeof(DRIVE_PROFILES) / sizeof(DRIVE_PROFILES[0]);
+
+void DriveEngineInit(DriveEngine* engine, const DriveProfile* profile)
+{
+    memset(engine, 0, sizeof(*engine));
+    for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+        engine->profiles[i] = profile;
+    }
+}
+
+void DriveEngineReset(DriveEngine* engine)
+{
+    engine->holdPending = 0;
+    engine->baseValid = false;
+}
+
+void DriveEngineSetProfile(DriveEngine* engine, uint8_t channel, const DriveProfile* profile)
+{
+    if (channel < INJECTOR_MAX_OUTPUTS) {
+        engine->profiles[channel] = profile;
+    }
+}
+
+bool DriveEngineNext(DriveEngine* engine, DriveEdgeSource source, void* context, DriveEdge* edge)
+{
+    int hold = -1;
+
+    if (!engine->baseValid) {
+        engine->baseValid = source(context, &engine->base);
+    }
+
+    for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+        if ((engine->holdPending & (1u << i)) &&
+            (hold < 0 || engine->holdTime[i] < engine->holdTime[hold])) {
+            hold = i;
+        }
+    }
+
+    // A closing at the same time as the end of the peak wins, the output never reaches the hold
+    if (hold >= 0 && (!engine->baseValid || engine->holdTime[hold] < engine->base.time)) {
+        edge->time = engine->holdTime[hold];
+        edge->channel = (uint8_t)hold;
+        edge->level = DRIVE_HOLD;
+        engine->holdPending &= (uint8_t)~(1u << hold);
+        return true;
+    }
+    if (!engine->baseValid) {
+        return false;
+    }
+
+    const InjectorEdge* base = &engine->base;
+    edge->time = base->time;
+    edge->channel = base->injector;
+    if (base->level) {
+        const DriveProfile* profile = engine->profiles[base->injector];
+        edge->level = DRIVE_FULL;
+        if (profile->peakUs > 0) {
+            engine->holdTime[base->injector] = base->time + profile->peakUs;
+            engine->holdPending |= (uint8_t)(1u << base->injector);
+        }
+    } else {
+        edge->level = DRIVE_OFF;
+        engine->holdPending &= (uint8_t)~(1u << base->injector);
+    }
+    engine->baseValid = false;
+    return true;
+}
+
+const DriveProfile* DriveProfileFromName(const char* name)
+{
+    for (int i = 0; i < DRIVE_PROFILE_COUNT; i++) {
+        if (strcasecmp(DRIVE_PROFILES[i].name, name) == 0) {
+            return &DRIVE_PROFILES[i];
+        }
+    }
+    return NULL;
+}
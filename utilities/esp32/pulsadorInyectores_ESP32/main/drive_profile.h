@@ -0,0 +1,75 @@
+/**
+ * @file drive_profile.h
+ * @brief Saturated and peak-and-hold drive of the injector outputs
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef DRIVE_PROFILE_H
+#define DRIVE_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "injector_schedule.h"
+
+// State of an injector output
+typedef enum {
+    DRIVE_OFF,                   // Injector closed
+    DRIVE_FULL,                  // Output fully on (peak, or the whole pulse of a saturated injector)
+    DRIVE_HOLD                   // Output switching at the hold duty and frequency
+} DriveLevel;
+
+// How an injector is driven during its pulse
+typedef struct {
+    const char* name;
+    uint32_t peakUs;             // Full-on time at the start of the pulse, 0 drives the whole pulse full-on
+    uint16_t holdDuty;           // Duty for the rest of the pulse (‰)
+    uint32_t holdFrequencyHz;
+} DriveProfile;
+
+// One change of an injector output
+typedef struct {
+    uint64_t time;               // Timer time of the change (μs)
+    uint8_t channel;
+    DriveLevel level;
+} DriveEdge;
+
+// Source of the open and close edges (engine sequence or test program)
+typedef bool (*DriveEdgeSource)(void* context, InjectorEdge* edge);
+
+// Profile of every channel and the peak ends still to come
+typedef struct {
+    const DriveProfile* profiles[INJECTOR_MAX_OUTPUTS];
+    uint64_t holdTime[INJECTOR_MAX_OUTPUTS];             // End of the peak of every channel in holdPending
+    uint8_t holdPending;         // Channels whose peak has not ended yet (bit per channel)
+    InjectorEdge base;           // Next edge of the source, already read
+    bool baseValid;
+} DriveEngine;
+
+// Predefined profiles
+extern const DriveProfile DRIVE_PROFILES[];
+extern const uint8_t DRIVE_PROFILE_COUNT;
+
+// Every channel starts with the given profile and no pending edge
+void DriveEngineInit(DriveEngine* engine, const DriveProfile* profile);
+
+// Drops the pending edges, the profiles are kept
+void DriveEngineReset(DriveEngine* engine);
+
+// Selects the profile of one channel, used from its next opening
+void DriveEngineSetProfile(DriveEngine* engine, uint8_t channel, const DriveProfile* profile);
+
+// Next output change: the source edges plus the end of every peak
+// Returns false when the source has no more edges
+bool DriveEngineNext(DriveEngine* engine, DriveEdgeSource source, void* context, DriveEdge* edge);
+
+// Finds a predefined profile by name, NULL if not found
+const DriveProfile* DriveProfileFromName(const char* name);
+
+#endif // DRIVE_PROFILE_H
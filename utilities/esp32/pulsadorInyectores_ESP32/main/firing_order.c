@@ -0,0 +1,170 @@
+/**
+ * @file firing_order.c
+ * @brief Firing orders and injection phasing of the injector pulser
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The cylinders of an even firing engine fire every 720 / N degrees in
+ * firing order. Sequential injection opens each injector at the firing
+ * angle of its cylinder, batch injection opens the first half of the
+ * firing order together and the second half 360° later, and simultaneous
+ * injection opens every injector on every turn of the crankshaft. The
+ * events are calculated once when the engine or the mode changes; the
+ * interrupt only walks through them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "firing_order.h"
+
+const EngineLayout ENGINE_LAYOUTS[] = {
+    { "Inline 4", 4, { 1, 3, 4, 2 } },                   // Common in many inline 4-cylinder engines
+    { "Inline 4", 4, { 1, 2, 4, 3 } },                   // Some European engines
+    { "Inline 4", 4, { 1, 3, 2, 4 } },                   // Some Japanese engines
+    { "Inline 3", 3, { 1, 2, 3 } },
+    { "Inline 5", 5, { 1, 2, 4, 5, 3 } },                // Audi, Volvo
+    { "Inline 6", 6, { 1, 5, 3, 6, 2, 4 } },
+    { "V6", 6, { 1, 2, 3, 4, 5, 6 } },                   // GM 60°, Nissan VQ
+    { "V6", 6, { 1, 4, 2, 5, 3, 6 } },                   // Ford Cologne
+    { "V8", 8, { 1, 8, 4, 3, 6, 5, 7, 2 } },             // GM small block
+    { "V8", 8, { 1, 5, 4, 2, 6, 3, 7, 8 } },             // Ford 302
+    { "V8", 8, { 1, 3, 7, 2, 6, 5, 4, 8 } },             // Ford 5.0 HO and modular
+};
+
+const uint8_t ENGINE_LAYOUT_COUNT = sizeof(ENGINE_LAYOUTS) / sizeof(ENGINE_LAYOUTS[0]);
+
+static const char* const MODE_NAMES[INJECTION_MODE_COUNT] = { "sequential", "batch", "simultaneous" };
+
+/**
+ * Checks that an order names every cylinder exactly once and has at least two cylinders
+ *
+ * @param layout Engine to check
+ * @return true if the order is valid
+ */
+static bool OrderValid(const EngineLayout* layout)
+{
+    uint8_t seen = 0;
+
+    if (layout->cylinders < FIRING_MIN_CYLINDERS || layout->cylinders > FIRING_MAX_CYLINDERS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < layout->cylinders; i++) {
+        uint8_t cylinder = layout->order[i];
+        if (cylinder < 1 || cylinder > layout->cylinders || (seen & (1u << (cylinder - 1)))) {
+            return false;
+        }
+        seen |= (uint8_t)(1u << (cylinder - 1));
+    }
+    return true;
+}
+
+bool FiringScheduleBuild(FiringSchedule* schedule, const EngineLayout* layout, InjectionMode mode)
+{
+    uint8_t n = layout->cylinders;
+
+    if (!OrderValid(layout) || mode >= INJECTION_MODE_COUNT) {
+        return false;
+    }
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->cylinders = n;
+
+    switch (mode) {
+        case INJECTION_SEQUENTIAL:
+            for (uint8_t i = 0; i < n; i++) {
+                schedule->events[i].angle = (uint16_t)(FIRING_CYCLE_DEGREES * i / n);
+                schedule->events[i].mask = (uint8_t)(1u << (layout->order[i] - 1));
+            }
+            schedule->count = n;
+            break;
+
+        case INJECTION_BATCH:
+            // With an odd number of cylinders the first half gets the extra one
+            for (uint8_t i = 0; i < n; i++) {
+                uint8_t group = i < (n + 1) / 2 ? 0 : 1;
+                schedule->events[group].mask |= (uint8_t)(1u << (layout->order[i] - 1));
+            }
+            schedule->events[1].angle = FIRING_CYCLE_DEGREES / 2;
+            schedule->count = 2;
+            break;
+
+        default:
+            schedule->events[0].mask = (uint8_t)((1u << n) - 1);
+            schedule->events[1].angle = FIRING_CYCLE_DEGREES / 2;
+            schedule->events[1].mask = schedule->events[0].mask;
+            schedule->count = 2;
+            break;
+    }
+
+    // An event with no injector would have nothing to open, the interrupt never sees one
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < schedule->count; i++) {
+        if (schedule->events[i].mask != 0) {
+            schedule->events[kept++] = schedule->events[i];
+        }
+    }
+    for (uint8_t i = kept; i < schedule->count; i++) {
+        schedule->events[i] = (FiringEvent){ 0, 0 };
+    }
+    schedule->count = kept;
+    return kept > 0;
+}
+
+bool FiringOrderParse(const char* text, EngineLayout* layout)
+{
+    EngineLayout parsed = { .name = "Custom" };
+    const char* p = text;
+
+    while (*p != '\0') {
+        char* end;
+        long cylinder = strtol(p, &end, 10);
+        if (end == p || parsed.cylinders >= FIRING_MAX_CYLINDERS || cylinder < 1 || cylinder > FIRING_MAX_CYLINDERS) {
+            return false;
+        }
+        parsed.order[parsed.cylinders++] = (uint8_t)cylinder;
+        p = end;
+        if (*p == '-' && p[1] != '\0') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+
+    if (!OrderValid(&parsed)) {
+        return false;
+    }
+    *layout = parsed;
+    return true;
+}
+
+void FiringOrderFormat(const EngineLayout* layout, char* text, uint8_t size)
+{
+    int length = 0;
+
+    text[0] = '\0';
+    for (uint8_t i = 0; i < layout->cylinders && length < size; i++) {
+        length += snprintf(text + length, size - length, i == 0 ? "%u" : "-%u", layout->order[i]);
+    }
+}
+
+const char* InjectionModeName(InjectionMode mode)
+{
+    return mode < INJECTION_MODE_COUNT ? MODE_NAMES[mode] : "unknown";
+}
+
+InjectionMode InjectionModeFromName(const char* name)
+{
+    for (int i = 0; i < INJECTION_MODE_COUNT; i++) {
+        if (strcasecmp(MODE_NAMES[i], name) == 0) {
+            return (InjectionMode)i;
+        }
+    }
+    return INJECTION_MODE_COUNT;
+}
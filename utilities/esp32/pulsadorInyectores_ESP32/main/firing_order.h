@@ -0,0 +1,80 @@
+/**
+ * @file firing_order.h
+ * @brief Firing orders and injection phasing of the injector pulser
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef FIRING_ORDER_H
+#define FIRING_ORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest engine
+#define FIRING_MAX_CYLINDERS    8
+
+// Smallest engine, batch injection needs a cylinder in each half of the cycle
+#define FIRING_MIN_CYLINDERS    2
+
+// Injection events of one cycle (sequential injection of the largest engine)
+#define FIRING_MAX_EVENTS       FIRING_MAX_CYLINDERS
+
+// Degrees of one engine cycle, two turns of the crankshaft
+#define FIRING_CYCLE_DEGREES    720
+
+// How the injectors are grouped
+typedef enum {
+    INJECTION_SEQUENTIAL,        // One injector per cylinder, in firing order
+    INJECTION_BATCH,             // Two halves of the firing order, 360° apart
+    INJECTION_SIMULTANEOUS,      // Every injector at once, every turn of the crankshaft
+    INJECTION_MODE_COUNT
+} InjectionMode;
+
+// Engine with evenly spaced firing
+typedef struct {
+    const char* name;
+    uint8_t cylinders;
+    uint8_t order[FIRING_MAX_CYLINDERS];                 // Cylinder numbers from 1
+} EngineLayout;
+
+// Injectors opened together at one angle of the cycle
+typedef struct {
+    uint16_t angle;              // Degrees from the start of the cycle (0-719)
+    uint8_t mask;                // Injectors opened (bit 0 is the injector of cylinder 1)
+} FiringEvent;
+
+// Events of one cycle, sorted by angle
+typedef struct {
+    FiringEvent events[FIRING_MAX_EVENTS];
+    uint8_t count;
+    uint8_t cylinders;
+} FiringSchedule;
+
+// Common engines
+extern const EngineLayout ENGINE_LAYOUTS[];
+extern const uint8_t ENGINE_LAYOUT_COUNT;
+
+// Builds the events of one cycle, returns false if the order is not valid
+bool FiringScheduleBuild(FiringSchedule* schedule, const EngineLayout* layout, InjectionMode mode);
+
+// Reads an order such as "1-5-3-6-2-4", every cylinder exactly once, at least two cylinders
+// Returns false if the text is not a valid order
+bool FiringOrderParse(const char* text, EngineLayout* layout);
+
+// Writes an order as "1-3-4-2"
+void FiringOrderFormat(const EngineLayout* layout, char* text, uint8_t size);
+
+// Returns "sequential", "batch" or "simultaneous"
+const char* InjectionModeName(InjectionMode mode);
+
+// Finds a mode by name, returns INJECTION_MODE_COUNT if not found
+InjectionMode InjectionModeFromName(const char* name);
+
+#endif // FIRING_ORDER_H
@@ -0,0 +1,158 @@
+/**
+ * @file injector_schedule.c
+ * @brief Open and close edges of the sequential injector pulser
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Every edge is calculated from the start of its cycle in absolute timer
+ * time, so the pulse widths and spacings never accumulate the latency of
+ * the interrupt that applies them. The event times of a cycle come from
+ * the firing schedule and are worked out once per timing, not in the
+ * interrupt. Each injector keeps its own closing time, which lets a pulse
+ * run past the next event when the width is longer than the gap to it. A
+ * new timing is only taken at the start of a cycle, so the cylinders of
+ * one cycle always get the same fuel.
+ */
+
+#include <string.h>
+#include "injector_schedule.h"
+
+/**
+ * Calculates the event times of a timing and limits its pulse to what the cycle allows
+ *
+ * @param cycle Cycle to fill
+ * @param timing Requested timing
+ */
+static void PrepareCycle(InjectorCycle* cycle, const InjectorTiming* timing)
+{
+    const FiringSchedule* firing = timing->firing;
+    uint32_t maxPulse = InjectorScheduleMaxPulse(timing);
+
+    memset(cycle, 0, sizeof(*cycle));
+    cycle->cycleUs = timing->cycleUs;
+    cycle->pulseUs = timing->pulseUs < maxPulse ? timing->pulseUs : maxPulse;
+    cycle->count = 0;
+    for (uint8_t i = 0; i < firing->count; i++) {
+        // Only injectors that exist, an event left with none is dropped
+        uint8_t mask = (uint8_t)(firing->events[i].mask & ((1u << INJECTOR_MAX_OUTPUTS) - 1));
+        if (mask == 0) {
+            continue;
+        }
+        cycle->offsetUs[cycle->count] = (uint32_t)((uint64_t)timing->cycleUs * firing->events[i].angle / FIRING_CYCLE_DEGREES);
+        cycle->mask[cycle->count] = mask;
+        cycle->count++;
+    }
+}
+
+void InjectorScheduleInit(InjectorSchedule* schedule, const InjectorTiming* timing, uint64_t start)
+{
+    memset(schedule, 0, sizeof(*schedule));
+    PrepareCycle(&schedule->active, timing);
+    schedule->cycleStart = start;
+    schedule->eventMask = schedule->active.mask[0];
+}
+
+void InjectorScheduleUpdate(InjectorSchedule* schedule, const InjectorTiming* timing)
+{
+    PrepareCycle(&schedule->pending, timing);
+    schedule->pendingValid = true;
+}
+
+InjectorEdge InjectorScheduleNext(InjectorSchedule* schedule)
+{
+    InjectorEdge edge;
+    int closing = -1;
+
+    // The last gap of a cycle already belongs to it, a new timing starts with the first event
+    // The first event is always at 0°, so the swap does not move the next opening
+    if (schedule->pendingValid && schedule->position == 0 && schedule->eventMask == schedule->active.mask[0]) {
+        schedule->active = schedule->pending;
+        schedule->pendingValid = false;
+        schedule->eventMask = schedule->active.mask[0];
+    }
+
+    const InjectorCycle* cycle = &schedule->active;
+    uint64_t nextOpen = schedule->cycleStart + cycle->offsetUs[schedule->position];
+
+    for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+        if ((schedule->openMask & (1u << i)) &&
+            (closing < 0 || schedule->closeTime[i] < schedule->closeTime[closing])) {
+            closing = i;
+        }
+    }
+
+    // The injectors of one event open at the same time, one edge each, lowest first
+    // The scan stops at the last output, a cycle without events has nothing to open
+    uint8_t injector = 0;
+    while (injector < INJECTOR_MAX_OUTPUTS && !(schedule->eventMask & (1u << injector))) {
+        injector++;
+    }
+
+    if (closing >= 0 && (schedule->closeTime[closing] <= nextOpen || injector >= INJECTOR_MAX_OUTPUTS)) {
+        edge.time = schedule->closeTime[closing];
+        edge.injector = (uint8_t)closing;
+        edge.level = 0;
+        schedule->openMask &= (uint8_t)~(1u << closing);
+        return edge;
+    }
+
+    if (injector >= INJECTOR_MAX_OUTPUTS) {
+        // Every injector is closed: an idle close edge one cycle later, where a new timing can start
+        edge.time = schedule->cycleStart + cycle->cycleUs;
+        edge.injector = 0;
+        edge.level = 0;
+        schedule->position = 0;
+        schedule->cycleStart += cycle->cycleUs;
+        schedule->cycles++;
+        schedule->eventMask = cycle->mask[0];
+        return edge;
+    }
+    schedule->eventMask &= (uint8_t)~(1u << injector);
+
+    // An injector still open when a new timing reaches it (shorter cycle, other order) gets its pulse extended
+    edge.time = nextOpen;
+    edge.injector = injector;
+    edge.level = 1;
+    schedule->closeTime[injector] = nextOpen + cycle->pulseUs;
+    schedule->openMask |= (uint8_t)(1u << injector);
+
+    if (schedule->eventMask == 0) {
+        if (++schedule->position >= cycle->count) {
+            schedule->position = 0;
+            schedule->cycleStart += cycle->cycleUs;
+            schedule->cycles++;
+        }
+        schedule->eventMask = cycle->mask[schedule->position];
+    }
+    return edge;
+}
+
+uint32_t InjectorScheduleMaxPulse(const InjectorTiming* timing)
+{
+    const FiringSchedule* firing = timing->firing;
+    uint32_t shortest = timing->cycleUs;
+
+    // Shortest time between two openings of the same injector, wrapping into the next cycle
+    // The event times are rounded the same way as in the schedule
+    for (uint8_t i = 0; i < firing->count; i++) {
+        for (uint8_t j = 1; j <= firing->count; j++) {
+            const FiringEvent* next = &firing->events[(i + j) % firing->count];
+            if (firing->events[i].mask & next->mask) {
+                uint32_t from = (uint32_t)((uint64_t)timing->cycleUs * firing->events[i].angle / FIRING_CYCLE_DEGREES);
+                uint32_t to = (uint32_t)((uint64_t)timing->cycleUs * next->angle / FIRING_CYCLE_DEGREES);
+                uint32_t gap = to > from ? to - from : to + timing->cycleUs - from;
+                if (gap < shortest) {
+                    shortest = gap;
+                }
+                break;
+            }
+        }
+    }
+    return shortest > INJECTOR_MIN_OFF_US ? shortest - INJECTOR_MIN_OFF_US : 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file injector_schedule.h
+ * @brief Open and close edges of the sequential injector pulser
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef INJECTOR_SCHEDULE_H
+#define INJECTOR_SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "firing_order.h"
+
+// Largest number of injector outputs
+#define INJECTOR_MAX_OUTPUTS    FIRING_MAX_CYLINDERS
+
+// Shortest time an injector stays closed between two of its pulses (μs)
+#define INJECTOR_MIN_OFF_US     500
+
+// Pulse width, cycle time and injection events requested for the engine
+typedef struct {
+    uint32_t pulseUs;            // Time each injector stays open
+    uint32_t cycleUs;            // One engine cycle, two turns of the crankshaft
+    const FiringSchedule* firing;
+} InjectorTiming;
+
+// Timing of one cycle with the event times already calculated
+// The events are copied, the firing schedule may change once it has been passed
+typedef struct {
+    uint32_t pulseUs;
+    uint32_t cycleUs;
+    uint32_t offsetUs[FIRING_MAX_EVENTS];                // Time of every event from the start of the cycle
+    uint8_t mask[FIRING_MAX_EVENTS];                     // Injectors opened by every event
+    uint8_t count;
+} InjectorCycle;
+
+// One change of an injector output
+typedef struct {
+    uint64_t time;               // Timer time of the change (μs)
+    uint8_t injector;
+    uint8_t level;               // 1 opens the injector, 0 closes it
+} InjectorEdge;
+
+// Schedule state, the timing of the running cycle never changes halfway
+typedef struct {
+    InjectorCycle active;
+    InjectorCycle pending;
+    bool pendingValid;           // pending replaces active at the next cycle boundary
+    uint64_t cycleStart;         // Start time of the running cycle
+    uint8_t position;            // Event of the next opening
+    uint8_t eventMask;           // Injectors of that event still to open
+    uint64_t closeTime[INJECTOR_MAX_OUTPUTS];            // Closing time of every open injector
+    uint8_t openMask;            // Injectors open right now (bit per injector)
+    uint32_t cycles;             // Cycles completed
+} InjectorSchedule;
+
+// Starts the first cycle at the given time with every injector closed
+void InjectorScheduleInit(InjectorSchedule* schedule, const InjectorTiming* timing, uint64_t start);
+
+// Requests a new timing, the running cycle finishes with the old one
+void InjectorScheduleUpdate(InjectorSchedule* schedule, const InjectorTiming* timing);
+
+// Removes and returns the earliest pending edge, closings first when two coincide
+InjectorEdge InjectorScheduleNext(InjectorSchedule* schedule);
+
+// Longest pulse that leaves every injector closed INJECTOR_MIN_OFF_US between two of its openings (μs)
+uint32_t InjectorScheduleMaxPulse(const InjectorTiming* timing);
+
+#endif // INJECTOR_SCHEDULE_H
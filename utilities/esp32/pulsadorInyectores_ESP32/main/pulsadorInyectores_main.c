@@ -10,18 +10,41 @@
  * @author AutomotiveGuide_es
  * @date April 2025
  *
- * This program simulates pulse signals for 4 fuel injectors
- * using different firing orders common in 4-cylinder engines.
+ * This program simulates pulse signals for up to 8 fuel injectors
+ * using the firing orders of common 3 to 8 cylinder engines, with
+ * sequential, batch or simultaneous injection.
  * 
  * The pulse speed is controlled by a potentiometer connected
  * to an analog input, simulating the throttle position.
  * 
  * The program leverages specific features of the ESP32 such as higher 
  * resolution ADC and configurable PWM for more precise control.
+ *
+ * The injector edges are generated by a hardware timer alarm, not by the
+ * task: the interrupt applies every open and close edge at its exact time
+ * and programs the alarm for the next one, so widths and spacings have
+ * microsecond resolution instead of the FreeRTOS tick.
+ *
+ * Cleaning and flow matching programs loaded over the serial port use the
+ * same interrupt. While a program runs nothing is written to the UART;
+ * the pulses and on-time of every channel are reported when it finishes.
+ *
+ * Each injector output is an MCPWM generator, so every channel can drive a
+ * high impedance injector fully on or a low impedance one with a
+ * peak-and-hold waveform, selected at runtime.
+ *
+ * The injection events of one cycle are calculated from the firing order
+ * and the injection mode whenever either changes; the interrupt only
+ * converts their angles to times of the current cycle.
+ *
+ * The interrupt never writes to the UART: it only counts the pulses and
+ * measures the period and width of every injector, and a low priority
+ * task prints a summary at the rate selected with the 'status' command.
  */
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -30,6 +53,16 @@
 #include "esp_log.h"
 #include "esp_adc_cal.h"
 #include "driver/uart.h"
+#include "driver/timer.h"
+#include "driver/mcpwm.h"
+#include "hal/mcpwm_ll.h"
+#include "soc/mcpwm_struct.h"
+#include "esp_timer.h"
+#include "injector_schedule.h"
+#include "test_program.h"
+#include "drive_profile.h"
+#include "firing_order.h"
+#include "status_report.h"
 
 // Tag for log messages
 static const char *TAG = "INJECTOR_PULSER";
@@ -39,16 +72,36 @@ static const char *TAG = "INJECTOR_PULSER";
 #define PIN_INJECTOR_2    GPIO_NUM_17    // Pin for Injector #2
 #define PIN_INJECTOR_3    GPIO_NUM_18    // Pin for Injector #3
 #define PIN_INJECTOR_4    GPIO_NUM_19    // Pin for Injector #4
+#define PIN_INJECTOR_5    GPIO_NUM_21    // Pin for Injector #5
+#define PIN_INJECTOR_6    GPIO_NUM_22    // Pin for Injector #6
+#define PIN_INJECTOR_7    GPIO_NUM_23    // Pin for Injector #7
+#define PIN_INJECTOR_8    GPIO_NUM_25    // Pin for Injector #8
 #define PIN_THROTTLE      ADC1_CHANNEL_6 // ADC1 channel 6 (GPIO34)
-#define PIN_ORDER_BUTTON  GPIO_NUM_5     // Button to change firing order
+#define PIN_ORDER_BUTTON  GPIO_NUM_5     // Button to change the engine and firing order
 #define PIN_STATUS_LED    GPIO_NUM_2     // Status indicator LED
 
 // SYSTEM PARAMETERS
 #define MIN_PULSE_TIME    2     // Minimum pulse time in ms (throttle at minimum)
 #define MAX_PULSE_TIME    15    // Maximum pulse time in ms (throttle at maximum)
-#define MIN_CYCLE_TIME    20    // Minimum time between cycles in ms (maximum RPM)
-#define MAX_CYCLE_TIME    200   // Maximum time between cycles in ms (minimum RPM)
+#define MIN_CYCLE_TIME    20    // Minimum engine cycle (720°) in ms (6000 RPM)
+#define MAX_CYCLE_TIME    800   // Maximum engine cycle (720°) in ms (150 RPM)
 #define ADC_RESOLUTION    4095  // ESP32 ADC resolution (12 bits = 4095)
+#define INJECTOR_COUNT    8     // Injector outputs
+#define STATUS_INTERVAL   1000  // Initial time between status summaries in ms
+
+// EDGE TIMER (1 μs per count)
+#define EDGE_TIMER_GROUP  TIMER_GROUP_0
+#define EDGE_TIMER        TIMER_0
+#define EDGE_TIMER_DIVIDER (TIMER_BASE_CLK / 1000000)
+#define EDGE_START_DELAY  1000  // Time from start to the first edge in μs
+#define EDGE_MERGE_US     2     // Edges closer than this are applied in the same interrupt
+
+// What drives the injectors
+typedef enum {
+    MODE_ENGINE,                         // Firing order sequence from the potentiometer
+    MODE_PROGRAM,                        // Test program loaded over the serial port
+    MODE_STOPPED                         // Every injector closed
+} PulserMode;
 
 // UART for serial communication
 #define UART_PORT         UART_NUM_0
@@ -56,22 +109,41 @@ static const char *TAG = "INJECTOR_PULSER";
 #define UART_RX_PIN       GPIO_NUM_3
 #define UART_BUF_SIZE     1024
 
-// FIRING ORDERS FOR 4-CYLINDER ENGINES
-// Each order is an array with the sequence of injectors the system should activate
-static const uint8_t ORDER_1342[] = {0, 2, 3, 1}; // Order 1-3-4-2 (common in many inline 4-cylinder engines)
-static const uint8_t ORDER_1243[] = {0, 1, 3, 2}; // Order 1-2-4-3 (some European engines)
-static const uint8_t ORDER_1324[] = {0, 2, 1, 3}; // Order 1-3-2-4 (some Japanese engines)
-
 // Global variables
-static uint8_t currentOrder = 0;         // 0=1342, 1=1243, 2=1324
-static uint8_t currentPosition = 0;      // Current position in the sequence (0-3)
-static int pulseWidth = 5;               // Initial pulse width in ms
-static int cycleTime = 100;              // Initial time between cycles in ms
+static uint8_t currentEngine = 0;        // Engine of ENGINE_LAYOUTS selected with the button
+static EngineLayout customEngine;        // Firing order entered with the 'order' command
+static const EngineLayout* engineLayout = &ENGINE_LAYOUTS[0];
+static InjectionMode injectionMode = INJECTION_SEQUENTIAL;
+static FiringSchedule firingSchedule;    // Events of the engine and mode in use
+static uint32_t pulseWidth = 5000;       // Initial pulse width in μs
+static uint32_t cycleTime = 400000;      // Initial engine cycle (720°) in μs
 static bool orderChanged = false;        // Flag to detect order change
 static uint64_t lastDebounceTime = 0;    // For button debounce
-static uint64_t previousTime = 0;        // For time control
 #define DEBOUNCE_DELAY 50               // Debounce time in ms
 
+// Edge schedule, shared by the task and the timer interrupt
+static InjectorSchedule schedule;
+static DriveEngine driveEngine;          // Adds the end of the peak to the open and close edges
+static DriveEdge nextEdge;               // Edge the alarm is programmed for
+static StatusReport statusReport;        // Counted by the interrupt, printed by the status task
+static volatile uint32_t statusInterval = STATUS_INTERVAL;  // Time between summaries in ms, 0 disables them
+static uint8_t openOutputs = 0;          // Injector outputs not off (bit per injector)
+static volatile PulserMode pulserMode = MODE_STOPPED;
+static portMUX_TYPE scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Test program, only changed while no program is running
+static TestProgram testProgram;
+static TestRunner testRunner;
+static TestResults testResults;
+static volatile bool programFinished = false;
+
+// Profile that can be changed with the 'custom' command
+static DriveProfile customProfile = { "custom", 1000, 250, 20000 };
+
+// Serial command line
+static char commandLine[80];
+static int commandLength = 0;
+
 // ADC calibration
 static esp_adc_cal_characteristics_t adc_chars;
 
@@ -80,16 +152,60 @@ static const gpio_num_t injectorPins[] = {
     PIN_INJECTOR_1,
     PIN_INJECTOR_2,
     PIN_INJECTOR_3,
-    PIN_INJECTOR_4
+    PIN_INJECTOR_4,
+    PIN_INJECTOR_5,
+    PIN_INJECTOR_6,
+    PIN_INJECTOR_7,
+    PIN_INJECTOR_8
+};
+
+// MCPWM generator of each injector
+// The ESP32 has six MCPWM timers: injectors 7 and 8 use the B generator of the timers
+// of injectors 1 and 2, so each pair shares one hold frequency (the duty is its own)
+typedef struct {
+    mcpwm_unit_t unit;
+    mcpwm_timer_t timer;
+    mcpwm_operator_t generator;
+    mcpwm_io_signals_t signal;
+} InjectorPwm;
+
+static const InjectorPwm injectorPwm[] = {
+    { MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, MCPWM0A },
+    { MCPWM_UNIT_0, MCPWM_TIMER_1, MCPWM_OPR_A, MCPWM1A },
+    { MCPWM_UNIT_0, MCPWM_TIMER_2, MCPWM_OPR_A, MCPWM2A },
+    { MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, MCPWM0A },
+    { MCPWM_UNIT_1, MCPWM_TIMER_1, MCPWM_OPR_A, MCPWM1A },
+    { MCPWM_UNIT_1, MCPWM_TIMER_2, MCPWM_OPR_A, MCPWM2A },
+    { MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_B, MCPWM0B },
+    { MCPWM_UNIT_0, MCPWM_TIMER_1, MCPWM_OPR_B, MCPWM1B }
 };
 
+// Registers of the two MCPWM units, the edges force the generators directly
+// The driver always pairs operator N with timer N
+static mcpwm_dev_t* const mcpwmDevices[MCPWM_UNIT_MAX] = { &MCPWM0, &MCPWM1 };
+
 // Function prototypes
 static void ConfigureInjectorPins(void);
 static void ConfigureADC(void);
 static void ConfigureUART(void);
+static void ConfigureEdgeTimer(void);
 static void PrintCurrentOrder(void);
-static void ActivateNextInjector(void);
-static void ActivateInjector(uint8_t injectorNum);
+static void PrintEngines(void);
+static void SelectEngine(const EngineLayout* layout, InjectionMode mode);
+static void PrintStatus(uint32_t interval);
+static void UpdateTiming(void);
+static InjectorTiming CurrentTiming(void);
+static void StartPulser(PulserMode mode);
+static bool TakeNextEdge(void);
+static bool TakeBaseEdge(void* context, InjectorEdge* edge);
+static void SetInjector(uint8_t injectorNum, DriveLevel level);
+static void SetProfile(uint8_t injectorNum, const DriveProfile* profile);
+static void PrintProfiles(void);
+static void EdgeTimerIsr(void* arg);
+static void ReadCommands(void);
+static void ProcessCommand(char* command);
+static void PrintProgram(void);
+static void PrintReport(void);
 static int ReadThrottle(void);
 static uint64_t GetMillis(void);
 static void SendUART(const char* data);
@@ -98,23 +214,32 @@ static void SendUART(const char* data);
 void InjectorPulserTask(void* pvParameters) {
     int throttleValue;
     int reading;
-    uint64_t currentTime;
+    uint32_t newPulseWidth;
+    uint32_t newCycleTime;
     
     // The system starts with a message on the UART
     SendUART("Injector Pulse Simulator - ESP-IDF Version\r\n");
     SendUART("-------------------------------------------------\r\n");
+    SendUART("Type 'help' for the test program commands\r\n");
     PrintCurrentOrder();
     
     while (1) {
         // Read the potentiometer and adjust cycle time and pulse width
         throttleValue = ReadThrottle();
         
-        // Map the throttle value to cycle time and pulse width
+        // Map the throttle value to cycle time and pulse width in μs
         // Note: As throttle increases, cycle time decreases (RPM increases)
-        cycleTime = (MAX_CYCLE_TIME - MIN_CYCLE_TIME) * (ADC_RESOLUTION - throttleValue) / ADC_RESOLUTION + MIN_CYCLE_TIME;
+        newCycleTime = (uint32_t)(MAX_CYCLE_TIME - MIN_CYCLE_TIME) * 1000 * (ADC_RESOLUTION - throttleValue) / ADC_RESOLUTION + MIN_CYCLE_TIME * 1000;
         
         // Pulse width increases with throttle (more fuel)
-        pulseWidth = (MAX_PULSE_TIME - MIN_PULSE_TIME) * throttleValue / ADC_RESOLUTION + MIN_PULSE_TIME;
+        newPulseWidth = (uint32_t)(MAX_PULSE_TIME - MIN_PULSE_TIME) * 1000 * throttleValue / ADC_RESOLUTION + MIN_PULSE_TIME * 1000;
+        
+        // The schedule takes the new values at the start of the next cycle
+        if (newCycleTime != cycleTime || newPulseWidth != pulseWidth) {
+            cycleTime = newCycleTime;
+            pulseWidth = newPulseWidth;
+            UpdateTiming();
+        }
         
         // Check if the button was pressed to change the order with debounce
         reading = gpio_get_level(PIN_ORDER_BUTTON);
@@ -124,8 +249,8 @@ void InjectorPulserTask(void* pvParameters) {
             // Apply debounce to avoid false readings
             if ((GetMillis() - lastDebounceTime) > DEBOUNCE_DELAY) {
                 orderChanged = true;
-                currentOrder = (currentOrder + 1) % 3; // Rotate between the 3 orders
-                PrintCurrentOrder();
+                currentEngine = (currentEngine + 1) % ENGINE_LAYOUT_COUNT; // Rotate between the engines
+                SelectEngine(&ENGINE_LAYOUTS[currentEngine], injectionMode);
                 lastDebounceTime = GetMillis();
             }
         }
@@ -135,15 +260,30 @@ void InjectorPulserTask(void* pvParameters) {
             orderChanged = false;
         }
         
-        // Perform time control for the injection sequence
-        currentTime = GetMillis();
-        if (currentTime - previousTime >= cycleTime) {
-            previousTime = currentTime;
-            ActivateNextInjector();
+        // Program commands from the serial port
+        ReadCommands();
+        
+        // The results are printed once the interrupt has closed the last pulse
+        if (programFinished) {
+            programFinished = false;
+            PrintReport();
         }
         
-        // Small pause to avoid CPU saturation
-        vTaskDelay(1 / portTICK_PERIOD_MS);
+        // The throttle and the button do not need to be read faster
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
+
+// Low priority task that prints the summary of the engine sequence
+// The UART can take as long as it needs, the interrupt only updates counters
+void StatusTask(void* pvParameters) {
+    while (1) {
+        uint32_t interval = statusInterval;
+        
+        vTaskDelay(pdMS_TO_TICKS(interval > 0 ? interval : STATUS_INTERVAL));
+        if (interval > 0 && pulserMode == MODE_ENGINE) {
+            PrintStatus(interval);
+        }
     }
 }
 
@@ -153,24 +293,33 @@ void app_main(void) {
     ConfigureInjectorPins();
     ConfigureADC();
     ConfigureUART();
+    TestProgramClear(&testProgram);
+    FiringScheduleBuild(&firingSchedule, engineLayout, injectionMode);
+    ConfigureEdgeTimer();
     
     // Log system startup
     ESP_LOGI(TAG, "Starting Injector Pulser");
     
-    // Create the main task
+    // Create the main task and the status task below it
     xTaskCreate(InjectorPulserTask, "injector_pulser_task", 4096, NULL, 5, NULL);
+    xTaskCreate(StatusTask, "status_task", 3072, NULL, 1, NULL);
 }
 
-// Configures GPIO pins
+// Configures GPIO pins and the MCPWM generators of the injectors
 static void ConfigureInjectorPins(void) {
     gpio_config_t io_conf;
+    mcpwm_config_t pwm_conf = {
+        .frequency = customProfile.holdFrequencyHz,
+        .cmpr_a = 0,
+        .cmpr_b = 0,
+        .duty_mode = MCPWM_DUTY_MODE_0,
+        .counter_mode = MCPWM_UP_COUNTER,
+    };
     
-    // Configure injector pins as outputs
+    // Configure the status LED as output
     io_conf.intr_type = GPIO_INTR_DISABLE;
     io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = (1ULL << PIN_INJECTOR_1) | (1ULL << PIN_INJECTOR_2) | 
-                          (1ULL << PIN_INJECTOR_3) | (1ULL << PIN_INJECTOR_4) | 
-                          (1ULL << PIN_STATUS_LED);
+    io_conf.pin_bit_mask = (1ULL << PIN_STATUS_LED);
     io_conf.pull_down_en = 0;
     io_conf.pull_up_en = 0;
     gpio_config(&io_conf);
@@ -183,9 +332,15 @@ static void ConfigureInjectorPins(void) {
     io_conf.pull_up_en = 1;
     gpio_config(&io_conf);
     
-    // Initialize all injectors to off
-    for (int i = 0; i < 4; i++) {
-        gpio_set_level(injectorPins[i], 0);
+    // Route every injector pin to its MCPWM generator, all injectors start saturated and off
+    // The B generators run on a timer already started by the A generator of the same timer
+    DriveEngineInit(&driveEngine, &DRIVE_PROFILES[0]);
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        ESP_ERROR_CHECK(mcpwm_gpio_init(injectorPwm[i].unit, injectorPwm[i].signal, injectorPins[i]));
+        if (injectorPwm[i].generator == MCPWM_OPR_A) {
+            ESP_ERROR_CHECK(mcpwm_init(injectorPwm[i].unit, injectorPwm[i].timer, &pwm_conf));
+        }
+        SetInjector(i, DRIVE_OFF);
     }
     gpio_set_level(PIN_STATUS_LED, 0);
 }
@@ -243,73 +398,510 @@ static void SendUART(const char* data) {
     uart_write_bytes(UART_PORT, data, strlen(data));
 }
 
-// Displays the current firing order on the serial monitor
-static void PrintCurrentOrder(void) {
-    char buffer[50];
+// Configures the timer whose alarm generates every injector edge
+static void ConfigureEdgeTimer(void) {
+    timer_config_t config = {
+        .divider = EDGE_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+    };
     
-    sprintf(buffer, "Firing Order: ");
-    SendUART(buffer);
+    // The counter runs freely, every alarm is an absolute time
+    ESP_ERROR_CHECK(timer_init(EDGE_TIMER_GROUP, EDGE_TIMER, &config));
+    ESP_ERROR_CHECK(timer_set_counter_value(EDGE_TIMER_GROUP, EDGE_TIMER, 0));
+    ESP_ERROR_CHECK(timer_isr_register(EDGE_TIMER_GROUP, EDGE_TIMER, EdgeTimerIsr, NULL, 0, NULL));
+    ESP_ERROR_CHECK(timer_enable_intr(EDGE_TIMER_GROUP, EDGE_TIMER));
+    ESP_ERROR_CHECK(timer_start(EDGE_TIMER_GROUP, EDGE_TIMER));
     
-    switch(currentOrder) {
-        case 0:
-            SendUART("1-3-4-2\r\n");
-            break;
-        case 1:
-            SendUART("1-2-4-3\r\n");
+    StartPulser(MODE_ENGINE);
+}
+
+// Timing of the engine sequence from the current pulse width, cycle time and injection events
+static InjectorTiming CurrentTiming(void) {
+    InjectorTiming timing = {
+        .pulseUs = pulseWidth,
+        .cycleUs = cycleTime,
+        .firing = &firingSchedule
+    };
+    return timing;
+}
+
+// Passes the current pulse width, cycle time and injection events to the schedule
+static void UpdateTiming(void) {
+    InjectorTiming timing = CurrentTiming();
+    
+    portENTER_CRITICAL(&scheduleLock);
+    InjectorScheduleUpdate(&schedule, &timing);
+    portEXIT_CRITICAL(&scheduleLock);
+}
+
+// Closes every injector and starts the engine sequence or the test program from scratch
+static void StartPulser(PulserMode mode) {
+    InjectorTiming timing = CurrentTiming();
+    uint64_t now;
+    
+    portENTER_CRITICAL(&scheduleLock);
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        SetInjector(i, DRIVE_OFF);
+    }
+    gpio_set_level(PIN_STATUS_LED, 0);
+    DriveEngineReset(&driveEngine);
+    
+    timer_get_counter_value(EDGE_TIMER_GROUP, EDGE_TIMER, &now);
+    if (mode == MODE_ENGINE) {
+        InjectorScheduleInit(&schedule, &timing, now + EDGE_START_DELAY);
+        StatusReportInit(&statusReport);
+    } else if (mode == MODE_PROGRAM) {
+        TestResultsClear(&testResults);
+        TestRunnerInit(&testRunner, &testProgram, now + EDGE_START_DELAY);
+    }
+    
+    pulserMode = mode;
+    if (mode != MODE_STOPPED && TakeNextEdge()) {
+        timer_set_alarm_value(EDGE_TIMER_GROUP, EDGE_TIMER, nextEdge.time);
+        timer_set_alarm(EDGE_TIMER_GROUP, EDGE_TIMER, TIMER_ALARM_EN);
+    } else {
+        timer_set_alarm(EDGE_TIMER_GROUP, EDGE_TIMER, TIMER_ALARM_DIS);
+    }
+    portEXIT_CRITICAL(&scheduleLock);
+}
+
+// Takes the next output change of the running mode, returns false when there is none
+static bool IRAM_ATTR TakeNextEdge(void) {
+    if (pulserMode != MODE_STOPPED && DriveEngineNext(&driveEngine, TakeBaseEdge, NULL, &nextEdge)) {
+        return true;
+    }
+    pulserMode = MODE_STOPPED;
+    return false;
+}
+
+// Next open or close edge of the engine sequence or the test program
+static bool IRAM_ATTR TakeBaseEdge(void* context, InjectorEdge* edge) {
+    if (pulserMode == MODE_ENGINE) {
+        *edge = InjectorScheduleNext(&schedule);
+        return true;
+    }
+    if (pulserMode == MODE_PROGRAM) {
+        if (TestRunnerNext(&testRunner, edge)) {
+            return true;
+        }
+        programFinished = true;
+    }
+    return false;
+}
+
+// Applies every edge that is due and programs the alarm for the next one
+static void IRAM_ATTR EdgeTimerIsr(void* arg) {
+    uint64_t now;
+    uint64_t appliedAt;
+    bool pending;
+    
+    timer_group_clr_intr_status_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER);
+    
+    portENTER_CRITICAL_ISR(&scheduleLock);
+    now = timer_group_get_counter_value_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER);
+    pending = pulserMode != MODE_STOPPED;
+    while (pending) {
+        while (pending && nextEdge.time <= now + EDGE_MERGE_US) {
+            SetInjector(nextEdge.channel, nextEdge.level);
+            if (nextEdge.level != DRIVE_HOLD) {
+                // Programs and the status summary use the time at which each output really opened and closed
+                InjectorEdge opening = { nextEdge.time, nextEdge.channel, nextEdge.level != DRIVE_OFF };
+                appliedAt = timer_group_get_counter_value_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER);
+                if (pulserMode == MODE_PROGRAM) {
+                    TestResultsRecord(&testResults, &opening, appliedAt);
+                } else {
+                    StatusReportRecord(&statusReport, &opening, appliedAt);
+                }
+            }
+            pending = TakeNextEdge();
+        }
+        if (!pending) {
             break;
-        case 2:
-            SendUART("1-3-2-4\r\n");
+        }
+        
+        // An alarm set in the past would never fire, check the time again after setting it
+        timer_group_set_alarm_value_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER, nextEdge.time);
+        now = timer_group_get_counter_value_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER);
+        if (nextEdge.time > now + EDGE_MERGE_US) {
             break;
+        }
+    }
+    
+    // The status LED is on while any injector is open
+    gpio_set_level(PIN_STATUS_LED, openOutputs != 0);
+    portEXIT_CRITICAL_ISR(&scheduleLock);
+    
+    if (pending) {
+        timer_group_enable_alarm_in_isr(EDGE_TIMER_GROUP, EDGE_TIMER);
     }
 }
 
-// Activates a specific injector
-static void ActivateInjector(uint8_t injectorNum) {
-    if (injectorNum < 4) {
-        gpio_set_level(injectorPins[injectorNum], 1);
+// Reads the serial port without waiting and runs every complete line
+static void ReadCommands(void) {
+    uint8_t data[32];
+    int length = uart_read_bytes(UART_PORT, data, sizeof(data), 0);
+    
+    for (int i = 0; i < length; i++) {
+        if (data[i] == '\r' || data[i] == '\n') {
+            if (commandLength > 0) {
+                commandLine[commandLength] = '\0';
+                ProcessCommand(commandLine);
+                commandLength = 0;
+            }
+        } else if (commandLength < (int)sizeof(commandLine) - 1) {
+            commandLine[commandLength++] = (char)data[i];
+        }
     }
 }
 
-// Activates the next injector in the sequence based on the selected order
-static void ActivateNextInjector(void) {
+// Runs one test program command
+static void ProcessCommand(char* command) {
     char buffer[100];
-    uint8_t injector = 0;
+    unsigned int a, b, c, d;
+    char channels[INJECTOR_COUNT + 1];
     
-    // Turn off all injectors first
-    for (int i = 0; i < 4; i++) {
-        gpio_set_level(injectorPins[i], 0);
+    if (strcmp(command, "help") == 0) {
+        SendUART("pulses N WIDTH_US FREQ_HZ   - N pulses of WIDTH_US at FREQ_HZ\r\n");
+        SendUART("sweep N START% END% FREQ_HZ - N pulses, duty from START% to END%\r\n");
+        SendUART("deadtime MV US              - Injector dead time at MV millivolts\r\n");
+        SendUART("supply MV                   - Injector supply voltage\r\n");
+        SendUART("channels 1234               - Injectors driven by the program\r\n");
+        SendUART("drive 1234 PROFILE          - saturated, peakhold or custom drive of the injectors\r\n");
+        SendUART("custom PEAK_US HOLD% FREQ_HZ - Peak time, hold duty and frequency of the custom profile\r\n");
+        SendUART("order 1-5-3-6-2-4           - Firing order of the engine, one injector per cylinder\r\n");
+        SendUART("mode sequential|batch|simultaneous - Injection mode\r\n");
+        SendUART("status MS                   - Time between status summaries, 0 turns them off\r\n");
+        SendUART("clear | list | run | stop | report | engine | drive | order\r\n");
+        return;
+    }
+    if (strcmp(command, "engine") == 0) {
+        StartPulser(MODE_ENGINE);
+        PrintCurrentOrder();
+        return;
+    }
+    if (strcmp(command, "stop") == 0) {
+        StartPulser(MODE_STOPPED);
+        SendUART("Stopped\r\n");
+        return;
+    }
+    if (strcmp(command, "report") == 0) {
+        PrintReport();
+        return;
+    }
+    if (strcmp(command, "list") == 0) {
+        PrintProgram();
+        return;
+    }
+    if (strcmp(command, "drive") == 0) {
+        PrintProfiles();
+        return;
+    }
+    if (sscanf(command, "status %u", &a) == 1) {
+        statusInterval = a;
+        SendUART(a > 0 ? "OK\r\n" : "Status summaries off\r\n");
+        return;
+    }
+    if (strcmp(command, "order") == 0) {
+        PrintEngines();
+        return;
+    }
+    if (strncmp(command, "order ", 6) == 0) {
+        EngineLayout layout;
+        if (!FiringOrderParse(command + 6, &layout)) {
+            SendUART("Invalid firing order\r\n");
+            return;
+        }
+        customEngine = layout;
+        SelectEngine(&customEngine, injectionMode);
+        return;
+    }
+    if (strncmp(command, "mode ", 5) == 0) {
+        InjectionMode mode = InjectionModeFromName(command + 5);
+        if (mode == INJECTION_MODE_COUNT) {
+            SendUART("Unknown mode\r\n");
+            return;
+        }
+        SelectEngine(engineLayout, mode);
+        return;
+    }
+    if (strncmp(command, "drive ", 6) == 0) {
+        char name[16];
+        const DriveProfile* profile = NULL;
+        if (sscanf(command, "drive %8s %15s", channels, name) == 2) {
+            profile = strcasecmp(name, customProfile.name) == 0 ? &customProfile : DriveProfileFromName(name);
+        }
+        if (profile == NULL) {
+            SendUART("Unknown profile\r\n");
+            return;
+        }
+        for (int i = 0; channels[i] != '\0'; i++) {
+            if (channels[i] >= '1' && channels[i] < '1' + INJECTOR_COUNT) {
+                SetProfile(channels[i] - '1', profile);
+            }
+        }
+        PrintProfiles();
+        return;
+    }
+    if (sscanf(command, "custom %u %u %u", &a, &b, &c) == 3) {
+        if (b > 100 || c == 0) {
+            SendUART("Invalid profile\r\n");
+            return;
+        }
+        portENTER_CRITICAL(&scheduleLock);
+        customProfile.peakUs = a;
+        customProfile.holdDuty = b * 10;
+        customProfile.holdFrequencyHz = c;
+        portEXIT_CRITICAL(&scheduleLock);
+        
+        // Channels already on the custom profile take the new hold PWM
+        for (int i = 0; i < INJECTOR_COUNT; i++) {
+            if (driveEngine.profiles[i] == &customProfile) {
+                SetProfile(i, &customProfile);
+            }
+        }
+        PrintProfiles();
+        return;
     }
     
-    // Determine which injector to activate based on the current order
-    switch(currentOrder) {
-        case 0: // Order 1-3-4-2
-            injector = ORDER_1342[currentPosition];
-            break;
-        case 1: // Order 1-2-4-3
-            injector = ORDER_1243[currentPosition];
-            break;
-        case 2: // Order 1-3-2-4
-            injector = ORDER_1324[currentPosition];
-            break;
+    // The program cannot change under the interrupt
+    if (pulserMode == MODE_PROGRAM) {
+        SendUART("Program running, send 'stop' first\r\n");
+        return;
+    }
+    
+    if (strcmp(command, "run") == 0) {
+        int bad = TestProgramCheck(&testProgram);
+        if (testProgram.stepCount == 0) {
+            SendUART("Empty program\r\n");
+        } else if (bad >= 0) {
+            sprintf(buffer, "Step %d: pulse plus dead time does not fit in the period\r\n", bad + 1);
+            SendUART(buffer);
+        } else {
+            sprintf(buffer, "Running %lu pulses per channel, %lu ms\r\n",
+                    (unsigned long)TestProgramPulses(&testProgram),
+                    (unsigned long)(TestProgramDurationUs(&testProgram) / 1000));
+            SendUART(buffer);
+            StartPulser(MODE_PROGRAM);
+        }
+    } else if (strcmp(command, "clear") == 0) {
+        TestProgramClear(&testProgram);
+        SendUART("Program cleared\r\n");
+    } else if (sscanf(command, "pulses %u %u %u", &a, &b, &c) == 3) {
+        SendUART(TestProgramAddPulses(&testProgram, a, b, c) ? "OK\r\n" : "Step rejected\r\n");
+    } else if (sscanf(command, "sweep %u %u %u %u", &a, &b, &c, &d) == 4) {
+        SendUART(TestProgramAddSweep(&testProgram, a, b * 10, c * 10, d) ? "OK\r\n" : "Step rejected\r\n");
+    } else if (sscanf(command, "deadtime %u %u", &a, &b) == 2) {
+        SendUART(TestProgramSetDeadTime(&testProgram, a, b) ? "OK\r\n" : "Dead time table full\r\n");
+    } else if (sscanf(command, "supply %u", &a) == 1) {
+        testProgram.supplyMv = a;
+        sprintf(buffer, "Dead time at %u mV: %u us\r\n", a, TestProgramDeadTime(&testProgram));
+        SendUART(buffer);
+    } else if (sscanf(command, "channels %8s", channels) == 1) {
+        uint8_t mask = 0;
+        for (int i = 0; channels[i] != '\0'; i++) {
+            if (channels[i] >= '1' && channels[i] < '1' + INJECTOR_COUNT) {
+                mask |= 1 << (channels[i] - '1');
+            }
+        }
+        testProgram.channels = mask;
+        SendUART(mask != 0 ? "OK\r\n" : "No channel selected\r\n");
+    } else {
+        SendUART("Unknown command, type 'help'\r\n");
+    }
+}
+
+// Displays the loaded program
+static void PrintProgram(void) {
+    char buffer[100];
+    
+    for (int i = 0; i < testProgram.stepCount; i++) {
+        const TestStep* step = &testProgram.steps[i];
+        sprintf(buffer, "Step %d: %lu pulses of %lu", i + 1, (unsigned long)step->count, (unsigned long)step->pulseUs);
+        SendUART(buffer);
+        if (step->type == TEST_STEP_SWEEP) {
+            sprintf(buffer, " to %lu", (unsigned long)step->endPulseUs);
+            SendUART(buffer);
+        }
+        sprintf(buffer, " us every %lu us\r\n", (unsigned long)step->periodUs);
+        SendUART(buffer);
+    }
+    for (int i = 0; i < testProgram.deadTimePoints; i++) {
+        sprintf(buffer, "Dead time at %u mV: %u us\r\n",
+                testProgram.deadTime[i].millivolts, testProgram.deadTime[i].deadTimeUs);
+        SendUART(buffer);
+    }
+    sprintf(buffer, "Supply: %u mV | Dead time: %u us | Channels:", testProgram.supplyMv,
+            TestProgramDeadTime(&testProgram));
+    SendUART(buffer);
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        if (testProgram.channels & (1 << i)) {
+            sprintf(buffer, " %d", i + 1);
+            SendUART(buffer);
+        }
+    }
+    SendUART("\r\n");
+}
+
+// Displays the drive profile of every injector
+static void PrintProfiles(void) {
+    char buffer[100];
+    
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        const DriveProfile* profile = driveEngine.profiles[i];
+        if (profile->peakUs == 0) {
+            sprintf(buffer, "Injector %d: %s\r\n", i + 1, profile->name);
+        } else {
+            sprintf(buffer, "Injector %d: %s | Peak: %lu us | Hold: %u%% at %lu Hz\r\n", i + 1, profile->name,
+                    (unsigned long)profile->peakUs, profile->holdDuty / 10,
+                    (unsigned long)profile->holdFrequencyHz);
+        }
+        SendUART(buffer);
+    }
+}
+
+// Displays the pulses and on-time each channel received in the last program
+static void PrintReport(void) {
+    char buffer[120];
+    TestResults results;
+    uint32_t expectedPulses = TestProgramPulses(&testProgram);
+    uint64_t expectedOnTime = TestProgramOnTimeUs(&testProgram);
+    
+    portENTER_CRITICAL(&scheduleLock);
+    results = testResults;
+    portEXIT_CRITICAL(&scheduleLock);
+    
+    sprintf(buffer, "Expected: %lu pulses, %llu us on-time per channel\r\n",
+            (unsigned long)expectedPulses, (unsigned long long)expectedOnTime);
+    SendUART(buffer);
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        if (!(testProgram.channels & (1 << i))) {
+            continue;
+        }
+        sprintf(buffer, "Injector %d: %lu pulses | On-time: %llu us | Error: %lld us\r\n", i + 1,
+                (unsigned long)results.pulses[i], (unsigned long long)results.onTimeUs[i],
+                (long long)results.onTimeUs[i] - (long long)expectedOnTime);
+        SendUART(buffer);
     }
+    sprintf(buffer, "Max edge latency: %lu us\r\n", (unsigned long)results.maxLatencyUs);
+    SendUART(buffer);
+}
+
+// Uses a new engine or injection mode from the next cycle on
+static void SelectEngine(const EngineLayout* layout, InjectionMode mode) {
+    FiringSchedule built;
     
-    // Activate the corresponding injector
-    ActivateInjector(injector);
+    // The schedule copies the events, the task can rebuild them while the interrupt runs
+    if (!FiringScheduleBuild(&built, layout, mode)) {
+        SendUART("Invalid firing order\r\n");
+        return;
+    }
+    engineLayout = layout;
+    injectionMode = mode;
+    firingSchedule = built;
+    UpdateTiming();
+    PrintCurrentOrder();
+}
+
+// Displays the current engine, firing order and injection mode on the serial monitor
+static void PrintCurrentOrder(void) {
+    char buffer[80];
+    char order[24];
     
-    // Blink the status LED for visualization
-    gpio_set_level(PIN_STATUS_LED, 1);
+    FiringOrderFormat(engineLayout, order, sizeof(order));
+    sprintf(buffer, "Engine: %s | Firing Order: %s | Injection: %s\r\n", engineLayout->name, order,
+            InjectionModeName(injectionMode));
+    SendUART(buffer);
+}
+
+// Displays the engines the button rotates through
+static void PrintEngines(void) {
+    char buffer[60];
+    char order[24];
+    
+    for (int i = 0; i < ENGINE_LAYOUT_COUNT; i++) {
+        FiringOrderFormat(&ENGINE_LAYOUTS[i], order, sizeof(order));
+        sprintf(buffer, "%s: %s\r\n", ENGINE_LAYOUTS[i].name, order);
+        SendUART(buffer);
+    }
+}
+
+// Displays the timing in use, what every injector received and the accuracy of the edges
+static void PrintStatus(uint32_t interval) {
+    char buffer[120];
+    InjectorCycle timing;
+    StatusReport summary;
+    uint32_t cycles;
     
-    // Advance to the next position in the sequence
-    currentPosition = (currentPosition + 1) % 4;
+    portENTER_CRITICAL(&scheduleLock);
+    timing = schedule.active;
+    cycles = schedule.cycles;
+    StatusReportTake(&statusReport, &summary);
+    portEXIT_CRITICAL(&scheduleLock);
     
-    // Display information on the serial monitor
-    sprintf(buffer, "Injector: %d | Cycle: %d ms | Pulse: %d ms\r\n", 
-            injector + 1, // +1 to show 1-4 instead of 0-3
-            cycleTime, 
-            pulseWidth);
+    // One cycle is two turns of the crankshaft
+    sprintf(buffer, "Cycle: %lu.%03lu ms | Pulse: %lu.%03lu ms | RPM: %lu | Cycles: %lu | Edges: %lu | Latency: %lu us\r\n",
+            (unsigned long)(timing.cycleUs / 1000), (unsigned long)(timing.cycleUs % 1000),
+            (unsigned long)(timing.pulseUs / 1000), (unsigned long)(timing.pulseUs % 1000),
+            (unsigned long)(120000000ULL / timing.cycleUs),
+            (unsigned long)cycles, (unsigned long)summary.edges, (unsigned long)summary.maxLatencyUs);
     SendUART(buffer);
     
-    // Turn off the LED after the pulse time
-    vTaskDelay(pulseWidth / portTICK_PERIOD_MS);
-    gpio_set_level(PIN_STATUS_LED, 0);
-}
\ No newline at end of file
+    // Period and width measured on the applied edges, pulses counted since the last summary
+    for (int i = 0; i < INJECTOR_COUNT; i++) {
+        if (summary.pulses[i] == 0) {
+            continue;
+        }
+        sprintf(buffer, "Injector %d: %lu pulses in %lu ms | Period: %lu.%03lu ms | Width: %lu.%03lu ms\r\n", i + 1,
+                (unsigned long)summary.pulses[i], (unsigned long)interval,
+                (unsigned long)(summary.periodUs[i] / 1000), (unsigned long)(summary.periodUs[i] % 1000),
+                (unsigned long)(summary.widthUs[i] / 1000), (unsigned long)(summary.widthUs[i] % 1000));
+        SendUART(buffer);
+    }
+}
+
+// Selects the drive profile of an injector and loads its hold PWM
+static void SetProfile(uint8_t injectorNum, const DriveProfile* profile) {
+    const InjectorPwm* pwm = &injectorPwm[injectorNum];
+    
+    // The generator keeps being forced high or low until the next hold edge uses the new PWM
+    // Injectors 7 and 8 change the hold frequency of injectors 1 and 2 too
+    if (profile->peakUs > 0) {
+        mcpwm_set_frequency(pwm->unit, pwm->timer, profile->holdFrequencyHz);
+        mcpwm_set_duty(pwm->unit, pwm->timer, pwm->generator, profile->holdDuty / 10.0f);
+    }
+    
+    portENTER_CRITICAL(&scheduleLock);
+    DriveEngineSetProfile(&driveEngine, injectorNum, profile);
+    portEXIT_CRITICAL(&scheduleLock);
+}
+
+// Sets the output of a specific injector
+static void IRAM_ATTR SetInjector(uint8_t injectorNum, DriveLevel level) {
+    if (injectorNum >= INJECTOR_COUNT) {
+        return;
+    }
+    
+    // Continuous software force with immediate update: the pin changes when the register is written.
+    // Changing the action table (mcpwm_set_signal_high/low) would only act at the next event of the
+    // hold PWM timer, up to one hold period late (50 μs at 20 kHz, more with a slow custom profile)
+    const InjectorPwm* pwm = &injectorPwm[injectorNum];
+    mcpwm_dev_t* device = mcpwmDevices[pwm->unit];
+    switch (level) {
+        case DRIVE_OFF:
+            mcpwm_ll_gen_set_continue_force_level(device, pwm->timer, pwm->generator, 0);
+            openOutputs &= ~(1 << injectorNum);
+            break;
+        case DRIVE_FULL:
+            mcpwm_ll_gen_set_continue_force_level(device, pwm->timer, pwm->generator, 1);
+            openOutputs |= 1 << injectorNum;
+            break;
+        case DRIVE_HOLD:
+            // Releases the force, the pin stays high until the next event of the duty loaded by SetProfile,
+            // so the peak can run up to one hold period longer; opening and closing are never late
+            mcpwm_ll_gen_disable_continue_force_action(device, pwm->timer, pwm->generator);
+            break;
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * @file status_report.c
+ * @brief Counters of the injector pulser for the periodic status summary
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * The timer interrupt only adds to these counters, which costs a few
+ * instructions per edge. A low priority task takes a copy at the rate
+ * selected by the user and formats it, so writing to the UART never
+ * delays an injector edge however slow the serial port is.
+ */
+
+#include <string.h>
+#include "status_report.h"
+
+void StatusReportInit(StatusReport* report)
+{
+    memset(report, 0, sizeof(*report));
+}
+
+void StatusReportRecord(StatusReport* report, const InjectorEdge* edge, uint64_t appliedAt)
+{
+    uint8_t injector = edge->injector;
+    uint8_t bit = (uint8_t)(1u << injector);
+
+    if (injector >= INJECTOR_MAX_OUTPUTS) {
+        return;
+    }
+    if (appliedAt > edge->time && appliedAt - edge->time > report->maxLatencyUs) {
+        report->maxLatencyUs = (uint32_t)(appliedAt - edge->time);
+    }
+    report->edges++;
+
+    if (edge->level) {
+        if (report->openedMask & bit) {
+            report->periodUs[injector] = (uint32_t)(appliedAt - report->openedAt[injector]);
+        }
+        report->openedAt[injector] = appliedAt;
+        report->openedMask |= bit;
+    } else if (report->openedMask & bit) {
+        report->pulses[injector]++;
+        report->widthUs[injector] = (uint32_t)(appliedAt - report->openedAt[injector]);
+    }
+}
+
+void StatusReportTake(StatusReport* report, StatusReport* summary)
+{
+    *summary = *report;
+
+    // The last period and width stay valid until the injector pulses again
+    memset(report->pulses, 0, sizeof(report->pulses));
+    report->edges = 0;
+    report->maxLatencyUs = 0;
+}
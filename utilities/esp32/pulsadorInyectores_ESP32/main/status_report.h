@@ -0,0 +1,41 @@
+/**
+ * @file status_report.h
+ * @brief Counters of the injector pulser for the periodic status summary
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef STATUS_REPORT_H
+#define STATUS_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "injector_schedule.h"
+
+// What the injectors received since the last summary, measured when each output was switched
+typedef struct {
+    uint32_t pulses[INJECTOR_MAX_OUTPUTS];               // Pulses closed since the last summary
+    uint32_t periodUs[INJECTOR_MAX_OUTPUTS];             // Time between the last two openings
+    uint32_t widthUs[INJECTOR_MAX_OUTPUTS];              // Width of the last closed pulse
+    uint64_t openedAt[INJECTOR_MAX_OUTPUTS];
+    uint8_t openedMask;          // Injectors opened at least once (bit per injector)
+    uint32_t edges;              // Open and close edges since the last summary
+    uint32_t maxLatencyUs;       // Longest delay of an edge after its time since the last summary
+} StatusReport;
+
+// Clears every counter and measurement
+void StatusReportInit(StatusReport* report);
+
+// Records an edge applied at the given time, only counts, never waits or writes
+void StatusReportRecord(StatusReport* report, const InjectorEdge* edge, uint64_t appliedAt);
+
+// Copies the counters for a summary and starts the next interval
+void StatusReportTake(StatusReport* report, StatusReport* summary);
+
+#endif // STATUS_REPORT_H
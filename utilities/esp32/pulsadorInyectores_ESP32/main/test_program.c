@@ -0,0 +1,270 @@
+/**
+ * @file test_program.c
+ * @brief Injector cleaning and flow matching programs
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * A program is a list of steps that pulse every selected injector at the
+ * same time, like a flow bench does. The widths are fuel pulses: the dead
+ * time of the injector at the supply voltage is added to each one, so the
+ * same program delivers the same fuel at 12 V and at 14 V. The runner
+ * produces the edges in absolute timer time, for the same interrupt that
+ * drives the engine sequence, and the results are taken from the time at
+ * which each output was really switched.
+ */
+
+#include <string.h>
+#include "test_program.h"
+
+/**
+ * Fuel pulse of one pulse of a step
+ *
+ * @param step Step of the program
+ * @param pulse Pulse within the step
+ * @return Pulse width without dead time (μs)
+ */
+static uint32_t StepPulse(const TestStep* step, uint32_t pulse)
+{
+    if (step->type != TEST_STEP_SWEEP || step->count < 2) {
+        return step->pulseUs;
+    }
+    int64_t span = (int64_t)step->endPulseUs - step->pulseUs;
+    return (uint32_t)(step->pulseUs + span * pulse / (step->count - 1));
+}
+
+/**
+ * Appends a step after checking the common limits
+ *
+ * @param program Program being built
+ * @param step Step to append
+ * @return false if the program is full or the step is empty
+ */
+static bool AddStep(TestProgram* program, const TestStep* step)
+{
+    if (program->stepCount >= TEST_MAX_STEPS || step->count == 0 || step->periodUs == 0) {
+        return false;
+    }
+    program->steps[program->stepCount++] = *step;
+    return true;
+}
+
+/**
+ * Loads the electrical width of the current pulse
+ *
+ * @param runner Running program
+ */
+static void LoadPulse(TestRunner* runner)
+{
+    const TestStep* step = &runner->program->steps[runner->step];
+    runner->pulseUs = StepPulse(step, runner->pulse) + TestProgramDeadTime(runner->program);
+}
+
+void TestProgramClear(TestProgram* program)
+{
+    memset(program, 0, sizeof(*program));
+    program->supplyMv = 13500;
+    program->channels = 0x0F;
+}
+
+bool TestProgramAddPulses(TestProgram* program, uint32_t count, uint32_t pulseUs, uint32_t frequencyHz)
+{
+    if (frequencyHz == 0) {
+        return false;
+    }
+    TestStep step = {
+        .type = TEST_STEP_PULSES,
+        .count = count,
+        .periodUs = 1000000 / frequencyHz,
+        .pulseUs = pulseUs,
+        .endPulseUs = pulseUs
+    };
+    return AddStep(program, &step);
+}
+
+bool TestProgramAddSweep(TestProgram* program, uint32_t count, uint16_t startDuty, uint16_t endDuty,
+                         uint32_t frequencyHz)
+{
+    if (frequencyHz == 0 || startDuty > 1000 || endDuty > 1000) {
+        return false;
+    }
+    uint32_t period = 1000000 / frequencyHz;
+    TestStep step = {
+        .type = TEST_STEP_SWEEP,
+        .count = count,
+        .periodUs = period,
+        .pulseUs = period * startDuty / 1000,
+        .endPulseUs = period * endDuty / 1000
+    };
+    return AddStep(program, &step);
+}
+
+bool TestProgramSetDeadTime(TestProgram* program, uint16_t millivolts, uint16_t deadTimeUs)
+{
+    uint8_t i = 0;
+    while (i < program->deadTimePoints && program->deadTime[i].millivolts < millivolts) {
+        i++;
+    }
+    if (i < program->deadTimePoints && program->deadTime[i].millivolts == millivolts) {
+        program->deadTime[i].deadTimeUs = deadTimeUs;
+        return true;
+    }
+    if (program->deadTimePoints >= TEST_MAX_DEADTIME_POINTS) {
+        return false;
+    }
+    memmove(&program->deadTime[i + 1], &program->deadTime[i],
+            (program->deadTimePoints - i) * sizeof(DeadTimePoint));
+    program->deadTime[i].millivolts = millivolts;
+    program->deadTime[i].deadTimeUs = deadTimeUs;
+    program->deadTimePoints++;
+    return true;
+}
+
+uint16_t TestProgramDeadTime(const TestProgram* program)
+{
+    const DeadTimePoint* table = program->deadTime;
+    uint8_t points = program->deadTimePoints;
+
+    if (points == 0) {
+        return 0;
+    }
+    if (program->supplyMv <= table[0].millivolts) {
+        return table[0].deadTimeUs;
+    }
+    for (uint8_t i = 1; i < points; i++) {
+        if (program->supplyMv <= table[i].millivolts) {
+            int32_t span = (int32_t)table[i].deadTimeUs - table[i - 1].deadTimeUs;
+            return (uint16_t)(table[i - 1].deadTimeUs + span * (program->supplyMv - table[i - 1].millivolts) /
+                              (table[i].millivolts - table[i - 1].millivolts));
+        }
+    }
+    return table[points - 1].deadTimeUs;
+}
+
+int TestProgramCheck(const TestProgram* program)
+{
+    uint32_t deadTime = TestProgramDeadTime(program);
+
+    for (int i = 0; i < program->stepCount; i++) {
+        const TestStep* step = &program->steps[i];
+        uint32_t shortest = step->pulseUs < step->endPulseUs ? step->pulseUs : step->endPulseUs;
+        uint32_t longest = step->pulseUs > step->endPulseUs ? step->pulseUs : step->endPulseUs;
+        if (shortest + deadTime < TEST_MIN_PULSE_US ||
+            longest + deadTime + INJECTOR_MIN_OFF_US > step->periodUs) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32_t TestProgramPulses(const TestProgram* program)
+{
+    uint32_t pulses = 0;
+    for (int i = 0; i < program->stepCount; i++) {
+        pulses += program->steps[i].count;
+    }
+    return pulses;
+}
+
+uint64_t TestProgramDurationUs(const TestProgram* program)
+{
+    uint64_t duration = 0;
+    for (int i = 0; i < program->stepCount; i++) {
+        duration += (uint64_t)program->steps[i].count * program->steps[i].periodUs;
+    }
+    return duration;
+}
+
+uint64_t TestProgramOnTimeUs(const TestProgram* program)
+{
+    uint32_t deadTime = TestProgramDeadTime(program);
+    uint64_t onTime = 0;
+
+    for (int i = 0; i < program->stepCount; i++) {
+        const TestStep* step = &program->steps[i];
+        if (step->type == TEST_STEP_SWEEP) {
+            for (uint32_t pulse = 0; pulse < step->count; pulse++) {
+                onTime += StepPulse(step, pulse) + deadTime;
+            }
+        } else {
+            onTime += (uint64_t)step->count * (step->pulseUs + deadTime);
+        }
+    }
+    return onTime;
+}
+
+void TestRunnerInit(TestRunner* runner, const TestProgram* program, uint64_t start)
+{
+    memset(runner, 0, sizeof(*runner));
+    runner->program = program;
+    runner->pulseStart = start;
+    runner->level = 1;
+    runner->phaseMask = program->channels;
+    runner->finished = program->stepCount == 0 || program->channels == 0;
+    if (!runner->finished) {
+        LoadPulse(runner);
+    }
+}
+
+bool TestRunnerNext(TestRunner* runner, InjectorEdge* edge)
+{
+    if (runner->finished) {
+        return false;
+    }
+
+    if (runner->phaseMask == 0) {
+        if (runner->level == 1) {
+            runner->level = 0;
+        } else {
+            // Pulse closed on every channel, the next one starts one period after this one
+            const TestProgram* program = runner->program;
+            runner->pulseStart += program->steps[runner->step].periodUs;
+            if (++runner->pulse >= program->steps[runner->step].count) {
+                runner->pulse = 0;
+                if (++runner->step >= program->stepCount) {
+                    runner->finished = true;
+                    return false;
+                }
+            }
+            LoadPulse(runner);
+            runner->level = 1;
+        }
+        runner->phaseMask = runner->program->channels;
+    }
+
+    uint8_t channel = 0;
+    while (!(runner->phaseMask & (1u << channel))) {
+        channel++;
+    }
+    runner->phaseMask &= (uint8_t)~(1u << channel);
+
+    edge->injector = channel;
+    edge->level = runner->level;
+    edge->time = runner->level ? runner->pulseStart : runner->pulseStart + runner->pulseUs;
+    return true;
+}
+
+void TestResultsClear(TestResults* results)
+{
+    memset(results, 0, sizeof(*results));
+}
+
+void TestResultsRecord(TestResults* results, const InjectorEdge* edge, uint64_t appliedAt)
+{
+    uint8_t channel = edge->injector;
+
+    if (appliedAt > edge->time && appliedAt - edge->time > results->maxLatencyUs) {
+        results->maxLatencyUs = (uint32_t)(appliedAt - edge->time);
+    }
+    if (edge->level) {
+        results->openedAt[channel] = appliedAt;
+    } else {
+        results->pulses[channel]++;
+        results->onTimeUs[channel] += appliedAt - results->openedAt[channel];
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test_program.h
+ * @brief Injector cleaning and flow matching programs
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ */
+
+#ifndef TEST_PROGRAM_H
+#define TEST_PROGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "injector_schedule.h"
+
+// Program size limits
+#define TEST_MAX_STEPS          16
+#define TEST_MAX_DEADTIME_POINTS 8
+
+// Shortest pulse of a program (μs)
+#define TEST_MIN_PULSE_US       100
+
+// Kinds of step
+typedef enum {
+    TEST_STEP_PULSES,            // Fixed pulse width
+    TEST_STEP_SWEEP              // Pulse width changes linearly from the first to the last pulse
+} TestStepType;
+
+// One step: count pulses on every selected channel at the same time
+typedef struct {
+    TestStepType type;
+    uint32_t count;
+    uint32_t periodUs;           // Time between the openings of two pulses
+    uint32_t pulseUs;            // Fuel pulse, without dead time (first pulse of a sweep)
+    uint32_t endPulseUs;         // Fuel pulse of the last pulse of a sweep
+} TestStep;
+
+// Injector dead time at one supply voltage
+typedef struct {
+    uint16_t millivolts;
+    uint16_t deadTimeUs;
+} DeadTimePoint;
+
+// Complete program, built from serial commands
+typedef struct {
+    TestStep steps[TEST_MAX_STEPS];
+    uint8_t stepCount;
+    DeadTimePoint deadTime[TEST_MAX_DEADTIME_POINTS];    // Sorted by voltage
+    uint8_t deadTimePoints;
+    uint16_t supplyMv;           // Injector supply voltage, selects the dead time
+    uint8_t channels;            // Injectors driven (bit per injector)
+} TestProgram;
+
+// Edges of a running program
+typedef struct {
+    const TestProgram* program;
+    uint8_t step;
+    uint32_t pulse;              // Pulse within the step
+    uint64_t pulseStart;         // Opening time of the current pulse
+    uint32_t pulseUs;            // Electrical width of the current pulse (fuel pulse + dead time)
+    uint8_t phaseMask;           // Channels still to switch in the current phase
+    uint8_t level;               // 1 while opening, 0 while closing
+    bool finished;
+} TestRunner;
+
+// What the injectors actually received, measured when each output was switched
+typedef struct {
+    uint32_t pulses[INJECTOR_MAX_OUTPUTS];
+    uint64_t onTimeUs[INJECTOR_MAX_OUTPUTS];             // Sum of the electrical pulse widths
+    uint64_t openedAt[INJECTOR_MAX_OUTPUTS];
+    uint32_t maxLatencyUs;       // Longest delay of an edge after its time
+} TestResults;
+
+// Empty program: all four injectors, no dead time compensation
+void TestProgramClear(TestProgram* program);
+
+// Appends a step of count pulses of pulseUs at frequencyHz, returns false if it does not fit
+bool TestProgramAddPulses(TestProgram* program, uint32_t count, uint32_t pulseUs, uint32_t frequencyHz);
+
+// Appends a sweep of count pulses from startDuty to endDuty (‰) at frequencyHz
+bool TestProgramAddSweep(TestProgram* program, uint32_t count, uint16_t startDuty, uint16_t endDuty,
+                         uint32_t frequencyHz);
+
+// Adds or replaces the dead time at one supply voltage
+bool TestProgramSetDeadTime(TestProgram* program, uint16_t millivolts, uint16_t deadTimeUs);
+
+// Dead time at the program supply voltage, interpolated between the table points (μs)
+uint16_t TestProgramDeadTime(const TestProgram* program);
+
+// Index of the first step whose pulses plus dead time do not fit in the period, -1 if all fit
+int TestProgramCheck(const TestProgram* program);
+
+// Total pulses per channel, expected duration and expected on-time per channel of the program
+uint32_t TestProgramPulses(const TestProgram* program);
+uint64_t TestProgramDurationUs(const TestProgram* program);
+uint64_t TestProgramOnTimeUs(const TestProgram* program);
+
+// Starts the program at the given time
+void TestRunnerInit(TestRunner* runner, const TestProgram* program, uint64_t start);
+
+// Next edge of the program, returns false once the last pulse has closed
+bool TestRunnerNext(TestRunner* runner, InjectorEdge* edge);
+
+// Clears the results
+void TestResultsClear(TestResults* results);
+
+// Records an edge applied at the given time
+void TestResultsRecord(TestResults* results, const InjectorEdge* edge, uint64_t appliedAt);
+
+#endif // TEST_PROGRAM_H
@@ -0,0 +1,243 @@
+/**
+ * @file drive_waveform.c
+ * @brief Host rendering of the injector drive waveforms
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs the same injector_schedule.c and drive_profile.c as the firmware
+ * with the eight injectors of a sequential V8 (GM order 1-8-4-3-6-5-7-2)
+ * at 6000 RPM (2.5 ms between openings) and pulses longer than the
+ * spacing, so up to three injectors overlap. Channel 4 is saturated,
+ * 1, 2, 5 and 7 peak-and-hold, and 3, 6 and 8 use a shorter peak than the
+ * pulse of some cycles and longer than others.
+ *
+ * Injectors 7 and 8 use the B generator of the MCPWM timers of
+ * injectors 1 and 2, as injectorPwm of the firmware: each pair has the
+ * hold frequency selected last and its own duty. Channel 8 takes its
+ * profile after channel 2, so both hold at its frequency, and the pulses
+ * of 2 and 8 (and of 1 and 7) overlap. Every hold must switch at the
+ * frequency of one of the profiles of its timer, and both injectors of
+ * each pair must have been holding at the same time at least once.
+ *
+ * Every output change is checked against the schedule: fully on at the
+ * opening, hold exactly one peak time later and off at the closing, with
+ * no hold when the pulse is shorter than the peak. The output of each pin
+ * is written as CSV every microsecond, with the hold PWM generated from a
+ * free-running timer like the MCPWM does, ready to be plotted.
+ *
+ * Build and run:
+ *   cc -O2 -I../main drive_waveform.c ../main/injector_schedule.c ../main/drive_profile.c ../main/firing_order.c -o drive_waveform
+ *   ./drive_waveform 100 > waveform.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "injector_schedule.h"
+#include "drive_profile.h"
+
+#define INJECTORS               8
+#define TIMERS                  6
+#define START_US                1000
+
+static const DriveProfile shortPeak = { "short", 1500, 300, 10000 };
+
+// MCPWM timer of every injector, injectors 7 and 8 share those of 1 and 2
+static const uint8_t injectorTimer[INJECTORS] = { 0, 1, 2, 3, 4, 5, 0, 1 };
+
+// Hold frequency loaded in every timer, as SetProfile loads it
+static uint32_t timerHz[TIMERS];
+
+static InjectorSchedule schedule;
+static uint32_t failures = 0;
+
+/**
+ * Edge source for the drive engine, the engine sequence never ends
+ *
+ * @param context Unused
+ * @param edge Next open or close edge
+ * @return Always true
+ */
+static bool ScheduleSource(void* context, InjectorEdge* edge)
+{
+    (void)context;
+    *edge = InjectorScheduleNext(&schedule);
+    return true;
+}
+
+/**
+ * Reports a failed check, only the first ones are printed
+ *
+ * @param edge Output change being checked
+ * @param message What is wrong
+ */
+static void Fail(const DriveEdge* edge, const char* message)
+{
+    if (failures++ < 20) {
+        fprintf(stderr, "FAIL at %llu us, injector %u: %s\n", (unsigned long long)edge->time,
+                edge->channel + 1, message);
+    }
+}
+
+/**
+ * Selects the profile of a channel, loading the hold PWM of its timer as SetProfile does
+ *
+ * @param engine Drive engine
+ * @param channel Injector channel
+ * @param profile Profile to use
+ */
+static void SetProfile(DriveEngine* engine, uint8_t channel, const DriveProfile* profile)
+{
+    if (profile->peakUs > 0) {
+        timerHz[injectorTimer[channel]] = profile->holdFrequencyHz;
+    }
+    DriveEngineSetProfile(engine, channel, profile);
+}
+
+/**
+ * Level of an output pin at a given time
+ *
+ * @param level Drive state of the output
+ * @param channel Injector channel
+ * @param profile Profile of the channel
+ * @param time Timer time (μs)
+ * @return 1 if the pin is high
+ */
+static int PinLevel(DriveLevel level, uint8_t channel, const DriveProfile* profile, uint64_t time)
+{
+    if (level == DRIVE_FULL) {
+        return 1;
+    }
+    if (level == DRIVE_HOLD) {
+        // The counter and frequency are those of the timer, the duty is the generator's own
+        uint64_t period = 1000000 / timerHz[injectorTimer[channel]];
+        return time % period < period * profile->holdDuty / 1000;
+    }
+    return 0;
+}
+
+// The other injector on the timer of a channel, or the channel itself
+static uint8_t TimerPartner(uint8_t channel)
+{
+    for (uint8_t i = 0; i < INJECTORS; i++) {
+        if (i != channel && injectorTimer[i] == injectorTimer[channel]) {
+            return i;
+        }
+    }
+    return channel;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t durationMs = argc > 1 ? (uint32_t)atoi(argv[1]) : 100;
+    uint64_t end = START_US + (uint64_t)durationMs * 1000;
+    EngineLayout layout;
+    FiringSchedule firing;
+    InjectorTiming timing = { .pulseUs = 7000, .cycleUs = 20000, .firing = &firing };
+    DriveEngine engine;
+    DriveEdge edge;
+    DriveLevel level[INJECTORS] = { DRIVE_OFF };
+    uint64_t openedAt[INJECTORS] = { 0 };
+    uint32_t pulseOf[INJECTORS] = { 0 };
+    uint32_t pulses = 0;
+    uint32_t holds = 0;
+    uint32_t sharedHolds[INJECTORS] = { 0 };
+    uint64_t t = START_US;
+
+    FiringOrderParse("1-8-4-3-6-5-7-2", &layout);
+    FiringScheduleBuild(&firing, &layout, INJECTION_SEQUENTIAL);
+    InjectorScheduleInit(&schedule, &timing, START_US);
+    DriveEngineInit(&engine, &DRIVE_PROFILES[0]);
+    SetProfile(&engine, 0, DriveProfileFromName("peakhold"));
+    SetProfile(&engine, 1, DriveProfileFromName("peakhold"));
+    SetProfile(&engine, 2, &shortPeak);
+    SetProfile(&engine, 4, DriveProfileFromName("peakhold"));
+    SetProfile(&engine, 5, &shortPeak);
+    SetProfile(&engine, 6, DriveProfileFromName("peakhold"));
+    SetProfile(&engine, 7, &shortPeak);
+
+    printf("time_us");
+    for (int i = 0; i < INJECTORS; i++) {
+        printf(",inj%d", i + 1);
+    }
+    printf("\n");
+
+    while (DriveEngineNext(&engine, ScheduleSource, NULL, &edge) && edge.time < end) {
+        const DriveProfile* profile = engine.profiles[edge.channel];
+        uint8_t partner;
+
+        // Render every microsecond up to this change
+        for (; t < edge.time; t++) {
+            printf("%llu", (unsigned long long)t);
+            for (int i = 0; i < INJECTORS; i++) {
+                printf(",%d", PinLevel(level[i], (uint8_t)i, engine.profiles[i], t));
+            }
+            printf("\n");
+        }
+
+        switch (edge.level) {
+            case DRIVE_FULL:
+                if (level[edge.channel] != DRIVE_OFF) {
+                    Fail(&edge, "opened while open");
+                }
+                openedAt[edge.channel] = edge.time;
+                pulseOf[edge.channel] = schedule.active.pulseUs;
+                break;
+            case DRIVE_HOLD:
+                holds++;
+                if (level[edge.channel] != DRIVE_FULL) {
+                    Fail(&edge, "hold without a peak");
+                } else if (edge.time - openedAt[edge.channel] != profile->peakUs) {
+                    Fail(&edge, "wrong peak time");
+                }
+                partner = TimerPartner(edge.channel);
+                if (timerHz[injectorTimer[edge.channel]] != profile->holdFrequencyHz &&
+                    timerHz[injectorTimer[edge.channel]] != engine.profiles[partner]->holdFrequencyHz) {
+                    Fail(&edge, "hold frequency of neither injector of its timer");
+                }
+                if (partner != edge.channel && level[partner] == DRIVE_HOLD) {
+                    sharedHolds[edge.channel]++;
+                }
+                break;
+            case DRIVE_OFF:
+                pulses++;
+                if (edge.time - openedAt[edge.channel] != pulseOf[edge.channel]) {
+                    Fail(&edge, "wrong pulse width");
+                }
+                if (level[edge.channel] == DRIVE_HOLD && pulseOf[edge.channel] <= profile->peakUs) {
+                    Fail(&edge, "hold in a pulse shorter than the peak");
+                }
+                if (level[edge.channel] == DRIVE_FULL && profile->peakUs > 0 &&
+                    pulseOf[edge.channel] > profile->peakUs) {
+                    Fail(&edge, "no hold in a pulse longer than the peak");
+                }
+                break;
+        }
+        level[edge.channel] = edge.level;
+
+        // Half way, the pulse drops below the short peak
+        if (edge.time >= START_US + (end - START_US) / 2 && timing.pulseUs != 1200) {
+            timing.pulseUs = 1200;
+            InjectorScheduleUpdate(&schedule, &timing);
+        }
+    }
+
+    // Both generators of a shared timer must have been holding at once
+    for (uint8_t i = 0; i < INJECTORS; i++) {
+        uint8_t partner = TimerPartner(i);
+        if (partner > i && sharedHolds[i] + sharedHolds[partner] == 0) {
+            fprintf(stderr, "FAIL injectors %u and %u never hold at the same time\n", i + 1, partner + 1);
+            failures++;
+        }
+    }
+
+    fprintf(stderr, "%u pulses, %u hold edges (%u on a shared timer) in %u ms at 6000 RPM\n", pulses, holds,
+            sharedHolds[0] + sharedHolds[1] + sharedHolds[6] + sharedHolds[7], durationMs);
+    fprintf(stderr, "%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
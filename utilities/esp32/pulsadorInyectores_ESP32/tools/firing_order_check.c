@@ -0,0 +1,312 @@
+/**
+ * @file firing_order_check.c
+ * @brief Host check of the injection events of every engine
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Builds the events of every engine of the firmware in the three
+ * injection modes and checks them: sequential opens one cylinder every
+ * 720 / N degrees in firing order, batch opens the two halves of the
+ * firing order 360° apart and simultaneous opens every injector on every
+ * turn. Then runs the same injector_schedule.c as the firmware for a few
+ * cycles and checks that every injector opens at the time of its angle,
+ * and only the injectors of the engine. The events of each engine are
+ * printed as a table. The order parser is checked with valid and wrong
+ * orders. A one-cylinder engine must be rejected in every mode (batch
+ * would leave its second event empty), and a schedule handed an empty
+ * event must still return edges instead of scanning past the last
+ * injector in the interrupt.
+ *
+ * Build and run:
+ *   cc -O2 -I../main firing_order_check.c ../main/firing_order.c ../main/injector_schedule.c -o firing_order_check
+ *   ./firing_order_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "firing_order.h"
+#include "injector_schedule.h"
+
+#define CYCLE_US                120000           // 1000 RPM
+#define PULSE_US                3000
+#define CYCLES                  10
+
+static uint32_t failures = 0;
+
+/**
+ * Reports a failed check, only the first ones are printed
+ *
+ * @param layout Engine being checked
+ * @param mode Injection mode being checked
+ * @param message What is wrong
+ */
+static void Fail(const EngineLayout* layout, InjectionMode mode, const char* message)
+{
+    char order[24];
+
+    if (failures++ < 20) {
+        FiringOrderFormat(layout, order, sizeof(order));
+        printf("FAIL %s %s %s: %s\n", layout->name, order, InjectionModeName(mode), message);
+    }
+}
+
+/**
+ * Checks the events of one engine and mode against the firing order
+ *
+ * @param layout Engine
+ * @param mode Injection mode
+ * @param firing Events built for them
+ */
+static void CheckEvents(const EngineLayout* layout, InjectionMode mode, const FiringSchedule* firing)
+{
+    uint8_t n = layout->cylinders;
+    uint8_t all = (uint8_t)((1u << n) - 1);
+    uint8_t opened = 0;
+    uint8_t perCycle = mode == INJECTION_SIMULTANEOUS ? 2 : 1;
+    uint8_t openings[FIRING_MAX_CYLINDERS] = { 0 };
+
+    for (uint8_t i = 0; i < firing->count; i++) {
+        if (firing->events[i].angle >= FIRING_CYCLE_DEGREES ||
+            (i > 0 && firing->events[i].angle <= firing->events[i - 1].angle)) {
+            Fail(layout, mode, "events not sorted in one cycle");
+        }
+        if (firing->events[i].mask == 0 || (firing->events[i].mask & ~all)) {
+            Fail(layout, mode, "event with no injector or outside the engine");
+        }
+        for (uint8_t c = 0; c < n; c++) {
+            openings[c] += (firing->events[i].mask >> c) & 1;
+        }
+        opened |= firing->events[i].mask;
+    }
+    for (uint8_t c = 0; c < n; c++) {
+        if (openings[c] != perCycle) {
+            Fail(layout, mode, "cylinder not opened the right number of times");
+        }
+    }
+    if (opened != all) {
+        Fail(layout, mode, "cylinder never opened");
+    }
+
+    switch (mode) {
+        case INJECTION_SEQUENTIAL:
+            if (firing->count != n) {
+                Fail(layout, mode, "not one event per cylinder");
+                break;
+            }
+            for (uint8_t i = 0; i < n; i++) {
+                if (firing->events[i].angle != FIRING_CYCLE_DEGREES * i / n ||
+                    firing->events[i].mask != (1u << (layout->order[i] - 1))) {
+                    Fail(layout, mode, "event out of firing order");
+                }
+            }
+            break;
+
+        case INJECTION_BATCH:
+            if (firing->count != 2 || firing->events[0].angle != 0 || firing->events[1].angle != 360) {
+                Fail(layout, mode, "not two events 360 degrees apart");
+                break;
+            }
+            for (uint8_t i = 0; i < n; i++) {
+                uint8_t group = i < (n + 1) / 2 ? 0 : 1;
+                if (!(firing->events[group].mask & (1u << (layout->order[i] - 1)))) {
+                    Fail(layout, mode, "cylinder in the wrong half of the firing order");
+                }
+            }
+            break;
+
+        default:
+            if (firing->count != 2 || firing->events[0].mask != all || firing->events[1].mask != all ||
+                firing->events[1].angle != 360) {
+                Fail(layout, mode, "not every injector on every turn");
+            }
+            break;
+    }
+}
+
+/**
+ * Runs the injector schedule with the events and checks every opening time
+ *
+ * @param layout Engine
+ * @param mode Injection mode
+ * @param firing Events built for them
+ */
+static void CheckSchedule(const EngineLayout* layout, InjectionMode mode, const FiringSchedule* firing)
+{
+    InjectorTiming timing = { .pulseUs = PULSE_US, .cycleUs = CYCLE_US, .firing = firing };
+    InjectorSchedule schedule;
+    uint32_t openings[INJECTOR_MAX_OUTPUTS] = { 0 };
+    uint32_t expected = 0;
+
+    InjectorScheduleInit(&schedule, &timing, 0);
+    for (uint8_t i = 0; i < firing->count; i++) {
+        for (uint8_t c = 0; c < INJECTOR_MAX_OUTPUTS; c++) {
+            expected += (firing->events[i].mask >> c) & 1;
+        }
+    }
+    expected *= CYCLES;
+
+    for (uint32_t opened = 0; opened < expected;) {
+        InjectorEdge edge = InjectorScheduleNext(&schedule);
+        if (edge.injector >= layout->cylinders) {
+            Fail(layout, mode, "injector outside the engine");
+            return;
+        }
+        if (edge.level == 0) {
+            continue;
+        }
+
+        // The opening must match an event of its cycle with this injector
+        uint64_t offset = edge.time % CYCLE_US;
+        bool found = false;
+        for (uint8_t i = 0; i < firing->count; i++) {
+            if ((firing->events[i].mask & (1u << edge.injector)) &&
+                offset == (uint64_t)CYCLE_US * firing->events[i].angle / FIRING_CYCLE_DEGREES) {
+                found = true;
+            }
+        }
+        if (!found) {
+            Fail(layout, mode, "opening at a time with no event for the injector");
+        }
+        openings[edge.injector]++;
+        opened++;
+    }
+
+    for (uint8_t c = 0; c < layout->cylinders; c++) {
+        if (openings[c] != (mode == INJECTION_SIMULTANEOUS ? 2 : 1) * CYCLES) {
+            Fail(layout, mode, "wrong number of openings of the schedule");
+        }
+    }
+}
+
+/**
+ * Prints the events of one engine and mode as a table row
+ *
+ * @param layout Engine
+ * @param mode Injection mode
+ * @param firing Events built for them
+ */
+static void PrintEvents(const EngineLayout* layout, InjectionMode mode, const FiringSchedule* firing)
+{
+    char order[24];
+
+    FiringOrderFormat(layout, order, sizeof(order));
+    printf("%-8s %-16s %-12s", layout->name, order, InjectionModeName(mode));
+    for (uint8_t i = 0; i < firing->count; i++) {
+        printf(" %3u:", firing->events[i].angle);
+        for (uint8_t c = 0; c < FIRING_MAX_CYLINDERS; c++) {
+            if (firing->events[i].mask & (1u << c)) {
+                printf("%u", c + 1);
+            }
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * 'order 1' followed by 'mode batch': the engine must be rejected, and a
+ * schedule given the empty second event of such a batch must keep
+ * returning edges of the one injector
+ */
+static void CheckSingleCylinder(void)
+{
+    const EngineLayout single = { "Custom", 1, { 1 } };
+    FiringSchedule firing;
+    InjectorSchedule schedule;
+    uint32_t openings = 0;
+
+    for (int m = 0; m < INJECTION_MODE_COUNT; m++) {
+        if (FiringScheduleBuild(&firing, &single, (InjectionMode)m)) {
+            Fail(&single, (InjectionMode)m, "one-cylinder engine accepted");
+        }
+    }
+
+    // What the batch build produced before: the second half of the order is empty
+    memset(&firing, 0, sizeof(firing));
+    firing.events[0] = (FiringEvent){ 0, 0x01 };
+    firing.events[1] = (FiringEvent){ 360, 0x00 };
+    firing.count = 2;
+    firing.cylinders = 1;
+
+    InjectorTiming timing = { .pulseUs = PULSE_US, .cycleUs = CYCLE_US, .firing = &firing };
+    InjectorScheduleInit(&schedule, &timing, 0);
+    for (int i = 0; i < 4 * CYCLES; i++) {
+        InjectorEdge edge = InjectorScheduleNext(&schedule);
+        if (edge.injector != 0) {
+            Fail(&single, INJECTION_BATCH, "empty event opened an injector outside the engine");
+            return;
+        }
+        openings += edge.level;
+    }
+    if (openings != 2 * CYCLES) {
+        Fail(&single, INJECTION_BATCH, "empty event changed the openings of the injector");
+    }
+
+    // No event at all: idle edges one cycle apart, nothing opens
+    firing.events[0].mask = 0;
+    InjectorScheduleInit(&schedule, &timing, 0);
+    for (int i = 0; i < CYCLES; i++) {
+        InjectorEdge edge = InjectorScheduleNext(&schedule);
+        if (edge.level != 0 || edge.time != (uint64_t)(i + 1) * CYCLE_US) {
+            Fail(&single, INJECTION_BATCH, "schedule without events did not idle one cycle at a time");
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    static const char* const VALID[] = { "1-5-3-6-2-4", "1-8-4-3-6-5-7-2", "2-1" };
+    static const char* const WRONG[] = { "", "1", "1-2-2-4", "1-3-4", "1-9", "1--2", "1-2-", "1,2", "0-1",
+                                         "1-2-3-4-5-6-7-8-9" };
+    EngineLayout parsed;
+    FiringSchedule firing;
+    char text[24];
+    uint32_t checked = 0;
+
+    for (uint8_t e = 0; e < ENGINE_LAYOUT_COUNT; e++) {
+        const EngineLayout* layout = &ENGINE_LAYOUTS[e];
+        for (int m = 0; m < INJECTION_MODE_COUNT; m++) {
+            InjectionMode mode = (InjectionMode)m;
+            if (!FiringScheduleBuild(&firing, layout, mode)) {
+                Fail(layout, mode, "engine rejected");
+                continue;
+            }
+            CheckEvents(layout, mode, &firing);
+            CheckSchedule(layout, mode, &firing);
+            PrintEvents(layout, mode, &firing);
+            checked++;
+        }
+
+        // The table order must survive being written and read back
+        FiringOrderFormat(layout, text, sizeof(text));
+        if (!FiringOrderParse(text, &parsed) || parsed.cylinders != layout->cylinders ||
+            memcmp(parsed.order, layout->order, layout->cylinders) != 0) {
+            Fail(layout, INJECTION_SEQUENTIAL, "order not read back");
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(VALID) / sizeof(VALID[0]); i++) {
+        if (!FiringOrderParse(VALID[i], &parsed)) {
+            printf("FAIL order \"%s\" rejected\n", VALID[i]);
+            failures++;
+        }
+    }
+    for (size_t i = 0; i < sizeof(WRONG) / sizeof(WRONG[0]); i++) {
+        if (FiringOrderParse(WRONG[i], &parsed)) {
+            printf("FAIL order \"%s\" accepted\n", WRONG[i]);
+            failures++;
+        }
+    }
+
+    CheckSingleCylinder();
+
+    printf("%u engines and modes checked\n", checked);
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file injector_schedule_check.c
+ * @brief Host check of the edges generated by the injector schedule
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs the same injector_schedule.c as the firmware, plays the edges as
+ * the timer interrupt would and checks every one of them: edges in time
+ * order, each injector opened at the angle of its injection event, exact
+ * pulse width, the minimum closed time between two pulses of an injector,
+ * overlapping pulses when the width is longer than the gap between events,
+ * and new timings taken only at the start of a cycle. The engine, the
+ * injection mode and the timing are changed at random points, also in the
+ * middle of cycles.
+ *
+ * Build and run:
+ *   cc -O2 -I../main injector_schedule_check.c ../main/injector_schedule.c ../main/firing_order.c -o injector_schedule_check
+ *   ./injector_schedule_check 100000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "injector_schedule.h"
+
+static uint32_t failures = 0;
+
+/**
+ * Reports a failed check, only the first ones are printed
+ *
+ * @param edge Edge being checked
+ * @param message What is wrong
+ */
+static void Fail(const InjectorEdge* edge, const char* message)
+{
+    if (failures++ < 20) {
+        printf("FAIL at %llu us, injector %u %s: %s\n", (unsigned long long)edge->time,
+               edge->injector + 1, edge->level ? "open" : "close", message);
+    }
+}
+
+/**
+ * Random engine, mode and timing in the range of the firmware, pulses may be longer than the gap between events
+ *
+ * @param firing Filled with the events of the engine
+ * @return Timing to request
+ */
+static InjectorTiming RandomTiming(FiringSchedule* firing)
+{
+    FiringScheduleBuild(firing, &ENGINE_LAYOUTS[rand() % ENGINE_LAYOUT_COUNT],
+                        (InjectionMode)(rand() % INJECTION_MODE_COUNT));
+    InjectorTiming timing = {
+        .cycleUs = 8000 + (uint32_t)(rand() % 792000),
+        .firing = firing
+    };
+    timing.pulseUs = 1000 + (uint32_t)(rand() % timing.cycleUs);
+    return timing;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t edges = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+    InjectorSchedule schedule;
+    FiringSchedule requestedFiring;
+    FiringSchedule cycleFiring;                      // Events the current cycle must use
+    InjectorTiming requested;                        // Last timing requested
+    InjectorTiming cycleTiming;                      // Timing the current cycle must use
+    bool requestPending = false;
+    uint64_t openedAt[INJECTOR_MAX_OUTPUTS] = { 0 };
+    uint64_t closedAt[INJECTOR_MAX_OUTPUTS] = { 0 };
+    uint32_t pulseOf[INJECTOR_MAX_OUTPUTS] = { 0 };
+    bool open[INJECTOR_MAX_OUTPUTS] = { false };
+    bool everOpened[INJECTOR_MAX_OUTPUTS] = { false };
+    uint64_t lastTime = 0;
+    uint64_t cycleStart = 1000;
+    uint8_t event = 0;
+    uint8_t remaining;                               // Injectors of the event still to open
+    uint32_t opens = 0;
+    uint32_t updates = 0;
+    uint32_t overlaps = 0;
+    uint32_t extended = 0;
+    uint32_t timingChanges = 0;
+    uint32_t timingOf[INJECTOR_MAX_OUTPUTS] = { 0 }; // Timing of the last opening of each injector
+    uint32_t maxOpen = 0;
+
+    srand(1);
+    requested = RandomTiming(&requestedFiring);
+    cycleFiring = requestedFiring;
+    cycleTiming = requested;
+    cycleTiming.firing = &cycleFiring;
+    if (cycleTiming.pulseUs > InjectorScheduleMaxPulse(&cycleTiming)) {
+        cycleTiming.pulseUs = InjectorScheduleMaxPulse(&cycleTiming);
+    }
+    remaining = cycleFiring.events[0].mask;
+    InjectorScheduleInit(&schedule, &requested, cycleStart);
+
+    for (uint32_t n = 0; n < edges; n++) {
+        // New timing at random points, as the task does when the throttle moves or the engine changes
+        if (rand() % 5 == 0) {
+            requested = RandomTiming(&requestedFiring);
+            InjectorScheduleUpdate(&schedule, &requested);
+            requestPending = true;
+            updates++;
+        }
+
+        InjectorEdge edge = InjectorScheduleNext(&schedule);
+        if (edge.time < lastTime) {
+            Fail(&edge, "edge before the previous one");
+        }
+        lastTime = edge.time;
+
+        if (edge.injector >= INJECTOR_MAX_OUTPUTS) {
+            Fail(&edge, "injector out of range");
+            continue;
+        }
+
+        if (edge.level == 0) {
+            if (!open[edge.injector]) {
+                Fail(&edge, "closing a closed injector");
+            } else if (edge.time - openedAt[edge.injector] != pulseOf[edge.injector]) {
+                Fail(&edge, "wrong pulse width");
+            }
+            open[edge.injector] = false;
+            closedAt[edge.injector] = edge.time;
+            continue;
+        }
+
+        // The first opening of a cycle takes the last requested timing
+        if (event == 0 && remaining == cycleFiring.events[0].mask && requestPending) {
+            timingChanges++;
+            cycleFiring = requestedFiring;
+            cycleTiming = requested;
+            cycleTiming.firing = &cycleFiring;
+            if (cycleTiming.pulseUs > InjectorScheduleMaxPulse(&cycleTiming)) {
+                cycleTiming.pulseUs = InjectorScheduleMaxPulse(&cycleTiming);
+            }
+            remaining = cycleFiring.events[0].mask;
+            requestPending = false;
+        }
+
+        // Each event opens its injectors at its angle of the cycle, lowest first
+        uint64_t expected = cycleStart + (uint64_t)cycleTiming.cycleUs * cycleFiring.events[event].angle /
+                            FIRING_CYCLE_DEGREES;
+        if (edge.time != expected) {
+            Fail(&edge, "wrong event time");
+        }
+        if (!(remaining & (1u << edge.injector)) || (remaining & ((1u << edge.injector) - 1))) {
+            Fail(&edge, "injector not in its event");
+        }
+        remaining &= (uint8_t)~(1u << edge.injector);
+        if (remaining == 0) {
+            if (++event >= cycleFiring.count) {
+                event = 0;
+                cycleStart += cycleTiming.cycleUs;
+            }
+            remaining = cycleFiring.events[event].mask;
+        }
+
+        // Only a new timing may reopen an open injector or shorten its closed time, its pulse is extended
+        if (open[edge.injector]) {
+            if (timingOf[edge.injector] == timingChanges) {
+                Fail(&edge, "opening an open injector");
+            }
+            extended++;
+        } else if (everOpened[edge.injector] && timingOf[edge.injector] == timingChanges &&
+                   edge.time - closedAt[edge.injector] < INJECTOR_MIN_OFF_US) {
+            Fail(&edge, "closed for less than the minimum");
+        }
+
+        uint32_t openCount = 1;
+        for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+            openCount += open[i] && i != edge.injector;
+        }
+        if (openCount > 1) {
+            overlaps++;
+        }
+        if (openCount > maxOpen) {
+            maxOpen = openCount;
+        }
+
+        open[edge.injector] = true;
+        everOpened[edge.injector] = true;
+        openedAt[edge.injector] = edge.time;
+        pulseOf[edge.injector] = cycleTiming.pulseUs;
+        timingOf[edge.injector] = timingChanges;
+        opens++;
+    }
+
+    printf("%u edges, %u openings, %u cycles, %u timing updates\n", edges, opens, schedule.cycles, updates);
+    printf("%u overlapping openings (up to %u injectors open), %u pulses extended by a new timing\n",
+           overlaps, maxOpen, extended);
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file status_report_check.c
+ * @brief Host check that the pulse path of the injector pulser does no I/O
+ *
+ * This file is part of the AutomotiveGuide_es project.
+ *
+ * > **Repository**: https://github.com/edgarefraindp/AutomotiveGuide_es
+ * > **For donations and support**: Please visit the GitHub repository page
+ *
+ * @author AutomotiveGuide_es
+ * @date April 2025
+ *
+ * Runs the same code as the edge interrupt of the firmware (schedule,
+ * drive profiles and status counters) for a V8 at 6000 RPM, with a random
+ * delay on every applied edge, and takes a summary at the status rate as
+ * the status task does. While the pulse path runs, the standard output
+ * and error of the process (unbuffered) go to a pipe: the check fails if
+ * a single byte reaches it. The pipe itself is checked first with a
+ * printf.
+ *
+ * The counters are checked too: the pulses of all the summaries add up to
+ * the pulses closed, and the measured period and width match the timing
+ * within the delay of the edges.
+ *
+ * Build and run (Linux or macOS):
+ *   cc -O2 -I../main status_report_check.c ../main/status_report.c ../main/injector_schedule.c ../main/drive_profile.c ../main/firing_order.c -o status_report_check
+ *   ./status_report_check 10000 1000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "status_report.h"
+#include "drive_profile.h"
+
+#define CYCLE_US                20000            // 6000 RPM
+#define PULSE_US                5000
+#define MAX_DELAY_US            8                // Random delay of an applied edge
+
+static InjectorSchedule schedule;
+static int trap[2];                              // Pipe that takes the output of the pulse path
+static int savedOut;
+static int savedErr;
+static uint32_t pulsePathBytes = 0;
+static uint32_t failures = 0;
+
+/**
+ * Sends the standard output and error to the pipe
+ */
+static void BeginPulsePath(void)
+{
+    dup2(trap[1], STDOUT_FILENO);
+    dup2(trap[1], STDERR_FILENO);
+}
+
+/**
+ * Restores the standard output and error and counts what reached the pipe
+ */
+static void EndPulsePath(void)
+{
+    char data[256];
+    ssize_t length;
+
+    dup2(savedOut, STDOUT_FILENO);
+    dup2(savedErr, STDERR_FILENO);
+    while ((length = read(trap[0], data, sizeof(data))) > 0) {
+        pulsePathBytes += (uint32_t)length;
+    }
+}
+
+/**
+ * Edge source for the drive engine, the engine sequence never ends
+ *
+ * @param context Unused
+ * @param edge Next open or close edge
+ * @return Always true
+ */
+static bool ScheduleSource(void* context, InjectorEdge* edge)
+{
+    (void)context;
+    *edge = InjectorScheduleNext(&schedule);
+    return true;
+}
+
+/**
+ * Reports a failed check, only the first ones are printed
+ *
+ * @param message What is wrong
+ * @param injector Injector being checked
+ * @param value Value found
+ */
+static void Fail(const char* message, int injector, uint32_t value)
+{
+    if (failures++ < 20) {
+        printf("FAIL injector %d: %s (%u)\n", injector + 1, message, value);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t durationMs = argc > 1 ? (uint32_t)atoi(argv[1]) : 10000;
+    uint32_t intervalMs = argc > 2 ? (uint32_t)atoi(argv[2]) : 1000;
+    FiringSchedule firing;
+    InjectorTiming timing = { .pulseUs = PULSE_US, .cycleUs = CYCLE_US, .firing = &firing };
+    DriveEngine engine;
+    DriveEdge edge;
+    StatusReport report;
+    StatusReport summary;
+    uint64_t end = (uint64_t)durationMs * 1000;
+    uint64_t nextSummary = (uint64_t)intervalMs * 1000;
+    uint32_t closed[INJECTOR_MAX_OUTPUTS] = { 0 };
+    uint32_t reported[INJECTOR_MAX_OUTPUTS] = { 0 };
+    uint32_t edges = 0;
+    uint32_t summaries = 0;
+    uint32_t lines = 0;
+
+    if (intervalMs == 0) {
+        intervalMs = 1000;
+    }
+
+    // Unbuffered, anything printed reaches the pipe at once
+    setvbuf(stdout, NULL, _IONBF, 0);
+    if (pipe(trap) != 0 || fcntl(trap[0], F_SETFL, O_NONBLOCK) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    savedOut = dup(STDOUT_FILENO);
+    savedErr = dup(STDERR_FILENO);
+
+    // The pipe must catch an ordinary printf, or the check proves nothing
+    BeginPulsePath();
+    printf("pulse path\n");
+    EndPulsePath();
+    if (pulsePathBytes == 0) {
+        printf("FAIL the output of the pulse path is not caught\n");
+        return 1;
+    }
+    pulsePathBytes = 0;
+    printf("Checking the pulse path: V8 sequential at 6000 RPM, %u ms, summary every %u ms\n", durationMs,
+           intervalMs);
+
+    srand(1);
+    FiringScheduleBuild(&firing, &ENGINE_LAYOUTS[8], INJECTION_SEQUENTIAL);    // GM small block V8
+    InjectorScheduleInit(&schedule, &timing, 0);
+    DriveEngineInit(&engine, DriveProfileFromName("peakhold"));
+    StatusReportInit(&report);
+
+    while (true) {
+        // Pulse path: what the timer interrupt runs for every edge
+        BeginPulsePath();
+        DriveEngineNext(&engine, ScheduleSource, NULL, &edge);
+        if (edge.time < nextSummary && edge.time < end && edge.level != DRIVE_HOLD) {
+            InjectorEdge applied = { edge.time, edge.channel, edge.level != DRIVE_OFF };
+            StatusReportRecord(&report, &applied, edge.time + (uint64_t)(rand() % (MAX_DELAY_US + 1)));
+            closed[edge.channel] += edge.level == DRIVE_OFF;
+            edges++;
+        }
+        EndPulsePath();
+
+        if (edge.time < nextSummary && edge.time < end) {
+            continue;
+        }
+
+        // Status task: takes the counters and prints them
+        StatusReportTake(&report, &summary);
+        summaries++;
+        printf("%6u ms | Edges: %u | Latency: %u us", (uint32_t)(nextSummary / 1000), summary.edges,
+               summary.maxLatencyUs);
+        lines++;
+        for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+            reported[i] += summary.pulses[i];
+            if (summary.pulses[i] == 0) {
+                continue;
+            }
+            printf(" | %d: %u", i + 1, summary.pulses[i]);
+            if (summary.periodUs[i] + MAX_DELAY_US < CYCLE_US || summary.periodUs[i] > CYCLE_US + MAX_DELAY_US) {
+                Fail("wrong period", i, summary.periodUs[i]);
+            }
+            if (summary.widthUs[i] + MAX_DELAY_US < PULSE_US || summary.widthUs[i] > PULSE_US + MAX_DELAY_US) {
+                Fail("wrong width", i, summary.widthUs[i]);
+            }
+        }
+        printf("\n");
+        if (summary.maxLatencyUs > MAX_DELAY_US) {
+            Fail("latency longer than any delay", 0, summary.maxLatencyUs);
+        }
+        if (edge.time >= end) {
+            break;
+        }
+        nextSummary += (uint64_t)intervalMs * 1000;
+
+        // The edge that ended the interval belongs to the next one
+        if (edge.level != DRIVE_HOLD && edge.time < nextSummary) {
+            InjectorEdge applied = { edge.time, edge.channel, edge.level != DRIVE_OFF };
+            BeginPulsePath();
+            StatusReportRecord(&report, &applied, edge.time + (uint64_t)(rand() % (MAX_DELAY_US + 1)));
+            EndPulsePath();
+            closed[edge.channel] += edge.level == DRIVE_OFF;
+            edges++;
+        }
+    }
+
+    for (int i = 0; i < INJECTOR_MAX_OUTPUTS; i++) {
+        if (reported[i] != closed[i]) {
+            Fail("pulses lost between summaries", i, reported[i]);
+        }
+    }
+    if (pulsePathBytes != 0) {
+        printf("FAIL %u bytes written by the pulse path\n", pulsePathBytes);
+        failures++;
+    }
+
+    printf("%u edges in the pulse path, %u bytes written, %u summaries (%u lines instead of %u, one per pulse)\n",
+           edges, pulsePathBytes, summaries, lines, edges / 2);
+    printf("%s: %u failures\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}